@@ -9,11 +9,23 @@
 #include "changeframelist.h"
 #include "dt.h"
 #include "utlvector.h"
+#include "bitvec.h"
+
+#if !defined( _X360 )
+#include <emmintrin.h>
+#define CHANGEFRAMELIST_SSE2 1
+#endif
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
 
+// Props are grouped in blocks of this many, and each block remembers the newest
+// tick of any of its props so GetPropsChangedAfterTick can skip whole blocks.
+#define CHANGEFRAMELIST_BLOCK_SHIFT	5
+#define CHANGEFRAMELIST_BLOCK_SIZE	( 1 << CHANGEFRAMELIST_BLOCK_SHIFT )
+
+
 class CChangeFrameList : public IChangeFrameList
 {
 public:
@@ -23,6 +35,11 @@ public:
 		m_ChangeTicks.SetSize( nProperties );
 		for ( int i=0; i < nProperties; i++ )
 			m_ChangeTicks[i] = iCurTick;
+
+		int nBlocks = ( nProperties + CHANGEFRAMELIST_BLOCK_SIZE - 1 ) >> CHANGEFRAMELIST_BLOCK_SHIFT;
+		m_BlockMaxTicks.SetSize( nBlocks );
+		for ( int i=0; i < nBlocks; i++ )
+			m_BlockMaxTicks[i] = iCurTick;
 	}
 
 
@@ -38,14 +55,8 @@ public:
 	{
 		CChangeFrameList *pRet = new CChangeFrameList;
 
-		int numProps = m_ChangeTicks.Count();
-
-		pRet->m_ChangeTicks.SetSize( numProps );
-
-		for ( int i=0; i < numProps; i++ )
-		{
-			pRet->m_ChangeTicks[ i ] = m_ChangeTicks[ i ];
-		}
+		pRet->m_ChangeTicks.CopyArray( m_ChangeTicks.Base(), m_ChangeTicks.Count() );
+		pRet->m_BlockMaxTicks.CopyArray( m_BlockMaxTicks.Base(), m_BlockMaxTicks.Count() );
 
 		return pRet;
 
@@ -60,7 +71,11 @@ public:
 	{
 		for ( int i=0; i < nPropIndices; i++ )
 		{
-			m_ChangeTicks[ pPropIndices[i] ] = iTick;
+			int iProp = pPropIndices[i];
+			m_ChangeTicks[ iProp ] = iTick;
+
+			int &iBlockMax = m_BlockMaxTicks[ iProp >> CHANGEFRAMELIST_BLOCK_SHIFT ];
+			iBlockMax = MAX( iBlockMax, iTick );
 		}
 	}
 
@@ -72,12 +87,39 @@ public:
 		
 		Assert( c <= nMaxOutProps );
 
-		for ( int i=0; i < c; i++ )
+		const int *pTicks = m_ChangeTicks.Base();
+		int nBlocks = m_BlockMaxTicks.Count();
+
+		for ( int iBlock=0; iBlock < nBlocks; iBlock++ )
 		{
-			if ( m_ChangeTicks[i] > iTick )
+			// Nothing in this block changed since the client's tick.
+			if ( m_BlockMaxTicks[iBlock] <= iTick )
+				continue;
+
+			int iFirst = iBlock << CHANGEFRAMELIST_BLOCK_SHIFT;
+			int nInBlock = MIN( c - iFirst, CHANGEFRAMELIST_BLOCK_SIZE );
+
+			if ( nInBlock == CHANGEFRAMELIST_BLOCK_SIZE )
+			{
+				unsigned int changed = GetChangedMask( &pTicks[iFirst], iTick );
+				while ( changed )
+				{
+					int iBit = FirstBitInWord( changed, 0 );
+					iOutProps[nOutProps] = iFirst + iBit;
+					++nOutProps;
+					changed &= changed - 1;
+				}
+			}
+			else
 			{
-				iOutProps[nOutProps] = i;
-				++nOutProps;
+				for ( int i=iFirst; i < iFirst + nInBlock; i++ )
+				{
+					if ( pTicks[i] > iTick )
+					{
+						iOutProps[nOutProps] = i;
+						++nOutProps;
+					}
+				}
 			}
 		}
 
@@ -92,8 +134,34 @@ protected:
 	}
 
 private:
+	// Returns a mask with bit i set if pTicks[i] > iTick, for a full block.
+	static FORCEINLINE unsigned int GetChangedMask( const int *pTicks, int iTick )
+	{
+		unsigned int mask = 0;
+#if defined( CHANGEFRAMELIST_SSE2 )
+		__m128i vTick = _mm_set1_epi32( iTick );
+		for ( int i=0; i < CHANGEFRAMELIST_BLOCK_SIZE; i += 8 )
+		{
+			__m128i vCmp0 = _mm_cmpgt_epi32( _mm_loadu_si128( (const __m128i *)&pTicks[i] ), vTick );
+			__m128i vCmp1 = _mm_cmpgt_epi32( _mm_loadu_si128( (const __m128i *)&pTicks[i+4] ), vTick );
+			// Pack the two compare results down to 8 bytes and take their sign bits.
+			__m128i vPacked = _mm_packs_epi16( _mm_packs_epi32( vCmp0, vCmp1 ), _mm_setzero_si128() );
+			mask |= (unsigned int)( _mm_movemask_epi8( vPacked ) & 0xFF ) << i;
+		}
+#else
+		for ( int i=0; i < CHANGEFRAMELIST_BLOCK_SIZE; i++ )
+		{
+			mask |= (unsigned int)( pTicks[i] > iTick ) << i;
+		}
+#endif
+		return mask;
+	}
+
 	// Change frames for each property.
 	CUtlVector<int>		m_ChangeTicks;
+
+	// Newest change frame in each block of CHANGEFRAMELIST_BLOCK_SIZE properties.
+	CUtlVector<int>		m_BlockMaxTicks;
 };
 
 
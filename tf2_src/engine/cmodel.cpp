@@ -129,6 +129,7 @@ void EndTrace( TraceInfo_t *&pTraceInfo )
 }
 
 static ConVar map_noareas( "map_noareas", "0", 0, "Disable area to area connection testing." );
+static ConVar cm_simdbrushes( "cm_simdbrushes", "1", 0, "Clip traces against four brush sides at a time." );
 
 void	FloodAreaConnections (CCollisionBSPData *pBSPData);
 
@@ -1203,6 +1204,106 @@ bool IntersectRayWithBox( const Ray_t &ray, const VectorAligned &inInvDelta, con
 	return false;
 }
 
+//-----------------------------------------------------------------------------
+// Clips the trace against the brush sides four at a time using the SoA copy of
+// the sides built at load.  Produces exactly what the per-side loop in
+// CM_ClipBoxToBrush does; returns false if the trace is completely in front
+// of one of the sides.
+//-----------------------------------------------------------------------------
+template <bool IS_POINT>
+FORCEINLINE bool CM_ClipBoxToBrushSidesSIMD( TraceInfo_t * RESTRICT pTraceInfo, const cbrush_t * RESTRICT brush,
+	float &enterfrac, float &leavefrac, bool &startout, bool &getout, cbrushside_t *&leadside )
+{
+	CCollisionBSPData *pBSPData = pTraceInfo->m_pBSPData;
+	const cbrushsidesimd_t * RESTRICT pGroup = &pBSPData->map_brushsidesimd[ pBSPData->map_brushsidesimdfirst[ brush - pBSPData->map_brushes.Base() ] ];
+	cbrushside_t * RESTRICT pSides = &pBSPData->map_brushsides[brush->firstbrushside];
+	int nGroups = ( brush->numsides + 3 ) >> 2;
+
+	const Vector& p1 = pTraceInfo->m_start;
+	const Vector& p2 = pTraceInfo->m_end;
+	fltx4 p1x = ReplicateX4( p1.x ), p1y = ReplicateX4( p1.y ), p1z = ReplicateX4( p1.z );
+	fltx4 p2x = ReplicateX4( p2.x ), p2y = ReplicateX4( p2.y ), p2z = ReplicateX4( p2.z );
+	fltx4 extX, extY, extZ;
+	if ( !IS_POINT )
+	{
+		extX = ReplicateX4( pTraceInfo->m_extents.x );
+		extY = ReplicateX4( pTraceInfo->m_extents.y );
+		extZ = ReplicateX4( pTraceInfo->m_extents.z );
+	}
+	fltx4 epsilon = ReplicateX4( DIST_EPSILON );
+
+	fltx4 anyStartOut = Four_Zeros;
+	fltx4 anyGetOut = Four_Zeros;
+	for ( int i = 0; i < nGroups; i++, pGroup++ )
+	{
+		fltx4 dist = pGroup->dist;
+		if ( !IS_POINT )
+		{
+			// push the planes out apropriately for mins/maxs
+			fltx4 push = AddSIMD( AddSIMD( fabs( MulSIMD( pGroup->normalX, extX ) ), fabs( MulSIMD( pGroup->normalY, extY ) ) ),
+				fabs( MulSIMD( pGroup->normalZ, extZ ) ) );
+			dist = AddSIMD( dist, push );
+		}
+
+		fltx4 d1 = AddSIMD( AddSIMD( MulSIMD( p1x, pGroup->normalX ), MulSIMD( p1y, pGroup->normalY ) ), MulSIMD( p1z, pGroup->normalZ ) );
+		fltx4 d2 = AddSIMD( AddSIMD( MulSIMD( p2x, pGroup->normalX ), MulSIMD( p2y, pGroup->normalY ) ), MulSIMD( p2z, pGroup->normalZ ) );
+		d1 = SubSIMD( d1, dist );
+		d2 = SubSIMD( d2, dist );
+
+		fltx4 front1 = CmpGtSIMD( d1, Four_Zeros );
+		fltx4 front2 = CmpGtSIMD( d2, Four_Zeros );
+		if ( IS_POINT )
+		{
+			// don't trace rays against bevel planes
+			front1 = AndNotSIMD( pGroup->bevelMask, front1 );
+			front2 = AndNotSIMD( pGroup->bevelMask, front2 );
+		}
+
+		// if completely in front of any face, no intersection
+		if ( !IsAllZeros( AndSIMD( front1, front2 ) ) )
+			return false;
+
+		// past this point a side starting in front is entered and a side ending in front is left
+		anyStartOut = OrSIMD( anyStartOut, front1 );
+		anyGetOut = OrSIMD( anyGetOut, front2 );
+		int nEnter = TestSignSIMD( front1 );
+		int nLeave = TestSignSIMD( front2 );
+		if ( !( nEnter | nLeave ) )
+			continue;
+
+		fltx4 denom = MaskedAssign( OrSIMD( front1, front2 ), SubSIMD( d1, d2 ), Four_Ones );
+		if ( nLeave )
+		{
+			fltx4 f = DivSIMD( AddSIMD( d1, epsilon ), denom );
+			f = MaskedAssign( front2, f, Four_Ones );
+			f = MinSIMD( MinSIMD( f, SplatYSIMD( f ) ), MinSIMD( SplatZSIMD( f ), SplatWSIMD( f ) ) );
+			if ( SubFloat( f, 0 ) < leavefrac )
+				leavefrac = SubFloat( f, 0 );
+		}
+		if ( nEnter )
+		{
+			// NOTE: This could be negative if d1 is less than the epsilon.
+			// If the trace is short (d1-d2 is small) then it could produce a large
+			// negative fraction. 
+			fltx4 f = DivSIMD( MaxSIMD( SubSIMD( d1, epsilon ), Four_Zeros ), denom );
+
+			// first side with the largest fraction wins, same as walking them in order
+			for ( int k = 0; k < 4; k++ )
+			{
+				if ( ( nEnter & ( 1 << k ) ) && SubFloat( f, k ) > enterfrac )
+				{
+					enterfrac = SubFloat( f, k );
+					leadside = pSides + ( i << 2 ) + k;
+				}
+			}
+		}
+	}
+
+	startout = !IsAllZeros( anyStartOut );
+	getout = !IsAllZeros( anyGetOut );
+	return true;
+}
+
 /*
 ================
 CM_ClipBoxToBrush
@@ -1236,75 +1337,83 @@ void FASTCALL CM_ClipBoxToBrush( TraceInfo_t * RESTRICT pTraceInfo, const cbrush
 	bool startout = false;
 	cbrushside_t* leadside = NULL;
 
-	float dist;
-
-	cbrushside_t *  RESTRICT side = &pTraceInfo->m_pBSPData->map_brushsides[brush->firstbrushside];
-	for ( const cbrushside_t * const sidelimit = side + brush->numsides; side < sidelimit; side++ )
+	if ( cm_simdbrushes.GetBool() )
 	{
-		cplane_t *plane = side->plane;
-		const Vector &planeNormal = plane->normal;
-
-		if (!IS_POINT)
-		{	
-			// general box case
-			// push the plane out apropriately for mins/maxs
+		if ( !CM_ClipBoxToBrushSidesSIMD<IS_POINT>( pTraceInfo, brush, enterfrac, leavefrac, startout, getout, leadside ) )
+			return;
+	}
+	else
+	{
+		float dist;
 
-			dist = DotProductAbs( planeNormal, pTraceInfo->m_extents );
-			dist = plane->dist + dist;
-		}
-		else
+		cbrushside_t *  RESTRICT side = &pTraceInfo->m_pBSPData->map_brushsides[brush->firstbrushside];
+		for ( const cbrushside_t * const sidelimit = side + brush->numsides; side < sidelimit; side++ )
 		{
-			// special point case
-			dist = plane->dist;
-			// don't trace rays against bevel planes 
-			if ( side->bBevel )
-				continue;
-		}
+			cplane_t *plane = side->plane;
+			const Vector &planeNormal = plane->normal;
 
-		float d1 = DotProduct (p1, planeNormal) - dist;
-		float d2 = DotProduct (p2, planeNormal) - dist;
+			if (!IS_POINT)
+			{	
+				// general box case
+				// push the plane out apropriately for mins/maxs
 
-		// if completely in front of face, no intersection
-		if( d1 > 0.f )
-		{
-			startout = true;
+				dist = DotProductAbs( planeNormal, pTraceInfo->m_extents );
+				dist = plane->dist + dist;
+			}
+			else
+			{
+				// special point case
+				dist = plane->dist;
+				// don't trace rays against bevel planes 
+				if ( side->bBevel )
+					continue;
+			}
 
-			// d1 > 0.f && d2 > 0.f
-			if( d2 > 0.f )
-				return;
+			float d1 = DotProduct (p1, planeNormal) - dist;
+			float d2 = DotProduct (p2, planeNormal) - dist;
 
-		} 
-		else
-		{
-			// d1 <= 0.f && d2 <= 0.f
-			if( d2 <= 0.f )
-				continue;
- 
-			// d2 > 0.f
-			getout = true;
-		}
+			// if completely in front of face, no intersection
+			if( d1 > 0.f )
+			{
+				startout = true;
 
-		// crosses face
-		if (d1 > d2)
-		{	// enter
-			// NOTE: This could be negative if d1 is less than the epsilon.
-			// If the trace is short (d1-d2 is small) then it could produce a large
-			// negative fraction. 
-			float f = (d1-DIST_EPSILON);
-			if ( f < 0.f )
-				f = 0.f;
-			f = f / (d1-d2);
-			if (f > enterfrac)
+				// d1 > 0.f && d2 > 0.f
+				if( d2 > 0.f )
+					return;
+
+			} 
+			else
 			{
-				enterfrac = f;
-				leadside = side;
+				// d1 <= 0.f && d2 <= 0.f
+				if( d2 <= 0.f )
+					continue;
+	 
+				// d2 > 0.f
+				getout = true;
+			}
+
+			// crosses face
+			if (d1 > d2)
+			{	// enter
+				// NOTE: This could be negative if d1 is less than the epsilon.
+				// If the trace is short (d1-d2 is small) then it could produce a large
+				// negative fraction. 
+				float f = (d1-DIST_EPSILON);
+				if ( f < 0.f )
+					f = 0.f;
+				f = f / (d1-d2);
+				if (f > enterfrac)
+				{
+					enterfrac = f;
+					leadside = side;
+				}
+			}
+			else
+			{	// leave
+				float f = (d1+DIST_EPSILON) / (d1-d2);
+				if (f < leavefrac)
+					leavefrac = f;
 			}
-		}
-		else
-		{	// leave
-			float f = (d1+DIST_EPSILON) / (d1-d2);
-			if (f < leavefrac)
-				leavefrac = f;
 		}
 	}
 
@@ -2183,9 +2292,245 @@ void CM_BoxTraceAgainstLeafList( const Ray_t &ray, int *pLeafList, int nLeafCoun
 	Assert( !ray.m_IsRay || trace.allsolid || ( trace.fraction >= trace.fractionleftsolid ) );
 }
 
+//-----------------------------------------------------------------------------
+// Trace recording: cm_trace_record captures every Ray_t sent to CM_BoxTrace so
+// the stream can be replayed offline against the same map with cm_trace_replay.
+//-----------------------------------------------------------------------------
+#define TRACERECORD_ID		(('R'<<24)+('T'<<16)+('M'<<8)+'C')
+#define TRACERECORD_VERSION	1
+
+struct tracerecordheader_t
+{
+	int		id;
+	int		version;
+	char	mapName[MAX_QPATH];
+};
+
+struct tracerecord_t
+{
+	Vector	start;
+	Vector	delta;
+	Vector	startOffset;
+	Vector	extents;
+	int		headnode;
+	int		brushmask;
+	byte	isRay;
+	byte	isSwept;
+	byte	pad[2];
+};
+
+static FileHandle_t g_hTraceRecordFile = FILESYSTEM_INVALID_HANDLE;
+static int g_nTraceRecordCount = 0;
+static CThreadFastMutex g_TraceRecordMutex;
+// only tells CM_BoxTrace whether to bother taking the lock, the handle is checked under it
+static volatile bool g_bTraceRecording = false;
+
+static void CM_RecordTrace( const Ray_t &ray, int headnode, int brushmask )
+{
+	tracerecord_t record;
+	record.start = ray.m_Start;
+	record.delta = ray.m_Delta;
+	record.startOffset = ray.m_StartOffset;
+	record.extents = ray.m_Extents;
+	record.headnode = headnode;
+	record.brushmask = brushmask;
+	record.isRay = ray.m_IsRay;
+	record.isSwept = ray.m_IsSwept;
+	record.pad[0] = record.pad[1] = 0;
+
+	AUTO_LOCK( g_TraceRecordMutex );
+	if ( g_hTraceRecordFile != FILESYSTEM_INVALID_HANDLE )
+	{
+		g_pFileSystem->Write( &record, sizeof(record), g_hTraceRecordFile );
+		g_nTraceRecordCount++;
+	}
+}
+
+static void CM_StopTraceRecord()
+{
+	AUTO_LOCK( g_TraceRecordMutex );
+	if ( g_hTraceRecordFile != FILESYSTEM_INVALID_HANDLE )
+	{
+		g_pFileSystem->Close( g_hTraceRecordFile );
+		g_hTraceRecordFile = FILESYSTEM_INVALID_HANDLE;
+		g_bTraceRecording = false;
+		Msg( "Recorded %d traces\n", g_nTraceRecordCount );
+	}
+}
+
+CON_COMMAND_F( cm_trace_record, "Record all collision traces against the world to a file for cm_trace_replay", FCVAR_CHEAT )
+{
+	if ( args.ArgC() != 2 )
+	{
+		Msg( "Usage: cm_trace_record <filename>\n" );
+		return;
+	}
+
+	CCollisionBSPData *pBSPData = GetCollisionBSPData();
+	if ( !pBSPData->numnodes )
+	{
+		Msg( "cm_trace_record: no map loaded\n" );
+		return;
+	}
+
+	CM_StopTraceRecord();
+
+	FileHandle_t hFile = g_pFileSystem->Open( args[1], "wb" );
+	if ( hFile == FILESYSTEM_INVALID_HANDLE )
+	{
+		Warning( "cm_trace_record: unable to open %s for writing\n", args[1] );
+		return;
+	}
+
+	tracerecordheader_t header;
+	Q_memset( &header, 0, sizeof(header) );
+	header.id = TRACERECORD_ID;
+	header.version = TRACERECORD_VERSION;
+	Q_strncpy( header.mapName, pBSPData->map_name, sizeof(header.mapName) );
+	g_pFileSystem->Write( &header, sizeof(header), hFile );
+
+	AUTO_LOCK( g_TraceRecordMutex );
+	g_nTraceRecordCount = 0;
+	g_hTraceRecordFile = hFile;
+	g_bTraceRecording = true;
+}
+
+CON_COMMAND_F( cm_trace_record_stop, "Stop recording collision traces", FCVAR_CHEAT )
+{
+	CM_StopTraceRecord();
+}
+
+CON_COMMAND_F( cm_trace_replay, "Replay a cm_trace_record file and time the brush clipping with and without cm_simdbrushes", FCVAR_CHEAT )
+{
+	if ( args.ArgC() < 2 )
+	{
+		Msg( "Usage: cm_trace_replay <filename> [passes]\n" );
+		return;
+	}
+	int nPasses = ( args.ArgC() >= 3 ) ? MAX( 1, Q_atoi( args[2] ) ) : 1;
+
+	CUtlBuffer buf;
+	if ( !g_pFileSystem->ReadFile( args[1], NULL, buf ) )
+	{
+		Warning( "cm_trace_replay: unable to read %s\n", args[1] );
+		return;
+	}
+
+	tracerecordheader_t header;
+	buf.Get( &header, sizeof(header) );
+	if ( !buf.IsValid() || header.id != TRACERECORD_ID || header.version != TRACERECORD_VERSION )
+	{
+		Warning( "cm_trace_replay: %s is not a trace recording\n", args[1] );
+		return;
+	}
+
+	CCollisionBSPData *pBSPData = GetCollisionBSPData();
+	if ( Q_stricmp( header.mapName, pBSPData->map_name ) )
+	{
+		Warning( "cm_trace_replay: recorded on %s but %s is loaded\n", header.mapName, pBSPData->map_name );
+		return;
+	}
+
+	int nTraces = buf.GetBytesRemaining() / sizeof(tracerecord_t);
+	CUtlVector<tracerecord_t> records;
+	records.SetCount( nTraces );
+	buf.Get( records.Base(), nTraces * sizeof(tracerecord_t) );
+
+	// rays, swept boxes, position tests
+	enum { TRACE_RAY, TRACE_BOX, TRACE_UNSWEPT, TRACE_CLASS_COUNT };
+	static const char *s_pClassNames[TRACE_CLASS_COUNT] = { "ray", "swept box", "unswept box" };
+
+	// build the rays up front and group them by class, so each class can be timed as one batch
+	CUtlVector<Ray_t> rays;
+	rays.SetCount( nTraces );
+	CUtlVector<int> classTraces[TRACE_CLASS_COUNT];
+	for ( int i = 0; i < nTraces; i++ )
+	{
+		const tracerecord_t &record = records[i];
+		Ray_t &ray = rays[i];
+		ray.m_Start = record.start;
+		ray.m_Delta = record.delta;
+		ray.m_StartOffset = record.startOffset;
+		ray.m_Extents = record.extents;
+		ray.m_IsRay = record.isRay != 0;
+		ray.m_IsSwept = record.isSwept != 0;
+		classTraces[ !ray.m_IsSwept ? TRACE_UNSWEPT : ( ray.m_IsRay ? TRACE_RAY : TRACE_BOX ) ].AddToTail( i );
+	}
+
+	// don't record our own traces
+	CM_StopTraceRecord();
+
+	bool bOldSIMD = cm_simdbrushes.GetBool();
+	CUtlVector<trace_t> results;
+	results.SetCount( nTraces );
+	double flClassTime[2][TRACE_CLASS_COUNT] = { { 0 } };
+	int nMismatches = 0;
+	for ( int nMode = 0; nMode < 2; nMode++ )
+	{
+		cm_simdbrushes.SetValue( nMode );
+
+		// check the results outside the timed batches
+		for ( int i = 0; i < nTraces; i++ )
+		{
+			trace_t tr;
+			CM_BoxTrace( rays[i], records[i].headnode, records[i].brushmask, true, tr );
+			if ( nMode == 0 )
+			{
+				results[i] = tr;
+			}
+			else if ( fabs( tr.fraction - results[i].fraction ) > 1e-5f || tr.startsolid != results[i].startsolid ||
+				tr.allsolid != results[i].allsolid || tr.contents != results[i].contents )
+			{
+				nMismatches++;
+			}
+		}
+
+		// one timer per batch, reading the clock per trace costs as much as a short trace
+		for ( int nClass = 0; nClass < TRACE_CLASS_COUNT; nClass++ )
+		{
+			const CUtlVector<int> &traces = classTraces[nClass];
+			if ( !traces.Count() )
+				continue;
+
+			trace_t tr;
+			double flStart = Plat_FloatTime();
+			for ( int nPass = 0; nPass < nPasses; nPass++ )
+			{
+				for ( int i = 0; i < traces.Count(); i++ )
+				{
+					int iTrace = traces[i];
+					CM_BoxTrace( rays[iTrace], records[iTrace].headnode, records[iTrace].brushmask, true, tr );
+				}
+			}
+			flClassTime[nMode][nClass] = Plat_FloatTime() - flStart;
+		}
+	}
+	cm_simdbrushes.SetValue( bOldSIMD );
+
+	Msg( "%d traces from %s, %d passes\n", nTraces, header.mapName, nPasses );
+	for ( int nClass = 0; nClass < TRACE_CLASS_COUNT; nClass++ )
+	{
+		int nClassCount = classTraces[nClass].Count();
+		if ( !nClassCount )
+			continue;
+		double flScale = 1e9 / ( (double)nClassCount * nPasses );
+		Msg( "  %-12s %8d   scalar %8.1f ns/trace   simd %8.1f ns/trace\n", s_pClassNames[nClass], nClassCount,
+			flClassTime[0][nClass] * flScale, flClassTime[1][nClass] * flScale );
+	}
+	if ( nMismatches )
+	{
+		Warning( "  %d traces gave different results with cm_simdbrushes 1\n", nMismatches );
+	}
+}
+
 void CM_BoxTrace( const Ray_t& ray, int headnode, int brushmask, bool computeEndpt, trace_t& tr )
 {
 	VPROF("BoxTrace");
+	if ( g_bTraceRecording )
+	{
+		CM_RecordTrace( ray, headnode, brushmask );
+	}
+
 	// for multi-check avoidance
 	TraceInfo_t *pTraceInfo = BeginTrace();		
 
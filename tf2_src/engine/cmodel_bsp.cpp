@@ -42,6 +42,7 @@ void CollisionBSPData_LoadLeafBrushes( CCollisionBSPData *pBSPData );
 void CollisionBSPData_LoadPlanes( CCollisionBSPData *pBSPData );
 void CollisionBSPData_LoadBrushes( CCollisionBSPData *pBSPData );
 void CollisionBSPData_LoadBrushSides( CCollisionBSPData *pBSPData, CUtlVector<unsigned short> &map_texinfo );
+void CollisionBSPData_BuildBrushSidesSIMD( CCollisionBSPData *pBSPData );
 void CollisionBSPData_LoadSubmodels( CCollisionBSPData *pBSPData );
 void CollisionBSPData_LoadNodes( CCollisionBSPData *pBSPData );
 void CollisionBSPData_LoadAreas( CCollisionBSPData *pBSPData );
@@ -157,6 +158,16 @@ void CollisionBSPData_Destroy( CCollisionBSPData *pBSPData )
 		pBSPData->map_brushsides.Detach();
 	}
 
+	if ( pBSPData->map_brushsidesimd.Base() )
+	{
+		pBSPData->map_brushsidesimd.Detach();
+	}
+
+	if ( pBSPData->map_brushsidesimdfirst.Base() )
+	{
+		pBSPData->map_brushsidesimdfirst.Detach();
+	}
+
 	if ( pBSPData->map_vis )
 	{
 		pBSPData->map_vis = NULL;
@@ -164,6 +175,7 @@ void CollisionBSPData_Destroy( CCollisionBSPData *pBSPData )
 
 	pBSPData->numplanes = 0;
 	pBSPData->numbrushsides = 0;
+	pBSPData->numbrushsidesimd = 0;
 	pBSPData->emptyleaf = pBSPData->solidleaf =0;
 	pBSPData->numnodes = 0;
 	pBSPData->numleafs = 0;
@@ -818,6 +830,70 @@ void CollisionBSPData_LoadBrushSides( CCollisionBSPData *pBSPData, CUtlVector<un
 		}
 	}
 	Assert( outBrushSide == pBSPData->numbrushsides && outBoxBrush == pBSPData->numboxbrushes );
+
+	CollisionBSPData_BuildBrushSidesSIMD( pBSPData );
+}
+
+
+//-----------------------------------------------------------------------------
+// Regroup the sides of each (non-box) brush four at a time in SoA form so
+// CM_ClipBoxToBrush can test a whole group of planes at once
+//-----------------------------------------------------------------------------
+void CollisionBSPData_BuildBrushSidesSIMD( CCollisionBSPData *pBSPData )
+{
+	int i, j;
+
+	// each brush starts a new group so a brush never shares lanes with another
+	int groupCount = 0;
+	for ( i = 0; i < pBSPData->numbrushes; i++ )
+	{
+		const cbrush_t &brush = pBSPData->map_brushes[i];
+		if ( !brush.IsBox() )
+		{
+			groupCount += ( brush.numsides + 3 ) >> 2;
+		}
+	}
+
+	pBSPData->map_brushsidesimd.Attach( groupCount, (cbrushsidesimd_t*)Hunk_Alloc( groupCount * sizeof(cbrushsidesimd_t), false ) );
+	pBSPData->map_brushsidesimdfirst.Attach( pBSPData->numbrushes, (unsigned short*)Hunk_Alloc( pBSPData->numbrushes * sizeof(unsigned short), false ) );
+	pBSPData->numbrushsidesimd = groupCount;
+
+	int outGroup = 0;
+	for ( i = 0; i < pBSPData->numbrushes; i++ )
+	{
+		const cbrush_t &brush = pBSPData->map_brushes[i];
+		pBSPData->map_brushsidesimdfirst[i] = outGroup;
+		if ( brush.IsBox() )
+			continue;
+
+		for ( j = 0; j < brush.numsides; j += 4 )
+		{
+			cbrushsidesimd_t * RESTRICT pGroup = &pBSPData->map_brushsidesimd[outGroup];
+			for ( int k = 0; k < 4; k++ )
+			{
+				if ( j + k < brush.numsides )
+				{
+					const cbrushside_t &side = pBSPData->map_brushsides[brush.firstbrushside + j + k];
+					SubFloat( pGroup->normalX, k ) = side.plane->normal.x;
+					SubFloat( pGroup->normalY, k ) = side.plane->normal.y;
+					SubFloat( pGroup->normalZ, k ) = side.plane->normal.z;
+					SubFloat( pGroup->dist, k ) = side.plane->dist;
+					SubInt( pGroup->bevelMask, k ) = side.bBevel ? 0xFFFFFFFF : 0;
+				}
+				else
+				{
+					// no plane, everything is behind it
+					SubFloat( pGroup->normalX, k ) = 0.0f;
+					SubFloat( pGroup->normalY, k ) = 0.0f;
+					SubFloat( pGroup->normalZ, k ) = 0.0f;
+					SubFloat( pGroup->dist, k ) = 1e30f;
+					SubInt( pGroup->bevelMask, k ) = 0xFFFFFFFF;
+				}
+			}
+			outGroup++;
+		}
+	}
+	Assert( outGroup == pBSPData->numbrushsidesimd );
 }
 
 
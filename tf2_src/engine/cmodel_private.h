@@ -100,6 +100,19 @@ struct cbrushside_t
 
 #define NUMSIDES_BOXBRUSH	0xFFFF
 
+// 80-bytes, aligned to 16-byte boundary
+// four consecutive sides of a brush with the planes stored as structure of arrays so a 
+// trace can clip against all of them at once.  Lanes past the end of the brush hold a
+// plane that nothing is ever in front of.
+struct cbrushsidesimd_t
+{
+	fltx4			normalX;
+	fltx4			normalY;
+	fltx4			normalZ;
+	fltx4			dist;
+	fltx4			bevelMask;					// all ones for bevel planes (and unused lanes)
+};
+
 struct cbrush_t
 {
 	int				contents;
@@ -315,6 +328,9 @@ public:
 	CRangeValidatedArray<cbrushside_t>	map_brushsides;
 	int									numboxbrushes;
 	CRangeValidatedArray<cboxbrush_t>	map_boxbrushes;
+	int									numbrushsidesimd;
+	CRangeValidatedArray<cbrushsidesimd_t> map_brushsidesimd;
+	CRangeValidatedArray<unsigned short> map_brushsidesimdfirst;	// per brush, index of its first map_brushsidesimd entry
 	int									numplanes;
 	CRangeValidatedArray<cplane_t>		map_planes;
 	int									numnodes;
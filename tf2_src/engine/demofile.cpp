@@ -9,6 +9,7 @@
 #include <utlbuffer.h>
 
 #include "demofile.h"
+#include "demostreamwriter.h"
 #include "filesystem_engine.h"
 #include "demo.h"
 #include "proto_version.h"
@@ -53,7 +54,8 @@ int CDbgPrint::s_nIndent = 0;
 CDemoFile::CDemoFile() :
 	m_pBuffer( NULL ),
 	m_bAllowHeaderWrite( true ),
-	m_bIsStreamBuffer( false )
+	m_bIsStreamBuffer( false ),
+	m_bIsAsyncWriter( false )
 {
 }
 
@@ -498,6 +500,7 @@ bool CDemoFile::Open(const char *name, bool bReadOnly, bool bMemoryBuffer, int n
 
 	// This is used by replay, which manually writes a header.
 	m_bAllowHeaderWrite = bAllowHeaderWrite;
+	m_bIsAsyncWriter = false;
 
 	if ( bMemoryBuffer )
 	{
@@ -531,6 +534,39 @@ bool CDemoFile::Open(const char *name, bool bReadOnly, bool bMemoryBuffer, int n
 	return true;
 }
 
+bool CDemoFile::OpenAsyncWrite( const char *name, int nMaxBufferSize )
+{
+	if ( m_pBuffer && m_pBuffer->IsValid() )
+	{
+		ConMsg ("CDemoFile::OpenAsyncWrite: file already open.\n");
+		return false;
+	}
+
+	m_szFileName[0] = 0;  // clear name
+	Q_memset( &m_DemoHeader, 0, sizeof(m_DemoHeader) ); // and demo header
+
+	m_bAllowHeaderWrite = true;
+
+	CDemoStreamWriter *pWriter = new CDemoStreamWriter();
+	m_pBuffer = pWriter;
+	m_bIsStreamBuffer = false;
+	m_bIsAsyncWriter = true;
+
+	// Demo files are always little endian
+	m_pBuffer->SetBigEndian( false );
+
+	if ( !pWriter->Open( name, NULL, nMaxBufferSize ) )
+	{
+		ConMsg ("CDemoFile::OpenAsyncWrite: couldn't open file %s for writing.\n", name );
+		Close();
+		return false;
+	}
+
+	Q_strncpy( m_szFileName, name, sizeof(m_szFileName) );
+
+	return true;
+}
+
 bool CDemoFile::IsOpen()
 {
 	return m_pBuffer && m_pBuffer->IsValid();
@@ -544,11 +580,17 @@ void CDemoFile::Close()
 		// Destructor will call Close() as needed
 		delete static_cast<CUtlStreamBuffer*>(m_pBuffer);
 	}
+	else if ( m_bIsAsyncWriter )
+	{
+		// Waits for the writer thread to finish
+		delete static_cast<CDemoStreamWriter*>(m_pBuffer);
+	}
 	else
 	{
 		delete m_pBuffer;
 	}
 	m_pBuffer = NULL;
+	m_bIsAsyncWriter = false;
 }
 
 int CDemoFile::GetSize()
@@ -556,6 +598,11 @@ int CDemoFile::GetSize()
 	return m_pBuffer->TellMaxPut();
 }
 
+CDemoStreamWriter *CDemoFile::GetStreamWriter()
+{
+	return m_bIsAsyncWriter ? static_cast<CDemoStreamWriter*>(m_pBuffer) : NULL;
+}
+
 // Returns the PROTOCOL_VERSION used when .dem was recorded
 int CDemoFile::GetProtocolVersion()
 {
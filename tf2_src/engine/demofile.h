@@ -28,6 +28,7 @@
 // Forward declarations
 //-----------------------------------------------------------------------------
 class IDemoBuffer;
+class CDemoStreamWriter;
 
 //-----------------------------------------------------------------------------
 // Demo file 
@@ -39,6 +40,8 @@ public:
 	~CDemoFile();
 
 	bool	Open(const char *name, bool bReadOnly, bool bMemoryBuffer = false, int nBufferSize = 0, bool bAllowHeaderWrite = true);
+	// Writes from a background thread, with at most nMaxBufferSize bytes waiting for the disk
+	bool	OpenAsyncWrite( const char *name, int nMaxBufferSize );
 	bool	IsOpen();
 	void	Close();
 
@@ -77,12 +80,16 @@ public:
 
 	// Returns the PROTOCOL_VERSION used when .dem was recorded
 	int		GetProtocolVersion();
+
+	// NULL unless opened with OpenAsyncWrite()
+	CDemoStreamWriter *GetStreamWriter();
 public:
 	char			m_szFileName[MAX_PATH];	//name of current demo file
 	demoheader_t    m_DemoHeader;  //general demo info
 	CUtlBuffer		*m_pBuffer;
 	bool			m_bAllowHeaderWrite;
 	bool			m_bIsStreamBuffer;
+	bool			m_bIsAsyncWriter;
 };
 
 #endif // DEMOFILE_H
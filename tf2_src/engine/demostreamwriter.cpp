@@ -0,0 +1,256 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Write-only demo file buffer that writes from a background thread
+//
+//===========================================================================//
+
+#include "demostreamwriter.h"
+#include "filesystem_engine.h"
+#include "tier1/strtools.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+// The writer thread wakes up this often even if it isn't signalled
+#define DEMO_STREAM_WRITER_WAIT_MS		100
+
+
+CDemoStreamWriter::CDemoStreamWriter() :
+	BaseClass( DEMO_STREAM_CHUNK_SIZE, DEMO_STREAM_CHUNK_SIZE, 0 ),
+	m_hFile( FILESYSTEM_INVALID_HANDLE ),
+	m_WriterThread( this ),
+	m_bExit( false ),
+	m_bWriteFailed( false ),
+	m_nChunks( 0 ),
+	m_nMaxChunks( 0 ),
+	m_nPendingSeek( -1 ),
+	m_nQueuedBytes( 0 )
+{
+	SetUtlBufferOverflowFuncs( &CDemoStreamWriter::GetOverflow, &CDemoStreamWriter::StreamPutOverflow );
+	m_szFileName[0] = 0;
+	V_memset( &m_Stats, 0, sizeof( m_Stats ) );
+}
+
+CDemoStreamWriter::~CDemoStreamWriter()
+{
+	Close();
+}
+
+bool CDemoStreamWriter::Open( const char *pFileName, const char *pPathID, int nMaxBufferSize )
+{
+	Assert( !IsOpen() );
+
+	m_hFile = g_pFileSystem->Open( pFileName, "wb", pPathID );
+	if ( m_hFile == FILESYSTEM_INVALID_HANDLE )
+	{
+		m_Error |= FILE_OPEN_ERROR;
+		return false;
+	}
+
+	V_strncpy( m_szFileName, pFileName, sizeof( m_szFileName ) );
+	V_memset( &m_Stats, 0, sizeof( m_Stats ) );
+
+	// One chunk is always being filled, so allow at least one more to be written meanwhile
+	m_nMaxChunks = MAX( 2, nMaxBufferSize / DEMO_STREAM_CHUNK_SIZE + 1 );
+	m_nPendingSeek = -1;
+	m_bExit = false;
+	m_bWriteFailed = false;
+
+	if ( !m_WriterThread.Start() )
+	{
+		Warning( "CDemoStreamWriter: couldn't start writer thread for %s.\n", pFileName );
+		g_pFileSystem->Close( m_hFile );
+		m_hFile = FILESYSTEM_INVALID_HANDLE;
+		m_Error |= FILE_OPEN_ERROR;
+		return false;
+	}
+
+	return true;
+}
+
+void CDemoStreamWriter::Close()
+{
+	if ( !IsOpen() )
+		return;
+
+	QueueStagedData();
+
+	// The writer drains the queue before it exits
+	m_bExit = true;
+	m_WorkEvent.Set();
+	m_WriterThread.Join();
+
+	g_pFileSystem->Close( m_hFile );
+	m_hFile = FILESYSTEM_INVALID_HANDLE;
+
+	Assert( m_WriteQueue.Count() == 0 );
+	Chunk_t *pChunk;
+	while ( m_FreeChunks.PopItem( &pChunk ) )
+	{
+		delete pChunk;
+	}
+	m_nChunks = 0;
+
+	if ( m_bWriteFailed )
+	{
+		Warning( "CDemoStreamWriter: write to %s failed, the file is incomplete.\n", m_szFileName );
+	}
+	else if ( m_Stats.m_nStalls )
+	{
+		Warning( "CDemoStreamWriter: waited %.1f ms for the disk %d times while writing %s.\n",
+			m_Stats.m_flStallTime * 1000.0f, m_Stats.m_nStalls, m_szFileName );
+	}
+}
+
+void CDemoStreamWriter::GetStats( DemoStreamWriterStats_t &stats ) const
+{
+	stats = m_Stats;
+}
+
+//-----------------------------------------------------------------------------
+// Hands the staged data to the writer when the staging chunk is full or the
+// put position moves
+//-----------------------------------------------------------------------------
+bool CDemoStreamWriter::StreamPutOverflow( int nSize )
+{
+	if ( !IsValid() || !IsOpen() )
+		return false;
+
+	if ( m_bWriteFailed )
+	{
+		m_Error |= FILE_WRITE_ERROR;
+		return false;
+	}
+
+	if ( !QueueStagedData() )
+		return false;
+
+	if ( nSize < 0 )
+	{
+		// Seeking, the next data written lands at the new put position
+		m_nOffset = -nSize - 1;
+		m_nPendingSeek = m_nOffset;
+		nSize = 0;
+	}
+	else
+	{
+		m_nOffset = TellPut();
+	}
+
+	// Room for the request plus null termination
+	m_Memory.EnsureCapacity( MAX( DEMO_STREAM_CHUNK_SIZE, nSize + 1 ) );
+	return true;
+}
+
+bool CDemoStreamWriter::QueueStagedData()
+{
+	const int nSize = TellPut() - m_nOffset;
+	if ( nSize <= 0 )
+		return true;
+
+	Chunk_t *pChunk = AllocChunk();
+	if ( !pChunk )
+	{
+		m_Error |= FILE_WRITE_ERROR;
+		return false;
+	}
+
+	// Swap rather than copy, the staging buffer becomes the chunk's old memory
+	pChunk->m_Memory.Swap( m_Memory );
+	pChunk->m_nSize = nSize;
+	pChunk->m_nSeekTo = m_nPendingSeek;
+	m_nPendingSeek = -1;
+
+	m_nQueuedBytes += nSize;
+	m_Stats.m_nMaxQueuedBytes = MAX( m_Stats.m_nMaxQueuedBytes, (int)m_nQueuedBytes );
+
+	m_WriteQueue.PushItem( pChunk );
+	m_WorkEvent.Set();
+	return true;
+}
+
+CDemoStreamWriter::Chunk_t *CDemoStreamWriter::AllocChunk()
+{
+	Chunk_t *pChunk;
+	if ( m_FreeChunks.PopItem( &pChunk ) )
+		return pChunk;
+
+	if ( m_nChunks < m_nMaxChunks )
+	{
+		++m_nChunks;
+		return new Chunk_t;
+	}
+
+	// The writer is behind, wait for it to free a chunk
+	const float flStartTime = Plat_FloatTime();
+	++m_Stats.m_nStalls;
+	while ( !m_FreeChunks.PopItem( &pChunk ) )
+	{
+		if ( m_bWriteFailed || !m_WriterThread.IsAlive() )
+			return NULL;
+
+		m_ChunkFreedEvent.Wait( DEMO_STREAM_WRITER_WAIT_MS );
+	}
+	m_Stats.m_flStallTime += Plat_FloatTime() - flStartTime;
+
+	return pChunk;
+}
+
+//-----------------------------------------------------------------------------
+// Writer thread
+//-----------------------------------------------------------------------------
+int CDemoStreamWriter::CWriterThread::Run()
+{
+	for ( ;; )
+	{
+		m_pOwner->m_WorkEvent.Wait( DEMO_STREAM_WRITER_WAIT_MS );
+
+		// Read before draining, everything queued before the flag was set gets written
+		const bool bExit = m_pOwner->m_bExit;
+		m_pOwner->WriteQueuedChunks();
+		if ( bExit )
+			break;
+	}
+
+	return 0;
+}
+
+void CDemoStreamWriter::WriteQueuedChunks()
+{
+	bool bWrote = false;
+	Chunk_t *pChunk;
+	while ( m_WriteQueue.PopItem( &pChunk ) )
+	{
+		if ( !m_bWriteFailed )
+		{
+			const float flStartTime = Plat_FloatTime();
+
+			if ( pChunk->m_nSeekTo >= 0 )
+			{
+				g_pFileSystem->Seek( m_hFile, pChunk->m_nSeekTo, FILESYSTEM_SEEK_HEAD );
+			}
+
+			if ( g_pFileSystem->Write( pChunk->m_Memory.Base(), pChunk->m_nSize, m_hFile ) != pChunk->m_nSize )
+			{
+				m_bWriteFailed = true;
+			}
+
+			const float flWriteTime = Plat_FloatTime() - flStartTime;
+			m_Stats.m_nBytesWritten += pChunk->m_nSize;
+			++m_Stats.m_nWrites;
+			m_Stats.m_flWriteTime += flWriteTime;
+			m_Stats.m_flMaxWriteTime = MAX( m_Stats.m_flMaxWriteTime, flWriteTime );
+			bWrote = true;
+		}
+
+		m_nQueuedBytes -= pChunk->m_nSize;
+		m_FreeChunks.PushItem( pChunk );
+		m_ChunkFreedEvent.Set();
+	}
+
+	// One flush per batch rather than per chunk
+	if ( bWrote )
+	{
+		g_pFileSystem->Flush( m_hFile );
+	}
+}
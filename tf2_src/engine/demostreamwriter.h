@@ -0,0 +1,116 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Write-only demo file buffer that does its disk I/O on a background
+//			thread, so a slow disk doesn't stall the thread recording the demo.
+//
+//			Data is staged in a pooled chunk.  When the chunk fills up it is
+//			swapped out for a free one and queued for the writer thread, which
+//			writes it with one large sequential write and puts it back in the
+//			pool.  Seeks (e.g. rewriting the demo header on close) are queued in
+//			order with the data.  If the writer falls behind by more than the
+//			buffer limit, the recording thread waits for it; those stalls are
+//			counted in the stats.
+//
+//===========================================================================//
+
+#ifndef DEMOSTREAMWRITER_H
+#define DEMOSTREAMWRITER_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier0/threadtools.h"
+#include "tier0/tslist.h"
+#include "tier1/utlbuffer.h"
+#include "filesystem.h"
+
+// Size of each write the background thread issues
+#define DEMO_STREAM_CHUNK_SIZE			( 256 * 1024 )
+
+struct DemoStreamWriterStats_t
+{
+	int64	m_nBytesWritten;
+	int		m_nWrites;
+	float	m_flWriteTime;			// total seconds spent in writes on the writer thread
+	float	m_flMaxWriteTime;		// slowest single write
+	int		m_nMaxQueuedBytes;		// most data ever waiting for the writer
+	int		m_nStalls;				// times the recording thread had to wait for a free chunk
+	float	m_flStallTime;			// total seconds the recording thread waited
+};
+
+//-----------------------------------------------------------------------------
+// Use it as a CUtlBuffer open for writing.  Not safe to use from more than
+// one thread at a time, the background thread is internal.
+//-----------------------------------------------------------------------------
+class CDemoStreamWriter : public CUtlBuffer
+{
+	typedef CUtlBuffer BaseClass;
+
+public:
+	CDemoStreamWriter();
+	~CDemoStreamWriter();
+
+	// nMaxBufferSize bounds the data waiting to be written
+	bool Open( const char *pFileName, const char *pPathID, int nMaxBufferSize );
+
+	// Queues whatever is left and waits for the writer thread to finish
+	void Close();
+
+	bool IsOpen() const { return m_hFile != FILESYSTEM_INVALID_HANDLE; }
+
+	// Approximate while the writer thread is running
+	void GetStats( DemoStreamWriterStats_t &stats ) const;
+
+private:
+	// error flags
+	enum
+	{
+		FILE_OPEN_ERROR = MAX_ERROR_FLAG << 1,
+		FILE_WRITE_ERROR = MAX_ERROR_FLAG << 2,
+	};
+
+	struct Chunk_t
+	{
+		CUtlMemory< unsigned char >	m_Memory;
+		int							m_nSize;
+		int							m_nSeekTo;		// file offset to write at, -1 to write after the previous chunk
+	};
+
+	class CWriterThread : public CThread
+	{
+	public:
+		CWriterThread( CDemoStreamWriter *pOwner ) : m_pOwner( pOwner ) { SetName( "DemoWriter" ); }
+		virtual int Run();
+
+	private:
+		CDemoStreamWriter *m_pOwner;
+	};
+	friend class CWriterThread;
+
+	// Overflow functions
+	bool StreamPutOverflow( int nSize );
+
+	bool QueueStagedData();
+	Chunk_t *AllocChunk();
+	void WriteQueuedChunks();
+
+	FileHandle_t			m_hFile;
+	char					m_szFileName[ MAX_PATH ];
+
+	CWriterThread			m_WriterThread;
+	CTSQueue< Chunk_t * >	m_WriteQueue;
+	CTSList< Chunk_t * >	m_FreeChunks;
+	CThreadEvent			m_WorkEvent;
+	CThreadEvent			m_ChunkFreedEvent;
+	volatile bool			m_bExit;
+	volatile bool			m_bWriteFailed;
+
+	int						m_nChunks;			// allocated, free or queued
+	int						m_nMaxChunks;
+	int						m_nPendingSeek;		// applies to the next queued chunk
+	CInterlockedInt			m_nQueuedBytes;
+
+	DemoStreamWriterStats_t	m_Stats;
+};
+
+#endif // DEMOSTREAMWRITER_H
@@ -67,6 +67,17 @@ public:
 	int		ComparePropData( CDeltaBitsReader* pOut, const SendProp *pProp );
 	void	CopyPropData( bf_write* pOut, const SendProp *pProp );
 
+	// Versions of the above for props with a fixed encoded size (see CSendTablePrecalc::m_DeltaPlan).
+	void	SkipFixedPropData( int nBits );
+	int		CompareFixedPropData( CDeltaBitsReader *pIn, int nBits );
+	void	CopyFixedPropData( bf_write *pOut, int nBits );
+
+	// Moves past a run of props with consecutive indices whose data and
+	// index bits were already checked by the caller. iLastProp is the last prop in the run.
+	void	SkipPropRun( int iLastProp, int nBits );
+
+	bf_read*	GetBitBuf();
+
 	// If you know you're done but you're not at the end (you haven't called until
 	// ReadNextPropIndex returns -1), call this so it won't assert in its destructor.
 	void		ForceFinished();
@@ -155,6 +166,40 @@ FORCEINLINE int CDeltaBitsReader::ComparePropData( CDeltaBitsReader *pInReader,
 	return g_PropTypeFns[pProp->m_Type].CompareDeltas( pProp, m_pBuf, pIn );
 }
 
+FORCEINLINE void CDeltaBitsReader::SkipFixedPropData( int nBits )
+{
+	m_pBuf->SeekRelative( nBits );
+}
+
+FORCEINLINE int CDeltaBitsReader::CompareFixedPropData( CDeltaBitsReader *pInReader, int nBits )
+{
+	bf_read *pIn = pInReader->m_pBuf;
+	int diff = 0;
+	for ( ; nBits > 32; nBits -= 32 )
+	{
+		diff |= ( m_pBuf->ReadUBitLong( 32 ) != pIn->ReadUBitLong( 32 ) );
+	}
+	diff |= ( m_pBuf->ReadUBitLong( nBits ) != pIn->ReadUBitLong( nBits ) );
+	return diff;
+}
+
+FORCEINLINE void CDeltaBitsReader::CopyFixedPropData( bf_write *pOut, int nBits )
+{
+	pOut->WriteBitsFromBuffer( m_pBuf, nBits );
+}
+
+FORCEINLINE void CDeltaBitsReader::SkipPropRun( int iLastProp, int nBits )
+{
+	Assert( iLastProp >= m_iLastProp && iLastProp < MAX_DATATABLE_PROPS );
+	m_pBuf->SeekRelative( nBits );
+	m_iLastProp = iLastProp;
+}
+
+FORCEINLINE bf_read* CDeltaBitsReader::GetBitBuf()
+{
+	return m_pBuf;
+}
+
 
 // ------------------------------------------------------------------------------------ //
 // CDeltaBitsWriter.
@@ -410,6 +455,27 @@ public:
 	
 	// Map prop offsets to indices for properties that can use it.
 	CUtlMap<unsigned short, unsigned short> m_PropOffsetToIndexMap;
+
+	// Built by SendTable_Init so SendTable_CalcDelta and SendTable_WritePropList don't
+	// have to go through g_PropTypeFns for props whose encoded size never changes.
+	// Consecutive fixed size props form a run, and a run that is present in both states
+	// is compared in 32 bit chunks (data and the prop indices between them) before
+	// falling back to comparing prop by prop.
+	class CDeltaPlanProp
+	{
+	public:
+		unsigned short	m_nFixedBits;	// 0 if the encoded size depends on the value.
+		unsigned short	m_iRunLastProp;	// Last prop of the run this prop is in.
+		int				m_iRunBit;		// Where this prop's data starts in m_DeltaRunIndexBits.
+		int				m_nRunBits;		// Bits from this prop's data to the end of the run.
+	};
+
+	CUtlVector<CDeltaPlanProp>	m_DeltaPlan;
+
+	// For each run: the value and mask of the prop index bits that must be between its props,
+	// with the data bits masked off. Lets a run compare check the indices really are consecutive.
+	CUtlVector<uint32>			m_DeltaRunIndexBits;
+	CUtlVector<uint32>			m_DeltaRunIndexMask;
 };
 
 
@@ -168,6 +168,48 @@ int	DecodeBits( DecodeInfo *pInfo, unsigned char *pOut )
 }
 
 
+static int Float_GetFixedEncodedBits( const SendProp *pProp )
+{
+	// Same order of checks as Float_SkipProp.
+	int flags = pProp->GetFlags();
+	if ( flags & ( SPROP_COORD | SPROP_COORD_MP | SPROP_COORD_MP_LOWPRECISION | SPROP_COORD_MP_INTEGRAL ) )
+		return 0;
+	else if ( flags & SPROP_NOSCALE )
+		return 32;
+	else if ( flags & SPROP_NORMAL )
+		return NORMAL_FRACTIONAL_BITS + 1;
+	else
+		return pProp->m_nBits;
+}
+
+int GetFixedEncodedBits( const SendProp *pProp )
+{
+	switch ( pProp->GetType() )
+	{
+		case DPT_Int:
+			return ( pProp->GetFlags() & SPROP_VARINT ) ? 0 : pProp->m_nBits;
+
+		case DPT_Float:
+			return Float_GetFixedEncodedBits( pProp );
+
+		case DPT_Vector:
+		{
+			int nBits = Float_GetFixedEncodedBits( pProp );
+			if ( !nBits )
+				return 0;
+			// Normals send a sign bit instead of the third component.
+			return ( pProp->GetFlags() & SPROP_NORMAL ) ? nBits * 2 + 1 : nBits * 3;
+		}
+
+		case DPT_VectorXY:
+			return Float_GetFixedEncodedBits( pProp ) * 2;
+
+		default:
+			return 0;
+	}
+}
+
+
 // ---------------------------------------------------------------------------------------- //
 // Most of the prop types can use this generic FastCopy version. Arrays are a bit of a pain.
 // ---------------------------------------------------------------------------------------- //
@@ -90,5 +90,9 @@ extern PropTypeFns g_PropTypeFns[DPT_NUMSendPropTypes];
 // data and returns the number of bits used to encode the data.
 int	DecodeBits( DecodeInfo *pInfo, unsigned char *pOut );
 
+// Returns the number of bits the property always encodes to, or 0 if the encoded
+// size depends on the value (coords, varints, strings and arrays).
+int	GetFixedEncodedBits( const SendProp *pProp );
+
 
 #endif // DATATABLE_ENCODE_H
@@ -286,6 +286,79 @@ static inline void ShowEncodeDeltaWatchInfo(
 }
 
 
+// Index bits CDeltaBitsWriter::WritePropIndex writes for a prop that directly follows the last one.
+#define DELTAPLAN_NEXT_PROP_INDEX		1
+#define DELTAPLAN_NEXT_PROP_INDEX_BITS	7
+
+
+// Compares a run of fixed size props (see CSendTablePrecalc::m_DeltaPlan) in both states
+// 32 bits at a time, starting at iProp's data. The 'to' state's prop indices are checked
+// against the plan too, so a matching range really is those props with consecutive indices.
+// Skips both readers past the props that are known to be unchanged and returns the last
+// of them, or -1 if not even the first one matched.
+static int SendTable_SkipUnchangedPropRun( 
+	const CSendTablePrecalc *pPrecalc,
+	int iProp,
+	CDeltaBitsReader *pFromReader,
+	CDeltaBitsReader *pToReader )
+{
+	const CSendTablePrecalc::CDeltaPlanProp *pPlan = &pPrecalc->m_DeltaPlan[iProp];
+	int nRunBits = pPlan->m_nRunBits;
+
+	// Can't be the run we're looking for if either state ends before it does.
+	bf_read *pFrom = pFromReader->GetBitBuf();
+	bf_read *pTo = pToReader->GetBitBuf();
+	if ( pFrom->GetNumBitsLeft() < nRunBits || pTo->GetNumBitsLeft() < nRunBits )
+		return -1;
+
+	int nIndexBytes = pPrecalc->m_DeltaRunIndexBits.Count() * sizeof( uint32 );
+	bf_read indexBits( pPrecalc->m_DeltaRunIndexBits.Base(), nIndexBytes );
+	bf_read indexMask( pPrecalc->m_DeltaRunIndexMask.Base(), nIndexBytes );
+	indexBits.Seek( pPlan->m_iRunBit );
+	indexMask.Seek( pPlan->m_iRunBit );
+
+	bf_read fromBits = *pFrom;
+	bf_read toBits = *pTo;
+
+	int nMatched = 0;
+	while ( nMatched < nRunBits )
+	{
+		int nBits = MIN( nRunBits - nMatched, 32 );
+		unsigned int fromVal = fromBits.ReadUBitLong( nBits );
+		unsigned int toVal = toBits.ReadUBitLong( nBits );
+		unsigned int indexVal = indexBits.ReadUBitLong( nBits );
+		unsigned int indexMaskVal = indexMask.ReadUBitLong( nBits );
+
+		if ( ( fromVal ^ toVal ) | ( ( toVal ^ indexVal ) & indexMaskVal ) )
+			break;
+
+		nMatched += nBits;
+	}
+
+	// Walk forward to the last prop that ended inside the matching bits.
+	int iLastProp = -1;
+	int nLastPropEnd = 0;
+	for ( int i = iProp; i <= pPlan->m_iRunLastProp; i++ )
+	{
+		const CSendTablePrecalc::CDeltaPlanProp *pCur = &pPrecalc->m_DeltaPlan[i];
+		int nEnd = nRunBits - pCur->m_nRunBits + pCur->m_nFixedBits;
+		if ( nEnd > nMatched )
+			break;
+
+		iLastProp = i;
+		nLastPropEnd = nEnd;
+	}
+
+	if ( iLastProp >= 0 )
+	{
+		pFromReader->SkipPropRun( iLastProp, nLastPropEnd );
+		pToReader->SkipPropRun( iLastProp, nLastPropEnd );
+	}
+
+	return iLastProp;
+}
+
+
 static FORCEINLINE void SendTable_EncodeProp( CEncodeInfo * pInfo, unsigned long iProp )
 {
 	// Call their proxy to get the property's value.
@@ -486,7 +559,15 @@ void SendTable_WritePropList(
 		// Seek the 'to' state to the current property we want to check.
 		while ( iToProp < (unsigned int) pCheckProps[i] )
 		{
-			inputBitsReader.SkipPropData( pPrecalc->GetProp( iToProp ) );
+			int nFixedBits = pPrecalc->m_DeltaPlan[iToProp].m_nFixedBits;
+			if ( nFixedBits )
+			{
+				inputBitsReader.SkipFixedPropData( nFixedBits );
+			}
+			else
+			{
+				inputBitsReader.SkipPropData( pPrecalc->GetProp( iToProp ) );
+			}
 			iToProp = inputBitsReader.ReadNextPropIndex();
 		}
 
@@ -510,7 +591,16 @@ void SendTable_WritePropList(
 			int iStartBit = pOut->GetNumBitsWritten();
 
 			deltaBitsWriter.WritePropIndex( iToProp );
-			inputBitsReader.CopyPropData( deltaBitsWriter.GetBitBuf(), pProp ); 
+
+			int nFixedBits = pPrecalc->m_DeltaPlan[iToProp].m_nFixedBits;
+			if ( nFixedBits )
+			{
+				inputBitsReader.CopyFixedPropData( deltaBitsWriter.GetBitBuf(), nFixedBits );
+			}
+			else
+			{
+				inputBitsReader.CopyPropData( deltaBitsWriter.GetBitBuf(), pProp ); 
+			}
 
 			nToStateBits = pOut->GetNumBitsWritten() - iStartBit;
 
@@ -580,15 +670,43 @@ int SendTable_CalcDelta(
 			// Skip any properties in the from state that aren't in the to state.
 			while ( iFromProp < iToProp )
 			{
-				fromBitsReader.SkipPropData( pPrecalc->GetProp( iFromProp ) );
+				int nFixedBits = pPrecalc->m_DeltaPlan[iFromProp].m_nFixedBits;
+				if ( nFixedBits )
+				{
+					fromBitsReader.SkipFixedPropData( nFixedBits );
+				}
+				else
+				{
+					fromBitsReader.SkipPropData( pPrecalc->GetProp( iFromProp ) );
+				}
 				iFromProp = fromBitsReader.ReadNextPropIndex();
 			}
 
 			if ( iFromProp == iToProp )
 			{
+				const CSendTablePrecalc::CDeltaPlanProp *pPlan = &pPrecalc->m_DeltaPlan[iToProp];
+
+				// Try to get past the rest of a fixed size run in one go.
+				if ( pPlan->m_iRunLastProp > iToProp &&
+					SendTable_SkipUnchangedPropRun( pPrecalc, iToProp, &fromBitsReader, &toBitsReader ) >= 0 )
+				{
+					iFromProp = fromBitsReader.ReadNextPropIndex();
+					continue;
+				}
+
 				// The property is in both states, so compare them and write the index 
 				// if the states are different.
-				if ( fromBitsReader.ComparePropData( &toBitsReader, pPrecalc->GetProp( iToProp ) ) )
+				int bChanged;
+				if ( pPlan->m_nFixedBits )
+				{
+					bChanged = fromBitsReader.CompareFixedPropData( &toBitsReader, pPlan->m_nFixedBits );
+				}
+				else
+				{
+					bChanged = fromBitsReader.ComparePropData( &toBitsReader, pPrecalc->GetProp( iToProp ) );
+				}
+
+				if ( bChanged )
 				{
 					*pDeltaProps++ = iToProp;
 					if ( pDeltaProps >= pDeltaPropsEnd )
@@ -603,7 +721,15 @@ int SendTable_CalcDelta(
 			else
 			{
 				// Only the 'to' state has this property, so just skip its data and register a change.
-				toBitsReader.SkipPropData( pPrecalc->GetProp( iToProp ) );
+				int nFixedBits = pPrecalc->m_DeltaPlan[iToProp].m_nFixedBits;
+				if ( nFixedBits )
+				{
+					toBitsReader.SkipFixedPropData( nFixedBits );
+				}
+				else
+				{
+					toBitsReader.SkipPropData( pPrecalc->GetProp( iToProp ) );
+				}
 				*pDeltaProps++ = iToProp;
 				if ( pDeltaProps >= pDeltaPropsEnd )
 				{
@@ -723,6 +849,87 @@ static void SendTable_Validate( CSendTablePrecalc *pPrecalc )
 }
 
 
+// Builds CSendTablePrecalc::m_DeltaPlan. The prop order is fixed by the flat property
+// array (it's what goes over the wire), so instead of reordering anything this marks
+// which props have a fixed encoded size and where the runs of them are.
+static void SendTable_BuildDeltaPlan( CSendTablePrecalc *pPrecalc )
+{
+	int nProps = pPrecalc->GetNumProps();
+	pPrecalc->m_DeltaPlan.SetCount( nProps );
+	pPrecalc->m_DeltaRunIndexBits.Purge();
+	pPrecalc->m_DeltaRunIndexMask.Purge();
+
+	for ( int i=0; i < nProps; i++ )
+	{
+		int nFixedBits = GetFixedEncodedBits( pPrecalc->GetProp( i ) );
+		pPrecalc->m_DeltaPlan[i].m_nFixedBits = ( nFixedBits > 0 ) ? nFixedBits : 0;
+		pPrecalc->m_DeltaPlan[i].m_iRunLastProp = i;
+		pPrecalc->m_DeltaPlan[i].m_iRunBit = -1;
+		pPrecalc->m_DeltaPlan[i].m_nRunBits = 0;
+	}
+
+	// Work backwards so each prop can pick up the rest of its run from the next one.
+	for ( int i=nProps-1; i >= 0; i-- )
+	{
+		CSendTablePrecalc::CDeltaPlanProp *pPlan = &pPrecalc->m_DeltaPlan[i];
+		if ( !pPlan->m_nFixedBits )
+			continue;
+
+		pPlan->m_nRunBits = pPlan->m_nFixedBits;
+		if ( i+1 < nProps && pPrecalc->m_DeltaPlan[i+1].m_nFixedBits )
+		{
+			pPlan->m_iRunLastProp = pPrecalc->m_DeltaPlan[i+1].m_iRunLastProp;
+			pPlan->m_nRunBits += DELTAPLAN_NEXT_PROP_INDEX_BITS + pPrecalc->m_DeltaPlan[i+1].m_nRunBits;
+		}
+	}
+
+	// Lay out the expected index bits for every run of more than one prop.
+	int nTotalBits = 0;
+	for ( int i=0; i < nProps; i++ )
+	{
+		CSendTablePrecalc::CDeltaPlanProp *pPlan = &pPrecalc->m_DeltaPlan[i];
+		if ( !pPlan->m_nFixedBits )
+			continue;
+
+		bool bInRun = ( i > 0 && pPrecalc->m_DeltaPlan[i-1].m_nFixedBits );
+		if ( !bInRun && pPlan->m_iRunLastProp == i )
+			continue;
+
+		if ( bInRun )
+		{
+			nTotalBits += DELTAPLAN_NEXT_PROP_INDEX_BITS;
+		}
+		pPlan->m_iRunBit = nTotalBits;
+		nTotalBits += pPlan->m_nFixedBits;
+	}
+
+	if ( !nTotalBits )
+		return;
+
+	int nWords = ( nTotalBits + 31 ) >> 5;
+	pPrecalc->m_DeltaRunIndexBits.SetCount( nWords );
+	pPrecalc->m_DeltaRunIndexMask.SetCount( nWords );
+	memset( pPrecalc->m_DeltaRunIndexBits.Base(), 0, nWords * sizeof( uint32 ) );
+	memset( pPrecalc->m_DeltaRunIndexMask.Base(), 0, nWords * sizeof( uint32 ) );
+
+	bf_write indexBits( pPrecalc->m_DeltaRunIndexBits.Base(), nWords * sizeof( uint32 ) );
+	bf_write indexMask( pPrecalc->m_DeltaRunIndexMask.Base(), nWords * sizeof( uint32 ) );
+	for ( int i=1; i < nProps; i++ )
+	{
+		// Index bits go right before the data of every prop but the first in a run.
+		const CSendTablePrecalc::CDeltaPlanProp *pPlan = &pPrecalc->m_DeltaPlan[i];
+		if ( pPlan->m_iRunBit < 0 || !pPrecalc->m_DeltaPlan[i-1].m_nFixedBits )
+			continue;
+
+		int iIndexBit = pPlan->m_iRunBit - DELTAPLAN_NEXT_PROP_INDEX_BITS;
+		indexBits.SeekToBit( iIndexBit );
+		indexBits.WriteUBitLong( DELTAPLAN_NEXT_PROP_INDEX, DELTAPLAN_NEXT_PROP_INDEX_BITS );
+		indexMask.SeekToBit( iIndexBit );
+		indexMask.WriteUBitLong( ( 1 << DELTAPLAN_NEXT_PROP_INDEX_BITS ) - 1, DELTAPLAN_NEXT_PROP_INDEX_BITS );
+	}
+}
+
+
 static void SendTable_CalcNextVectorElems( SendTable *pTable )
 {
 	for ( int i=0; i < pTable->GetNumProps(); i++ )
@@ -764,6 +971,7 @@ static bool SendTable_InitTable( SendTable *pTable )
 		return false;
 
 	SendTable_Validate( pPrecalc );
+	SendTable_BuildDeltaPlan( pPrecalc );
 	return true;
 }
 
@@ -853,6 +1061,7 @@ void SendTable_PrintStats( void )
 	int numSendProps = 0;
 	int numFlatProps = 0;
 	int numExcludeProps = 0;
+	int numFixedSizeProps = 0;
 
 	for ( int i=0; i < g_SendTables.Count(); i++ )
 	{
@@ -862,6 +1071,12 @@ void SendTable_PrintStats( void )
 		numSendProps += st->GetNumProps();
 		numFlatProps += st->m_pPrecalc->GetNumProps();
 
+		for ( int j=0; j < st->m_pPrecalc->m_DeltaPlan.Count(); j++ )
+		{
+			if ( st->m_pPrecalc->m_DeltaPlan[j].m_nFixedBits )
+				numFixedSizeProps++;
+		}
+
 		for ( int j=0; j < st->GetNumProps(); j++ )
 		{
 			SendProp* sp = st->GetProp( j );
@@ -900,6 +1115,7 @@ void SendTable_PrintStats( void )
 	Msg("Array Props   : %i\n", numArrays );
 	Msg("Table Props   : %i\n", numSubTables );
 	Msg("Exclu Props   : %i\n", numExcludeProps );
+	Msg("Fixed Size    : %i\n", numFixedSizeProps );
 }
 
 
@@ -12,6 +12,7 @@
 
 #include <mempool.h>
 #include <utllinkedlist.h>
+#include <tier0/tslist.h>
 
 
 class PackedEntity;
@@ -23,6 +24,29 @@ class CEventInfo;
 #define INVALID_PACKED_ENTITY_HANDLE (0)
 typedef intptr_t PackedEntityHandle_t;
 
+//-----------------------------------------------------------------------------
+// Purpose: Backing memory for one snapshot's arrays.  Allocation is a pointer
+//  bump; arenas are recycled when their snapshot is freed and grow to the most
+//  the snapshot used, so steady state ticks don't touch the heap.
+//-----------------------------------------------------------------------------
+class CFrameSnapshotArena
+{
+public:
+							CFrameSnapshotArena();
+							~CFrameSnapshotArena();
+
+	void					*Alloc( int nSize );
+
+	// Frees everything, growing the arena if the last user overflowed it
+	void					Reset();
+
+private:
+	CUtlMemory< byte >		m_Memory;
+	int						m_nUsed;
+	int						m_nRequested;	// total asked for since the last reset
+	CUtlVector< byte * >	m_Overflow;		// heap allocations that didn't fit
+};
+
 //-----------------------------------------------------------------------------
 // Purpose: Individual entity data, did the entity exist and what was it's serial number
 //-----------------------------------------------------------------------------
@@ -81,6 +105,9 @@ public:
 
 	CFrameSnapshot*			NextSnapshot() const;						
 
+	// Arrays that live as long as the snapshot, not constructed
+	template< class T > T	*AllocArray( int nCount ) { return (T *)m_pArena->Alloc( nCount * sizeof( T ) ); }
+
 
 public:
 	CInterlockedInt			m_ListIndex;	// Index info CFrameSnapshotManager::m_FrameSnapshots.
@@ -105,6 +132,8 @@ public:
 
 	CUtlVector<int>			m_iExplicitDeleteSlots;
 
+	CFrameSnapshotArena		*m_pArena;
+
 private:
 
 	// Snapshots auto-delete themselves when their refcount goes to zero.
@@ -163,11 +192,24 @@ public:
 	// List of entities to explicitly delete
 	void			AddExplicitDelete( int iSlot );
 
+	// Return the calling thread's cached free PackedEntities to the shared list
+	void			FlushThreadPackedEntityCache();
+
 private:
 	void	DeleteFrameSnapshot( CFrameSnapshot* pSnapshot );
 
+	// PackedEntities are freed to a per-thread cache, then to a lock-free shared list
+	PackedEntity	*AllocPackedEntity();
+	void			FreePackedEntity( PackedEntity *pPackedEntity );
+	TSLNodeBase_t	*AllocPackedEntitySlab();
+
 	CUtlLinkedList<CFrameSnapshot*, unsigned short>		m_FrameSnapshots;
-	CClassMemoryPool< PackedEntity >					m_PackedEntitiesPool;
+	CUtlVector<CFrameSnapshotArena*>					m_FreeArenas;
+
+	CTSSimpleList<TSLNodeBase_t>	m_FreePackedEntities;
+	CUtlVector<byte *>				m_PackedEntitySlabs;	// guarded by m_WriteMutex
+	CInterlockedInt					m_nPackedEntities;		// allocated and not yet freed
+	CInterlockedInt					m_nThreadCachedPackedEntities;	// free, but held in some thread's cache
 
 	int								m_nPackedEntityCacheCounter;  // increase with every cache access
 	CUtlVector<UnpackedDataCache_t>	m_PackedEntityCache;	// cache for uncompressed packed entities
@@ -29,6 +29,9 @@
 
 extern CNetworkStringTableContainer *networkStringTableContainerServer;
 
+static ConVar tv_demo_async_write( "tv_demo_async_write", "1", 0, "Write SourceTV demos from a background thread so slow disks don't stall the server." );
+static ConVar tv_demo_async_buffer( "tv_demo_async_buffer", "32", 0, "Megabytes of SourceTV demo data allowed to wait for the disk before the server waits for it.", true, 1, true, 512 );
+
 //////////////////////////////////////////////////////////////////////
 // Construction/Destruction
 //////////////////////////////////////////////////////////////////////
@@ -61,7 +64,11 @@ void CHLTVDemoRecorder::StartRecording( const char *filename, bool bContinuously
 {
 	StopRecording();	// stop if we're already recording
 	
-	if ( !m_DemoFile.Open( filename, false ) )
+	const bool bOpened = tv_demo_async_write.GetBool() ?
+		m_DemoFile.OpenAsyncWrite( filename, tv_demo_async_buffer.GetInt() * 1024 * 1024 ) :
+		m_DemoFile.Open( filename, false );
+
+	if ( !bOpened )
 	{
 		ConMsg ("StartRecording: couldn't open demo file %s.\n", filename );
 		return;
@@ -39,6 +39,7 @@
 #include "sv_steamauth.h"
 #include "tier0/icommandline.h"
 #include "sys_dll.h"
+#include "demostreamwriter.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -2205,6 +2206,16 @@ CON_COMMAND( tv_status, "Show SourceTV server status." )
 	{
 		ConMsg("Recording to \"%s\", length %s.\n", hltv->m_DemoRecorder.GetDemoFile()->m_szFileName, 
 			COM_FormatSeconds( host_state.interval_per_tick * hltv->m_DemoRecorder.GetRecordingTick() ) );
+
+		CDemoStreamWriter *pWriter = hltv->m_DemoRecorder.GetDemoFile()->GetStreamWriter();
+		if ( pWriter )
+		{
+			DemoStreamWriterStats_t stats;
+			pWriter->GetStats( stats );
+			ConMsg("Demo writer %.1f MB in %i writes, slowest %.1f ms, max queued %i KB, %i stalls (%.1f ms)\n",
+				stats.m_nBytesWritten / ( 1024.0f * 1024.0f ), stats.m_nWrites, stats.m_flMaxWriteTime * 1000.0f,
+				stats.m_nMaxQueuedBytes / 1024, stats.m_nStalls, stats.m_flStallTime * 1000.0f );
+		}
 	}		
 }
 
@@ -14,6 +14,7 @@
 
 #include "tier1/fmtstr.h"
 #include "vstdlib/jobthread.h"
+#include "vstdlib/IKeyValuesSystem.h"
 
 #ifdef USE_SDL
 	#include "appframework/ilaunchermgr.h"
@@ -357,6 +358,11 @@ CON_COMMAND( mem_test, "" )
 	MemAlloc_CrtCheckMemory();
 }
 
+CON_COMMAND( kv_symbol_stats, "Show KeyValues symbol table size, probe lengths and lock contention." )
+{
+	KeyValuesSystem()->DumpSymbolTableStats();
+}
+
 static ConVar host_competitive_ever_enabled( "host_competitive_ever_enabled", "0", FCVAR_HIDDEN, "Has competitive ever been enabled this run?", true, 0, true, 1, true, 1, false, 1, NULL  );
 
 static ConVar mem_test_each_frame( "mem_test_each_frame", "0", 0, "Run heap check at end of every frame\n" );
@@ -22,6 +22,7 @@
 #include "tier0/memdbgon.h"
 ConVar sv_dumpstringtables( "sv_dumpstringtables", "0", FCVAR_CHEAT );
 ConVar sv_compressstringtablebaselines_threshhold( "sv_compressstringtablebaselines_threshold", "2048", 0, "Minimum size (in bytes) for stringtablebaseline buffer to be compressed." );
+ConVar sv_stringtablebaselinecache( "sv_stringtablebaselinecache", "1", 0, "Reuse each string table's encoded baseline for connecting clients until the table changes." );
 
 #define SUBSTRING_BITS	5
 struct StringHistoryEntry
@@ -218,9 +219,18 @@ CNetworkStringTable::CNetworkStringTable( TABLEID id, const char *tableName, int
 	m_nTickCount = 0;
 	m_pMirrorTable = NULL;
 	m_nLastChangedTick = 0;
+	m_nDataVersion = 0;
 	m_bChangeHistoryEnabled = false;
 	m_bLocked = false;
 
+#ifndef SHARED_NET_STRING_TABLES
+	m_nBaselineBits = 0;
+	m_nBaselineVersion = -1;
+	m_nBaselineCompressThreshold = 0;
+	m_nBaselineCacheHits = 0;
+	m_nBaselineCacheMisses = 0;
+#endif
+
 	m_nMaxEntries = maxentries;
 	m_nEntryBits = Q_log2( m_nMaxEntries );
 
@@ -330,6 +340,8 @@ CNetworkStringTable::~CNetworkStringTable( void )
 //-----------------------------------------------------------------------------
 void CNetworkStringTable::DeleteAllStrings( void )
 {
+	m_nDataVersion++;
+
 	delete m_pItems;
 	if ( m_bIsFilenames )
 	{
@@ -440,6 +452,7 @@ void CNetworkStringTable::RestoreTick(int tick)
 	// TODO optimize this, most of the time the tables doens't really change
 
 	m_nLastChangedTick = 0;
+	m_nDataVersion++;
 
 	int count = m_pItems->Count();
 		
@@ -875,6 +888,11 @@ int CNetworkStringTable::AddString( bool bIsServer, const char *string, int leng
 			}
 		}
 
+		if ( bHasChanged )
+		{
+			m_nDataVersion++;
+		}
+
 		if ( bHasChanged && !m_bChangeHistoryEnabled )
 		{
 			DataChanged( -i, item );
@@ -935,6 +953,11 @@ int CNetworkStringTable::AddString( bool bIsServer, const char *string, int leng
 			}
 		}
 
+		if ( bHasChanged )
+		{
+			m_nDataVersion++;
+		}
+
 		if ( bHasChanged && !m_bChangeHistoryEnabled )
 		{
 			DataChanged( i, item );
@@ -999,6 +1022,7 @@ void CNetworkStringTable::SetStringUserData( int stringNumber, int length /*=0*/
 	if ( p->SetUserData( m_nTickCount, length, userdata ) )
 	{
 		// Mark changed
+		m_nDataVersion++;
 		DataChanged( saveStringNumber, p );
 	}
 }
@@ -1212,6 +1236,9 @@ void CNetworkStringTable::Dump( void )
 {
 	ConMsg( "Table %s\n", GetTableName() );
 	ConMsg( "  %i/%i items\n", GetNumStrings(), GetMaxStrings() );
+#ifndef SHARED_NET_STRING_TABLES
+	ConMsg( "  baseline cache: %i hits, %i misses\n", m_nBaselineCacheHits, m_nBaselineCacheMisses );
+#endif
 	for ( int i = 0; i < GetNumStrings() ; i++ )
 	{
 		ConMsg( "  %i : %s\n", i, GetString( i ) );
@@ -1247,6 +1274,44 @@ bool CNetworkStringTable::WriteBaselines( SVC_CreateStringTable &msg, char *msg_
 	return entries == msg.m_nNumEntries;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Appends the cached baseline message if the table hasn't changed since
+//			it was encoded
+//-----------------------------------------------------------------------------
+bool CNetworkStringTable::WriteCachedBaseline( bf_write &buf )
+{
+	if ( m_nBaselineVersion != m_nDataVersion ||
+		 m_nBaselineCompressThreshold != sv_compressstringtablebaselines_threshhold.GetInt() )
+		return false;
+
+	buf.WriteBits( m_Baseline.Base(), m_nBaselineBits );
+	m_nBaselineCacheHits++;
+	return true;
+}
+
+void CNetworkStringTable::CacheBaseline( SVC_CreateStringTable &msg )
+{
+	VPROF_BUDGET( "CNetworkStringTable::CacheBaseline", VPROF_BUDGETGROUP_OTHER_NETWORKING );
+
+	m_nBaselineCacheMisses++;
+
+	// table data plus the message header: type, name, counts, length and userdata sizes
+	int nSize = msg.m_DataOut.GetNumBytesWritten() + Q_strlen( msg.m_szTableName ) + 1 + 32;
+	m_Baseline.SetCount( nSize );
+
+	bf_write cache( "CNetworkStringTable::CacheBaseline", m_Baseline.Base(), nSize );
+	if ( !msg.WriteToBuffer( cache ) )
+	{
+		m_nBaselineVersion = -1;
+		m_Baseline.Purge();
+		return;
+	}
+
+	m_nBaselineBits = cache.GetNumBitsWritten();
+	m_nBaselineVersion = m_nDataVersion;
+	m_nBaselineCompressThreshold = sv_compressstringtablebaselines_threshhold.GetInt();
+}
+
 #endif
 
 
@@ -1259,6 +1324,10 @@ CNetworkStringTableContainer::CNetworkStringTableContainer( void )
 	m_bLocked = true;
 	m_nTickCount = 0;
 	m_bEnableRollback = false;
+#ifndef SHARED_NET_STRING_TABLES
+	m_nBaselineCacheHits = 0;
+	m_nBaselineCacheMisses = 0;
+#endif
 }
 
 //-----------------------------------------------------------------------------
@@ -1400,17 +1469,46 @@ void CNetworkStringTableContainer::WriteBaselines( bf_write &buf )
 	SVC_CreateStringTable msg;
 
 	size_t msg_buffer_size = 2 * NET_MAX_PAYLOAD;
-	char *msg_buffer = new char[ msg_buffer_size ];
-	if ( !msg_buffer )
-	{
-		Host_Error( "Failed to allocate %llu bytes of memory in CNetworkStringTableContainer::WriteBaselines\n", (uint64)msg_buffer_size );
-	}
+	char *msg_buffer = NULL;
 
 	for ( int i = 0 ; i < m_Tables.Count() ; i++ )
 	{
 		CNetworkStringTable *table = (CNetworkStringTable*) GetTable( i );
 
 		int before = buf.GetNumBytesWritten();
+
+		// Tables that haven't changed since the last client connected are copied as is
+		bool bCached = sv_stringtablebaselinecache.GetBool() && table->WriteCachedBaseline( buf );
+		if ( bCached )
+		{
+			m_nBaselineCacheHits++;
+
+			if ( buf.IsOverflowed() )
+			{
+				Host_Error( "Overflow error writing string table baseline %s\n", table->GetTableName() );
+			}
+
+			if ( sv_dumpstringtables.GetBool() )
+			{
+				DevMsg( "CNetworkStringTableContainer::WriteBaselines wrote %d bytes for table %s (cached) [space remaining %d bytes]\n", buf.GetNumBytesWritten() - before, table->GetTableName(), buf.GetNumBytesLeft() );
+			}
+			continue;
+		}
+
+		if ( sv_stringtablebaselinecache.GetBool() )
+		{
+			m_nBaselineCacheMisses++;
+		}
+
+		if ( !msg_buffer )
+		{
+			msg_buffer = new char[ msg_buffer_size ];
+			if ( !msg_buffer )
+			{
+				Host_Error( "Failed to allocate %llu bytes of memory in CNetworkStringTableContainer::WriteBaselines\n", (uint64)msg_buffer_size );
+			}
+		}
+
 		if ( !table->WriteBaselines( msg, msg_buffer, msg_buffer_size ) )
 		{
 			Host_Error( "Index error writing string table baseline %s\n", table->GetTableName() );
@@ -1452,6 +1550,11 @@ void CNetworkStringTableContainer::WriteBaselines( bf_write &buf )
 			delete [] compressedData;
 		}
 
+		if ( sv_stringtablebaselinecache.GetBool() )
+		{
+			table->CacheBaseline( msg );
+		}
+
 		if ( !msg.WriteToBuffer( buf ) )
 		{
 			Host_Error( "Overflow error writing string table baseline %s\n", table->GetTableName() );
@@ -1467,6 +1570,24 @@ void CNetworkStringTableContainer::WriteBaselines( bf_write &buf )
 	delete[] msg_buffer;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CNetworkStringTableContainer::PrintBaselineCacheStats( void )
+{
+	ConMsg( "String table baseline cache (sv_stringtablebaselinecache %d):\n", sv_stringtablebaselinecache.GetInt() );
+	for ( int i = 0; i < m_Tables.Count(); i++ )
+	{
+		CNetworkStringTable *table = m_Tables[ i ];
+		ConMsg( "  %-32s %6d hits %6d misses %6d bytes\n", table->GetTableName(),
+			table->GetBaselineCacheHits(), table->GetBaselineCacheMisses(), table->GetBaselineCacheBytes() );
+	}
+
+	int nTotal = m_nBaselineCacheHits + m_nBaselineCacheMisses;
+	ConMsg( "  total %d hits %d misses (%.1f%% hit rate)\n", m_nBaselineCacheHits, m_nBaselineCacheMisses,
+		nTotal ? 100.0f * m_nBaselineCacheHits / nTotal : 0.0f );
+}
+
 void CNetworkStringTableContainer::WriteStringTables( bf_write& buf )
 {
 	int numTables = m_Tables.Size();
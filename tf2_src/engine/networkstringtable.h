@@ -91,6 +91,13 @@ public:
 	bool			ReadStringTable( bf_read& buf );
 
 	bool			WriteBaselines( SVC_CreateStringTable &msg, char *msg_buffer, int msg_buffer_size );
+
+	// Encoded baseline message, reused for every client until the table changes
+	bool			WriteCachedBaseline( bf_write &buf );
+	void			CacheBaseline( SVC_CreateStringTable &msg );
+	int				GetBaselineCacheHits( void ) const { return m_nBaselineCacheHits; }
+	int				GetBaselineCacheMisses( void ) const { return m_nBaselineCacheMisses; }
+	int				GetBaselineCacheBytes( void ) const { return m_Baseline.Count(); }
 #endif
 
 	void			TriggerCallbacks( int tick_ack  );
@@ -119,6 +126,7 @@ protected:
 	int						m_nEntryBits;
 	int						m_nTickCount;
 	int						m_nLastChangedTick;
+	int						m_nDataVersion;		// bumped whenever a string or its userdata changes
 
 	bool					m_bChangeHistoryEnabled : 1;
 	bool					m_bLocked : 1;
@@ -139,6 +147,16 @@ protected:
 
 	INetworkStringDict		*m_pItems;
 	INetworkStringDict		*m_pItemsClientSide;	 // For m_bAllowClientSideAddString, these items are non-networked and are referenced by a negative string index!!!
+
+#ifndef SHARED_NET_STRING_TABLES
+	// cached SVC_CreateStringTable, valid while m_nBaselineVersion == m_nDataVersion
+	CUtlVector< byte >		m_Baseline;
+	int						m_nBaselineBits;
+	int						m_nBaselineVersion;
+	int						m_nBaselineCompressThreshold;
+	int						m_nBaselineCacheHits;		// signons that reused m_Baseline
+	int						m_nBaselineCacheMisses;		// signons that had to encode the table
+#endif
 };
 
 //-----------------------------------------------------------------------------
@@ -182,6 +200,9 @@ public:
 	void		WriteUpdateMessage( CBaseClient *client, int tick_ack, bf_write &buf );
 	void		WriteBaselines( bf_write &buf );
 	void		DirectUpdate( int tick_ack );	// fill mirror table directly with updates
+
+	// Print how often WriteBaselines could reuse each table's cached baseline
+	void		PrintBaselineCacheStats( void );
 #endif
 
 	void		TriggerCallbacks( int tick_ack ); // fire callback functions 
@@ -207,6 +228,12 @@ private:
 	bool		m_bEnableRollback;	// enables rollback feature
 
 	CUtlVector < CNetworkStringTable* > m_Tables;	// the string tables
+
+#ifndef SHARED_NET_STRING_TABLES
+	// baseline cache totals, kept across levels unlike the per-table counts
+	int			m_nBaselineCacheHits;
+	int			m_nBaselineCacheMisses;
+#endif
 };
 
 #endif // NETWORKSTRINGTABLE_H
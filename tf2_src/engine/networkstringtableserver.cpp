@@ -60,3 +60,10 @@ void SV_PrintStringTables( void )
 	s_NetworkStringTableServer.Dump();
 }
 
+#ifndef SHARED_NET_STRING_TABLES
+CON_COMMAND( sv_stringtablebaselinecache_stats, "Print how often connecting clients were sent a cached string table baseline." )
+{
+	s_NetworkStringTableServer.PrintBaselineCacheStats();
+}
+#endif
+
@@ -19,6 +19,17 @@
 
 DEFINE_FIXEDSIZE_ALLOCATOR( CFrameSnapshot, 64, 64 );
 
+// PackedEntity memory is carved from slabs this big and never returned to the heap until shutdown
+#define PACKED_ENTITIES_PER_SLAB		( MAX_EDICTS / 16 )
+#define PACKED_ENTITY_BLOCK_SIZE		AlignValue( MAX( sizeof( PackedEntity ), sizeof( TSLNodeBase_t ) ), TSLIST_NODE_ALIGNMENT )
+
+// Free PackedEntities kept by each thread before they go back to the shared list.  Kept
+// small since pool threads only give theirs back when a pack job ends.
+#define PACKED_ENTITY_THREAD_CACHE		32
+
+static CTHREADLOCALPTR( TSLNodeBase_t ) s_pThreadFreePackedEntities;
+static CTHREADLOCALINT s_nThreadFreePackedEntities;
+
 
 static ConVar sv_creationtickcheck( "sv_creationtickcheck", "1", FCVAR_CHEAT | FCVAR_DEVELOPMENTONLY, "Do extended check for encoding of timestamps against tickcount" );
 extern	CGlobalVars g_ServerGlobalVariables;
@@ -30,7 +41,7 @@ CFrameSnapshotManager *framesnapshotmanager = &g_FrameSnapshotManager;
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
-CFrameSnapshotManager::CFrameSnapshotManager( void ) : m_PackedEntitiesPool( MAX_EDICTS / 16, CUtlMemoryPool::GROW_SLOW )
+CFrameSnapshotManager::CFrameSnapshotManager( void )
 {
 	COMPILE_TIME_ASSERT( INVALID_PACKED_ENTITY_HANDLE == 0 );
 	Q_memset( m_pPackedData, 0x00, MAX_EDICTS * sizeof(PackedEntityHandle_t) );
@@ -45,7 +56,17 @@ CFrameSnapshotManager::~CFrameSnapshotManager( void )
 	AssertMsg1( m_FrameSnapshots.Count() == 0 || IsInErrorExit(), "Expected m_FrameSnapshots to be empty. It had %i items.", m_FrameSnapshots.Count() );
 
 	// TODO: This assert has been failing. HenryG says it's a valid assert and that we're probably leaking memory.
-	AssertMsg1( m_PackedEntitiesPool.Count() == 0 || IsInErrorExit(), "Expected m_PackedEntitiesPool to be empty. It had %i items.", m_PackedEntitiesPool.Count() );
+	AssertMsg1( m_nPackedEntities == 0 || IsInErrorExit(), "Expected all PackedEntities to be freed. %i are still allocated.", (int)m_nPackedEntities );
+
+	m_FreeArenas.PurgeAndDeleteElements();
+
+	// Thread caches point into the slabs, nothing may allocate after this
+	m_FreePackedEntities.Detach();
+	FOR_EACH_VEC( m_PackedEntitySlabs, i )
+	{
+		MemAlloc_FreeAligned( m_PackedEntitySlabs[i] );
+	}
+	m_PackedEntitySlabs.Purge();
 }
 
 //-----------------------------------------------------------------------------
@@ -59,6 +80,15 @@ void CFrameSnapshotManager::LevelChanged()
 
 	// Release the most recent snapshot...
 	m_PackedEntityCache.RemoveAll();
+
+	// Entity counts differ between maps, let the arenas size themselves again
+	m_FreeArenas.PurgeAndDeleteElements();
+
+	// every block is either live, on the shared list or in a thread cache
+	AssertMsg4( m_nPackedEntities + m_FreePackedEntities.Count() + m_nThreadCachedPackedEntities == m_PackedEntitySlabs.Count() * PACKED_ENTITIES_PER_SLAB,
+		"PackedEntity blocks don't add up: %i live, %i free, %i in thread caches, %i in slabs.",
+		(int)m_nPackedEntities, m_FreePackedEntities.Count(), (int)m_nThreadCachedPackedEntities, m_PackedEntitySlabs.Count() * PACKED_ENTITIES_PER_SLAB );
+
 	COMPILE_TIME_ASSERT( INVALID_PACKED_ENTITY_HANDLE == 0 );
 	Q_memset( m_pPackedData, 0x00, MAX_EDICTS * sizeof(PackedEntityHandle_t) );
 }
@@ -87,7 +117,19 @@ CFrameSnapshot*	CFrameSnapshotManager::CreateEmptySnapshot( int tickcount, int m
 	snap->m_pValidEntities = NULL;
 	snap->m_pHLTVEntityData = NULL;
 	snap->m_pReplayEntityData = NULL;
-	snap->m_pEntities = new CFrameSnapshotEntry[maxEntities];
+
+	// Reuse the most recently freed arena, it's the likeliest to still be in cache
+	if ( m_FreeArenas.Count() )
+	{
+		snap->m_pArena = m_FreeArenas.Tail();
+		m_FreeArenas.RemoveMultipleFromTail( 1 );
+	}
+	else
+	{
+		snap->m_pArena = new CFrameSnapshotArena;
+	}
+
+	snap->m_pEntities = snap->AllocArray<CFrameSnapshotEntry>( maxEntities );
 
 	CFrameSnapshotEntry *entry = snap->m_pEntities;
 	
@@ -151,20 +193,20 @@ CFrameSnapshot* CFrameSnapshotManager::TakeTickSnapshot( int tickcount )
 		nValidEntities[snap->m_nValidEntities++] = i;
 	}
 
-	// create dynamic valid entities array and copy indices
-	snap->m_pValidEntities = new unsigned short[snap->m_nValidEntities];
+	// create valid entities array and copy indices
+	snap->m_pValidEntities = snap->AllocArray<unsigned short>( snap->m_nValidEntities );
 	Q_memcpy( snap->m_pValidEntities, nValidEntities, snap->m_nValidEntities * sizeof(unsigned short) );
 
 	if ( hltv && hltv->IsActive() )
 	{
-		snap->m_pHLTVEntityData = new CHLTVEntityData[snap->m_nValidEntities];
+		snap->m_pHLTVEntityData = snap->AllocArray<CHLTVEntityData>( snap->m_nValidEntities );
 		Q_memset( snap->m_pHLTVEntityData, 0, snap->m_nValidEntities * sizeof(CHLTVEntityData) );
 	}
 
 #if defined( REPLAY_ENABLED )
 	if ( replay && replay->IsActive() )
 	{
-		snap->m_pReplayEntityData = new CReplayEntityData[snap->m_nValidEntities];
+		snap->m_pReplayEntityData = snap->AllocArray<CReplayEntityData>( snap->m_nValidEntities );
 		Q_memset( snap->m_pReplayEntityData, 0, snap->m_nValidEntities * sizeof(CReplayEntityData) );
 	}
 #endif
@@ -191,7 +233,12 @@ void CFrameSnapshotManager::DeleteFrameSnapshot( CFrameSnapshot* pSnapshot )
 	}
 
 	m_FrameSnapshots.Remove( pSnapshot->m_ListIndex );
+
+	CFrameSnapshotArena *pArena = pSnapshot->m_pArena;
 	delete pSnapshot;
+
+	pArena->Reset();
+	m_FreeArenas.AddToTail( pArena );
 }
 
 void CFrameSnapshotManager::RemoveEntityReference( PackedEntityHandle_t handle )
@@ -202,21 +249,24 @@ void CFrameSnapshotManager::RemoveEntityReference( PackedEntityHandle_t handle )
 
 	if ( --packedEntity->m_ReferenceCount <= 0)
 	{
-		AUTO_LOCK( m_WriteMutex );
-
-		m_PackedEntitiesPool.Free( packedEntity );
-
 		// if we have a uncompression cache, remove reference too
-		FOR_EACH_VEC( m_PackedEntityCache, i )
+		if ( m_PackedEntityCache.Count() )
 		{
-			UnpackedDataCache_t &pdc = m_PackedEntityCache[i];
-			if ( pdc.pEntity == packedEntity )
+			AUTO_LOCK( m_WriteMutex );
+
+			FOR_EACH_VEC( m_PackedEntityCache, i )
 			{
-				pdc.pEntity = NULL;
-				pdc.counter = 0;
-				break;
+				UnpackedDataCache_t &pdc = m_PackedEntityCache[i];
+				if ( pdc.pEntity == packedEntity )
+				{
+					pdc.pEntity = NULL;
+					pdc.counter = 0;
+					break;
+				}
 			}
 		}
+
+		FreePackedEntity( packedEntity );
 	}
 }
 
@@ -316,16 +366,103 @@ CThreadFastMutex &CFrameSnapshotManager::GetMutex()
 	return m_WriteMutex;
 }
 
+//-----------------------------------------------------------------------------
+// PackedEntity allocation.  Entities are packed on worker threads but mostly
+// freed on the main thread when snapshots are released, so each thread keeps
+// a bounded cache and overflows to the shared list.  No locks unless a new
+// slab is needed.
+//-----------------------------------------------------------------------------
+PackedEntity *CFrameSnapshotManager::AllocPackedEntity()
+{
+	TSLNodeBase_t *pNode = (TSLNodeBase_t *)s_pThreadFreePackedEntities;
+	if ( pNode )
+	{
+		s_pThreadFreePackedEntities = pNode->Next;
+		s_nThreadFreePackedEntities--;
+		--m_nThreadCachedPackedEntities;
+	}
+	else
+	{
+		pNode = m_FreePackedEntities.Pop();
+		if ( !pNode )
+		{
+			pNode = AllocPackedEntitySlab();
+		}
+	}
+
+	++m_nPackedEntities;
+	return Construct( (PackedEntity *)pNode );
+}
+
+void CFrameSnapshotManager::FreePackedEntity( PackedEntity *pPackedEntity )
+{
+	Destruct( pPackedEntity );
+	--m_nPackedEntities;
+
+	TSLNodeBase_t *pNode = (TSLNodeBase_t *)pPackedEntity;
+	if ( s_nThreadFreePackedEntities < PACKED_ENTITY_THREAD_CACHE )
+	{
+		pNode->Next = (TSLNodeBase_t *)s_pThreadFreePackedEntities;
+		s_pThreadFreePackedEntities = pNode;
+		s_nThreadFreePackedEntities++;
+		++m_nThreadCachedPackedEntities;
+	}
+	else
+	{
+		m_FreePackedEntities.Push( pNode );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Hands the calling thread's cached PackedEntities back to the shared list.
+// Pool threads call this when a pack job ends, otherwise what they freed
+// would sit there until they next pack.
+//-----------------------------------------------------------------------------
+void CFrameSnapshotManager::FlushThreadPackedEntityCache()
+{
+	TSLNodeBase_t *pNode = (TSLNodeBase_t *)s_pThreadFreePackedEntities;
+	while ( pNode )
+	{
+		TSLNodeBase_t *pNext = pNode->Next;
+		m_FreePackedEntities.Push( pNode );
+		--m_nThreadCachedPackedEntities;
+		pNode = pNext;
+	}
+
+	s_pThreadFreePackedEntities = NULL;
+	s_nThreadFreePackedEntities = 0;
+}
+
+TSLNodeBase_t *CFrameSnapshotManager::AllocPackedEntitySlab()
+{
+	AUTO_LOCK( m_WriteMutex );
+
+	// Another thread may have added a slab while we waited
+	TSLNodeBase_t *pNode = m_FreePackedEntities.Pop();
+	if ( pNode )
+		return pNode;
+
+	MEM_ALLOC_CREDIT();
+	byte *pSlab = (byte *)MemAlloc_AllocAligned( PACKED_ENTITY_BLOCK_SIZE * PACKED_ENTITIES_PER_SLAB, TSLIST_NODE_ALIGNMENT );
+	m_PackedEntitySlabs.AddToTail( pSlab );
+
+	// Keep the first block, share the rest
+	for ( int i = 1; i < PACKED_ENTITIES_PER_SLAB; i++ )
+	{
+		m_FreePackedEntities.Push( (TSLNodeBase_t *)( pSlab + i * PACKED_ENTITY_BLOCK_SIZE ) );
+	}
+
+	return (TSLNodeBase_t *)pSlab;
+}
+
 //-----------------------------------------------------------------------------
 // Returns the pack data for a particular entity for a particular snapshot
 //-----------------------------------------------------------------------------
 
 PackedEntity* CFrameSnapshotManager::CreatePackedEntity( CFrameSnapshot* pSnapshot, int entity )
 {
-	m_WriteMutex.Lock();
-	PackedEntity *packedEntity = m_PackedEntitiesPool.Alloc();
+	PackedEntity *packedEntity = AllocPackedEntity();
 	PackedEntityHandle_t handle = reinterpret_cast< PackedEntityHandle_t >( packedEntity );
-	m_WriteMutex.Unlock();
 	
 	Assert( entity < pSnapshot->m_nNumEntities );
 
@@ -441,6 +578,7 @@ CFrameSnapshot::CFrameSnapshot()
 	m_nTempEntities = 0;
 	m_pTempEntities = NULL;
 	m_pValidEntities = NULL;
+	m_pArena = NULL;
 	m_nReferences = 0;
 #if defined( _DEBUG )
 	++g_nAllocatedSnapshots;
@@ -451,9 +589,7 @@ CFrameSnapshot::CFrameSnapshot()
 
 CFrameSnapshot::~CFrameSnapshot()
 {
-	delete [] m_pValidEntities;
-	delete [] m_pEntities;
-
+	// The arrays belong to m_pArena, which the manager recycles
 	if ( m_pTempEntities )
 	{
 		Assert( m_nTempEntities>0 );
@@ -461,19 +597,8 @@ CFrameSnapshot::~CFrameSnapshot()
 		{
 			delete m_pTempEntities[i];
 		}
-
-		delete [] m_pTempEntities;
-	}
-
-	if ( m_pHLTVEntityData )
-	{
-		delete [] m_pHLTVEntityData;
 	}
 
-	if ( m_pReplayEntityData )
-	{
-		delete [] m_pReplayEntityData;
-	}
 	Assert ( m_nReferences == 0 );
 
 #if defined( _DEBUG )
@@ -506,3 +631,61 @@ CFrameSnapshot* CFrameSnapshot::NextSnapshot() const
 }
 
 
+// ------------------------------------------------------------------------------------------------ //
+// CFrameSnapshotArena
+// ------------------------------------------------------------------------------------------------ //
+
+// Keeps every array aligned for any of the snapshot data types
+#define FRAME_SNAPSHOT_ARENA_ALIGN		16
+
+CFrameSnapshotArena::CFrameSnapshotArena()
+{
+	m_nUsed = 0;
+	m_nRequested = 0;
+}
+
+CFrameSnapshotArena::~CFrameSnapshotArena()
+{
+	FOR_EACH_VEC( m_Overflow, i )
+	{
+		delete [] m_Overflow[i];
+	}
+}
+
+void *CFrameSnapshotArena::Alloc( int nSize )
+{
+	nSize = AlignValue( nSize, FRAME_SNAPSHOT_ARENA_ALIGN );
+	m_nRequested += nSize;
+
+	if ( m_nUsed + nSize <= m_Memory.Count() )
+	{
+		void *pMemory = m_Memory.Base() + m_nUsed;
+		m_nUsed += nSize;
+		return pMemory;
+	}
+
+	// Out of room, the arena grows on the next Reset()
+	MEM_ALLOC_CREDIT();
+	byte *pMemory = new byte[ nSize ];
+	m_Overflow.AddToTail( pMemory );
+	return pMemory;
+}
+
+void CFrameSnapshotArena::Reset()
+{
+	if ( m_Overflow.Count() )
+	{
+		FOR_EACH_VEC( m_Overflow, i )
+		{
+			delete [] m_Overflow[i];
+		}
+		m_Overflow.RemoveAll();
+
+		MEM_ALLOC_CREDIT();
+		m_Memory.Purge();
+		m_Memory.EnsureCapacity( m_nRequested );
+	}
+
+	m_nUsed = 0;
+	m_nRequested = 0;
+}
@@ -1806,7 +1806,7 @@ void CGameServer::CopyTempEntities( CFrameSnapshot* pSnapshot )
 		// copy temp entities if any
 		pSnapshot->m_nTempEntities = m_TempEntities.Count();
 
-		pSnapshot->m_pTempEntities = new CEventInfo*[pSnapshot->m_nTempEntities];
+		pSnapshot->m_pTempEntities = pSnapshot->AllocArray<CEventInfo *>( pSnapshot->m_nTempEntities );
 
 		Q_memcpy( pSnapshot->m_pTempEntities, m_TempEntities.Base(), m_TempEntities.Count() * sizeof( CEventInfo * ) );
 
@@ -398,6 +398,11 @@ struct PackWork_t
 	{
 		SV_PackEntity( item.nIdx, item.pEdict, item.pSnapshot->m_pEntities[ item.nIdx ].m_pClass, item.pSnapshot );
 	}
+
+	static void End()
+	{
+		framesnapshotmanager->FlushThreadPackedEntityCache();
+	}
 };
 
 void PackEntities_Normal( 
@@ -451,7 +456,7 @@ void PackEntities_Normal(
 	// Process work
 	if ( sv_parallel_packentities.GetBool() )
 	{
-		ParallelProcess( "PackWork_t::Process", workItems.Base(), workItems.Count(), &PackWork_t::Process );
+		ParallelProcess( "PackWork_t::Process", workItems.Base(), workItems.Count(), &PackWork_t::Process, NULL, &PackWork_t::End );
 	}
 	else
 	{
@@ -29,6 +29,7 @@
 ConVar rr_debugresponses( "rr_debugresponses", "0", FCVAR_NONE, "Show verbose matching output (1 for simple, 2 for rule scoring). If set to 3, it will only show response success/failure for npc_selected NPCs." );
 ConVar rr_debugrule( "rr_debugrule", "", FCVAR_NONE, "If set to the name of the rule, that rule's score will be shown whenever a concept is passed into the response rules system.");
 ConVar rr_dumpresponses( "rr_dumpresponses", "0", FCVAR_NONE, "Dump all response_rules.txt and rules (requires restart)" );
+ConVar rr_ruleindex( "rr_ruleindex", "1", FCVAR_NONE, "Only score the rules whose indexed criterion matches the query. 0 scores every rule." );
 
 static CUtlSymbolTable g_RS;
 
@@ -59,6 +60,7 @@ public:
 		maxequals = false;
 		maxval = 0.0f;
 		minval = 0.0f;
+		tokenval = 0.0f;
 
 		token = UTL_INVAL_SYMBOL;
 		rawtoken = UTL_INVAL_SYMBOL;
@@ -110,6 +112,7 @@ public:
 
 	float	maxval;
 	float	minval;
+	float	tokenval;		// numeric value of the token, for isnumeric matchers
 
 	bool	valid : 1;      //1
 	bool	isnumeric : 1;  //2
@@ -684,6 +687,11 @@ public:
 
 	int			FindBestMatchingRule( const AI_CriteriaSet& set, bool verbose );
 
+	bool		IsRuleIndexCriterion( int icriterion );
+	void		BuildRuleIndex();
+	void		InvalidateRuleIndex() { m_bRuleIndexValid = false; }
+	void		GetCandidateRules( const AI_CriteriaSet& set, CUtlVector< int > &candidates );
+
 	float		ScoreCriteriaAgainstRule( const AI_CriteriaSet& set, int irule, bool verbose = false );
 	float		RecursiveScoreSubcriteriaAgainstRule( const AI_CriteriaSet& set, Criteria *parent, bool& exclude, bool verbose /*=false*/ );
 	float		ScoreCriteriaAgainstRuleCriteria( const AI_CriteriaSet& set, int icriterion, bool& exclude, bool verbose = false );
@@ -710,6 +718,13 @@ public:
 	CUtlDict< Rule, short >	m_Rules;
 	CUtlDict< Enumeration, short > m_Enumerations;
 
+	// Rules bucketed by the value of one required criterion, see BuildRuleIndex
+	CUtlVector< CUtlString >	m_RuleIndexNames;		// criterion names the buckets are keyed on
+	CUtlDict< int, int >		m_RuleIndexKeys;		// "name\nvalue" -> bucket
+	CUtlVector< CUtlVector< unsigned short > >	m_RuleIndexBuckets;	// rule indices, ascending
+	CUtlVector< unsigned short >	m_UnindexedRules;	// scored for every query
+	bool		m_bRuleIndexValid;
+
 	char		token[ 1204 ];
 
 	bool		m_bUnget;
@@ -762,6 +777,7 @@ CResponseSystem::CResponseSystem()
 	m_bUnget = false;
 	m_bPrecache = true;
 	m_bCustomManagable = false;
+	m_bRuleIndexValid = false;
 }
 
 //-----------------------------------------------------------------------------
@@ -817,6 +833,7 @@ void CResponseSystem::Clear()
 	m_Criteria.RemoveAll();
 	m_Rules.RemoveAll();
 	m_Enumerations.RemoveAll();
+	InvalidateRuleIndex();
 }
 
 //-----------------------------------------------------------------------------
@@ -988,6 +1005,7 @@ void CResponseSystem::ComputeMatcher( Criteria *c, Matcher& matcher )
 
 	matcher.SetToken( token );
 	matcher.SetRaw( rawtoken );
+	matcher.tokenval = (float)atof( token );
 	matcher.valid = true;
 }
 
@@ -996,11 +1014,16 @@ bool CResponseSystem::CompareUsingMatcher( const char *setValue, Matcher& m, boo
 	if ( !m.valid )
 		return false;
 
-	float v = (float)atof( setValue );
-	if ( setValue[0] == '[' )
+	// Plain string matches don't need the numeric value
+	float v = 0.0f;
+	if ( m.usemin || m.usemax || m.isnumeric )
 	{
-		bool found = false;
-		v = LookupEnumeration( setValue, found );
+		v = (float)atof( setValue );
+		if ( setValue[0] == '[' )
+		{
+			bool found = false;
+			v = LookupEnumeration( setValue, found );
+		}
 	}
 	
 	int minmaxcount = 0;
@@ -1047,7 +1070,7 @@ bool CResponseSystem::CompareUsingMatcher( const char *setValue, Matcher& m, boo
 	{
 		if ( m.isnumeric )
 		{
-			if ( v == (float)atof( m.GetToken() ) )
+			if ( v == m.tokenval )
 				return false;
 		}
 		else
@@ -1066,7 +1089,7 @@ bool CResponseSystem::CompareUsingMatcher( const char *setValue, Matcher& m, boo
 		if ( !setValue || !setValue[0] )
 			return false;
 
-		return v == (float)atof( m.GetToken() );
+		return v == m.tokenval;
 	}
 
 	return !Q_stricmp( setValue, m.GetToken() ) ? true : false;
@@ -1676,6 +1699,166 @@ bool CResponseSystem::GetBestResponse( ResponseSearchResult& searchResult, Rule
 	return bret;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Whether a rule criterion can key the rule index.  The rule can only
+//			match a set holding this criterion with exactly this value.
+//-----------------------------------------------------------------------------
+bool CResponseSystem::IsRuleIndexCriterion( int icriterion )
+{
+	Criteria *c = &m_Criteria[ icriterion ];
+	if ( !c->required || c->IsSubCriteriaType() || !c->name )
+		return false;
+
+	// Numbers and ranges match more than one spelling, and != matches a missing criterion.
+	// A string token is never empty, so a missing criterion ("") doesn't match it either.
+	Matcher &m = c->matcher;
+	return m.valid && !m.isnumeric && !m.notequal && !m.usemin && !m.usemax;
+}
+
+static bool GetRuleIndexKey( char *pszKey, int nKeySize, const char *pszName, const char *pszValue )
+{
+	int len = Q_snprintf( pszKey, nKeySize, "%s\n%s", pszName, pszValue );
+	return len >= 0 && len < nKeySize;
+}
+
+static int __cdecl RuleIndexCompare( const int *pLeft, const int *pRight )
+{
+	return *pLeft - *pRight;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Buckets the rules by the value of one required criterion, so a query
+//			only scores the rules in the buckets its own values select.  Each rule
+//			goes in the bucket of its required criterion whose value is shared by
+//			the fewest rules (usually the concept), rules without one are always
+//			scored.
+//-----------------------------------------------------------------------------
+void CResponseSystem::BuildRuleIndex()
+{
+	m_RuleIndexNames.Purge();
+	m_RuleIndexKeys.Purge();
+	m_RuleIndexBuckets.Purge();
+	m_UnindexedRules.Purge();
+
+	char key[ 256 ];
+
+	// How many rules could go in each bucket
+	CUtlDict< int, int > keyCounts;
+	int c = m_Rules.Count();
+	for ( int i = 0; i < c; i++ )
+	{
+		Rule *rule = &m_Rules[ i ];
+		for ( int j = 0; j < rule->m_Criteria.Count(); j++ )
+		{
+			int icriterion = rule->m_Criteria[ j ];
+			Criteria *pCriteria = &m_Criteria[ icriterion ];
+			if ( !IsRuleIndexCriterion( icriterion ) ||
+				 !GetRuleIndexKey( key, sizeof( key ), pCriteria->name, pCriteria->matcher.GetToken() ) )
+				continue;
+
+			int idx = keyCounts.Find( key );
+			if ( idx == keyCounts.InvalidIndex() )
+			{
+				idx = keyCounts.Insert( key, 0 );
+			}
+			keyCounts[ idx ]++;
+		}
+	}
+
+	for ( int i = 0; i < c; i++ )
+	{
+		Rule *rule = &m_Rules[ i ];
+
+		Criteria *pBest = NULL;
+		int bestCount = 0;
+		for ( int j = 0; j < rule->m_Criteria.Count(); j++ )
+		{
+			int icriterion = rule->m_Criteria[ j ];
+			Criteria *pCriteria = &m_Criteria[ icriterion ];
+			if ( !IsRuleIndexCriterion( icriterion ) ||
+				 !GetRuleIndexKey( key, sizeof( key ), pCriteria->name, pCriteria->matcher.GetToken() ) )
+				continue;
+
+			int count = keyCounts[ keyCounts.Find( key ) ];
+			if ( !pBest || count < bestCount )
+			{
+				pBest = pCriteria;
+				bestCount = count;
+			}
+		}
+
+		if ( !pBest )
+		{
+			m_UnindexedRules.AddToTail( i );
+			continue;
+		}
+
+		GetRuleIndexKey( key, sizeof( key ), pBest->name, pBest->matcher.GetToken() );
+		int idx = m_RuleIndexKeys.Find( key );
+		if ( idx == m_RuleIndexKeys.InvalidIndex() )
+		{
+			idx = m_RuleIndexKeys.Insert( key, m_RuleIndexBuckets.AddToTail() );
+
+			// Set lookups ignore case, so "Concept" and "concept" are one name
+			int n;
+			for ( n = 0; n < m_RuleIndexNames.Count(); n++ )
+			{
+				if ( !Q_stricmp( m_RuleIndexNames[ n ].Get(), pBest->name ) )
+					break;
+			}
+			if ( n == m_RuleIndexNames.Count() )
+			{
+				m_RuleIndexNames.AddToTail( pBest->name );
+			}
+		}
+		m_RuleIndexBuckets[ m_RuleIndexKeys[ idx ] ].AddToTail( i );
+	}
+
+	m_bRuleIndexValid = true;
+
+	DevMsg( 1, "CResponseSystem:  indexed %i of %i rules into %i buckets on %i criteria\n",
+		c - m_UnindexedRules.Count(), c, m_RuleIndexBuckets.Count(), m_RuleIndexNames.Count() );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Lists the rules that can match the set, in ascending order
+//-----------------------------------------------------------------------------
+void CResponseSystem::GetCandidateRules( const AI_CriteriaSet& set, CUtlVector< int > &candidates )
+{
+	if ( !m_bRuleIndexValid )
+	{
+		BuildRuleIndex();
+	}
+
+	char key[ 256 ];
+	for ( int n = 0; n < m_RuleIndexNames.Count(); n++ )
+	{
+		const char *pszName = m_RuleIndexNames[ n ].Get();
+		int found = set.FindCriterionIndex( pszName );
+		if ( found == -1 || !GetRuleIndexKey( key, sizeof( key ), pszName, set.GetValue( found ) ) )
+			continue;
+
+		int idx = m_RuleIndexKeys.Find( key );
+		if ( idx == m_RuleIndexKeys.InvalidIndex() )
+			continue;
+
+		CUtlVector< unsigned short > &bucket = m_RuleIndexBuckets[ m_RuleIndexKeys[ idx ] ];
+		for ( int i = 0; i < bucket.Count(); i++ )
+		{
+			candidates.AddToTail( bucket[ i ] );
+		}
+	}
+
+	for ( int i = 0; i < m_UnindexedRules.Count(); i++ )
+	{
+		candidates.AddToTail( m_UnindexedRules[ i ] );
+	}
+
+	// Tied rules are picked from in rule order, as when scoring every rule.  Each rule
+	// is in a single bucket and the names are distinct, so there are no duplicates.
+	candidates.Sort( RuleIndexCompare );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : set - 
@@ -1687,10 +1870,21 @@ int CResponseSystem::FindBestMatchingRule( const AI_CriteriaSet& set, bool verbo
 	CUtlVector< int >	bestrules;
 	float bestscore = 0.001f;
 
-	int c = m_Rules.Count();
-	int i;
-	for ( i = 0; i < c; i++ )
+	// Rules that aren't candidates fail a required criterion and would score 0, but
+	// the debug output describes every rule, so score them all when it's on
+	const char *pszDebugRule = rr_debugrule.GetString();
+	bool bUseIndex = rr_ruleindex.GetBool() && !verbose && !( pszDebugRule && pszDebugRule[0] );
+
+	CUtlVector< int >	candidates;
+	if ( bUseIndex )
+	{
+		GetCandidateRules( set, candidates );
+	}
+
+	int c = bUseIndex ? candidates.Count() : m_Rules.Count();
+	for ( int n = 0; n < c; n++ )
 	{
+		int i = bUseIndex ? candidates[ n ] : n;
 		float score = ScoreCriteriaAgainstRule( set, i, verbose );
 		// Check equals so that we keep track of all matching rules
 		if ( score >= bestscore )
@@ -2607,6 +2801,7 @@ void CResponseSystem::ParseRule( void )
 	if ( validRule )
 	{
 		m_Rules.Insert( ruleName, newRule );
+		InvalidateRuleIndex();
 	}
 	else
 	{
@@ -2804,6 +2999,7 @@ void CResponseSystem::CopyRuleFrom( Rule *pSrcRule, int iRule, CResponseSystem *
 
 	// Add rule.
 	pCustomSystem->m_Rules.Insert( m_Rules.GetElementName( iRule ), dstRule );
+	pCustomSystem->InvalidateRuleIndex();
 }
 
 //-----------------------------------------------------------------------------
@@ -1875,6 +1875,54 @@ void CBaseAnimating::SetupBones( matrix3x4_t *pBoneToWorld, int boneMask )
 	RemoveEFlags( EFL_SETTING_UP_BONES );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Times SetupBones on every animating entity in the map, once with
+//			the scalar bone path and once with the SIMD one (anim_simdbones).
+//-----------------------------------------------------------------------------
+CON_COMMAND_F( sv_bonesetup_benchmark, "Time SetupBones on all animating entities with and without anim_simdbones. Usage: sv_bonesetup_benchmark [iterations]", FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nIterations = ( args.ArgC() > 1 ) ? MAX( atoi( args[1] ), 1 ) : 100;
+
+	ConVarRef anim_simdbones( "anim_simdbones" );
+	bool bOldSIMD = anim_simdbones.GetBool();
+
+	matrix3x4_t boneToWorld[MAXSTUDIOBONES];
+	double flTotal[2] = { 0.0, 0.0 };
+	int nEntities = 0;
+
+	for ( CBaseEntity *pEntity = gEntList.FirstEnt(); pEntity; pEntity = gEntList.NextEnt( pEntity ) )
+	{
+		CBaseAnimating *pAnimating = pEntity->GetBaseAnimating();
+		if ( !pAnimating || !pAnimating->GetModelPtr() )
+			continue;
+
+		double flTime[2];
+		for ( int nPass = 0; nPass < 2; nPass++ )
+		{
+			anim_simdbones.SetValue( nPass );
+
+			double flStart = Plat_FloatTime();
+			for ( int i = 0; i < nIterations; i++ )
+			{
+				pAnimating->SetupBones( boneToWorld, BONE_USED_BY_ANYTHING );
+			}
+			flTime[nPass] = ( Plat_FloatTime() - flStart ) * 1000000.0 / nIterations;
+			flTotal[nPass] += flTime[nPass];
+		}
+
+		Msg( "%-24s %-48s %3d bones: scalar %7.2f us, simd %7.2f us\n", pAnimating->GetClassname(), STRING( pAnimating->GetModelName() ),
+			pAnimating->GetModelPtr()->numbones(), flTime[0], flTime[1] );
+		++nEntities;
+	}
+
+	anim_simdbones.SetValue( bOldSIMD );
+
+	Msg( "%d entities, %d iterations: scalar %.2f us, simd %.2f us per frame\n", nEntities, nIterations, flTotal[0], flTotal[1] );
+}
+
 //=========================================================
 //=========================================================
 int CBaseAnimating::GetNumBones ( void )
@@ -617,6 +617,7 @@ CBaseEntity *CBaseEntity::GetFollowedEntity()
 void CBaseEntity::SetClassname( const char *className )
 {
 	m_iClassname = AllocPooledString( className );
+	gEntList.NotifyEntityNameChanged( this );
 }
 
 void CBaseEntity::SetModelIndex( int index )
@@ -3012,6 +3013,15 @@ FORCEINLINE bool NamesMatch( const char *pszQuery, string_t nameToMatch )
 	return false;
 }
 
+void CBaseEntity::SetName( string_t newName )
+{
+	if ( m_iName == newName )
+		return;
+
+	m_iName = newName;
+	gEntList.NotifyEntityNameChanged( this );
+}
+
 bool CBaseEntity::NameMatchesComplex( const char *pszNameOrWildcard )
 {
 	if ( !Q_stricmp( "!player", pszNameOrWildcard) )
@@ -3229,6 +3239,9 @@ int CBaseEntity::Restore( IRestore &restore )
 		m_hGroundEntity->AddEntityToGroundList( this );
 	}
 
+	// The name and classname were read straight into their fields
+	gEntList.NotifyEntityNameChanged( this );
+
 	return status;
 }
 
@@ -646,6 +646,7 @@ CEventQueue::CEventQueue()
 {
 	m_Events.m_flFireTime = -FLT_MAX;
 	m_Events.m_pNext = NULL;
+	m_pTail = &m_Events;
 
 	Init();
 }
@@ -769,6 +770,12 @@ void CEventQueue::Clear( void )
 	}
 
 	m_Events.m_pNext = NULL;
+	m_pTail = &m_Events;
+
+	ResetWheel();
+	m_nWheelBaseTick = 0;
+
+	ClearTargetCache();
 }
 
 void CEventQueue::Dump( void )
@@ -862,13 +869,59 @@ void CEventQueue::AddEvent( CBaseEntity *target, const char *action, float fireD
 //-----------------------------------------------------------------------------
 void CEventQueue::AddEvent( EventQueuePrioritizedEvent_t *newEvent )
 {
-	// loop through the actions looking for a place to insert
+	// find the last event that fires no later than the new one; the new event goes
+	// right after it, so events with the same fire time are serviced in the order added
+	int nTick = TIME_TO_TICKS( newEvent->m_flFireTime );
 	EventQueuePrioritizedEvent_t *pe;
-	for ( pe = &m_Events; pe->m_pNext != NULL; pe = pe->m_pNext )
+
+	if ( m_pTail->m_flFireTime <= newEvent->m_flFireTime )
+	{
+		// common case, nothing queued fires later
+		pe = m_pTail;
+	}
+	else if ( IsInWheel( nTick ) )
 	{
-		if ( pe->m_pNext->m_flFireTime > newEvent->m_flFireTime )
+		pe = m_pWheel[nTick & EVENTQUEUE_WHEEL_MASK];
+		if ( pe )
+		{
+			// back up within the events on this tick
+			while ( pe->m_flFireTime > newEvent->m_flFireTime )
+			{
+				pe = pe->m_pPrev;
+			}
+		}
+		else
+		{
+			// nothing on this tick yet, go after the last event on an earlier one
+			int nPrevTick = FindPrevWheelTick( nTick );
+			if ( IsInWheel( nPrevTick ) )
+			{
+				pe = m_pWheel[nPrevTick & EVENTQUEUE_WHEEL_MASK];
+			}
+			else
+			{
+				// only overdue events can come first
+				for ( pe = &m_Events; pe->m_pNext != NULL; pe = pe->m_pNext )
+				{
+					if ( pe->m_pNext->m_flFireTime > newEvent->m_flFireTime )
+						break;
+				}
+			}
+		}
+	}
+	else if ( nTick < m_nWheelBaseTick )
+	{
+		for ( pe = &m_Events; pe->m_pNext != NULL; pe = pe->m_pNext )
+		{
+			if ( pe->m_pNext->m_flFireTime > newEvent->m_flFireTime )
+				break;
+		}
+	}
+	else
+	{
+		// past the end of the wheel, only other far events can follow it
+		for ( pe = m_pTail; pe->m_flFireTime > newEvent->m_flFireTime; pe = pe->m_pPrev )
 		{
-			break;
 		}
 	}
 
@@ -882,16 +935,212 @@ void CEventQueue::AddEvent( EventQueuePrioritizedEvent_t *newEvent )
 	{
 		newEvent->m_pNext->m_pPrev = newEvent;
 	}
+	else
+	{
+		m_pTail = newEvent;
+	}
+
+	// keep the wheel up to date
+	if ( IsInWheel( nTick ) )
+	{
+		EventQueuePrioritizedEvent_t *pLast = m_pWheel[nTick & EVENTQUEUE_WHEEL_MASK];
+		if ( !pLast || pLast == pe )
+		{
+			SetWheelSlot( nTick, newEvent );
+		}
+	}
+	else if ( nTick >= m_nWheelBaseTick + EVENTQUEUE_WHEEL_SIZE )
+	{
+		if ( !m_pFirstFarEvent || m_pFirstFarEvent == newEvent->m_pNext )
+		{
+			m_pFirstFarEvent = newEvent;
+		}
+	}
 }
 
 void CEventQueue::RemoveEvent( EventQueuePrioritizedEvent_t *pe )
 {
 	Assert( pe->m_pPrev );
+
+	int nTick = TIME_TO_TICKS( pe->m_flFireTime );
+	if ( IsInWheel( nTick ) && m_pWheel[nTick & EVENTQUEUE_WHEEL_MASK] == pe )
+	{
+		EventQueuePrioritizedEvent_t *pPrev = pe->m_pPrev;
+		bool bSameTick = ( pPrev != &m_Events && TIME_TO_TICKS( pPrev->m_flFireTime ) == nTick );
+		SetWheelSlot( nTick, bSameTick ? pPrev : NULL );
+	}
+
+	if ( m_pFirstFarEvent == pe )
+	{
+		m_pFirstFarEvent = pe->m_pNext;
+	}
+
 	pe->m_pPrev->m_pNext = pe->m_pNext;
 	if ( pe->m_pNext )
 	{
 		pe->m_pNext->m_pPrev = pe->m_pPrev;
 	}
+	else
+	{
+		m_pTail = pe->m_pPrev;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: timing wheel helpers
+//-----------------------------------------------------------------------------
+inline bool CEventQueue::IsInWheel( int nTick ) const
+{
+	return (unsigned int)( nTick - m_nWheelBaseTick ) < (unsigned int)EVENTQUEUE_WHEEL_SIZE;
+}
+
+void CEventQueue::SetWheelSlot( int nTick, EventQueuePrioritizedEvent_t *pe )
+{
+	int iSlot = nTick & EVENTQUEUE_WHEEL_MASK;
+	m_pWheel[iSlot] = pe;
+	if ( pe )
+	{
+		m_nWheelBits[iSlot >> 5] |= ( 1u << ( iSlot & 31 ) );
+	}
+	else
+	{
+		m_nWheelBits[iSlot >> 5] &= ~( 1u << ( iSlot & 31 ) );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: returns the latest tick before nTick that has events in the wheel,
+//			or a tick before the start of the wheel if there isn't one
+//-----------------------------------------------------------------------------
+int CEventQueue::FindPrevWheelTick( int nTick ) const
+{
+	int t = nTick - 1;
+	while ( t >= m_nWheelBaseTick )
+	{
+		// slots that share a word are consecutive ticks
+		int iSlot = t & EVENTQUEUE_WHEEL_MASK;
+		int iBit = iSlot & 31;
+		uint32 nBits = m_nWheelBits[iSlot >> 5] & ( 0xFFFFFFFFu >> ( 31 - iBit ) );
+		if ( nBits )
+		{
+			while ( !( nBits & ( 1u << iBit ) ) )
+			{
+				--iBit;
+				--t;
+			}
+			return t;
+		}
+
+		t -= iBit + 1;
+	}
+
+	return m_nWheelBaseTick - 1;
+}
+
+void CEventQueue::ResetWheel( void )
+{
+	memset( m_pWheel, 0, sizeof( m_pWheel ) );
+	memset( m_nWheelBits, 0, sizeof( m_nWheelBits ) );
+	m_pFirstFarEvent = NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: moves the start of the wheel to the current tick, indexing the far
+//			events that now fall inside it
+//-----------------------------------------------------------------------------
+void CEventQueue::AdvanceWheel( int nBaseTick )
+{
+	if ( nBaseTick == m_nWheelBaseTick )
+		return;
+
+	EventQueuePrioritizedEvent_t *pe;
+	if ( nBaseTick < m_nWheelBaseTick || nBaseTick - m_nWheelBaseTick >= EVENTQUEUE_WHEEL_SIZE )
+	{
+		// time jumped (restore, or a long gap between services), index everything again
+		ResetWheel();
+		pe = m_Events.m_pNext;
+	}
+	else
+	{
+		// anything still left on the ticks we're passing is overdue and fires next
+		for ( int nTick = m_nWheelBaseTick; nTick < nBaseTick; ++nTick )
+		{
+			SetWheelSlot( nTick, NULL );
+		}
+		pe = m_pFirstFarEvent;
+	}
+
+	m_nWheelBaseTick = nBaseTick;
+
+	for ( ; pe != NULL; pe = pe->m_pNext )
+	{
+		int nTick = TIME_TO_TICKS( pe->m_flFireTime );
+		if ( nTick >= m_nWheelBaseTick + EVENTQUEUE_WHEEL_SIZE )
+			break;
+
+		if ( nTick >= m_nWheelBaseTick )
+		{
+			// the list is sorted, so the last one seen on each tick wins
+			SetWheelSlot( nTick, pe );
+		}
+	}
+
+	m_pFirstFarEvent = pe;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds the entities a target name resolves to, caching the result
+//			until an entity is renamed or a named entity is removed.
+// Output : false if the name can't be cached and must be searched for directly
+//-----------------------------------------------------------------------------
+bool CEventQueue::GetCachedTargets( string_t iTarget, int *piFirst, int *pnCount )
+{
+	const char *pszTarget = STRING( iTarget );
+
+	// procedural names depend on the activator and caller
+	if ( pszTarget[0] == '!' )
+		return false;
+
+	if ( m_nTargetCacheSerialNumber != gEntList.GetNameSerialNumber() )
+	{
+		ClearTargetCache();
+		m_nTargetCacheSerialNumber = gEntList.GetNameSerialNumber();
+	}
+
+	// only pooled strings make stable keys
+	string_t iPooled = FindPooledString( pszTarget );
+	if ( iPooled == NULL_STRING )
+		return false;
+
+	const void *pKey = STRING( iPooled );
+	UtlHashHandle_t h = m_TargetCache.Find( pKey );
+	if ( h == m_TargetCache.InvalidHandle() )
+	{
+		TargetRange_t range;
+		range.m_iFirst = m_CachedTargets.Count();
+
+		CBaseEntity *pTarget = NULL;
+		while ( ( pTarget = gEntList.FindEntityByName( pTarget, pszTarget ) ) != NULL )
+		{
+			m_CachedTargets.AddToTail( pTarget );
+		}
+
+		range.m_nCount = m_CachedTargets.Count() - range.m_iFirst;
+		h = m_TargetCache.Insert( pKey, range );
+	}
+
+	*piFirst = m_TargetCache[h].m_iFirst;
+	*pnCount = m_TargetCache[h].m_nCount;
+	return true;
+}
+
+void CEventQueue::ClearTargetCache( void )
+{
+	m_TargetCache.RemoveAll();
+	m_CachedTargets.RemoveAll();
+	m_nTargetCacheSerialNumber = -1;
 }
 
 
@@ -905,6 +1154,12 @@ void CEventQueue::ServiceEvents( void )
 		return;
 	}
 
+#ifdef TF_DLL
+	AdvanceWheel( TIME_TO_TICKS( engine->GetServerTime() ) );
+#else
+	AdvanceWheel( TIME_TO_TICKS( gpGlobals->curtime ) );
+#endif
+
 	EventQueuePrioritizedEvent_t *pe = m_Events.m_pNext;
 
 #ifdef TF_DLL
@@ -923,9 +1178,27 @@ void CEventQueue::ServiceEvents( void )
 			// In the context the event, the searching entity is also the caller
 			CBaseEntity *pSearchingEntity = pe->m_pCaller;
 			CBaseEntity *target = NULL;
+
+			// Walk the cached matches for as long as nothing renames or removes a named
+			// entity; if an input does, carry on searching from the last target found.
+			int iCached, nCached;
+			bool bCached = GetCachedTargets( pe->m_iTarget, &iCached, &nCached );
 			while ( 1 )
 			{
-				target = gEntList.FindEntityByName( target, pe->m_iTarget, pSearchingEntity, pe->m_pActivator, pe->m_pCaller );
+				if ( bCached && m_nTargetCacheSerialNumber != gEntList.GetNameSerialNumber() )
+				{
+					bCached = false;
+				}
+
+				if ( bCached )
+				{
+					target = ( nCached-- > 0 ) ? m_CachedTargets[iCached++] : NULL;
+				}
+				else
+				{
+					target = gEntList.FindEntityByName( target, pe->m_iTarget, pSearchingEntity, pe->m_pActivator, pe->m_pCaller );
+				}
+
 				if ( !target )
 					break;
 
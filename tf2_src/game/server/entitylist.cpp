@@ -127,12 +127,22 @@ void AimTarget_ForceRepopulateList()
 // NOTE: This is usually a small subset of the global entity list, so it's
 // an optimization to maintain this list incrementally rather than polling each
 // frame.
+// The entries are also scheduled on a timing wheel keyed by next think tick, so
+// each frame only visits the entities that simulate or are due to think instead
+// of the whole list.
 struct simthinkentry_t
 {
 	unsigned short	entEntry;
 	unsigned short	unused0;
 	int				nextThinkTick;
 };
+
+#define SIMTHINK_WHEEL_BITS		8
+#define SIMTHINK_WHEEL_SIZE		( 1 << SIMTHINK_WHEEL_BITS )
+#define SIMTHINK_WHEEL_MASK		( SIMTHINK_WHEEL_SIZE - 1 )
+#define SIMTHINK_DUE_LIST		SIMTHINK_WHEEL_SIZE		// simulating, or think tick has come
+#define SIMTHINK_NO_LIST		0xFFFF
+
 class CSimThinkManager : public IEntityListener
 {
 public:
@@ -143,10 +153,17 @@ public:
 	void Clear()
 	{
 		m_simThinkList.Purge();
+		m_dueList.Purge();
 		for ( int i = 0; i < ARRAYSIZE(m_entinfoIndex); i++ )
 		{
 			m_entinfoIndex[i] = 0xFFFF;
+			m_scheduleList[i] = SIMTHINK_NO_LIST;
 		}
+		for ( int i = 0; i < ARRAYSIZE(m_scheduleHead); i++ )
+		{
+			m_scheduleHead[i] = 0xFFFF;
+		}
+		m_nScheduledTick = -1;
 	}
 	void LevelInitPreEntity()
 	{
@@ -175,6 +192,7 @@ public:
 		if ( listHandle != 0xFFFF )
 		{
 			Assert(m_simThinkList[listHandle].entEntry == index);
+			Unschedule( index );
 			m_simThinkList.FastRemove( listHandle );
 			m_entinfoIndex[index] = 0xFFFF;
 			
@@ -192,22 +210,39 @@ public:
 
 	int ListCopy( CBaseEntity *pList[], int listMax )
 	{
+		AdvanceSchedule( gpGlobals->tickcount );
+
+		// Gather what's due and put it back in list order, so entities
+		// simulate and think in the same order they did when the whole
+		// list was walked.
 		int count = MIN(listMax, ListCount());
-		int out = 0;
-		for ( int i = 0; i < count; i++ )
+		m_dueList.RemoveAll();
+		for ( int index = m_scheduleHead[SIMTHINK_DUE_LIST]; index != 0xFFFF; index = m_scheduleNext[index] )
 		{
-			// only copy out entities that will simulate or think this frame
-			if ( m_simThinkList[i].nextThinkTick <= gpGlobals->tickcount )
+			int listHandle = m_entinfoIndex[index];
+			if ( listHandle < count && m_simThinkList[listHandle].nextThinkTick <= gpGlobals->tickcount )
 			{
-				Assert(m_simThinkList[i].nextThinkTick>=0);
-				int entinfoIndex = m_simThinkList[i].entEntry;
-				const CEntInfo *pInfo = gEntList.GetEntInfoPtrByIndex( entinfoIndex );
-				pList[out] = (CBaseEntity *)pInfo->m_pEntity;
-				Assert(m_simThinkList[i].nextThinkTick==0 || pList[out]->GetFirstThinkTick()==m_simThinkList[i].nextThinkTick);
-				Assert( gEntList.IsEntityPtr( pList[out] ) );
-				out++;
+				m_dueList.AddToTail( listHandle );
 			}
 		}
+		m_dueList.Sort( CompareListHandles );
+
+		VPROF_INCREMENT_COUNTER( "SimThink entities", ListCount() );
+		VPROF_INCREMENT_COUNTER( "SimThink entities due", m_dueList.Count() );
+
+		int out = 0;
+		for ( int i = 0; i < m_dueList.Count(); i++ )
+		{
+			// only copy out entities that will simulate or think this frame
+			int listHandle = m_dueList[i];
+			Assert(m_simThinkList[listHandle].nextThinkTick>=0);
+			int entinfoIndex = m_simThinkList[listHandle].entEntry;
+			const CEntInfo *pInfo = gEntList.GetEntInfoPtrByIndex( entinfoIndex );
+			pList[out] = (CBaseEntity *)pInfo->m_pEntity;
+			Assert(m_simThinkList[listHandle].nextThinkTick==0 || pList[out]->GetFirstThinkTick()==m_simThinkList[listHandle].nextThinkTick);
+			Assert( gEntList.IsEntityPtr( pList[out] ) );
+			out++;
+		}
 
 		return out;
 	}
@@ -255,12 +290,106 @@ public:
 					m_simThinkList[m_entinfoIndex[index]].nextThinkTick = 0;
 				}
 			}
+
+			Schedule( index, m_simThinkList[m_entinfoIndex[index]].nextThinkTick );
 		}
 	}
 
 private:
+	static int __cdecl CompareListHandles( const unsigned short *pLeft, const unsigned short *pRight )
+	{
+		return (int)*pLeft - (int)*pRight;
+	}
+
+	void LinkToList( int index, int iList )
+	{
+		m_scheduleList[index] = iList;
+		m_schedulePrev[index] = 0xFFFF;
+		m_scheduleNext[index] = m_scheduleHead[iList];
+		if ( m_scheduleHead[iList] != 0xFFFF )
+		{
+			m_schedulePrev[m_scheduleHead[iList]] = index;
+		}
+		m_scheduleHead[iList] = index;
+	}
+
+	void Unschedule( int index )
+	{
+		int iList = m_scheduleList[index];
+		if ( iList == SIMTHINK_NO_LIST )
+			return;
+
+		unsigned short prev = m_schedulePrev[index];
+		unsigned short next = m_scheduleNext[index];
+		if ( prev != 0xFFFF )
+			m_scheduleNext[prev] = next;
+		else
+			m_scheduleHead[iList] = next;
+		if ( next != 0xFFFF )
+			m_schedulePrev[next] = prev;
+
+		m_scheduleList[index] = SIMTHINK_NO_LIST;
+	}
+
+	// entities that simulate, or whose think tick has already been reached, go on
+	// the due list; the rest wait in the wheel slot for their think tick
+	void Schedule( int index, int nextThinkTick )
+	{
+		int iList = ( nextThinkTick <= 0 || nextThinkTick <= m_nScheduledTick ) ? SIMTHINK_DUE_LIST : ( nextThinkTick & SIMTHINK_WHEEL_MASK );
+		if ( m_scheduleList[index] == iList )
+			return;
+
+		Unschedule( index );
+		LinkToList( index, iList );
+	}
+
+	// moves the entities whose think tick has come from the wheel to the due list
+	void AdvanceSchedule( int nTick )
+	{
+		if ( nTick < m_nScheduledTick )
+		{
+			// time went backwards, schedule everything again
+			m_nScheduledTick = nTick;
+			for ( int i = 0; i < m_simThinkList.Count(); i++ )
+			{
+				Unschedule( m_simThinkList[i].entEntry );
+				Schedule( m_simThinkList[i].entEntry, m_simThinkList[i].nextThinkTick );
+			}
+			return;
+		}
+
+		// slots hold every lap of the wheel, entries for a later lap stay where they are
+		int nSlots = MIN( nTick - m_nScheduledTick, SIMTHINK_WHEEL_SIZE );
+		for ( int i = 0; i < nSlots; i++ )
+		{
+			int iSlot = ( nTick - i ) & SIMTHINK_WHEEL_MASK;
+			int index = m_scheduleHead[iSlot];
+			while ( index != 0xFFFF )
+			{
+				int next = m_scheduleNext[index];
+				if ( m_simThinkList[m_entinfoIndex[index]].nextThinkTick <= nTick )
+				{
+					Unschedule( index );
+					LinkToList( index, SIMTHINK_DUE_LIST );
+				}
+				index = next;
+			}
+		}
+
+		m_nScheduledTick = nTick;
+	}
+
 	unsigned short m_entinfoIndex[NUM_ENT_ENTRIES];
 	CUtlVector<simthinkentry_t>	m_simThinkList;
+
+	// schedule, by entinfo index
+	unsigned short m_scheduleList[NUM_ENT_ENTRIES];
+	unsigned short m_schedulePrev[NUM_ENT_ENTRIES];
+	unsigned short m_scheduleNext[NUM_ENT_ENTRIES];
+	unsigned short m_scheduleHead[SIMTHINK_WHEEL_SIZE + 1];
+	int m_nScheduledTick;		// last tick moved from the wheel to the due list
+
+	CUtlVector<unsigned short> m_dueList;
 };
 
 CSimThinkManager g_SimThinkManager;
@@ -290,10 +419,444 @@ CBaseEntityClassList::~CBaseEntityClassList()
 {
 }
 
+//-----------------------------------------------------------------------------
+// CEntityNameIndex
+//-----------------------------------------------------------------------------
+
+// the same case folding NamesMatch uses
+static inline unsigned char FoldEntityNameChar( unsigned char c )
+{
+	return ( (unsigned char)( c - 'A' ) <= (unsigned char)( 'Z' - 'A' ) ) ? c - 'A' + 'a' : c;
+}
+
+unsigned int CEntityNameIndex::NameHashFunctor::operator()( const char *pszName ) const
+{
+	// FNV-1a over the folded name
+	unsigned int nHash = 2166136261u;
+	for ( const unsigned char *p = (const unsigned char *)pszName; *p; ++p )
+	{
+		nHash = ( nHash ^ FoldEntityNameChar( *p ) ) * 16777619u;
+	}
+	return nHash;
+}
+
+bool CEntityNameIndex::NameEqualFunctor::operator()( const char *pszName1, const char *pszName2 ) const
+{
+	const unsigned char *p1 = (const unsigned char *)pszName1;
+	const unsigned char *p2 = (const unsigned char *)pszName2;
+	for ( ; FoldEntityNameChar( *p1 ) == FoldEntityNameChar( *p2 ); ++p1, ++p2 )
+	{
+		if ( !*p1 )
+			return true;
+	}
+	return false;
+}
+
+CEntityNameIndex::CEntityNameIndex()
+{
+	Purge();
+}
+
+CEntityNameIndex::~CEntityNameIndex()
+{
+	Purge();
+}
+
+void CEntityNameIndex::Purge()
+{
+	for ( int i = 0; i < m_Buckets.Count(); ++i )
+	{
+		delete [] m_Buckets[i].m_pszName;
+	}
+
+	m_Buckets.Purge();
+	m_FreeBuckets.Purge();
+	m_BucketsByName.Purge();
+	m_Trie.Purge();
+	m_FreeTrieNodes.Purge();
+
+	for ( int i = 0; i < NUM_ENT_ENTRIES; ++i )
+	{
+		m_Entries[i].m_iName = NULL_STRING;
+		m_Entries[i].m_nOrder = 0;
+		m_Entries[i].m_iBucket = m_Entries[i].m_iPrev = m_Entries[i].m_iNext = -1;
+	}
+
+	// the root
+	TrieNode_t &root = m_Trie[ m_Trie.AddToTail() ];
+	root.m_iFirstChild = root.m_iNextSibling = root.m_iBucket = -1;
+	root.m_nBuckets = 0;
+	root.m_cChar = 0;
+}
+
+void CEntityNameIndex::SetEntityName( int iEntity, unsigned int nOrder, string_t iName )
+{
+	Entry_t &entry = m_Entries[iEntity];
+	if ( entry.m_iName == iName )
+		return;
+
+	if ( entry.m_iBucket != -1 )
+	{
+		// a different string for the same name keeps its place
+		if ( iName != NULL_STRING && NameEqualFunctor()( m_Buckets[entry.m_iBucket].m_pszName, STRING( iName ) ) )
+		{
+			entry.m_iName = iName;
+			return;
+		}
+
+		Unlink( iEntity );
+	}
+
+	entry.m_iName = iName;
+	if ( iName != NULL_STRING )
+	{
+		entry.m_nOrder = nOrder;
+		Link( iEntity, iName );
+	}
+}
+
+void CEntityNameIndex::Link( int iEntity, string_t iName )
+{
+	const char *pszName = STRING( iName );
+
+	int iBucket;
+	UtlHashHandle_t h = m_BucketsByName.Find( pszName );
+	if ( h != m_BucketsByName.InvalidHandle() )
+	{
+		iBucket = m_BucketsByName[h];
+	}
+	else
+	{
+		if ( m_FreeBuckets.Count() )
+		{
+			iBucket = m_FreeBuckets.Tail();
+			m_FreeBuckets.Remove( m_FreeBuckets.Count() - 1 );
+		}
+		else
+		{
+			iBucket = m_Buckets.AddToTail();
+		}
+
+		// keep our own copy, the bucket can outlive the entity that created it
+		Bucket_t &bucket = m_Buckets[iBucket];
+		bucket.m_pszName = V_strdup( pszName );
+		bucket.m_iHead = bucket.m_iTail = bucket.m_iResume = -1;
+		m_BucketsByName.Insert( bucket.m_pszName, iBucket );
+		AddToTrie( iBucket );
+	}
+
+	// usually the newest entity with the name, so look for its place from the back
+	Bucket_t &bucket = m_Buckets[iBucket];
+	Entry_t &entry = m_Entries[iEntity];
+	int iPrev = bucket.m_iTail;
+	while ( iPrev != -1 && m_Entries[iPrev].m_nOrder > entry.m_nOrder )
+	{
+		iPrev = m_Entries[iPrev].m_iPrev;
+	}
+	int iNext = ( iPrev != -1 ) ? m_Entries[iPrev].m_iNext : bucket.m_iHead;
+
+	entry.m_iBucket = iBucket;
+	entry.m_iPrev = iPrev;
+	entry.m_iNext = iNext;
+
+	if ( iPrev != -1 )
+		m_Entries[iPrev].m_iNext = iEntity;
+	else
+		bucket.m_iHead = iEntity;
+
+	if ( iNext != -1 )
+		m_Entries[iNext].m_iPrev = iEntity;
+	else
+		bucket.m_iTail = iEntity;
+}
+
+void CEntityNameIndex::Unlink( int iEntity )
+{
+	Entry_t &entry = m_Entries[iEntity];
+	int iBucket = entry.m_iBucket;
+	Bucket_t &bucket = m_Buckets[iBucket];
+
+	if ( entry.m_iPrev != -1 )
+		m_Entries[entry.m_iPrev].m_iNext = entry.m_iNext;
+	else
+		bucket.m_iHead = entry.m_iNext;
+
+	if ( entry.m_iNext != -1 )
+		m_Entries[entry.m_iNext].m_iPrev = entry.m_iPrev;
+	else
+		bucket.m_iTail = entry.m_iPrev;
+
+	if ( bucket.m_iResume == iEntity )
+		bucket.m_iResume = entry.m_iPrev;
+
+	entry.m_iBucket = entry.m_iPrev = entry.m_iNext = -1;
+
+	if ( bucket.m_iHead != -1 )
+		return;
+
+	// last entity with this name
+	RemoveFromTrie( iBucket );
+	m_BucketsByName.Remove( bucket.m_pszName );
+	delete [] bucket.m_pszName;
+	bucket.m_pszName = NULL;
+	m_FreeBuckets.AddToTail( iBucket );
+
+	if ( m_FreeBuckets.Count() == m_Buckets.Count() )
+	{
+		// nothing left (level shutdown), only the root is still in use
+		Assert( GetTrieNodeCount() == 1 );
+		m_Buckets.RemoveAll();
+		m_FreeBuckets.RemoveAll();
+		m_Trie.RemoveMultipleFromTail( m_Trie.Count() - 1 );
+		m_FreeTrieNodes.RemoveAll();
+		m_Trie[0].m_iFirstChild = -1;
+	}
+}
+
+int CEntityNameIndex::FindTrieChild( int iNode, unsigned char c ) const
+{
+	for ( int iChild = m_Trie[iNode].m_iFirstChild; iChild != -1; iChild = m_Trie[iChild].m_iNextSibling )
+	{
+		if ( m_Trie[iChild].m_cChar == c )
+			return iChild;
+	}
+	return -1;
+}
+
+void CEntityNameIndex::AddToTrie( int iBucket )
+{
+	int iNode = 0;
+	m_Trie[iNode].m_nBuckets++;
+
+	for ( const unsigned char *p = (const unsigned char *)m_Buckets[iBucket].m_pszName; *p; ++p )
+	{
+		unsigned char c = FoldEntityNameChar( *p );
+		int iChild = FindTrieChild( iNode, c );
+		if ( iChild == -1 )
+		{
+			if ( m_FreeTrieNodes.Count() )
+			{
+				iChild = m_FreeTrieNodes.Tail();
+				m_FreeTrieNodes.Remove( m_FreeTrieNodes.Count() - 1 );
+			}
+			else
+			{
+				iChild = m_Trie.AddToTail();
+			}
+
+			TrieNode_t &child = m_Trie[iChild];
+			child.m_iFirstChild = -1;
+			child.m_iNextSibling = m_Trie[iNode].m_iFirstChild;
+			child.m_iBucket = -1;
+			child.m_nBuckets = 0;
+			child.m_cChar = c;
+			m_Trie[iNode].m_iFirstChild = iChild;
+		}
+
+		iNode = iChild;
+		m_Trie[iNode].m_nBuckets++;
+	}
+
+	Assert( m_Trie[iNode].m_iBucket == -1 );
+	m_Trie[iNode].m_iBucket = iBucket;
+}
+
+void CEntityNameIndex::RemoveFromTrie( int iBucket )
+{
+	int iNode = 0;
+	m_Trie[iNode].m_nBuckets--;
+
+	// the first node left without buckets, everything below it on the path is empty too
+	int iPrune = -1;
+	int iPruneParent = -1;
+
+	for ( const unsigned char *p = (const unsigned char *)m_Buckets[iBucket].m_pszName; *p; ++p )
+	{
+		int iParent = iNode;
+		iNode = FindTrieChild( iNode, FoldEntityNameChar( *p ) );
+		Assert( iNode != -1 );
+		if ( --m_Trie[iNode].m_nBuckets == 0 )
+		{
+			if ( iPrune == -1 )
+			{
+				iPrune = iNode;
+				iPruneParent = iParent;
+			}
+			m_FreeTrieNodes.AddToTail( iNode );
+		}
+	}
+
+	Assert( m_Trie[iNode].m_iBucket == iBucket );
+	m_Trie[iNode].m_iBucket = -1;
+
+	if ( iPrune == -1 )
+		return;
+
+	// cut the empty branch off its parent, its nodes are already on the free list
+	int *pLink = &m_Trie[iPruneParent].m_iFirstChild;
+	while ( *pLink != iPrune )
+	{
+		pLink = &m_Trie[*pLink].m_iNextSibling;
+	}
+	*pLink = m_Trie[iPrune].m_iNextSibling;
+}
+
+int CEntityNameIndex::NextInBucket( int iBucket, int iStartEntity, unsigned int nStartOrder ) const
+{
+	if ( iStartEntity != -1 && m_Entries[iStartEntity].m_iBucket == iBucket )
+		return m_Entries[iStartEntity].m_iNext;
+
+	// a wildcard search asks every matching bucket again for each result, so pick up
+	// where the last search of this bucket stopped if it hasn't gone past the start
+	const Bucket_t &bucket = m_Buckets[iBucket];
+	int iEntity = bucket.m_iHead;
+	int iResume = bucket.m_iResume;
+	if ( iResume != -1 && m_Entries[iResume].m_iBucket == iBucket && m_Entries[iResume].m_nOrder <= nStartOrder )
+	{
+		iEntity = m_Entries[iResume].m_iNext;
+	}
+
+	for ( ; iEntity != -1; iEntity = m_Entries[iEntity].m_iNext )
+	{
+		if ( m_Entries[iEntity].m_nOrder > nStartOrder )
+			break;
+
+		bucket.m_iResume = iEntity;
+	}
+	return iEntity;
+}
+
+int CEntityNameIndex::FindNext( const char *pszName, int nPrefixLen, int iStartEntity, unsigned int nStartOrder ) const
+{
+	if ( nPrefixLen < 0 )
+	{
+		UtlHashHandle_t h = m_BucketsByName.Find( pszName );
+		if ( h == m_BucketsByName.InvalidHandle() )
+			return -1;
+
+		return NextInBucket( m_BucketsByName[h], iStartEntity, nStartOrder );
+	}
+
+	// find the names starting with the prefix...
+	int iNode = 0;
+	for ( int i = 0; i < nPrefixLen && iNode != -1; ++i )
+	{
+		iNode = FindTrieChild( iNode, FoldEntityNameChar( pszName[i] ) );
+	}
+
+	if ( iNode == -1 || !m_Trie[iNode].m_nBuckets )
+		return -1;
+
+	// ...and take whichever of their entities comes first
+	int iBest = -1;
+	CUtlVectorFixedGrowable< int, 64 > stack;
+	stack.AddToTail( iNode );
+	while ( stack.Count() )
+	{
+		const TrieNode_t &node = m_Trie[ stack.Tail() ];
+		stack.Remove( stack.Count() - 1 );
+
+		if ( node.m_iBucket != -1 )
+		{
+			int iEntity = NextInBucket( node.m_iBucket, iStartEntity, nStartOrder );
+			if ( iEntity != -1 && ( iBest == -1 || m_Entries[iEntity].m_nOrder < m_Entries[iBest].m_nOrder ) )
+			{
+				iBest = iEntity;
+			}
+		}
+
+		for ( int iChild = node.m_iFirstChild; iChild != -1; iChild = m_Trie[iChild].m_iNextSibling )
+		{
+			if ( m_Trie[iChild].m_nBuckets )
+			{
+				stack.AddToTail( iChild );
+			}
+		}
+	}
+
+	return iBest;
+}
+
+//-----------------------------------------------------------------------------
+// Renames a set of entities over and over and checks the name trie gives
+// the nodes of names nobody uses any more back instead of growing.
+//-----------------------------------------------------------------------------
+CON_COMMAND_F( ent_name_index_test, "Checks the entity name index keeps its size under name churn", FCVAR_CHEAT )
+{
+	const int nEntities = 256;
+	// each round's names start with a character of their own, so share no nodes with
+	// any other round's but have the same shape and should need as many of them
+	static const char s_szRoundChars[] = "abcdefghijklmnopqrstuvwxyz012345";
+	const int nRounds = sizeof( s_szRoundChars ) - 1;
+	static char s_szNames[2][nEntities][32];
+
+	CEntityNameIndex *pIndex = new CEntityNameIndex;
+	unsigned int nOrder = 0;
+	int nRoundNodes = -1;
+	int nAllocated = -1;
+	bool bPassed = true;
+
+	for ( int nRound = 0; nRound < nRounds; ++nRound )
+	{
+		for ( int i = 0; i < nEntities; ++i )
+		{
+			char *pszName = s_szNames[nRound & 1][i];
+			V_snprintf( pszName, sizeof( s_szNames[0][0] ), "%c_churn_%03d", s_szRoundChars[nRound], i );
+			pIndex->SetEntityName( i, ++nOrder, MAKE_STRING( pszName ) );
+		}
+
+		if ( pIndex->FindNext( s_szNames[nRound & 1][0], 9, -1, 0 ) != 0 )
+		{
+			Warning( "ent_name_index_test: round %d, prefix search doesn't find the first entity\n", nRound );
+			bPassed = false;
+		}
+
+		if ( nRoundNodes == -1 )
+		{
+			nRoundNodes = pIndex->GetTrieNodeCount();
+		}
+		else if ( pIndex->GetTrieNodeCount() != nRoundNodes )
+		{
+			Warning( "ent_name_index_test: round %d uses %d trie nodes, the first one used %d\n", nRound, pIndex->GetTrieNodeCount(), nRoundNodes );
+			bPassed = false;
+		}
+
+		// the old and new names only coexist while one round replaces the other
+		if ( nRound == 1 )
+		{
+			nAllocated = pIndex->GetTrieNodesAllocated();
+		}
+		else if ( nRound > 1 && pIndex->GetTrieNodesAllocated() > nAllocated )
+		{
+			Warning( "ent_name_index_test: round %d grew the trie to %d nodes, was %d\n", nRound, pIndex->GetTrieNodesAllocated(), nAllocated );
+			bPassed = false;
+		}
+	}
+
+	for ( int i = 0; i < nEntities; ++i )
+	{
+		pIndex->RemoveEntity( i );
+	}
+
+	if ( pIndex->GetTrieNodeCount() != 1 )
+	{
+		Warning( "ent_name_index_test: %d trie nodes left with no names\n", pIndex->GetTrieNodeCount() );
+		bPassed = false;
+	}
+
+	delete pIndex;
+
+	Msg( "ent_name_index_test: %s (%d nodes per round)\n", bPassed ? "passed" : "FAILED", nRoundNodes );
+}
+
+
 CGlobalEntityList::CGlobalEntityList()
 {
 	m_iHighestEnt = m_iNumEnts = m_iNumEdicts = 0;
 	m_bClearingEntities = false;
+	m_iNameSerialNumber = 0;
+	m_nNextEntityOrder = 0;
+	memset( m_nEntityOrder, 0, sizeof( m_nEntityOrder ) );
 }
 
 
@@ -481,6 +1044,29 @@ bool CGlobalEntityList::IsEntityPtr( void *pTest )
 //-----------------------------------------------------------------------------
 CBaseEntity *CGlobalEntityList::FindEntityByClassname( CBaseEntity *pStartEntity, const char *szName )
 {
+	// a leading wildcard could match anything, walk the list for those
+	if ( szName && szName[0] && szName[0] != '*' )
+	{
+		const char *pszWildcard = strchr( szName, '*' );
+		int nPrefixLen = pszWildcard ? pszWildcard - szName : -1;
+		int iEntity = pStartEntity ? pStartEntity->GetRefEHandle().GetEntryIndex() : -1;
+		unsigned int nStartOrder = pStartEntity ? m_nEntityOrder[iEntity] : 0;
+
+		while ( ( iEntity = m_ClassnameIndex.FindNext( szName, nPrefixLen, iEntity, nStartOrder ) ) != -1 )
+		{
+			CBaseEntity *pEntity = (CBaseEntity *)GetEntInfoPtrByIndex( iEntity )->m_pEntity;
+			nStartOrder = m_nEntityOrder[iEntity];
+
+			// the index only matches the part before the '*'
+			if ( pszWildcard && !pEntity->ClassMatches( szName ) )
+				continue;
+
+			return pEntity;
+		}
+
+		return NULL;
+	}
+
 	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
 
 	for ( ;pInfo; pInfo = pInfo->m_pNext )
@@ -590,6 +1176,31 @@ CBaseEntity *CGlobalEntityList::FindEntityByName( CBaseEntity *pStartEntity, con
 
 		return NULL;
 	}
+
+	if ( szName[0] != '*' )
+	{
+		const char *pszWildcard = strchr( szName, '*' );
+		int nPrefixLen = pszWildcard ? pszWildcard - szName : -1;
+		int iEntity = pStartEntity ? pStartEntity->GetRefEHandle().GetEntryIndex() : -1;
+		unsigned int nStartOrder = pStartEntity ? m_nEntityOrder[iEntity] : 0;
+
+		while ( ( iEntity = m_NameIndex.FindNext( szName, nPrefixLen, iEntity, nStartOrder ) ) != -1 )
+		{
+			CBaseEntity *ent = (CBaseEntity *)GetEntInfoPtrByIndex( iEntity )->m_pEntity;
+			nStartOrder = m_nEntityOrder[iEntity];
+
+			// the index only matches the part before the '*'
+			if ( pszWildcard && !ent->NameMatches( szName ) )
+				continue;
+
+			if ( pFilter && !pFilter->ShouldFindEntity(ent) )
+				continue;
+
+			return ent;
+		}
+
+		return NULL;
+	}
 	
 	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
 
@@ -1095,6 +1706,17 @@ void CGlobalEntityList::OnAddEntity( IHandleEntity *pEnt, CBaseHandle handle )
 	
 	// NOTE: Must be a CBaseEntity on server
 	Assert( pBaseEnt );
+
+	// index it for searches, in list order
+	int iEntity = handle.GetEntryIndex();
+	m_nEntityOrder[iEntity] = ++m_nNextEntityOrder;
+	m_ClassnameIndex.SetEntityName( iEntity, m_nEntityOrder[iEntity], pBaseEnt->m_iClassname );
+	if ( pBaseEnt->GetEntityName() != NULL_STRING )
+	{
+		m_NameIndex.SetEntityName( iEntity, m_nEntityOrder[iEntity], pBaseEnt->GetEntityName() );
+		m_iNameSerialNumber++;
+	}
+
 	//DevMsg(2,"Created %s\n", pBaseEnt->GetClassname() );
 	for ( i = m_entityListeners.Count()-1; i >= 0; i-- )
 	{
@@ -1125,9 +1747,35 @@ void CGlobalEntityList::OnRemoveEntity( IHandleEntity *pEnt, CBaseHandle handle
 	if ( pBaseEnt->edict() )
 		m_iNumEdicts--;
 
+	// entities without a name can't be found by name, so they don't affect searches
+	if ( m_NameIndex.GetEntityName( handle.GetEntryIndex() ) != NULL_STRING )
+	{
+		m_iNameSerialNumber++;
+	}
+
+	m_NameIndex.RemoveEntity( handle.GetEntryIndex() );
+	m_ClassnameIndex.RemoveEntity( handle.GetEntryIndex() );
+
 	m_iNumEnts--;
 }
 
+void CGlobalEntityList::NotifyEntityNameChanged( CBaseEntity *pEnt )
+{
+	// not in the list yet, it gets indexed when it's added
+	CBaseHandle hEnt = pEnt->GetRefEHandle();
+	if ( !hEnt.IsValid() )
+		return;
+
+	int iEntity = hEnt.GetEntryIndex();
+	if ( m_NameIndex.GetEntityName( iEntity ) != pEnt->GetEntityName() )
+	{
+		m_NameIndex.SetEntityName( iEntity, m_nEntityOrder[iEntity], pEnt->GetEntityName() );
+		m_iNameSerialNumber++;
+	}
+
+	m_ClassnameIndex.SetEntityName( iEntity, m_nEntityOrder[iEntity], pEnt->m_iClassname );
+}
+
 void CGlobalEntityList::NotifyCreateEntity( CBaseEntity *pEnt )
 {
 	if ( !pEnt )
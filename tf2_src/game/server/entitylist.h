@@ -14,6 +14,7 @@
 #endif
 
 #include "baseentity.h"
+#include "utlhashtable.h"
 
 class IEntityListener;
 
@@ -66,6 +67,81 @@ public:
 	virtual CBaseEntity *GetFilterResult( void ) = 0;
 };
 
+//-----------------------------------------------------------------------------
+// Purpose: Index from entity name (or classname) to the entities using it.
+//			Entities sharing a name are kept in the order they were added to
+//			the global list, so continuing a search from a start entity finds
+//			the same entities a walk of the whole list would. Names compare
+//			the way CBaseEntity::NameMatches does, ascii case insensitive;
+//			a trie over the names answers trailing '*' wildcard queries.
+//-----------------------------------------------------------------------------
+class CEntityNameIndex
+{
+public:
+	CEntityNameIndex();
+	~CEntityNameIndex();
+
+	// Adds the entity, moves it to another name, or removes it if iName is NULL_STRING.
+	// nOrder must increase with the entity's position in the global list.
+	void SetEntityName( int iEntity, unsigned int nOrder, string_t iName );
+	void RemoveEntity( int iEntity ) { SetEntityName( iEntity, 0, NULL_STRING ); }
+	string_t GetEntityName( int iEntity ) const { return m_Entries[iEntity].m_iName; }
+
+	// Returns the first entity after iStartEntity (or after nStartOrder if it isn't indexed
+	// here, -1 and 0 to start at the beginning) whose name equals pszName, or starts with its
+	// first nPrefixLen characters if nPrefixLen >= 0. Returns -1 if there isn't one.
+	int FindNext( const char *pszName, int nPrefixLen, int iStartEntity, unsigned int nStartOrder ) const;
+
+	// Trie nodes in use, and allocated including the ones waiting to be reused
+	int GetTrieNodeCount() const { return m_Trie.Count() - m_FreeTrieNodes.Count(); }
+	int GetTrieNodesAllocated() const { return m_Trie.Count(); }
+
+private:
+	struct Entry_t
+	{
+		string_t m_iName;
+		unsigned int m_nOrder;
+		int m_iBucket;
+		int m_iPrev;
+		int m_iNext;
+	};
+
+	struct Bucket_t
+	{
+		char *m_pszName;
+		int m_iHead;
+		int m_iTail;
+		mutable int m_iResume;	// last entity a search stepped past, so the next one needn't start at the head
+	};
+
+	struct TrieNode_t
+	{
+		int m_iFirstChild;
+		int m_iNextSibling;
+		int m_iBucket;
+		int m_nBuckets;		// buckets in this subtree
+		unsigned char m_cChar;
+	};
+
+	struct NameHashFunctor { unsigned int operator()( const char *pszName ) const; };
+	struct NameEqualFunctor { bool operator()( const char *pszName1, const char *pszName2 ) const; };
+
+	int NextInBucket( int iBucket, int iStartEntity, unsigned int nStartOrder ) const;
+	void Link( int iEntity, string_t iName );
+	void Unlink( int iEntity );
+	int FindTrieChild( int iNode, unsigned char c ) const;
+	void AddToTrie( int iBucket );
+	void RemoveFromTrie( int iBucket );
+	void Purge();
+
+	Entry_t m_Entries[NUM_ENT_ENTRIES];
+	CUtlVector< Bucket_t > m_Buckets;
+	CUtlVector< int > m_FreeBuckets;
+	CUtlHashtable< const char *, int, NameHashFunctor, NameEqualFunctor > m_BucketsByName;
+	CUtlVector< TrieNode_t > m_Trie;
+	CUtlVector< int > m_FreeTrieNodes;
+};
+
 //-----------------------------------------------------------------------------
 // Purpose: a global list of all the entities in the game.  All iteration through
 //			entities is done through this object.
@@ -81,6 +157,14 @@ private:
 	bool m_bClearingEntities;
 	CUtlVector<IEntityListener *>	m_entityListeners;
 
+	int m_iNameSerialNumber;
+
+	// search indices, m_nEntityOrder follows the order of the entity list
+	unsigned int m_nNextEntityOrder;
+	unsigned int m_nEntityOrder[NUM_ENT_ENTRIES];
+	CEntityNameIndex m_NameIndex;
+	CEntityNameIndex m_ClassnameIndex;
+
 public:
 	IServerNetworkable* GetServerNetworkable( CBaseHandle hEnt ) const;
 	CBaseNetworkable* GetBaseNetworkable( CBaseHandle hEnt ) const;
@@ -112,6 +196,13 @@ public:
 	void NotifyCreateEntity( CBaseEntity *pEnt );
 	void NotifySpawn( CBaseEntity *pEnt );
 	void NotifyRemoveEntity( CBaseHandle hEnt );
+
+	// entity's name or classname has changed
+	void NotifyEntityNameChanged( CBaseEntity *pEnt );
+
+	// changes whenever a FindEntityByName search could return something different,
+	// so callers can cache the results of name lookups
+	int GetNameSerialNumber() const { return m_iNameSerialNumber; }
 	// iteration functions
 
 	// returns the next entity after pCurrentEnt;  if pCurrentEnt is NULL, return the first entity
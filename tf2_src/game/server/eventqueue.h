@@ -15,6 +15,7 @@
 #endif
 
 #include "mempool.h"
+#include "utlhashtable.h"
 
 struct EventQueuePrioritizedEvent_t
 {
@@ -71,9 +72,47 @@ private:
 	void AddEvent( EventQueuePrioritizedEvent_t *event );
 	void RemoveEvent( EventQueuePrioritizedEvent_t *pe );
 
+	// timing wheel
+	enum
+	{
+		EVENTQUEUE_WHEEL_BITS = 9,
+		EVENTQUEUE_WHEEL_SIZE = ( 1 << EVENTQUEUE_WHEEL_BITS ),
+		EVENTQUEUE_WHEEL_MASK = EVENTQUEUE_WHEEL_SIZE - 1,
+	};
+
+	bool IsInWheel( int nTick ) const;
+	void SetWheelSlot( int nTick, EventQueuePrioritizedEvent_t *pe );
+	int FindPrevWheelTick( int nTick ) const;
+	void ResetWheel( void );
+	void AdvanceWheel( int nBaseTick );
+
+	// target name cache
+	bool GetCachedTargets( string_t iTarget, int *piFirst, int *pnCount );
+	void ClearTargetCache( void );
+
 	DECLARE_SIMPLE_DATADESC();
 	EventQueuePrioritizedEvent_t m_Events;
+	EventQueuePrioritizedEvent_t *m_pTail;
 	int m_iListCount;
+
+	// The list above stays sorted by fire time. The wheel indexes it by tick: for every
+	// tick in [m_nWheelBaseTick, m_nWheelBaseTick + EVENTQUEUE_WHEEL_SIZE) it holds the last
+	// event firing on that tick, so inserts don't have to walk the list. Events past the
+	// end of the wheel start at m_pFirstFarEvent and get pulled in as the wheel advances.
+	int m_nWheelBaseTick;
+	EventQueuePrioritizedEvent_t *m_pWheel[EVENTQUEUE_WHEEL_SIZE];
+	uint32 m_nWheelBits[EVENTQUEUE_WHEEL_SIZE / 32];
+	EventQueuePrioritizedEvent_t *m_pFirstFarEvent;
+
+	// Entities matching each pooled target name, valid until the entity list's name serial number changes
+	struct TargetRange_t
+	{
+		int m_iFirst;
+		int m_nCount;
+	};
+	CUtlHashtable< const void *, TargetRange_t > m_TargetCache;
+	CUtlVector< CBaseEntity * > m_CachedTargets;
+	int m_nTargetCacheSerialNumber;
 };
 
 extern CEventQueue g_EventQueue;
@@ -69,6 +69,7 @@
 #include "dt_utlvector_send.h"
 #include "vote_controller.h"
 #include "ai_speech.h"
+#include "serverbenchmark_base.h"
 
 #if defined USES_ECON_ITEMS
 #include "econ_wearable.h"
@@ -3447,6 +3448,12 @@ void CBasePlayer::ProcessUsercmds( CUserCmd *cmds, int numcmds, int totalcmds,
 
 		ctx->cmds.AddToTail( *pCmd );
 	}
+
+	if ( g_pServerBenchmark->IsRecordingUsercmds() )
+	{
+		g_pServerBenchmark->RecordUsercmds( this, ctx->cmds.Base(), numcmds );
+	}
+
 	ctx->numcmds			= numcmds;
 	ctx->totalcmds			= totalcmds,
 	ctx->dropped_packets	= dropped_packets;
@@ -9,6 +9,12 @@
 #include "props.h"
 #include "filesystem.h"
 #include "tier0/icommandline.h"
+#include "tier0/vprof.h"
+#include "tier1/delegates.h"
+#include "tier1/utlbuffer.h"
+#include "inetchannelinfo.h"
+#include "usercmd.h"
+#include "bitbuf.h"
 
 
 // Server benchmark. Only works on specified maps.
@@ -17,9 +23,17 @@
 // Create 20 players and move them around and have them shoot.
 // At the end, report the # seconds it took to complete the test.
 // Don't start measuring for the first N ticks to account for HD load.
+//
+// With sv_benchmark_replay set, it replaces the stress bots and physics props with one bot per
+// player in a file made by sv_benchmark_record and feeds each bot the usercmds its player sent.
+// Either way it writes per-tick stats to sv_benchmark_json at the end.
 
 static ConVar sv_benchmark_numticks( "sv_benchmark_numticks", "3300", 0, "If > 0, then it only runs the benchmark for this # of ticks." );
 static ConVar sv_benchmark_autovprofrecord( "sv_benchmark_autovprofrecord", "0", 0, "If running a benchmark and this is set, it will record a vprof file over the duration of the benchmark with filename benchmark.vprof." );
+static ConVar sv_benchmark_replay( "sv_benchmark_replay", "", 0, "If set, the benchmark has bots replay the usercmds recorded in this file with sv_benchmark_record instead of spawning stress bots and physics props. sv_benchmark_numticks 0 runs the whole recording." );
+static ConVar sv_benchmark_json( "sv_benchmark_json", "sv_benchmark.json", 0, "When a benchmark finishes, write per-tick VPROF budget group, network and allocation stats to this file. Empty to disable." );
+
+extern ConVar sv_usercmd_custom_random_seed;
 
 static float s_flBenchmarkStartWaitSeconds = 3;	// Wait this many seconds after level load before starting the benchmark.
 
@@ -40,6 +54,476 @@ static double Benchmark_ValidTime()
 }
 
 
+// ---------------------------------------------------------------------------------------------- //
+// Counts allocations while the benchmark is running. This replaces g_pMemAlloc so every module
+// goes through it, not just the server.
+// ---------------------------------------------------------------------------------------------- //
+class CBenchmarkMemAlloc : public IMemAlloc
+{
+	// Methods of IMemAlloc
+public:
+	virtual void *Alloc( size_t nSize )													{ CountAlloc( nSize ); return m_pMemAlloc->Alloc( nSize ); }
+	virtual void *Realloc( void *pMem, size_t nSize )									{ CountAlloc( nSize ); return m_pMemAlloc->Realloc( pMem, nSize ); }
+	DELEGATE_TO_OBJECT_1V(			Free, void *, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_2( void *,	Expand_NoLongerSupported, void *, size_t, m_pMemAlloc );
+	virtual void *Alloc( size_t nSize, const char *pFileName, int nLine )				{ CountAlloc( nSize ); return m_pMemAlloc->Alloc( nSize, pFileName, nLine ); }
+	virtual void *Realloc( void *pMem, size_t nSize, const char *pFileName, int nLine )	{ CountAlloc( nSize ); return m_pMemAlloc->Realloc( pMem, nSize, pFileName, nLine ); }
+	DELEGATE_TO_OBJECT_3V(			Free, void *, const char *, int, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_4( void*,	Expand_NoLongerSupported, void *, size_t, const char *, int, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_1( size_t,	GetSize, void *, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_2V(			PushAllocDbgInfo, const char *, int, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_0V(			PopAllocDbgInfo, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_1( long,		CrtSetBreakAlloc, long, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_2( int,		CrtSetReportMode, int, int, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_1( int,		CrtIsValidHeapPointer, const void *, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_3( int,		CrtIsValidPointer, const void *, unsigned int, int, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_0( int,		CrtCheckMemory, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_1( int,		CrtSetDbgFlag, int, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_1V(			CrtMemCheckpoint, _CrtMemState *, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_0V(			DumpStats, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_1V(			DumpStatsFileBase, const char *, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_2( void*,	CrtSetReportFile, int, void*, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_1( void*,	CrtSetReportHook, void*, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_5( int,		CrtDbgReport, int, const char *, int, const char *, const char *, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_0( int,		heapchk, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_0( bool,		IsDebugHeap, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_2V(			GetActualDbgInfo, const char *&, int &, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_5V(			RegisterAllocation, const char *, int, int, int, unsigned, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_5V(			RegisterDeallocation, const char *, int, int, int, unsigned, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_0( int,		GetVersion, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_0V(			CompactHeap, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_1( MemAllocFailHandler_t, SetAllocFailHandler, MemAllocFailHandler_t, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_1V(			DumpBlockStats, void *, m_pMemAlloc );
+#if defined( _MEMTEST )	
+	DELEGATE_TO_OBJECT_2V(			SetStatsExtraInfo, const char *, const char *, m_pMemAlloc );
+#endif
+	DELEGATE_TO_OBJECT_0(size_t,	MemoryAllocFailed, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_0( uint32,	GetDebugInfoSize, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_1V(			SaveDebugInfo, void *, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_1V(			RestoreDebugInfo, const void *, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_3V(			InitDebugInfo, void *, const char *, int, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_2V(			GlobalMemoryStatus, size_t *, size_t *, m_pMemAlloc );
+
+	// Other public methods
+public:
+	CBenchmarkMemAlloc()
+	{
+		m_pMemAlloc = NULL;
+		m_bActive = false;
+		m_nAllocs = 0;
+		m_nAllocBytes = 0;
+	}
+
+	void Start()
+	{
+		if ( m_bActive )
+			return;
+
+		// Once set, m_pMemAlloc is never cleared: other threads can still be
+		// inside one of our methods after Stop() puts the real allocator back.
+		if ( !m_pMemAlloc )
+		{
+			m_pMemAlloc = g_pMemAlloc;
+		}
+		g_pMemAlloc = this;
+		m_bActive = true;
+	}
+
+	void Stop()
+	{
+		if ( !m_bActive )
+			return;
+
+		g_pMemAlloc = m_pMemAlloc;
+		m_bActive = false;
+	}
+
+	// These wrap, so only look at differences.
+	uint32 GetAllocCount() const	{ return (uint32)m_nAllocs; }
+	uint32 GetAllocBytes() const	{ return (uint32)m_nAllocBytes; }
+
+private:
+	void CountAlloc( size_t nSize )
+	{
+		ThreadInterlockedIncrement( &m_nAllocs );
+		ThreadInterlockedExchangeAdd( &m_nAllocBytes, (int32)nSize );
+	}
+
+	IMemAlloc *m_pMemAlloc;
+	bool m_bActive;
+	volatile int32 m_nAllocs;
+	volatile int32 m_nAllocBytes;
+};
+
+static CBenchmarkMemAlloc s_BenchmarkMemAlloc;
+
+
+// ---------------------------------------------------------------------------------------------- //
+// Recorded usercmds.
+//
+// The file is a header followed by events in the order they happened. Usercmds are delta
+// compressed against the previous usercmd of the same player with WriteUsercmd, and their
+// tick_count is stored relative to the start of the recording so lag compensation still
+// lines up when they're replayed at a different server tick.
+// ---------------------------------------------------------------------------------------------- //
+#define BENCHMARK_USERCMD_FILE_ID		MAKEID( 'S', 'B', 'U', 'C' )
+#define BENCHMARK_USERCMD_FILE_VERSION	1
+
+enum EBenchmarkEventType
+{
+	BENCHMARKEVENT_USERCMD = 0,
+	BENCHMARKEVENT_SETUP,			// The player changed team or class.
+};
+
+struct BenchmarkEvent_t
+{
+	int m_nTick;					// Ticks since the start of the recording.
+	int m_iSlot;					// Which recorded player this is for.
+	int m_nType;					// EBenchmarkEventType
+	int m_iTeam;					// BENCHMARKEVENT_SETUP only.
+	int m_iClass;
+	CUserCmd m_Cmd;					// BENCHMARKEVENT_USERCMD only.
+};
+
+static bool SaveBenchmarkEvents( const char *pFilename, const CUtlVector<BenchmarkEvent_t> &events, int nSlots )
+{
+	CUtlBuffer buf;
+	buf.PutInt( BENCHMARK_USERCMD_FILE_ID );
+	buf.PutInt( BENCHMARK_USERCMD_FILE_VERSION );
+	buf.PutFloat( gpGlobals->interval_per_tick );
+	buf.PutInt( nSlots );
+	buf.PutInt( events.Count() );
+
+	CUserCmd lastCmds[MAX_PLAYERS];
+	for ( int i=0; i < events.Count(); i++ )
+	{
+		const BenchmarkEvent_t &event = events[i];
+		buf.PutInt( event.m_nTick );
+		buf.PutUnsignedChar( event.m_iSlot );
+		buf.PutUnsignedChar( event.m_nType );
+
+		if ( event.m_nType == BENCHMARKEVENT_SETUP )
+		{
+			buf.PutInt( event.m_iTeam );
+			buf.PutInt( event.m_iClass );
+		}
+		else
+		{
+			byte data[128];
+			bf_write cmdBuf( "SaveBenchmarkEvents", data, sizeof( data ) );
+			WriteUsercmd( &cmdBuf, &event.m_Cmd, &lastCmds[event.m_iSlot] );
+			lastCmds[event.m_iSlot] = event.m_Cmd;
+
+			if ( cmdBuf.IsOverflowed() )
+			{
+				Warning( "sv_benchmark_record: usercmd too large\n" );
+				return false;
+			}
+
+			buf.PutUnsignedChar( cmdBuf.GetNumBytesWritten() );
+			buf.Put( data, cmdBuf.GetNumBytesWritten() );
+		}
+	}
+
+	return filesystem->WriteFile( pFilename, "DEFAULT_WRITE_PATH", buf );
+}
+
+static bool LoadBenchmarkEvents( const char *pFilename, CUtlVector<BenchmarkEvent_t> &events, int &nSlots )
+{
+	events.Purge();
+	nSlots = 0;
+
+	char szFilename[MAX_PATH];
+	Q_strncpy( szFilename, pFilename, sizeof( szFilename ) );
+	Q_DefaultExtension( szFilename, ".sbuc", sizeof( szFilename ) );
+	pFilename = szFilename;
+
+	CUtlBuffer buf;
+	if ( !filesystem->ReadFile( pFilename, "MOD", buf ) )
+	{
+		Warning( "Can't read benchmark replay file %s.\n", pFilename );
+		return false;
+	}
+
+	if ( buf.GetInt() != BENCHMARK_USERCMD_FILE_ID || buf.GetInt() != BENCHMARK_USERCMD_FILE_VERSION )
+	{
+		Warning( "%s is not a benchmark replay file or is from an older version.\n", pFilename );
+		return false;
+	}
+
+	float flTickInterval = buf.GetFloat();
+	if ( flTickInterval != gpGlobals->interval_per_tick )
+	{
+		Warning( "%s was recorded with a tick interval of %f, the server is running at %f.\n", pFilename, flTickInterval, gpGlobals->interval_per_tick );
+	}
+
+	nSlots = buf.GetInt();
+	int nEvents = buf.GetInt();
+	if ( nSlots < 0 || nSlots > MAX_PLAYERS || nEvents < 0 || !buf.IsValid() )
+	{
+		Warning( "%s is corrupt.\n", pFilename );
+		return false;
+	}
+
+	events.EnsureCapacity( nEvents );
+
+	CUserCmd lastCmds[MAX_PLAYERS];
+	bool bCorrupt = false;
+	for ( int i=0; i < nEvents && !bCorrupt; i++ )
+	{
+		BenchmarkEvent_t &event = events[events.AddToTail()];
+		event.m_nTick = buf.GetInt();
+		event.m_iSlot = buf.GetUnsignedChar();
+		event.m_nType = buf.GetUnsignedChar();
+		event.m_iTeam = event.m_iClass = 0;
+
+		if ( event.m_iSlot >= nSlots )
+		{
+			bCorrupt = true;
+			break;
+		}
+
+		if ( event.m_nType == BENCHMARKEVENT_SETUP )
+		{
+			event.m_iTeam = buf.GetInt();
+			event.m_iClass = buf.GetInt();
+		}
+		else
+		{
+			byte data[128];
+			int nBytes = buf.GetUnsignedChar();
+			if ( nBytes > (int)sizeof( data ) )
+			{
+				bCorrupt = true;
+				break;
+			}
+
+			buf.Get( data, nBytes );
+			if ( !buf.IsValid() )
+			{
+				bCorrupt = true;
+				break;
+			}
+
+			bf_read cmdBuf( "LoadBenchmarkEvents", data, nBytes );
+			ReadUsercmd( &cmdBuf, &event.m_Cmd, &lastCmds[event.m_iSlot] );
+			lastCmds[event.m_iSlot] = event.m_Cmd;
+
+			bCorrupt = cmdBuf.IsOverflowed();
+		}
+
+		bCorrupt = bCorrupt || !buf.IsValid();
+	}
+
+	if ( bCorrupt || events.Count() != nEvents || !buf.IsValid() )
+	{
+		Warning( "%s is corrupt.\n", pFilename );
+		events.Purge();
+		return false;
+	}
+
+	return true;
+}
+
+
+// ---------------------------------------------------------------------------------------------- //
+// CServerBenchmarkRecorder records the usercmds of every human player.
+// ---------------------------------------------------------------------------------------------- //
+class CServerBenchmarkRecorder : public CAutoGameSystem
+{
+public:
+	CServerBenchmarkRecorder() : CAutoGameSystem( "CServerBenchmarkRecorder" )
+	{
+		m_bRecording = false;
+	}
+
+	virtual void LevelShutdownPreEntity()
+	{
+		// A recording is only good for the map it was made on.
+		StopRecording();
+	}
+
+	bool IsRecording() const
+	{
+		return m_bRecording;
+	}
+
+	void StartRecording( const char *pFilename )
+	{
+		StopRecording();
+
+		Q_strncpy( m_szFilename, pFilename, sizeof( m_szFilename ) );
+		Q_DefaultExtension( m_szFilename, ".sbuc", sizeof( m_szFilename ) );
+		m_bRecording = true;
+		m_nStartTick = gpGlobals->tickcount;
+		m_nSlots = 0;
+		m_Events.Purge();
+
+		for ( int i=0; i < MAX_PLAYERS; i++ )
+		{
+			m_Players[i].m_nUserID = -1;
+		}
+
+		Msg( "Recording usercmds to %s.\n", m_szFilename );
+	}
+
+	void StopRecording()
+	{
+		if ( !m_bRecording )
+			return;
+
+		m_bRecording = false;
+		if ( SaveBenchmarkEvents( m_szFilename, m_Events, m_nSlots ) )
+		{
+			Msg( "Wrote %d ticks of usercmds for %d players to %s.\n", gpGlobals->tickcount - m_nStartTick, m_nSlots, m_szFilename );
+		}
+		else
+		{
+			Warning( "Couldn't write %s.\n", m_szFilename );
+		}
+
+		m_Events.Purge();
+	}
+
+	void RecordUsercmds( CBasePlayer *pPlayer, const CUserCmd *pCmds, int nCmds )
+	{
+		if ( !m_bRecording || pPlayer->IsFakeClient() || pPlayer->IsHLTV() || pPlayer->IsReplay() )
+			return;
+
+		int iPlayer = pPlayer->entindex() - 1;
+		if ( iPlayer < 0 || iPlayer >= MAX_PLAYERS )
+			return;
+
+		// Someone who reconnects into the same entity index gets a new slot.
+		RecordedPlayer_t &player = m_Players[iPlayer];
+		int nUserID = pPlayer->GetUserID();
+		if ( player.m_nUserID != nUserID )
+		{
+			if ( m_nSlots >= MAX_PLAYERS )
+				return;
+
+			player.m_nUserID = nUserID;
+			player.m_iSlot = m_nSlots++;
+			player.m_iTeam = player.m_iClass = -1;
+		}
+
+		int nTick = gpGlobals->tickcount - m_nStartTick;
+
+		int iTeam = pPlayer->GetTeamNumber();
+		int iClass = CServerBenchmarkHook::s_pBenchmarkHook ? CServerBenchmarkHook::s_pBenchmarkHook->GetReplayPlayerClass( pPlayer ) : 0;
+		if ( iTeam != player.m_iTeam || iClass != player.m_iClass )
+		{
+			player.m_iTeam = iTeam;
+			player.m_iClass = iClass;
+
+			BenchmarkEvent_t &event = m_Events[m_Events.AddToTail()];
+			event.m_nTick = nTick;
+			event.m_iSlot = player.m_iSlot;
+			event.m_nType = BENCHMARKEVENT_SETUP;
+			event.m_iTeam = iTeam;
+			event.m_iClass = iClass;
+		}
+
+		// Store them oldest first.
+		for ( int i = nCmds - 1; i >= 0; i-- )
+		{
+			BenchmarkEvent_t &event = m_Events[m_Events.AddToTail()];
+			event.m_nTick = nTick;
+			event.m_iSlot = player.m_iSlot;
+			event.m_nType = BENCHMARKEVENT_USERCMD;
+			event.m_iTeam = event.m_iClass = 0;
+			event.m_Cmd = pCmds[i];
+			event.m_Cmd.tick_count -= m_nStartTick;
+		}
+	}
+
+private:
+	struct RecordedPlayer_t
+	{
+		int m_nUserID;
+		int m_iSlot;
+		int m_iTeam;
+		int m_iClass;
+	};
+
+	bool m_bRecording;
+	char m_szFilename[MAX_PATH];
+	int m_nStartTick;
+	int m_nSlots;
+	RecordedPlayer_t m_Players[MAX_PLAYERS];
+	CUtlVector<BenchmarkEvent_t> m_Events;
+};
+
+static CServerBenchmarkRecorder s_BenchmarkRecorder;
+
+
+// ---------------------------------------------------------------------------------------------- //
+// Helpers for the JSON results.
+// ---------------------------------------------------------------------------------------------- //
+struct BenchmarkStats_t
+{
+	float m_flP50;
+	float m_flP99;
+	float m_flMax;
+	double m_flTotal;
+};
+
+static BenchmarkStats_t CalculateBenchmarkStats( const CUtlVector<float> &samples )
+{
+	BenchmarkStats_t stats;
+	memset( &stats, 0, sizeof( stats ) );
+	if ( samples.Count() == 0 )
+		return stats;
+
+	CUtlVector<float> sorted;
+	sorted.CopyArray( samples.Base(), samples.Count() );
+	sorted.Sort();
+
+	int nLast = sorted.Count() - 1;
+	stats.m_flP50 = sorted[ nLast / 2 ];
+	stats.m_flP99 = sorted[ ( nLast * 99 ) / 100 ];
+	stats.m_flMax = sorted[ nLast ];
+	for ( int i=0; i < sorted.Count(); i++ )
+	{
+		stats.m_flTotal += sorted[i];
+	}
+
+	return stats;
+}
+
+static void WriteBenchmarkStats( FileHandle_t fh, const char *pName, const CUtlVector<float> &samples )
+{
+	BenchmarkStats_t stats = CalculateBenchmarkStats( samples );
+	filesystem->FPrintf( fh, "\"%s\": { \"p50\": %.4f, \"p99\": %.4f, \"max\": %.4f, \"total\": %.4f }", pName, stats.m_flP50, stats.m_flP99, stats.m_flMax, stats.m_flTotal );
+}
+
+static void WriteJSONString( FileHandle_t fh, const char *pString )
+{
+	char szEscaped[512];
+	int iOut = 0;
+	for ( const char *pCur = pString; *pCur && iOut < (int)sizeof( szEscaped ) - 7; pCur++ )
+	{
+		unsigned char c = *pCur;
+		if ( c == '"' || c == '\\' )
+		{
+			szEscaped[iOut++] = '\\';
+			szEscaped[iOut++] = c;
+		}
+		else if ( c < ' ' )
+		{
+			iOut += Q_snprintf( &szEscaped[iOut], sizeof( szEscaped ) - iOut, "\\u%04x", c );
+		}
+		else
+		{
+			szEscaped[iOut++] = c;
+		}
+	}
+	szEscaped[iOut] = 0;
+
+	filesystem->FPrintf( fh, "\"%s\"", szEscaped );
+}
+
+
 // ---------------------------------------------------------------------------------------------- //
 // CServerBenchmark implementation.
 // ---------------------------------------------------------------------------------------------- //
@@ -49,6 +533,11 @@ public:
 	CServerBenchmark()
 	{
 		m_BenchmarkState = BENCHMARKSTATE_NOT_RUNNING;
+		m_nBenchmarkMode = 0;
+		m_bReplay = false;
+		m_bOverrodeRandomSeed = false;
+		m_nOldCustomRandomSeed = 0;
+		m_bStartedVProf = false;
 		
 		// The benchmark should always have the same seed and do exactly the same thing on the same ticks.
 		m_RandomStream.SetSeed( 1111 ); 
@@ -81,6 +570,33 @@ public:
 		if ( !CServerBenchmarkHook::s_pBenchmarkHook )
 			Error( "This game doesn't support server benchmarks (no CServerBenchmarkHook found)." );
 
+		// Replaying recorded usercmds?
+		m_bReplay = false;
+		m_nReplaySlots = 0;
+		m_ReplayEvents.Purge();
+		if ( sv_benchmark_replay.GetString()[0] )
+		{
+			if ( !LoadBenchmarkEvents( sv_benchmark_replay.GetString(), m_ReplayEvents, m_nReplaySlots ) )
+				return false;
+
+			m_bReplay = true;
+
+			// Player code seeds each usercmd from the clock when this is on, which would make
+			// two runs of the same recording diverge. Put it back in EndBenchmark.
+			if ( !m_bOverrodeRandomSeed )
+			{
+				m_nOldCustomRandomSeed = sv_usercmd_custom_random_seed.GetInt();
+				m_bOverrodeRandomSeed = true;
+			}
+			sv_usercmd_custom_random_seed.SetValue( 0 );
+		}
+
+		m_nBenchmarkTicks = sv_benchmark_numticks.GetInt();
+		if ( m_bReplay && m_nBenchmarkTicks <= 0 )
+		{
+			m_nBenchmarkTicks = m_ReplayEvents.Count() ? m_ReplayEvents.Tail().m_nTick + 1 : 0;
+		}
+
 		m_BenchmarkState = BENCHMARKSTATE_START_WAIT;
 		m_flBenchmarkStartTime = Plat_FloatTime();
 		m_flBenchmarkStartWaitTime = flCountdown;
@@ -91,6 +607,16 @@ public:
 		// Setup the benchmark environment.
 		engine->SetDedicatedServerBenchmarkMode( true );	// Run 1 tick per frame and ignore all timing stuff.
 
+		// VProf can only be turned on between frames, so ask for it now and it'll be running by the time the countdown finishes.
+		m_bStartedVProf = false;
+#ifdef VPROF_ENABLED
+		if ( !g_VProfCurrentProfile.IsEnabled() )
+		{
+			engine->ServerCommand( "vprof_on\n" );
+			m_bStartedVProf = true;
+		}
+#endif
+
 		// Tell the game-specific hook that we're starting.
 		CServerBenchmarkHook::s_pBenchmarkHook->StartBenchmark();
 		CServerBenchmarkHook::s_pBenchmarkHook->GetPhysicsModelNames( m_PhysicsModelNames );
@@ -107,6 +633,13 @@ public:
 		// Wait a certain number of ticks to start the benchmark.
 		if ( m_BenchmarkState == BENCHMARKSTATE_START_WAIT )
 		{
+			// Replay bots have to be in the game before the first recorded tick.
+			if ( m_bReplay )
+			{
+				UpdateReplayBotCreation();
+				UpdateReplayBots();
+			}
+
 			if ( (Plat_FloatTime() - m_flBenchmarkStartTime) < m_flBenchmarkStartWaitTime )
 			{
 				UpdateStartWaitCounter();
@@ -120,20 +653,27 @@ public:
 				m_fl_ValidTime_BenchmarkStartTime = Benchmark_ValidTime();
 				m_nBenchmarkStartTick = gpGlobals->tickcount;
 				m_nLastPhysicsObjectTick = m_nLastPhysicsForceTick = 0;
+				m_iNextReplayEvent = 0;
 				m_BenchmarkState = BENCHMARKSTATE_RUNNING;
 
 				StartVProfRecord();
+				StartTickStats();
 
 				RandomSeed( 0 );
 				m_RandomStream.SetSeed( 0 );
 			}
 		}
+		else
+		{
+			// Everything since the last update was one tick.
+			UpdateTickStats();
+		}
 
 		int nTicksRunSoFar = gpGlobals->tickcount - m_nBenchmarkStartTick;
 		UpdateBenchmarkCounter();
 	
 		// Are we finished with the benchmark?
-		if ( nTicksRunSoFar >= sv_benchmark_numticks.GetInt() )
+		if ( nTicksRunSoFar >= m_nBenchmarkTicks )
 		{
 			EndVProfRecord();
 			OutputResults();
@@ -142,9 +682,17 @@ public:
 		}
 
 		// Ok, update whatever we're doing in the benchmark.
-		UpdatePlayerCreation();
-		UpdateVPhysicsObjects();
-		CServerBenchmarkHook::s_pBenchmarkHook->UpdateBenchmark();
+		if ( m_bReplay )
+		{
+			UpdateReplay( nTicksRunSoFar );
+			UpdateReplayBots();
+		}
+		else
+		{
+			UpdatePlayerCreation();
+			UpdateVPhysicsObjects();
+			CServerBenchmarkHook::s_pBenchmarkHook->UpdateBenchmark();
+		}
 	}
 
 	void StartVProfRecord()
@@ -184,7 +732,21 @@ public:
 			engine->ServerCommand( "quit\n" );
 		}
 		
+		s_BenchmarkMemAlloc.Stop();
+		if ( m_bStartedVProf )
+		{
+			engine->ServerCommand( "vprof_off\n" );
+			m_bStartedVProf = false;
+		}
+
 		m_BenchmarkState = BENCHMARKSTATE_NOT_RUNNING;
+		m_bReplay = false;
+		m_ReplayEvents.Purge();
+		if ( m_bOverrodeRandomSeed )
+		{
+			sv_usercmd_custom_random_seed.SetValue( m_nOldCustomRandomSeed );
+			m_bOverrodeRandomSeed = false;
+		}
 		engine->SetDedicatedServerBenchmarkMode( false );
 	}
 
@@ -199,6 +761,101 @@ public:
 		return false;
 	}
 
+	virtual bool IsRecordingUsercmds()
+	{
+		return s_BenchmarkRecorder.IsRecording();
+	}
+
+	virtual void RecordUsercmds( CBasePlayer *pPlayer, const CUserCmd *pCmds, int nCmds )
+	{
+		s_BenchmarkRecorder.RecordUsercmds( pPlayer, pCmds, nCmds );
+	}
+
+	virtual bool IsReplayPlayer( CBasePlayer *pPlayer )
+	{
+		if ( !m_bReplay )
+			return false;
+
+		for ( int i=0; i < m_nReplaySlots; i++ )
+		{
+			if ( m_ReplayPlayers[i].m_hPlayer == pPlayer )
+				return true;
+		}
+
+		return false;
+	}
+
+	void UpdateReplayBotCreation()
+	{
+		for ( ; m_nBotsCreated < m_nReplaySlots; m_nBotsCreated++ )
+		{
+			// Start them on whatever team and class they first show up with.
+			ReplayPlayer_t &player = m_ReplayPlayers[m_nBotsCreated];
+			player.m_iTeam = player.m_iClass = 0;
+			for ( int i=0; i < m_ReplayEvents.Count(); i++ )
+			{
+				if ( m_ReplayEvents[i].m_iSlot == m_nBotsCreated && m_ReplayEvents[i].m_nType == BENCHMARKEVENT_SETUP )
+				{
+					player.m_iTeam = m_ReplayEvents[i].m_iTeam;
+					player.m_iClass = m_ReplayEvents[i].m_iClass;
+					break;
+				}
+			}
+
+			player.m_hPlayer = CServerBenchmarkHook::s_pBenchmarkHook->CreateReplayBot( player.m_iTeam, player.m_iClass );
+			if ( !player.m_hPlayer )
+				Warning( "Benchmark: couldn't create a bot for recorded player %d.\n", m_nBotsCreated );
+		}
+	}
+
+	void UpdateReplayBots()
+	{
+		for ( int i=0; i < m_nReplaySlots; i++ )
+		{
+			CBasePlayer *pPlayer = m_ReplayPlayers[i].m_hPlayer;
+			if ( pPlayer )
+			{
+				CServerBenchmarkHook::s_pBenchmarkHook->UpdateReplayBot( pPlayer, m_ReplayPlayers[i].m_iTeam, m_ReplayPlayers[i].m_iClass );
+			}
+		}
+	}
+
+	// Hand each bot the usercmds its player sent on this tick, the same way the engine would have.
+	void UpdateReplay( int nTick )
+	{
+		for ( int i=0; i < m_nReplaySlots; i++ )
+		{
+			m_ReplayPlayers[i].m_Cmds.RemoveAll();
+		}
+
+		for ( ; m_iNextReplayEvent < m_ReplayEvents.Count() && m_ReplayEvents[m_iNextReplayEvent].m_nTick <= nTick; m_iNextReplayEvent++ )
+		{
+			const BenchmarkEvent_t &event = m_ReplayEvents[m_iNextReplayEvent];
+			ReplayPlayer_t &player = m_ReplayPlayers[event.m_iSlot];
+			if ( event.m_nType == BENCHMARKEVENT_SETUP )
+			{
+				player.m_iTeam = event.m_iTeam;
+				player.m_iClass = event.m_iClass;
+			}
+			else
+			{
+				// ProcessUsercmds wants the newest one first.
+				int iCmd = player.m_Cmds.AddToHead( event.m_Cmd );
+				player.m_Cmds[iCmd].tick_count += m_nBenchmarkStartTick;
+			}
+		}
+
+		for ( int i=0; i < m_nReplaySlots; i++ )
+		{
+			CBasePlayer *pPlayer = m_ReplayPlayers[i].m_hPlayer;
+			int nCmds = m_ReplayPlayers[i].m_Cmds.Count();
+			if ( pPlayer && nCmds )
+			{
+				pPlayer->ProcessUsercmds( m_ReplayPlayers[i].m_Cmds.Base(), nCmds, nCmds, 0, false );
+			}
+		}
+	}
+
 	void UpdateVPhysicsObjects()
 	{
 		int nPhysicsObjectInterval = sv_benchmark_numticks.GetInt() / s_nBenchmarkPhysicsObjects;
@@ -285,10 +942,10 @@ public:
 	void UpdateBenchmarkCounter()
 	{
 		float flCurTime = Plat_FloatTime();
-		if ( (flCurTime - m_flLastBenchmarkCounterUpdate) > 3.0f )
+		if ( (flCurTime - m_flLastBenchmarkCounterUpdate) > 3.0f && m_nBenchmarkTicks > 0 )
 		{
 			m_flLastBenchmarkCounterUpdate = flCurTime;
-			Msg( "Benchmark: %d%% complete.\n", ((gpGlobals->tickcount - m_nBenchmarkStartTick) * 100) / sv_benchmark_numticks.GetInt() );
+			Msg( "Benchmark: %d%% complete.\n", ((gpGlobals->tickcount - m_nBenchmarkStartTick) * 100) / m_nBenchmarkTicks );
 		}
 	}
 
@@ -326,16 +983,199 @@ public:
 		}
 	}
 
+	// Per-tick stats. Each sample covers everything between two calls to UpdateBenchmark, which is
+	// exactly one tick since benchmark mode runs one tick per frame.
+	void StartTickStats()
+	{
+		m_TickTimes.Purge();
+		m_AllocCounts.Purge();
+		m_AllocBytes.Purge();
+		for ( int i=0; i < m_BudgetGroupTimes.Count(); i++ )
+		{
+			m_BudgetGroupTimes[i].Purge();
+		}
+		m_BudgetGroupTimes.Purge();
+		m_BudgetGroupTotals.Purge();
+
+		s_BenchmarkMemAlloc.Start();
+		m_nLastAllocCount = s_BenchmarkMemAlloc.GetAllocCount();
+		m_nLastAllocBytes = s_BenchmarkMemAlloc.GetAllocBytes();
+		m_flLastTickTime = Benchmark_ValidTime();
+		m_bHaveVProf = false;
+#ifdef VPROF_ENABLED
+		m_bHaveVProf = g_VProfCurrentProfile.IsEnabled();
+		GetBudgetGroupTotals( m_BudgetGroupTotals );
+#endif
+
+		for ( int i = 1; i <= MAX_PLAYERS && i <= gpGlobals->maxClients; i++ )
+		{
+			INetChannelInfo *pNetInfo = engine->GetPlayerNetInfo( i );
+			m_nStartBytesSent[i-1] = pNetInfo ? pNetInfo->GetTotalData( FLOW_OUTGOING ) : 0;
+			m_nStartPacketsSent[i-1] = pNetInfo ? pNetInfo->GetSequenceNr( FLOW_OUTGOING ) : 0;
+		}
+	}
+
+	void UpdateTickStats()
+	{
+		double flTime = Benchmark_ValidTime();
+		m_TickTimes.AddToTail( (float)( ( flTime - m_flLastTickTime ) * 1000.0 ) );
+		m_flLastTickTime = flTime;
+
+		uint32 nAllocCount = s_BenchmarkMemAlloc.GetAllocCount();
+		uint32 nAllocBytes = s_BenchmarkMemAlloc.GetAllocBytes();
+		m_AllocCounts.AddToTail( (float)( nAllocCount - m_nLastAllocCount ) );
+		m_AllocBytes.AddToTail( (float)( nAllocBytes - m_nLastAllocBytes ) );
+		m_nLastAllocCount = nAllocCount;
+		m_nLastAllocBytes = nAllocBytes;
+
+#ifdef VPROF_ENABLED
+		CUtlVector<double> totals;
+		GetBudgetGroupTotals( totals );
+
+		// Groups can be added at any time. Pretend new ones were there all along with no time in them.
+		while ( m_BudgetGroupTimes.Count() < totals.Count() )
+		{
+			CUtlVector<float> &times = m_BudgetGroupTimes[m_BudgetGroupTimes.AddToTail()];
+			times.SetCount( m_TickTimes.Count() - 1 );
+			times.FillWithValue( 0.0f );
+		}
+		while ( m_BudgetGroupTotals.Count() < totals.Count() )
+		{
+			m_BudgetGroupTotals.AddToTail( 0.0 );
+		}
+
+		for ( int i=0; i < totals.Count(); i++ )
+		{
+			m_BudgetGroupTimes[i].AddToTail( (float)( totals[i] - m_BudgetGroupTotals[i] ) );
+			m_BudgetGroupTotals[i] = totals[i];
+		}
+#endif
+	}
+
+#ifdef VPROF_ENABLED
+	// Node times only ever go up, so the time a group took over a tick is the difference in its total.
+	static void AddBudgetGroupTotals_R( CVProfNode *pNode, CUtlVector<double> &totals )
+	{
+		for ( ; pNode; pNode = pNode->GetSibling() )
+		{
+			int iGroup = pNode->GetBudgetGroupID();
+			if ( iGroup >= 0 && iGroup < totals.Count() )
+			{
+				totals[iGroup] += pNode->GetTotalTimeLessChildren();
+			}
+
+			AddBudgetGroupTotals_R( pNode->GetChild(), totals );
+		}
+	}
+
+	static void GetBudgetGroupTotals( CUtlVector<double> &totals )
+	{
+		totals.SetCount( g_VProfCurrentProfile.GetNumBudgetGroups() );
+		totals.FillWithValue( 0.0 );
+		AddBudgetGroupTotals_R( g_VProfCurrentProfile.GetRoot()->GetChild(), totals );
+	}
+#endif
+
 	void OutputResults()
 	{
 		float flRunTime = Benchmark_ValidTime() - m_fl_ValidTime_BenchmarkStartTime;
+		int nTicks = m_TickTimes.Count();
 
 		Warning( "------------------ SERVER BENCHMARK RESULTS ------------------\n" );
 		Warning( "Total time          : %.2f seconds\n", flRunTime );
-		Warning( "Num ticks simulated : %d\n", sv_benchmark_numticks.GetInt() );
-		Warning( "Ticks per second    : %.2f\n", sv_benchmark_numticks.GetInt() / flRunTime );
+		Warning( "Num ticks simulated : %d\n", nTicks );
+		Warning( "Ticks per second    : %.2f\n", nTicks / flRunTime );
 		Warning( "Benchmark CRC       : %d\n", CalculateBenchmarkCRC() );
 		Warning( "--------------------------------------------------------------\n" );
+
+		if ( sv_benchmark_json.GetString()[0] )
+		{
+			WriteJSONResults( sv_benchmark_json.GetString(), flRunTime );
+		}
+	}
+
+	void WriteJSONResults( const char *pFilename, float flRunTime )
+	{
+		FileHandle_t fh = filesystem->Open( pFilename, "wt", "DEFAULT_WRITE_PATH" );
+		if ( !fh )
+		{
+			Warning( "Couldn't write %s.\n", pFilename );
+			return;
+		}
+
+		int nTicks = m_TickTimes.Count();
+
+		filesystem->FPrintf( fh, "{\n" );
+		filesystem->FPrintf( fh, "\t\"map\": " );
+		WriteJSONString( fh, STRING( gpGlobals->mapname ) );
+		filesystem->FPrintf( fh, ",\n\t\"mode\": \"%s\",\n", m_bReplay ? "replay" : "stress" );
+		if ( m_bReplay )
+		{
+			filesystem->FPrintf( fh, "\t\"replay\": " );
+			WriteJSONString( fh, sv_benchmark_replay.GetString() );
+			filesystem->FPrintf( fh, ",\n" );
+		}
+		filesystem->FPrintf( fh, "\t\"ticks\": %d,\n", nTicks );
+		filesystem->FPrintf( fh, "\t\"tick_interval\": %f,\n", gpGlobals->interval_per_tick );
+		filesystem->FPrintf( fh, "\t\"seconds\": %.4f,\n", flRunTime );
+		filesystem->FPrintf( fh, "\t\"ticks_per_second\": %.2f,\n", flRunTime > 0.0f ? nTicks / flRunTime : 0.0f );
+		filesystem->FPrintf( fh, "\t\"crc\": %d,\n", CalculateBenchmarkCRC() );
+		filesystem->FPrintf( fh, "\t\"vprof\": %s,\n", m_bHaveVProf ? "true" : "false" );
+
+		filesystem->FPrintf( fh, "\t" );
+		WriteBenchmarkStats( fh, "tick_ms", m_TickTimes );
+		filesystem->FPrintf( fh, ",\n" );
+
+		// Budget group times in milliseconds. Groups that never took any time are left out.
+		filesystem->FPrintf( fh, "\t\"budget_groups_ms\": {" );
+		bool bFirst = true;
+#ifdef VPROF_ENABLED
+		for ( int i=0; i < m_BudgetGroupTimes.Count(); i++ )
+		{
+			BenchmarkStats_t stats = CalculateBenchmarkStats( m_BudgetGroupTimes[i] );
+			if ( stats.m_flTotal <= 0.0 )
+				continue;
+
+			filesystem->FPrintf( fh, "%s\n\t\t", bFirst ? "" : "," );
+			bFirst = false;
+			WriteJSONString( fh, g_VProfCurrentProfile.GetBudgetGroupName( i ) );
+			filesystem->FPrintf( fh, ": { \"p50\": %.4f, \"p99\": %.4f, \"max\": %.4f, \"total\": %.4f }", stats.m_flP50, stats.m_flP99, stats.m_flMax, stats.m_flTotal );
+		}
+#endif
+		filesystem->FPrintf( fh, "%s},\n", bFirst ? "" : "\n\t" );
+
+		// Allocations by every module, on every thread.
+		filesystem->FPrintf( fh, "\t\"allocations\": {\n\t\t" );
+		WriteBenchmarkStats( fh, "count", m_AllocCounts );
+		filesystem->FPrintf( fh, ",\n\t\t" );
+		WriteBenchmarkStats( fh, "bytes", m_AllocBytes );
+		filesystem->FPrintf( fh, "\n\t},\n" );
+
+		// What the server sent each client. Bots only get real packets because benchmark mode turns on sv_stressbots.
+		filesystem->FPrintf( fh, "\t\"clients\": [" );
+		bFirst = true;
+		for ( int i = 1; i <= MAX_PLAYERS && i <= gpGlobals->maxClients; i++ )
+		{
+			CBasePlayer *pPlayer = UTIL_PlayerByIndex( i );
+			INetChannelInfo *pNetInfo = engine->GetPlayerNetInfo( i );
+			if ( !pPlayer || !pNetInfo )
+				continue;
+
+			int nBytes = pNetInfo->GetTotalData( FLOW_OUTGOING ) - m_nStartBytesSent[i-1];
+			int nPackets = pNetInfo->GetSequenceNr( FLOW_OUTGOING ) - m_nStartPacketsSent[i-1];
+
+			filesystem->FPrintf( fh, "%s\n\t\t{ \"index\": %d, \"name\": ", bFirst ? "" : ",", i );
+			bFirst = false;
+			WriteJSONString( fh, pPlayer->GetPlayerName() );
+			filesystem->FPrintf( fh, ", \"replay\": %s, \"bytes_sent\": %d, \"packets_sent\": %d, \"bytes_per_tick\": %.2f }",
+				IsReplayPlayer( pPlayer ) ? "true" : "false", nBytes, nPackets, nTicks ? (float)nBytes / nTicks : 0.0f );
+		}
+		filesystem->FPrintf( fh, "%s]\n", bFirst ? "" : "\n\t" );
+
+		filesystem->FPrintf( fh, "}\n" );
+		filesystem->Close( fh );
+
+		Msg( "Wrote benchmark results to %s.\n", pFilename );
 	}
 
 	int CalculateBenchmarkCRC()
@@ -384,6 +1224,7 @@ private:
 	float m_flBenchmarkStartWaitTime;
 
 	int m_nBenchmarkStartTick;
+	int m_nBenchmarkTicks;
 	int m_nStartWaitCounter;
 	int m_nLastPhysicsObjectTick;
 	int m_nLastPhysicsForceTick;
@@ -395,6 +1236,36 @@ private:
 	int m_nBenchmarkMode;
 
 	CUniformRandomStream m_RandomStream;
+
+	// Replay.
+	struct ReplayPlayer_t
+	{
+		CHandle<CBasePlayer> m_hPlayer;
+		int m_iTeam;
+		int m_iClass;
+		CUtlVector<CUserCmd> m_Cmds;	// This tick's, newest first.
+	};
+	bool m_bReplay;
+	bool m_bOverrodeRandomSeed;
+	int m_nOldCustomRandomSeed;
+	int m_nReplaySlots;
+	int m_iNextReplayEvent;
+	CUtlVector<BenchmarkEvent_t> m_ReplayEvents;
+	ReplayPlayer_t m_ReplayPlayers[MAX_PLAYERS];
+
+	// Stats, one sample per tick.
+	bool m_bStartedVProf;
+	bool m_bHaveVProf;
+	double m_flLastTickTime;
+	uint32 m_nLastAllocCount;
+	uint32 m_nLastAllocBytes;
+	CUtlVector<float> m_TickTimes;
+	CUtlVector<float> m_AllocCounts;
+	CUtlVector<float> m_AllocBytes;
+	CUtlVector< CUtlVector<float> > m_BudgetGroupTimes;
+	CUtlVector<double> m_BudgetGroupTotals;
+	int m_nStartBytesSent[MAX_PLAYERS];
+	int m_nStartPacketsSent[MAX_PLAYERS];
 };
 
 static CServerBenchmark g_ServerBenchmark;
@@ -408,6 +1279,28 @@ CON_COMMAND( sv_benchmark_force_start, "Force start the benchmark. This is only
 	g_ServerBenchmark.InternalStartBenchmark( 1, 1 );
 }
 
+CON_COMMAND( sv_benchmark_record, "Record the usercmds of all human players to a file that sv_benchmark_replay can play back with bots. Stops at the end of the map or with sv_benchmark_record_stop." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() != 2 )
+	{
+		Msg( "Usage: sv_benchmark_record <filename>\n" );
+		return;
+	}
+
+	s_BenchmarkRecorder.StartRecording( args[1] );
+}
+
+CON_COMMAND( sv_benchmark_record_stop, "Stop recording usercmds and write the file." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	s_BenchmarkRecorder.StopRecording();
+}
+
 
 // ---------------------------------------------------------------------------------------------- //
 // CServerBenchmarkHook implementation.
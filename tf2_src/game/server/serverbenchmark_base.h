@@ -11,6 +11,9 @@
 #endif
 
 
+class CUserCmd;
+
+
 // The base server code calls into this.
 class IServerBenchmark
 {
@@ -22,6 +25,12 @@ public:
 	virtual bool IsBenchmarkRunning() = 0;
 	virtual bool IsLocalBenchmarkPlayer( CBasePlayer *pPlayer ) = 0;
 
+	// sv_benchmark_record saves the usercmds of every human player so sv_benchmark_replay
+	// can feed them to bots later. Replay bots must not be driven by the game's bot AI.
+	virtual bool IsRecordingUsercmds() = 0;
+	virtual void RecordUsercmds( CBasePlayer *pPlayer, const CUserCmd *pCmds, int nCmds ) = 0;	// Newest first, like ProcessUsercmds.
+	virtual bool IsReplayPlayer( CBasePlayer *pPlayer ) = 0;
+
 	// Game-specific benchmark code should use this.
 	virtual int RandomInt( int nMin, int nMax ) = 0;
 	virtual float RandomFloat( float flMin, float flMax ) = 0;
@@ -56,8 +65,15 @@ public:
 	// If you want to manage the bots yourself, you can return NULL here.
 	virtual CBasePlayer* CreateBot() = 0;
 
+	// Replay support. The class is whatever the game uses to tell player classes apart, 0 if it has none.
+	// UpdateReplayBot is called every tick and should make the bot join iTeam and iClass if it isn't on them yet.
+	virtual int GetReplayPlayerClass( CBasePlayer *pPlayer ) { return 0; }
+	virtual CBasePlayer* CreateReplayBot( int iTeam, int iClass ) { return CreateBot(); }
+	virtual void UpdateReplayBot( CBasePlayer *pPlayer, int iTeam, int iClass ) {}
+
 private:
 	friend class CServerBenchmark;
+	friend class CServerBenchmarkRecorder;
 	static CServerBenchmarkHook *s_pBenchmarkHook; // There can be only one!!
 };
 
@@ -224,6 +224,39 @@ public:
 		return pPlayer;
 	}
 
+	virtual int GetReplayPlayerClass( CBasePlayer *pPlayer )
+	{
+		CTFPlayer *pTFPlayer = ToTFPlayer( pPlayer );
+		return pTFPlayer ? pTFPlayer->GetPlayerClass()->GetClassIndex() : TF_CLASS_UNDEFINED;
+	}
+
+	virtual CBasePlayer* CreateReplayBot( int iTeam, int iClass )
+	{
+		return BotPutInServer( false, false, iTeam, iClass, NULL );
+	}
+
+	// Replay bots don't run Bot_Think, so do the team and class picking it would have done.
+	virtual void UpdateReplayBot( CBasePlayer *pPlayer, int iTeam, int iClass )
+	{
+		CTFPlayer *pTFPlayer = ToTFPlayer( pPlayer );
+		if ( !pTFPlayer )
+			return;
+
+		if ( iTeam != TEAM_UNASSIGNED && pTFPlayer->GetTeamNumber() != iTeam )
+		{
+			switch ( iTeam )
+			{
+			case TF_TEAM_RED:		pTFPlayer->HandleCommand_JoinTeam( "red" ); break;
+			case TF_TEAM_BLUE:		pTFPlayer->HandleCommand_JoinTeam( "blue" ); break;
+			case TEAM_SPECTATOR:	pTFPlayer->HandleCommand_JoinTeam( "spectator" ); break;
+			}
+		}
+		else if ( iClass > TF_CLASS_UNDEFINED && iClass < TF_CLASS_COUNT_ALL && pTFPlayer->GetTeamNumber() >= FIRST_GAME_TEAM && pTFPlayer->GetDesiredPlayerClassIndex() != iClass )
+		{
+			pTFPlayer->HandleCommand_JoinClass( GetPlayerClassData( iClass )->m_szClassName );
+		}
+	}
+
 private:
 	int m_nBotsCreated;
 	bool m_bSetupLocalPlayer;
@@ -649,7 +649,8 @@ void Bot_RunAll( void )
 	{
 		CTFPlayer *pPlayer = ToTFPlayer( UTIL_PlayerByIndex( i ) );
 
-		if ( isTempBot( pPlayer ) && pPlayer->MyNextBotPointer() == NULL )
+		// Benchmark replay bots are driven by recorded usercmds instead.
+		if ( isTempBot( pPlayer ) && pPlayer->MyNextBotPointer() == NULL && !g_pServerBenchmark->IsReplayPlayer( pPlayer ) )
 		{
 			Bot_Think( pPlayer );
 		}
@@ -440,7 +440,14 @@ bool CBaseEntity::KeyValue( const char *szKeyName, const char *szValue )
 	
 	if ( FStrEq( szKeyName, "targetname" ) )
 	{
-		m_iName = AllocPooledString( szValue );
+		SetName( AllocPooledString( szValue ) );
+		return true;
+	}
+
+	// would otherwise go through the data description, which doesn't update the entity list's index
+	if ( FStrEq( szKeyName, "classname" ) )
+	{
+		SetClassname( szValue );
 		return true;
 	}
 
@@ -10,6 +10,7 @@
 #include "rtime.h"
 #include "gcsdk/enumutils.h"
 #include "smartptr.h"
+#include "tier1/generichash.h"
 
 #ifdef GC_DLL
 #include "gcsdk/sqlaccess/sqlaccess.h"
@@ -1514,6 +1515,14 @@ bool CEconItem::BIsKeyLess( const CSharedObject & soRHS ) const
 	return m_ulID < soSchemaRHS.m_ulID;
 }
 
+//----------------------------------------------------------------------------
+// Purpose: Hashes the item ID, the only field BIsKeyLess looks at.
+//----------------------------------------------------------------------------
+uint32 CEconItem::GetKeyHash() const
+{
+	return MurmurHash2( &m_ulID, sizeof( m_ulID ), 0 );
+}
+
 //----------------------------------------------------------------------------
 // Purpose: Copy the data from the specified schema shared object into this. 
 //			Both objects must be of the same type.
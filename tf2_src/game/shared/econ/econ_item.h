@@ -570,6 +570,7 @@ public:
 #endif
 
 	virtual bool BIsKeyLess( const CSharedObject & soRHS ) const ;
+	virtual uint32 GetKeyHash() const OVERRIDE;
 	virtual void Copy( const CSharedObject & soRHS );
 	virtual void Dump() const;
 	virtual CUtlString GetDebugString() const OVERRIDE;
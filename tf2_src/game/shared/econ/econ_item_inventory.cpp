@@ -2338,3 +2338,93 @@ CON_COMMAND_F( item_generate_all_descriptions, "Generate full item descriptions
 #endif // STAGING_ONLY || _DEBUG
 
 
+
+#if defined( CLIENT_DLL )
+//-----------------------------------------------------------------------------
+// Purpose: Times the shared object cache operations the GC messages and
+//			inventory queries use, on a made up backpack.
+//-----------------------------------------------------------------------------
+CON_COMMAND_F( item_socache_benchmark, "Times shared object cache lookups on a made up backpack. Format: item_socache_benchmark [item count]", FCVAR_CHEAT )
+{
+	const int nItems = clamp( args.ArgC() > 1 ? V_atoi( args[1] ) : 3000, 1, 100000 );
+	const int nPasses = 20;
+
+	CSharedObjectTypeCache typeCache( CEconItem::k_nTypeID );
+	CUtlVector< itemid_t > vecItemIDs;
+	vecItemIDs.EnsureCapacity( nItems );
+
+	// item IDs are increasing with gaps, like the ones from the GC
+	CFastTimer timerAdd;
+	timerAdd.Start();
+	itemid_t ulItemID = 1000000000ull;
+	for ( int i = 0; i < nItems; i++ )
+	{
+		ulItemID += RandomInt( 1, 1000 );
+		vecItemIDs.AddToTail( ulItemID );
+
+		CEconItem *pItem = new CEconItem;
+		pItem->SetItemID( ulItemID );
+		typeCache.AddObjectClean( pItem );
+	}
+	timerAdd.End();
+
+	CEconItem soIndex;
+	int nFound = 0;
+	CFastTimer timerFind;
+	timerFind.Start();
+	for ( int nPass = 0; nPass < nPasses; nPass++ )
+	{
+		FOR_EACH_VEC( vecItemIDs, i )
+		{
+			soIndex.SetItemID( vecItemIDs[i] );
+			if ( typeCache.FindSharedObject( soIndex ) )
+				nFound++;
+		}
+	}
+	timerFind.End();
+
+	// the key by key scan the cache used before it was hashed
+	int nScanFound = 0;
+	CFastTimer timerScan;
+	timerScan.Start();
+	FOR_EACH_VEC( vecItemIDs, i )
+	{
+		soIndex.SetItemID( vecItemIDs[i] );
+		for ( uint32 nObj = 0; nObj < typeCache.GetCount(); nObj++ )
+		{
+			if ( typeCache.GetObject( nObj )->BIsKeyEqual( soIndex ) )
+			{
+				nScanFound++;
+				break;
+			}
+		}
+	}
+	timerScan.End();
+
+	// a destroy and create message for every item
+	CFastTimer timerChurn;
+	timerChurn.Start();
+	FOR_EACH_VEC( vecItemIDs, i )
+	{
+		soIndex.SetItemID( vecItemIDs[i] );
+		CSharedObject *pItem = typeCache.RemoveObject( soIndex );
+		if ( pItem )
+		{
+			typeCache.AddObject( pItem );
+		}
+	}
+	timerChurn.End();
+
+	Msg( "%d items: add %.3f us, find %.3f us, linear find %.3f us, remove and add %.3f us per item\n",
+		nItems,
+		timerAdd.GetDuration().GetMicrosecondsF() / nItems,
+		timerFind.GetDuration().GetMicrosecondsF() / ( nItems * nPasses ),
+		timerScan.GetDuration().GetMicrosecondsF() / nItems,
+		timerChurn.GetDuration().GetMicrosecondsF() / nItems );
+
+	if ( nFound != nItems * nPasses || nScanFound != nItems || (int)typeCache.GetCount() != nItems )
+	{
+		Warning( "item_socache_benchmark: lookups found %d of %d items, linear scan found %d\n", nFound, nItems * nPasses, nScanFound );
+	}
+}
+#endif // CLIENT_DLL
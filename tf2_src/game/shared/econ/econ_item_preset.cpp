@@ -59,6 +59,11 @@ bool CEconItemPerClassPresetData::BIsKeyLess( const CSharedObject& soRHS ) const
 	return m_unClassID < soPresetData->m_unClassID;
 }
 
+uint32 CEconItemPerClassPresetData::GetKeyHash() const
+{
+	return HashItem( (unsigned)m_unClassID );
+}
+
 #ifdef GC
 static bool BYieldingAddPresetItemRowsForSpecificPreset( GCSDK::CSQLAccess &sqlAccess, CSchItemPresetInstance& schItemPresetInstance, const CUtlVector<PresetSlotItem_t>& vecPresetData )
 {
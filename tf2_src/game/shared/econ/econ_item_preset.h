@@ -52,6 +52,7 @@ public:
 	CEconItemPerClassPresetData( uint32 unAccountID, equipped_class_t unClassID );
 
 	virtual bool BIsKeyLess( const CSharedObject& soRHS ) const;
+	virtual uint32 GetKeyHash() const OVERRIDE;
 
 #ifdef GC
 	virtual bool BYieldingAddInsertToTransaction( GCSDK::CSQLAccess &sqlAccess ) OVERRIDE;
@@ -39,6 +39,8 @@
 	#include "econ_item_system.h"
 	#include "econ_item.h"
 	#include "activitylist.h"
+	#include "vstdlib/jobthread.h"
+	#include "tier0/icommandline.h"
 
 	#if defined(TF_CLIENT_DLL) || defined(TF_DLL)
 		#include "tf_gcmessages.h"
@@ -4029,6 +4031,7 @@ bool CQuestObjectiveDefinition::BInitFromKV( KeyValues *pKVItem, CUtlVector<CUtl
 //-----------------------------------------------------------------------------
 CEconItemDefinition::CEconItemDefinition( void )
 :	m_pKVItem( NULL ),
+m_pKVPrefabMerged( NULL ),
 m_bEnabled( false ),
 m_unMinItemLevel( 1 ),
 m_unMaxItemLevel( 1 ),
@@ -4120,6 +4123,9 @@ CEconItemDefinition::~CEconItemDefinition( void )
 	if ( m_pKVItem )
 		m_pKVItem->deleteThis();
 	m_pKVItem = NULL;
+	if ( m_pKVPrefabMerged )
+		m_pKVPrefabMerged->deleteThis();
+	m_pKVPrefabMerged = NULL;
 	delete m_pTool;
 	delete m_BundleInfo;
 	delete m_pDictIcons;
@@ -4813,8 +4819,16 @@ const char *CEconItemSchema::FindStringTableEntry( const char *pszTableName, int
 bool CEconItemDefinition::BInitFromKV( KeyValues *pKVItem, CUtlVector<CUtlString> *pVecErrors /* = NULL */ )
 {
 	// Set standard members
-	m_pKVItem = new KeyValues( pKVItem->GetName() );
-	MergeDefinitionPrefab( m_pKVItem, pKVItem );
+	if ( m_pKVPrefabMerged )
+	{
+		m_pKVItem = m_pKVPrefabMerged;
+		m_pKVPrefabMerged = NULL;
+	}
+	else
+	{
+		m_pKVItem = new KeyValues( pKVItem->GetName() );
+		MergeDefinitionPrefab( m_pKVItem, pKVItem );
+	}
 	m_bEnabled = m_pKVItem->GetBool( "enabled" );
 
     // initializing this one first so that it will be available for all the errors below
@@ -6288,6 +6302,330 @@ bool CEconItemSchema::BInitBinaryBuffer( CUtlBuffer &buffer, CUtlVector<CUtlStri
 	return false;
 }
 
+#if defined(CLIENT_DLL) || defined(GAME_DLL)
+//-----------------------------------------------------------------------------
+// Parsed schema text is cached as binary KeyValues in the DEFAULT_WRITE_PATH,
+// keyed by the SHA-1 of the text, so unchanged files load without a text parse.
+// -noschemacache turns this off.
+//-----------------------------------------------------------------------------
+#define ECON_SCHEMA_CACHE_ID		MAKEID('E','S','K','V')
+#define ECON_SCHEMA_CACHE_VERSION	1
+
+struct EconSchemaCacheHeader_t
+{
+	uint32	m_nId;
+	uint32	m_nVersion;
+	uint32	m_nTextSize;
+	uint32	m_nDataSize;				// binary KeyValues following the header
+	unsigned char m_sha[ k_cubHash ];	// of the text
+};
+
+static void GetSchemaCacheFileName( const char *pszName, char *pszFileName, int nFileNameSize )
+{
+#ifdef CLIENT_DLL
+	V_snprintf( pszFileName, nFileNameSize, "cache/%s_client.kvb", pszName );
+#else
+	V_snprintf( pszFileName, nFileNameSize, "cache/%s_server.kvb", pszName );
+#endif
+}
+
+static KeyValues *ReadSchemaCache( const char *pszName, const unsigned char *pSHA, int nTextSize )
+{
+	char szFileName[ MAX_PATH ];
+	GetSchemaCacheFileName( pszName, szFileName, sizeof( szFileName ) );
+
+	CUtlBuffer buf;
+	if ( !g_pFullFileSystem->ReadFile( szFileName, "DEFAULT_WRITE_PATH", buf ) )
+		return NULL;
+
+	EconSchemaCacheHeader_t header;
+	if ( buf.TellPut() < (int)sizeof( header ) )
+		return NULL;
+
+	buf.Get( &header, sizeof( header ) );
+	if ( header.m_nId != ECON_SCHEMA_CACHE_ID || header.m_nVersion != ECON_SCHEMA_CACHE_VERSION ||
+		 header.m_nTextSize != (uint32)nTextSize || V_memcmp( header.m_sha, pSHA, k_cubHash ) != 0 ||
+		 header.m_nDataSize != (uint32)( buf.TellPut() - sizeof( header ) ) )
+		return NULL;
+
+	KeyValues *pKV = new KeyValues( "CEconItemSchema" );
+	if ( !pKV->ReadAsBinary( buf ) )
+	{
+		pKV->deleteThis();
+		return NULL;
+	}
+	return pKV;
+}
+
+static void WriteSchemaCache( const char *pszName, KeyValues *pKV, const unsigned char *pSHA, int nTextSize )
+{
+	char szFileName[ MAX_PATH ];
+	GetSchemaCacheFileName( pszName, szFileName, sizeof( szFileName ) );
+
+	EconSchemaCacheHeader_t header;
+	V_memset( &header, 0, sizeof( header ) );
+	header.m_nId = ECON_SCHEMA_CACHE_ID;
+	header.m_nVersion = ECON_SCHEMA_CACHE_VERSION;
+	header.m_nTextSize = nTextSize;
+	V_memcpy( header.m_sha, pSHA, k_cubHash );
+
+	CUtlBuffer buf;
+	buf.Put( &header, sizeof( header ) );
+	if ( !pKV->WriteAsBinary( buf ) )
+		return;
+
+	// a torn write fails the size check on the next load
+	( (EconSchemaCacheHeader_t *)buf.Base() )->m_nDataSize = buf.TellPut() - sizeof( header );
+	g_pFullFileSystem->CreateDirHierarchy( "cache", "DEFAULT_WRITE_PATH" );
+	g_pFullFileSystem->WriteFile( szFileName, "DEFAULT_WRITE_PATH", buf );
+}
+
+//-----------------------------------------------------------------------------
+// A run of consecutive top level keys of the schema text, parsed as one job
+//-----------------------------------------------------------------------------
+struct SchemaTextSection_t
+{
+	const char	*m_pText;
+	int			m_nSize;
+	KeyValues	*m_pKV;		// holds the run's keys once parsed, NULL if that failed
+};
+
+enum ESchemaTextToken
+{
+	k_ESchemaTextToken_Error,
+	k_ESchemaTextToken_EOF,
+	k_ESchemaTextToken_String,
+	k_ESchemaTextToken_Open,
+	k_ESchemaTextToken_Close,
+	k_ESchemaTextToken_Other,	// #base/#include and conditionals
+};
+
+// Tokenizes the same way KeyValues::ReadToken does without escape sequences
+static ESchemaTextToken NextSchemaTextToken( const char *pText, int nSize, int &nPos, int *pnTokenStart = NULL )
+{
+	while ( nPos < nSize )
+	{
+		if ( isspace( (unsigned char)pText[nPos] ) )
+		{
+			nPos++;
+		}
+		else if ( pText[nPos] == '/' && nPos + 1 < nSize && pText[nPos + 1] == '/' )
+		{
+			while ( nPos < nSize && pText[nPos] != '\n' )
+				nPos++;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	if ( nPos >= nSize || pText[nPos] == 0 )
+		return k_ESchemaTextToken_EOF;
+
+	if ( pnTokenStart )
+	{
+		*pnTokenStart = nPos;
+	}
+	char c = pText[nPos++];
+	if ( c == '"' )
+	{
+		while ( nPos < nSize && pText[nPos] != '"' )
+		{
+			// the no escape conversion still has an escape character
+			if ( pText[nPos] == 0x7F || pText[nPos] == 0 )
+				return k_ESchemaTextToken_Error;
+			nPos++;
+		}
+		if ( nPos >= nSize )
+			return k_ESchemaTextToken_Error;
+		nPos++;
+		return k_ESchemaTextToken_String;
+	}
+
+	if ( c == '{' )
+		return k_ESchemaTextToken_Open;
+	if ( c == '}' )
+		return k_ESchemaTextToken_Close;
+
+	bool bOther = ( c == '#' || c == '[' );
+	while ( nPos < nSize && pText[nPos] && !isspace( (unsigned char)pText[nPos] ) && pText[nPos] != '"' && pText[nPos] != '{' && pText[nPos] != '}' )
+	{
+		bOther = bOther || pText[nPos] == '[';
+		nPos++;
+	}
+	return bOther ? k_ESchemaTextToken_Other : k_ESchemaTextToken_String;
+}
+
+//-----------------------------------------------------------------------------
+// Splits text with a single root key into runs of the root's subkeys.  Returns
+// false if the text uses anything the split doesn't handle (#base, #include,
+// conditionals on top level keys, several roots), it is then parsed in one go.
+//-----------------------------------------------------------------------------
+static bool BSplitSchemaText( const char *pText, int nSize, CUtlString &sRootName, CUtlVector<SchemaTextSection_t> &vecSections )
+{
+	int nPos = 0;
+	int nStart = 0;
+	if ( NextSchemaTextToken( pText, nSize, nPos, &nStart ) != k_ESchemaTextToken_String )
+		return false;
+
+	// the root name, without its quotes
+	if ( pText[nStart] == '"' )
+	{
+		sRootName.SetDirect( pText + nStart + 1, nPos - nStart - 2 );
+	}
+	else
+	{
+		sRootName.SetDirect( pText + nStart, nPos - nStart );
+	}
+
+	if ( NextSchemaTextToken( pText, nSize, nPos ) != k_ESchemaTextToken_Open )
+		return false;
+
+	// aim for enough runs to keep the thread pool busy, but don't split small keys apart
+	const int nTargetSize = MAX( 64 * 1024, nSize / 32 );
+	int nRunStart = -1;
+	while ( 1 )
+	{
+		int nKeyStart = 0;
+		ESchemaTextToken eToken = NextSchemaTextToken( pText, nSize, nPos, &nKeyStart );
+		if ( eToken == k_ESchemaTextToken_Close )
+			break;
+		if ( eToken != k_ESchemaTextToken_String )
+			return false;
+
+		eToken = NextSchemaTextToken( pText, nSize, nPos );
+		if ( eToken == k_ESchemaTextToken_Open )
+		{
+			int nDepth = 1;
+			while ( nDepth > 0 )
+			{
+				eToken = NextSchemaTextToken( pText, nSize, nPos );
+				if ( eToken == k_ESchemaTextToken_Open )
+					nDepth++;
+				else if ( eToken == k_ESchemaTextToken_Close )
+					nDepth--;
+				else if ( eToken == k_ESchemaTextToken_EOF || eToken == k_ESchemaTextToken_Error )
+					return false;
+			}
+		}
+		else if ( eToken != k_ESchemaTextToken_String )
+		{
+			return false;
+		}
+
+		if ( nRunStart < 0 )
+		{
+			nRunStart = nKeyStart;
+		}
+		if ( nPos - nRunStart >= nTargetSize )
+		{
+			SchemaTextSection_t &section = vecSections[ vecSections.AddToTail() ];
+			section.m_pText = pText + nRunStart;
+			section.m_nSize = nPos - nRunStart;
+			section.m_pKV = NULL;
+			nRunStart = -1;
+		}
+	}
+
+	if ( nRunStart >= 0 )
+	{
+		SchemaTextSection_t &section = vecSections[ vecSections.AddToTail() ];
+		section.m_pText = pText + nRunStart;
+		section.m_nSize = nPos - 1 - nRunStart;
+		section.m_pKV = NULL;
+	}
+
+	return NextSchemaTextToken( pText, nSize, nPos ) == k_ESchemaTextToken_EOF;
+}
+
+static void ParseSchemaTextSection( SchemaTextSection_t &section )
+{
+	// wrap the run in a key of its own so KeyValues parses it as one block
+	CUtlBuffer buf( 0, section.m_nSize + 16, CUtlBuffer::TEXT_BUFFER );
+	buf.PutString( "\"section\"\n{\n" );
+	buf.Put( section.m_pText, section.m_nSize );
+	buf.PutString( "\n}\n" );
+
+	section.m_pKV = new KeyValues( "section" );
+	if ( !section.m_pKV->LoadFromBuffer( NULL, buf ) )
+	{
+		section.m_pKV->deleteThis();
+		section.m_pKV = NULL;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Parses schema text, or loads it from the cache when the text is unchanged.
+// The root's subkeys are parsed in parallel and put back together in file
+// order, so the result is the same as a single LoadFromBuffer.
+//-----------------------------------------------------------------------------
+static KeyValues *LoadSchemaKeyValues( const char *pszCacheName, const char *pszResourceName, CUtlBuffer &bufText )
+{
+	const char *pText = (const char *)bufText.PeekGet();
+	int nSize = bufText.GetBytesRemaining();
+
+	unsigned char sha[ k_cubHash ];
+	GenerateHash( sha, pText, nSize );
+
+	const bool bUseCache = !CommandLine()->FindParm( "-noschemacache" );
+	if ( bUseCache )
+	{
+		KeyValues *pKV = ReadSchemaCache( pszCacheName, sha, nSize );
+		if ( pKV )
+			return pKV;
+	}
+
+	CUtlString sRootName;
+	CUtlVector<SchemaTextSection_t> vecSections;
+	if ( !BSplitSchemaText( pText, nSize, sRootName, vecSections ) )
+	{
+		// includes or conditionals at the top level, which also means the text alone can't key a cache
+		KeyValues *pKV = new KeyValues( "CEconItemSchema" );
+		if ( !pKV->LoadFromBuffer( pszResourceName, bufText, g_pFullFileSystem, "GAME" ) )
+		{
+			pKV->deleteThis();
+			return NULL;
+		}
+		return pKV;
+	}
+
+	ParallelProcess( "LoadSchemaKeyValues", vecSections.Base(), vecSections.Count(), &ParseSchemaTextSection );
+
+	bool bSuccess = true;
+	KeyValues *pKV = new KeyValues( sRootName.Get() );
+	FOR_EACH_VEC( vecSections, i )
+	{
+		KeyValues *pKVSection = vecSections[i].m_pKV;
+		if ( !pKVSection )
+		{
+			bSuccess = false;
+			continue;
+		}
+
+		// move the keys over in file order
+		for ( KeyValues *pKVSub = pKVSection->GetFirstSubKey(); pKVSub; pKVSub = pKVSection->GetFirstSubKey() )
+		{
+			pKVSection->RemoveSubKey( pKVSub );
+			pKV->AddSubKey( pKVSub );
+		}
+		pKVSection->deleteThis();
+	}
+
+	if ( !bSuccess )
+	{
+		pKV->deleteThis();
+		return NULL;
+	}
+
+	if ( bUseCache )
+	{
+		WriteSchemaCache( pszCacheName, pKV, sha, nSize );
+	}
+	return pKV;
+}
+#endif // CLIENT_DLL || GAME_DLL
+
 unsigned char g_sha1ItemSchemaText[ k_cubHash ];
 
 //-----------------------------------------------------------------------------
@@ -6300,8 +6638,13 @@ bool CEconItemSchema::BInitTextBuffer( CUtlBuffer &buffer, CUtlVector<CUtlString
 	GenerateHash( g_sha1ItemSchemaText, buffer.Base(), buffer.TellPut() );
 
 	Reset();
+#if defined(CLIENT_DLL) || defined(GAME_DLL)
+	m_pKVRawDefinition = LoadSchemaKeyValues( "items_game", NULL, buffer );
+	if ( m_pKVRawDefinition )
+#else
 	m_pKVRawDefinition = new KeyValues( "CEconItemSchema" );
 	if ( m_pKVRawDefinition->LoadFromBuffer( NULL, buffer ) )
+#endif
 	{
 		return BInitSchema( m_pKVRawDefinition, pVecErrors )
 			&& BPostSchemaInit( pVecErrors );
@@ -6675,8 +7018,18 @@ bool CEconItemSchema::BInitSchema( KeyValues *pKVRawDefinition, CUtlVector<CUtlS
 	// TF2 Paint Kits
 	// No included in schema file (Too Big).  Loaded Seperately
 	// Load the KV and add it to the pKVRawDefinition
+#if defined(CLIENT_DLL) || defined(GAME_DLL)
+	CUtlBuffer bufPaintkits( 0, 0, CUtlBuffer::TEXT_BUFFER );
+	KeyValues *pPaintkitKV = NULL;
+	if ( g_pFullFileSystem->ReadFile( "scripts/items/paintkits_master.txt", "GAME", bufPaintkits ) )
+	{
+		pPaintkitKV = LoadSchemaKeyValues( "paintkits_master", "scripts/items/paintkits_master.txt", bufPaintkits );
+	}
+	SCHEMA_INIT_CHECK( NULL != pPaintkitKV, "Unable to Load paintkits_master.txt KV File!" );
+#else
 	KeyValues *pPaintkitKV = new KeyValues( "item_paintkit_definitions" );
 	SCHEMA_INIT_CHECK( pPaintkitKV->LoadFromFile( g_pFullFileSystem, "scripts/items/paintkits_master.txt", "GAME" ), "Unable to Load paintkits_master.txt KV File!" );
+#endif
 	pKVRawDefinition->AddSubKey( pPaintkitKV );
 
 	// Init Item Paint Kits
@@ -7353,6 +7706,61 @@ bool CEconItemSchema::BInitAttributes( KeyValues *pKVAttributes, CUtlVector<CUtl
 }
 
 
+#if defined(CLIENT_DLL) || defined(GAME_DLL)
+//-----------------------------------------------------------------------------
+// Merging prefabs is most of the work of initializing an item definition and
+// only reads the prefabs, so BInitItems does it for every item up front on the
+// thread pool.  Merges that aren't taken because the init failed part way are
+// freed with the jobs.
+//-----------------------------------------------------------------------------
+struct ItemPrefabMergeJob_t
+{
+	KeyValues	*m_pKVItem;
+	KeyValues	*m_pKVMerged;
+};
+
+static void MergeItemDefinitionPrefab( ItemPrefabMergeJob_t &job )
+{
+	job.m_pKVMerged = new KeyValues( job.m_pKVItem->GetName() );
+	MergeDefinitionPrefab( job.m_pKVMerged, job.m_pKVItem );
+}
+
+class CItemPrefabMerges
+{
+public:
+	CItemPrefabMerges( KeyValues *pKVItems )
+	{
+		FOR_EACH_TRUE_SUBKEY( pKVItems, pKVItem )
+		{
+			ItemPrefabMergeJob_t job = { pKVItem, NULL };
+			m_vecJobs.AddToTail( job );
+		}
+		ParallelProcess( "CEconItemSchema::BInitItems", m_vecJobs.Base(), m_vecJobs.Count(), &MergeItemDefinitionPrefab );
+	}
+
+	~CItemPrefabMerges()
+	{
+		FOR_EACH_VEC( m_vecJobs, i )
+		{
+			if ( m_vecJobs[i].m_pKVMerged )
+				m_vecJobs[i].m_pKVMerged->deleteThis();
+		}
+	}
+
+	// Hands over the merge for the i'th item
+	KeyValues *Take( int i )
+	{
+		Assert( m_vecJobs[i].m_pKVMerged );
+		KeyValues *pKVMerged = m_vecJobs[i].m_pKVMerged;
+		m_vecJobs[i].m_pKVMerged = NULL;
+		return pKVMerged;
+	}
+
+private:
+	CUtlVector<ItemPrefabMergeJob_t> m_vecJobs;
+};
+#endif // CLIENT_DLL || GAME_DLL
+
 //-----------------------------------------------------------------------------
 // Purpose:	Initializes the items section of the schema
 // Input:	pKVItems - The items section of the KeyValues 
@@ -7382,8 +7790,15 @@ bool CEconItemSchema::BInitItems( KeyValues *pKVItems, CUtlVector<CUtlString> *p
 	// initialize the item definitions
 	if ( NULL != pKVItems )
 	{
+#if defined(CLIENT_DLL) || defined(GAME_DLL)
+		CItemPrefabMerges prefabMerges( pKVItems );
+		int iNextItem = 0;
+#endif
 		FOR_EACH_TRUE_SUBKEY( pKVItems, pKVItem )
 		{
+#if defined(CLIENT_DLL) || defined(GAME_DLL)
+			const int iItem = iNextItem++;
+#endif
 			if ( Q_stricmp( pKVItem->GetName(), "default" ) == 0 )
 			{
 #if defined(CLIENT_DLL) || defined(GAME_DLL)
@@ -7392,6 +7807,7 @@ bool CEconItemSchema::BInitItems( KeyValues *pKVItems, CUtlVector<CUtlString> *p
 					"Duplicate 'default' item definition." );
 
 				m_pDefaultItemDefinition = CreateEconItemDefinition();
+				m_pDefaultItemDefinition->SetPrefabMergedDefinition( prefabMerges.Take( iItem ) );
 				SCHEMA_INIT_SUBSTEP( m_pDefaultItemDefinition->BInitFromKV( pKVItem, pVecErrors ) );
 #endif
 			}
@@ -7413,6 +7829,9 @@ bool CEconItemSchema::BInitItems( KeyValues *pKVItems, CUtlVector<CUtlString> *p
 				CEconItemDefinition *pItemDef = CreateEconItemDefinition();
 				nMapIndex = m_mapItems.Insert( nItemIndex, pItemDef );
 				m_mapItemsSorted.Insert( nItemIndex, pItemDef );
+#if defined(CLIENT_DLL) || defined(GAME_DLL)
+				pItemDef->SetPrefabMergedDefinition( prefabMerges.Take( iItem ) );
+#endif
 				SCHEMA_INIT_SUBSTEP( m_mapItems[nMapIndex]->BInitFromKV( pKVItem, pVecErrors ) );
 
 				// Cache off Tools references
@@ -1331,6 +1331,10 @@ public:
 
 	bool		BInitItemMappings( CUtlVector<CUtlString> *pVecErrors );
 
+	// The schema merges prefabs for all the items in parallel ahead of BInitFromKV, which
+	// then takes ownership of the result instead of doing the merge itself.
+	void		SetPrefabMergedDefinition( KeyValues *pKVMerged )	{ Assert( !m_pKVPrefabMerged ); m_pKVPrefabMerged = pKVMerged; }
+
 	void		BInitVisualBlockFromKV( KeyValues *pKVItem, CUtlVector<CUtlString> *pVecErrors = NULL );
 	void		BInitStylesBlockFromKV( KeyValues *pKVStyles, perteamvisuals_t *pVisData, CUtlVector<CUtlString> *pVecErrors );
 
@@ -1564,6 +1568,9 @@ private:
 	// Pointer to the raw KeyValue definition of the item
 	KeyValues *	m_pKVItem;
 
+	// Set by SetPrefabMergedDefinition until BInitFromKV uses it
+	KeyValues *	m_pKVPrefabMerged;
+
 	// Required values from m_pKVItem:
 
 	// The number used to refer to this definition in the DB
@@ -9,6 +9,7 @@
 
 #include "tf_ladder_data.h"
 #include "gcsdk/enumutils.h"
+#include "tier1/generichash.h"
 
 #ifdef CLIENT_DLL
 #include "econ/confirm_dialog.h"
@@ -104,6 +105,13 @@ bool CSOTFLadderData::BIsKeyLess( const CSharedObject & soRHS ) const
 	return obj.season_id() < rhs.season_id();
 }
 
+uint32 CSOTFLadderData::GetKeyHash() const
+{
+	const CSOTFLadderPlayerStats &obj = Obj();
+	uint32 unKey[3] = { obj.account_id(), (uint32)obj.match_group(), obj.season_id() };
+	return MurmurHash2( unKey, sizeof( unKey ), 0 );
+}
+
 //-----------------------------------------------------------------------------
 bool CSOTFLadderData::BYieldingAddInsertToTransaction( GCSDK::CSQLAccess & sqlAccess )
 {
@@ -336,6 +344,13 @@ bool CSOTFMatchResultPlayerInfo::BIsKeyLess( const CSharedObject & soRHS ) const
 	return obj.season_id() < rhs.season_id();
 }
 
+uint32 CSOTFMatchResultPlayerInfo::GetKeyHash() const
+{
+	const CSOTFMatchResultPlayerStats &obj = Obj();
+	uint32 unKey[2] = { (uint32)obj.match_group(), obj.season_id() };
+	return MurmurHash2( unKey, sizeof( unKey ), 0 );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -36,6 +36,7 @@ public:
 	DECLARE_CLASS_MEMPOOL( CSOTFLadderData );
 
 	virtual bool BIsKeyLess( const CSharedObject & soRHS ) const OVERRIDE;
+	virtual uint32 GetKeyHash() const OVERRIDE;
 
 	virtual bool BYieldingAddInsertToTransaction( GCSDK::CSQLAccess & sqlAccess ) OVERRIDE;
 	virtual bool BYieldingAddWriteToTransaction( GCSDK::CSQLAccess & sqlAccess, const CUtlVector< int > &fields ) OVERRIDE;
@@ -64,6 +65,7 @@ public:
 	CSOTFMatchResultPlayerInfo( uint32 unAccountID );
 
 	virtual bool BIsKeyLess( const CSharedObject & soRHS ) const OVERRIDE;
+	virtual uint32 GetKeyHash() const OVERRIDE;
 
 	virtual bool BYieldingAddInsertToTransaction( GCSDK::CSQLAccess & sqlAccess ) OVERRIDE;
 	virtual bool BYieldingAddWriteToTransaction( GCSDK::CSQLAccess & sqlAccess, const CUtlVector< int > &fields ) OVERRIDE;
@@ -4,6 +4,7 @@
 
 #include "tf_rating_data.h"
 #include "gcsdk/enumutils.h"
+#include "tier1/generichash.h"
 
 #ifdef CLIENT_DLL
 #include "tf_matchmaking_shared.h"
@@ -92,6 +93,14 @@ bool CTFRatingData::BIsKeyLess( const CSharedObject & soRHS ) const
 	return obj.rating_type() < rhs.rating_type();
 }
 
+//-----------------------------------------------------------------------------
+uint32 CTFRatingData::GetKeyHash() const
+{
+	const CSOTFRatingData &obj = Obj();
+	uint32 unKey[2] = { obj.account_id(), (uint32)obj.rating_type() };
+	return MurmurHash2( unKey, sizeof( unKey ), 0 );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: This is a database backed object, but, all mutations to these
 //          should go through BYieldingUpdateRatingAndAddToTransaction and its
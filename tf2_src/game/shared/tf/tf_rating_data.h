@@ -48,6 +48,7 @@ public:
 	virtual bool BIsDatabaseBacked() const OVERRIDE { return true; }
 
 	virtual bool BIsKeyLess( const CSharedObject & soRHS ) const OVERRIDE;
+	virtual uint32 GetKeyHash() const OVERRIDE;
 
 	// We purposefully pass false to our template to make Obj() immutable -- these calls currently are just hooked up to
 	// assert.  All database writes should go through BYieldingUpdateRatingAndAddToTransaction, or it's SOCache helper.
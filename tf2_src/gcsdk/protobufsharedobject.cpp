@@ -10,6 +10,7 @@
 #include "google/protobuf/descriptor.h"
 #include "google/protobuf/reflection_ops.h"
 #include "google/protobuf/descriptor.pb.h"
+#include "tier1/generichash.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -382,6 +383,56 @@ bool CProtoBufSharedObjectBase::BIsKeyLess( const CSharedObject & soRHS  ) const
 	return false;
 }
 
+//----------------------------------------------------------------------------
+// Purpose: hashes a field into unSeed so that fields IsProtoBufFieldLess
+//			considers equal hash the same. Floats and messages are left out
+//			since they don't compare in a way that can be hashed.
+//----------------------------------------------------------------------------
+static uint32 HashProtoBufField( const ::google::protobuf::Message & msg, const ::google::protobuf::FieldDescriptor *pField, uint32 unSeed )
+{
+	const ::google::protobuf::Reflection *pReflection = msg.GetReflection();
+	uint64 unValue;
+	switch( pField->cpp_type() )
+	{
+		case ::google::protobuf::FieldDescriptor::CPPTYPE_INT32:	unValue = (uint64)(int64)pReflection->GetInt32( msg, pField );		break;
+		case ::google::protobuf::FieldDescriptor::CPPTYPE_UINT32:	unValue = pReflection->GetUInt32( msg, pField );					break;
+		case ::google::protobuf::FieldDescriptor::CPPTYPE_INT64:	unValue = (uint64)pReflection->GetInt64( msg, pField );				break;
+		case ::google::protobuf::FieldDescriptor::CPPTYPE_UINT64:	unValue = pReflection->GetUInt64( msg, pField );					break;
+		case ::google::protobuf::FieldDescriptor::CPPTYPE_BOOL:		unValue = pReflection->GetBool( msg, pField ) ? 1 : 0;				break;
+		case ::google::protobuf::FieldDescriptor::CPPTYPE_ENUM:		unValue = (uint64)(int64)pReflection->GetEnum( msg, pField )->number();	break;
+
+		case ::google::protobuf::FieldDescriptor::CPPTYPE_STRING:
+			// compared with Q_stricmp
+			return MurmurHash2LowerCase( pReflection->GetString( msg, pField ).c_str(), unSeed );
+
+		default:
+			return unSeed;
+	}
+
+	return MurmurHash2( &unValue, sizeof( unValue ), unSeed );
+}
+
+//----------------------------------------------------------------------------
+// Purpose: Combines the hashes of the key fields
+//----------------------------------------------------------------------------
+uint32 CProtoBufSharedObjectBase::GetKeyHash() const
+{
+	const ::google::protobuf::Message & msg = *GetPObject();
+	const ::google::protobuf::Descriptor *pDescriptor = msg.GetDescriptor();
+
+	uint32 unHash = 0;
+	for( int nField = 0; nField < pDescriptor->field_count(); nField++ )
+	{
+		const ::google::protobuf::FieldDescriptor *pFieldDescriptor = pDescriptor->field( nField );
+		if( !IsKeyField( pFieldDescriptor ) )
+			continue;
+
+		unHash = HashProtoBufField( msg, pFieldDescriptor, unHash );
+	}
+
+	return unHash;
+}
+
 
 void CProtoBufSharedObjectBase::RecursiveAddProtoBufToKV( KeyValues *pKVDest, const ::google::protobuf::Message & msg )
 {
@@ -4,6 +4,7 @@
 //
 //=============================================================================
 #include "stdafx.h"
+#include "tier1/generichash.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -224,6 +225,27 @@ bool CSchemaSharedObjectBase::BIsKeyLess( const CSharedObject & soRHS ) const
 }
 
 
+//----------------------------------------------------------------------------
+// Purpose: Hashes the raw primary key columns that BIsKeyLess compares
+//----------------------------------------------------------------------------
+uint32 CSchemaSharedObjectBase::GetKeyHash() const
+{
+	CColumnSet csPK( GetPObject()->GetPSchema()->GetRecordInfo() );
+	csPK.MakePrimaryKey();
+
+	uint32 unHash = 0;
+	FOR_EACH_COLUMN_IN_SET( csPK, unColumnIndex )
+	{
+		uint8 *pubData;
+		uint32 cubData;
+		DbgVerify( GetPObject()->BGetField( csPK.GetColumn( unColumnIndex ), &pubData, &cubData ) );
+		unHash = MurmurHash2( pubData, cubData, unHash );
+	}
+
+	return unHash;
+}
+
+
 //----------------------------------------------------------------------------
 // Purpose: Copy the data from the specified schema shared object into this. 
 //			Both objects must be of the same type.
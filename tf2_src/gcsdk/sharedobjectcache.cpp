@@ -21,7 +21,8 @@ static GCConVar add_object_clean_do_has_element( "add_object_clean_do_has_elemen
 // Purpose: Constructor
 //----------------------------------------------------------------------------
 CSharedObjectTypeCache::CSharedObjectTypeCache( int nTypeID )
-: m_nTypeID( nTypeID )
+: m_nUnhashedObjects( 0 )
+, m_nTypeID( nTypeID )
 {
 
 }
@@ -53,6 +54,7 @@ CSharedObjectTypeCache::~CSharedObjectTypeCache()
 #endif
 	}
 	m_vecObjects.Purge();
+	m_hashObjects.Purge();
 }
 
 //----------------------------------------------------------------------------
@@ -64,6 +66,14 @@ void CSharedObjectTypeCache::AddObjectInternal( CSharedObject *pObject )
 	Assert( pObject );
 
 	m_vecObjects.AddToTail( pObject );
+
+	bool bInserted;
+	m_hashObjects.Insert( pObject, m_vecObjects.Count() - 1, &bInserted );
+	if ( !bInserted )
+	{
+		// another object already has this key and keeps being the one that's found
+		m_nUnhashedObjects++;
+	}
 #ifdef GC
 #if ENABLE_SO_CONSTRUCT_DESTRUCT_PARANOIA
 	AssertMsg1( pObject->m_nRefCount >= 0, "AddObjectInternal(): Invalid ref count for shared object %s", pObject->GetDebugString().String() );
@@ -136,10 +146,67 @@ CSharedObject *CSharedObjectTypeCache::RemoveObjectByIndex( uint32 nObj )
 	--pObj->m_nRefCount;
 #endif // ENABLE_SO_CONSTRUCT_DESTRUCT_PARANOIA
 #endif // GC
-	m_vecObjects.Remove( nObj );
+	m_vecObjects.FastRemove( nObj );
+
+	// the last object took the removed one's slot
+	if ( nObj < (uint32)m_vecObjects.Count() )
+	{
+		CSharedObject *pMoved = m_vecObjects[nObj];
+		UtlHashHandle_t hMoved = m_hashObjects.Find( pMoved );
+		if ( hMoved != m_hashObjects.InvalidHandle() && m_hashObjects.Key( hMoved ) == pMoved )
+		{
+			m_hashObjects[hMoved] = nObj;
+		}
+	}
+
+	RemoveObjectFromKeyHash( pObj );
 	return pObj;
 }
 
+
+//----------------------------------------------------------------------------
+// Purpose: Takes an object that was just removed from m_vecObjects out of the
+//			key hash. If another object had the same key it takes its place.
+//----------------------------------------------------------------------------
+void CSharedObjectTypeCache::RemoveObjectFromKeyHash( CSharedObject *pObject )
+{
+	UtlHashHandle_t hObject = m_hashObjects.Find( pObject );
+	if ( hObject == m_hashObjects.InvalidHandle() || m_hashObjects.Key( hObject ) != pObject )
+	{
+		// Either one of the duplicates that were never in the hash, or the key
+		// changed while the object was in the cache. Tell them apart the slow way.
+		for ( hObject = m_hashObjects.FirstHandle(); hObject != m_hashObjects.InvalidHandle(); hObject = m_hashObjects.NextHandle( hObject ) )
+		{
+			if ( m_hashObjects.Key( hObject ) == pObject )
+				break;
+		}
+
+		if ( hObject == m_hashObjects.InvalidHandle() )
+		{
+			Assert( m_nUnhashedObjects > 0 );
+			m_nUnhashedObjects--;
+			return;
+		}
+
+		AssertMsg1( false, "Key of shared object %s changed while it was in the cache", pObject->GetDebugString().String() );
+	}
+
+	m_hashObjects.RemoveByHandle( hObject );
+
+	if ( m_nUnhashedObjects > 0 )
+	{
+		FOR_EACH_VEC( m_vecObjects, nObj )
+		{
+			if ( m_vecObjects[nObj]->BIsKeyEqual( *pObject ) )
+			{
+				m_hashObjects.Insert( m_vecObjects[nObj], nObj );
+				m_nUnhashedObjects--;
+				break;
+			}
+		}
+	}
+}
+
 //----------------------------------------------------------------------------
 // Purpose: Empties the object lists and deletes all elements
 //----------------------------------------------------------------------------
@@ -161,6 +228,8 @@ void CSharedObjectTypeCache::DestroyAllObjects()
 #endif
 	}
 	m_vecObjects.Purge();
+	m_hashObjects.Purge();
+	m_nUnhashedObjects = 0;
 }
 
 
@@ -170,6 +239,8 @@ void CSharedObjectTypeCache::DestroyAllObjects()
 void CSharedObjectTypeCache::RemoveAllObjectsWithoutDeleting()
 {
 	m_vecObjects.RemoveAll();
+	m_hashObjects.RemoveAll();
+	m_nUnhashedObjects = 0;
 }
 
 
@@ -180,6 +251,7 @@ void CSharedObjectTypeCache::RemoveAllObjectsWithoutDeleting()
 void CSharedObjectTypeCache::EnsureCapacity( uint32 nItems )
 {
 	m_vecObjects.EnsureCapacity( nItems );
+	m_hashObjects.Reserve( nItems );
 }
 
 
@@ -189,27 +261,26 @@ void CSharedObjectTypeCache::EnsureCapacity( uint32 nItems )
 //----------------------------------------------------------------------------
 CSharedObject *CSharedObjectTypeCache::FindSharedObject( const CSharedObject & soIndex )
 {
-	int nIndex = FindSharedObjectIndex( soIndex );
-	if( m_vecObjects.IsValidIndex( nIndex ) )
-		return m_vecObjects[nIndex];
+	UtlHashHandle_t hObject = m_hashObjects.Find( const_cast<CSharedObject *>( &soIndex ) );
+	if( hObject != m_hashObjects.InvalidHandle() )
+		return m_hashObjects.Key( hObject );
 	else
 		return NULL;
 }
 
 
 //----------------------------------------------------------------------------
-// Purpose: Searches the object list for an object that matches the provided
-//			object on its index fields.
+// Purpose: Returns the position in the object list of the object that matches
+//			the provided object on its index fields.
 //----------------------------------------------------------------------------
 int CSharedObjectTypeCache::FindSharedObjectIndex( const CSharedObject & soIndex ) const
 {
-	FOR_EACH_VEC( m_vecObjects, nObj )
-	{
-		if( m_vecObjects[nObj]->BIsKeyEqual( soIndex ) )
-			return nObj;
-	}
+	UtlHashHandle_t hObject = m_hashObjects.Find( const_cast<CSharedObject *>( &soIndex ) );
+	if( hObject == m_hashObjects.InvalidHandle() )
+		return -1;
 
-	return -1;
+	Assert( m_vecObjects[ m_hashObjects[hObject] ] == m_hashObjects.Key( hObject ) );
+	return m_hashObjects[hObject];
 }
 
 
@@ -1372,6 +1372,61 @@ void WorldSpaceSlerp(
 
 
 
+static ConVar anim_simdbones( "anim_simdbones", "1", FCVAR_REPLICATED, "Blend bones and build bone matrices four at a time with SIMD." );
+
+//-----------------------------------------------------------------------------
+// Purpose: slerp (or blend) q1 toward q2 four bones at a time.  pS2 holds the
+//			weight of q2 for each bone, bones with no weight are left alone.
+//			Matches QuaternionSlerp/QuaternionBlend per bone, including
+//			skipping the alignment for BONE_FIXED_ALIGNMENT bones.
+//-----------------------------------------------------------------------------
+static void BlendBoneQuaternionsSIMD( 
+	const CStudioHdr *pStudioHdr,
+	Quaternion q1[MAXSTUDIOBONES], 
+	const Quaternion q2[MAXSTUDIOBONES], 
+	const float *pS2,
+	int nBoneCount,
+	bool bSlerp )
+{
+	// only gather the bones that change so every group of four does real work
+	int *pBones = (int*)stackalloc( nBoneCount * sizeof(int) );
+	int nBones = 0;
+	for ( int i = 0; i < nBoneCount; i++ )
+	{
+		if ( pS2[i] > 0.0f )
+		{
+			pBones[nBones++] = i;
+		}
+	}
+
+	ALIGN16 float flS1[4] ALIGN16_POST;
+	ALIGN16 uint32 nFixedMask[4] ALIGN16_POST;
+	int iBone[4];
+	for ( int n = 0; n < nBones; n += 4 )
+	{
+		// a partial group repeats its last bone, which just stores the same result twice
+		for ( int k = 0; k < 4; k++ )
+		{
+			int i = pBones[ MIN( n + k, nBones - 1 ) ];
+			iBone[k] = i;
+			flS1[k] = 1.0 - pS2[i];
+			nFixedMask[k] = ( pStudioHdr->boneFlags(i) & BONE_FIXED_ALIGNMENT ) ? 0xFFFFFFFF : 0;
+		}
+
+		FourQuaternions p, q;
+		p.LoadAndSwizzle( q2[iBone[0]], q2[iBone[1]], q2[iBone[2]], q2[iBone[3]] );
+		q.LoadAndSwizzle( q1[iBone[0]], q1[iBone[1]], q1[iBone[2]], q1[iBone[3]] );
+
+		FourQuaternions qAligned = p.Align( q );
+		qAligned.MaskedAssign( LoadAlignedSIMD( (float *)nFixedMask ), q, qAligned );
+
+		fltx4 s1 = LoadAlignedSIMD( flS1 );
+		FourQuaternions result = bSlerp ? p.SlerpNoAlign( qAligned, s1 ) : p.BlendNoAlign( qAligned, s1 );
+		result.SwizzleAndStore( q1[iBone[0]], q1[iBone[1]], q1[iBone[2]], q1[iBone[3]] );
+	}
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: blend together q1,pos1 with q2,pos2.  Return result in q1,pos1.  
 //			0 returns q1, pos1.  1 returns q2, pos2
@@ -1481,6 +1536,12 @@ void SlerpBones(
 		return;
 	}
 
+	bool bSIMD = anim_simdbones.GetBool();
+	if ( bSIMD )
+	{
+		BlendBoneQuaternionsSIMD( pStudioHdr, q1, q2, pS2, nBoneCount, true );
+	}
+
 	QuaternionAligned q3;
 	for (i = 0; i < nBoneCount; i++)
 	{
@@ -1490,36 +1551,39 @@ void SlerpBones(
 
 		s1 = 1.0 - s2;
 
+		if ( !bSIMD )
+		{
 #ifdef _X360
-		fltx4  q1simd, q2simd, result;
-		q1simd = LoadUnalignedSIMD( q1[i].Base() );
-		q2simd = LoadAlignedSIMD( q2[i] );
+			fltx4  q1simd, q2simd, result;
+			q1simd = LoadUnalignedSIMD( q1[i].Base() );
+			q2simd = LoadAlignedSIMD( q2[i] );
 #endif
-		if ( pStudioHdr->boneFlags(i) & BONE_FIXED_ALIGNMENT )
-		{
+			if ( pStudioHdr->boneFlags(i) & BONE_FIXED_ALIGNMENT )
+			{
 #ifndef _X360
-			QuaternionSlerpNoAlign( q2[i], q1[i], s1, q3 );
+				QuaternionSlerpNoAlign( q2[i], q1[i], s1, q3 );
 #else
-			result = QuaternionSlerpNoAlignSIMD( q2simd, q1simd, s1 );
+				result = QuaternionSlerpNoAlignSIMD( q2simd, q1simd, s1 );
 #endif
-		}
-		else
-		{
+			}
+			else
+			{
 #ifndef _X360
-			QuaternionSlerp( q2[i], q1[i], s1, q3 );
+				QuaternionSlerp( q2[i], q1[i], s1, q3 );
 #else
-			result = QuaternionSlerpSIMD( q2simd, q1simd, s1 );
+				result = QuaternionSlerpSIMD( q2simd, q1simd, s1 );
 #endif
-		}
+			}
 
 #ifndef _X360
-		q1[i][0] = q3[0];
-		q1[i][1] = q3[1];
-		q1[i][2] = q3[2];
-		q1[i][3] = q3[3];
+			q1[i][0] = q3[0];
+			q1[i][1] = q3[1];
+			q1[i][2] = q3[2];
+			q1[i][3] = q3[3];
 #else
-		StoreUnalignedSIMD( q1[i].Base(), result );
+			StoreUnalignedSIMD( q1[i].Base(), result );
 #endif
+		}
 
 		pos1[i][0] = pos1[i][0] * s1 + pos2[i][0] * s2;
 		pos1[i][1] = pos1[i][1] * s1 + pos2[i][1] * s2;
@@ -1592,8 +1656,13 @@ void BlendBones(
 	float s2 = s;
 	float s1 = 1.0 - s2;
 
-	for (i = 0; i < pStudioHdr->numbones(); i++)
+	// Build weightlist for all bones
+	int nBoneCount = pStudioHdr->numbones();
+	float *pS2 = (float*)stackalloc( nBoneCount * sizeof(float) );
+	for (i = 0; i < nBoneCount; i++)
 	{
+		pS2[i] = 0.0f;
+
 		// skip unused bones
 		if (!(pStudioHdr->boneFlags(i) & boneMask))
 		{
@@ -1611,18 +1680,35 @@ void BlendBones(
 
 		if (j >= 0 && seqdesc.weight( j ) > 0.0)
 		{
-			if (pStudioHdr->boneFlags(i) & BONE_FIXED_ALIGNMENT)
-			{
-				QuaternionBlendNoAlign( q2[i], q1[i], s1, q3 );
-			}
-			else
+			pS2[i] = s2;
+		}
+	}
+
+	bool bSIMD = anim_simdbones.GetBool();
+	if ( bSIMD )
+	{
+		BlendBoneQuaternionsSIMD( pStudioHdr, q1, q2, pS2, nBoneCount, false );
+	}
+
+	for (i = 0; i < nBoneCount; i++)
+	{
+		if (pS2[i] > 0.0f)
+		{
+			if ( !bSIMD )
 			{
-				QuaternionBlend( q2[i], q1[i], s1, q3 );
+				if (pStudioHdr->boneFlags(i) & BONE_FIXED_ALIGNMENT)
+				{
+					QuaternionBlendNoAlign( q2[i], q1[i], s1, q3 );
+				}
+				else
+				{
+					QuaternionBlend( q2[i], q1[i], s1, q3 );
+				}
+				q1[i][0] = q3[0];
+				q1[i][1] = q3[1];
+				q1[i][2] = q3[2];
+				q1[i][3] = q3[3];
 			}
-			q1[i][0] = q3[0];
-			q1[i][1] = q3[1];
-			q1[i][2] = q3[2];
-			q1[i][3] = q3[3];
 			pos1[i][0] = pos1[i][0] * s1 + pos2[i][0] * s2;
 			pos1[i][1] = pos1[i][1] * s1 + pos2[i][1] * s2;
 			pos1[i][2] = pos1[i][2] * s1 + pos2[i][2] * s2;
@@ -4547,7 +4633,6 @@ void Studio_BuildMatrices(
 		}
 	}
 
-	matrix3x4_t bonematrix;
 	matrix3x4_t rotationmatrix; // model to world transformation
 	AngleMatrix( angles, origin, rotationmatrix );
 
@@ -4567,21 +4652,55 @@ void Studio_BuildMatrices(
 		VectorScale( rotationmatrix[2], flScale, rotationmatrix[2] );
 	}
 
+	// gather the bones to build, parents first.  Not in place: the chain is
+	// read from the end, so writing from the start would overwrite unread bones
+	int *pBones = (int *)stackalloc( MAX( chainlength, 1 ) * sizeof(int) );
+	int nBones = 0;
 	for (j = chainlength - 1; j >= 0; j--)
 	{
 		i = chain[j];
 		if (pStudioHdr->boneFlags(i) & boneMask)
 		{
-			QuaternionMatrix( q[i], pos[i], bonematrix );
+			pBones[nBones++] = i;
+		}
+	}
 
-			if (pStudioHdr->boneParent(i) == -1) 
-			{
-				ConcatTransforms (rotationmatrix, bonematrix, bonetoworld[i]);
-			} 
-			else 
-			{
-				ConcatTransforms (bonetoworld[pStudioHdr->boneParent(i)], bonematrix, bonetoworld[i]);
-			}
+	// the local matrices don't depend on each other, so build them four at a time
+	matrix3x4_t *pBoneMatrix = (matrix3x4_t *)stackalloc( ( nBones + 3 ) * sizeof(matrix3x4_t) );
+	if ( anim_simdbones.GetBool() )
+	{
+		for (j = 0; j < nBones; j += 4)
+		{
+			// a partial group repeats its last bone into the spare matrices at the end
+			int i0 = pBones[j];
+			int i1 = pBones[ MIN( j + 1, nBones - 1 ) ];
+			int i2 = pBones[ MIN( j + 2, nBones - 1 ) ];
+			int i3 = pBones[ MIN( j + 3, nBones - 1 ) ];
+
+			FourQuaternions q4;
+			q4.LoadAndSwizzle( q[i0], q[i1], q[i2], q[i3] );
+			q4.ToMatrices( pos[i0], pos[i1], pos[i2], pos[i3], 
+				pBoneMatrix[j], pBoneMatrix[j+1], pBoneMatrix[j+2], pBoneMatrix[j+3] );
+		}
+	}
+	else
+	{
+		for (j = 0; j < nBones; j++)
+		{
+			QuaternionMatrix( q[pBones[j]], pos[pBones[j]], pBoneMatrix[j] );
+		}
+	}
+
+	for (j = 0; j < nBones; j++)
+	{
+		i = pBones[j];
+		if (pStudioHdr->boneParent(i) == -1) 
+		{
+			ConcatTransforms (rotationmatrix, pBoneMatrix[j], bonetoworld[i]);
+		} 
+		else 
+		{
+			ConcatTransforms (bonetoworld[pStudioHdr->boneParent(i)], pBoneMatrix[j], bonetoworld[i]);
 		}
 	}
 }
@@ -42,6 +42,7 @@ public:
 	virtual bool BUpdateFromNetwork( const CSharedObject & objUpdate ) OVERRIDE;
 
 	virtual bool BIsKeyLess( const CSharedObject & soRHS ) const ;
+	virtual uint32 GetKeyHash() const OVERRIDE;
 	virtual void Copy( const CSharedObject & soRHS );
 	virtual void Dump() const OVERRIDE;
 
@@ -64,6 +64,7 @@ public:
 	virtual bool BUpdateFromNetwork( const CSharedObject & objUpdate ) { return false; }
 
 	virtual bool BIsKeyLess( const CSharedObject & soRHS ) const;
+	virtual uint32 GetKeyHash() const;
 	virtual void Copy( const CSharedObject & soRHS );
 	virtual void Dump() const;
 //	virtual bool BIsNetworkDirty() const { return false; }
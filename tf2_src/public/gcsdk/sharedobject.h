@@ -99,6 +99,11 @@ public:
 
 	bool BIsKeyEqual( const CSharedObject & soRHS ) const;
 
+	// Hash of the fields BIsKeyLess compares. Objects that are BIsKeyEqual must
+	// return the same hash. The default puts every object in the same bucket, so
+	// type caches fall back to comparing keys one by one.
+	virtual uint32 GetKeyHash() const { return 0; }
+
 	static void RegisterFactory( int nTypeID, SOCreationFunc_t fnFactory, uint32 unFlags, const char *pchClassName );
 	static CSharedObject *Create( int nTypeID );
 	static uint32 GetTypeFlags( int nTypeID );
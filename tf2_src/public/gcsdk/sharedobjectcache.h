@@ -11,6 +11,7 @@
 #endif
 
 #include "sharedobject.h"
+#include "tier1/utlhashtable.h"
 
 namespace GCSDK
 {
@@ -50,8 +51,26 @@ public:
 private:
 	int FindSharedObjectIndex( const CSharedObject & soIndex ) const;
 	void AddObjectInternal( CSharedObject *pObject );
+	void RemoveObjectFromKeyHash( CSharedObject *pObject );
 
+	struct KeyHashFunctor
+	{
+		unsigned int operator()( const CSharedObject *pObject ) const { return pObject->GetKeyHash(); }
+	};
+
+	struct KeyEqualFunctor
+	{
+		bool operator()( const CSharedObject *pLHS, const CSharedObject *pRHS ) const { return pLHS->BIsKeyEqual( *pRHS ); }
+	};
+
+	// m_hashObjects finds objects by key and holds their index in m_vecObjects.
+	// Removing an object moves the last one into its slot, so the vector isn't
+	// kept in the order objects were added. When several objects share a key only
+	// one of them is in the hash, the rest are counted in m_nUnhashedObjects.
+	// Keys must not change while an object is in the cache.
 	CSharedObjectVec m_vecObjects;
+	CUtlHashtable< CSharedObject *, int, KeyHashFunctor, KeyEqualFunctor > m_hashObjects;
+	int m_nUnhashedObjects;
 	int m_nTypeID;
 };
 
@@ -363,5 +363,211 @@ FORCEINLINE fltx4 QuaternionSlerpSIMD( const fltx4 &p, const fltx4 &q, float t )
 
 #endif // ALLOW_SIMD_QUATERNION_MATH
 
+
+//---------------------------------------------------------------------
+// class FourQuaternions stores 4 independent quaternions in the format
+// x x x x y y y y z z z z w w w w, the same way FourVectors does for
+// vectors. Unlike the AoS functions above these are fine on PC: each
+// lane is a separate quaternion, so there are no horizontal ops and the
+// data never has to leave the SIMD registers until it is stored.
+// Each function matches its scalar counterpart in mathlib, lane by lane.
+//---------------------------------------------------------------------
+class ALIGN16 FourQuaternions
+{
+public:
+	fltx4 x, y, z, w;
+
+	/// load 4 Quaternions and transpose them into SoA form
+	FORCEINLINE void LoadAndSwizzle( const Quaternion &a, const Quaternion &b, const Quaternion &c, const Quaternion &d )
+	{
+		x = LoadUnalignedSIMD( a.Base() );
+		y = LoadUnalignedSIMD( b.Base() );
+		z = LoadUnalignedSIMD( c.Base() );
+		w = LoadUnalignedSIMD( d.Base() );
+		TransposeSIMD( x, y, z, w );
+	}
+
+	/// transpose back to AoS form and store to 4 Quaternions
+	FORCEINLINE void SwizzleAndStore( Quaternion &a, Quaternion &b, Quaternion &c, Quaternion &d ) const
+	{
+		fltx4 qa = x, qb = y, qc = z, qd = w;
+		TransposeSIMD( qa, qb, qc, qd );
+		StoreUnalignedSIMD( a.Base(), qa );
+		StoreUnalignedSIMD( b.Base(), qb );
+		StoreUnalignedSIMD( c.Base(), qc );
+		StoreUnalignedSIMD( d.Base(), qd );
+	}
+
+	/// 4 dot products
+	FORCEINLINE fltx4 operator*( const FourQuaternions &q ) const
+	{
+		fltx4 dot = MulSIMD( x, q.x );
+		dot = MaddSIMD( y, q.y, dot );
+		dot = MaddSIMD( z, q.z, dot );
+		dot = MaddSIMD( w, q.w, dot );
+		return dot;
+	}
+
+	/// lanes of mask take a, the others b
+	FORCEINLINE void MaskedAssign( const fltx4 &mask, const FourQuaternions &a, const FourQuaternions &b )
+	{
+		x = ::MaskedAssign( mask, a.x, b.x );
+		y = ::MaskedAssign( mask, a.y, b.y );
+		z = ::MaskedAssign( mask, a.z, b.z );
+		w = ::MaskedAssign( mask, a.w, b.w );
+	}
+
+	/// see QuaternionNormalize. zero length quaternions are left alone
+	FORCEINLINE void Normalize( void )
+	{
+		fltx4 radius = *this * *this;
+		fltx4 zeroMask = CmpEqSIMD( radius, Four_Zeros );
+		fltx4 iradius = DivSIMD( Four_Ones, SqrtSIMD( ::MaskedAssign( zeroMask, Four_Ones, radius ) ) );
+		x = MulSIMD( x, iradius );
+		y = MulSIMD( y, iradius );
+		z = MulSIMD( z, iradius );
+		w = MulSIMD( w, iradius );
+	}
+
+	/// see QuaternionAlign. returns q, or -q where that is closer to this
+	FORCEINLINE FourQuaternions Align( const FourQuaternions &q ) const
+	{
+		fltx4 dx = SubSIMD( x, q.x ), sx = AddSIMD( x, q.x );
+		fltx4 dy = SubSIMD( y, q.y ), sy = AddSIMD( y, q.y );
+		fltx4 dz = SubSIMD( z, q.z ), sz = AddSIMD( z, q.z );
+		fltx4 dw = SubSIMD( w, q.w ), sw = AddSIMD( w, q.w );
+		fltx4 a = MulSIMD( dx, dx );
+		a = MaddSIMD( dy, dy, a );
+		a = MaddSIMD( dz, dz, a );
+		a = MaddSIMD( dw, dw, a );
+		fltx4 b = MulSIMD( sx, sx );
+		b = MaddSIMD( sy, sy, b );
+		b = MaddSIMD( sz, sz, b );
+		b = MaddSIMD( sw, sw, b );
+		fltx4 flipMask = CmpGtSIMD( a, b );
+
+		FourQuaternions result;
+		result.x = ::MaskedAssign( flipMask, NegSIMD( q.x ), q.x );
+		result.y = ::MaskedAssign( flipMask, NegSIMD( q.y ), q.y );
+		result.z = ::MaskedAssign( flipMask, NegSIMD( q.z ), q.z );
+		result.w = ::MaskedAssign( flipMask, NegSIMD( q.w ), q.w );
+		return result;
+	}
+
+	/// see QuaternionBlendNoAlign. 0 returns this, 1 returns q
+	FORCEINLINE FourQuaternions BlendNoAlign( const FourQuaternions &q, const fltx4 &t ) const
+	{
+		fltx4 sclp = SubSIMD( Four_Ones, t );
+		FourQuaternions result;
+		result.x = AddSIMD( MulSIMD( sclp, x ), MulSIMD( t, q.x ) );
+		result.y = AddSIMD( MulSIMD( sclp, y ), MulSIMD( t, q.y ) );
+		result.z = AddSIMD( MulSIMD( sclp, z ), MulSIMD( t, q.z ) );
+		result.w = AddSIMD( MulSIMD( sclp, w ), MulSIMD( t, q.w ) );
+		result.Normalize();
+		return result;
+	}
+
+	/// see QuaternionBlend
+	FORCEINLINE FourQuaternions Blend( const FourQuaternions &q, const fltx4 &t ) const
+	{
+		return BlendNoAlign( Align( q ), t );
+	}
+
+	/// see QuaternionSlerpNoAlign. 0 returns this, 1 returns q
+	FORCEINLINE FourQuaternions SlerpNoAlign( const FourQuaternions &q, const fltx4 &t ) const
+	{
+		fltx4 epsilon = ReplicateX4( 0.000001f );
+		fltx4 cosom = *this * q;
+		fltx4 oneMinusT = SubSIMD( Four_Ones, t );
+
+		// lanes that are too close together for the sin() division fall back to a lerp
+		fltx4 slerpMask = CmpGtSIMD( SubSIMD( Four_Ones, cosom ), epsilon );
+		fltx4 sclp = oneMinusT;
+		fltx4 sclq = t;
+		if ( !IsAllZeros( slerpMask ) )
+		{
+			fltx4 omega = ArcCosSIMD( ::MaskedAssign( slerpMask, cosom, Four_Zeros ) );
+			fltx4 sinom = ::MaskedAssign( slerpMask, SinSIMD( omega ), Four_Ones );
+			sclp = ::MaskedAssign( slerpMask, DivSIMD( SinSIMD( MulSIMD( oneMinusT, omega ) ), sinom ), sclp );
+			sclq = ::MaskedAssign( slerpMask, DivSIMD( SinSIMD( MulSIMD( t, omega ) ), sinom ), sclq );
+		}
+
+		FourQuaternions result;
+		result.x = AddSIMD( MulSIMD( sclp, x ), MulSIMD( sclq, q.x ) );
+		result.y = AddSIMD( MulSIMD( sclp, y ), MulSIMD( sclq, q.y ) );
+		result.z = AddSIMD( MulSIMD( sclp, z ), MulSIMD( sclq, q.z ) );
+		result.w = AddSIMD( MulSIMD( sclp, w ), MulSIMD( sclq, q.w ) );
+
+		// lanes that are (almost) opposite rotate through a perpendicular quaternion instead
+		fltx4 oppositeMask = CmpLeSIMD( AddSIMD( Four_Ones, cosom ), epsilon );
+		if ( !IsAllZeros( oppositeMask ) )
+		{
+			fltx4 halfPi = ReplicateX4( 0.5f * M_PI_F );
+			fltx4 perpP = SinSIMD( MulSIMD( oneMinusT, halfPi ) );
+			fltx4 perpQ = SinSIMD( MulSIMD( t, halfPi ) );
+			result.x = ::MaskedAssign( oppositeMask, SubSIMD( MulSIMD( perpP, x ), MulSIMD( perpQ, q.y ) ), result.x );
+			result.y = ::MaskedAssign( oppositeMask, AddSIMD( MulSIMD( perpP, y ), MulSIMD( perpQ, q.x ) ), result.y );
+			result.z = ::MaskedAssign( oppositeMask, SubSIMD( MulSIMD( perpP, z ), MulSIMD( perpQ, q.w ) ), result.z );
+			result.w = ::MaskedAssign( oppositeMask, q.z, result.w );
+		}
+		return result;
+	}
+
+	/// see QuaternionSlerp
+	FORCEINLINE FourQuaternions Slerp( const FourQuaternions &q, const fltx4 &t ) const
+	{
+		return SlerpNoAlign( Align( q ), t );
+	}
+
+	/// build the 4 rotation matrices (see QuaternionMatrix) and set their translation from pos
+	FORCEINLINE void ToMatrices( const Vector &pos0, const Vector &pos1, const Vector &pos2, const Vector &pos3,
+		matrix3x4_t &out0, matrix3x4_t &out1, matrix3x4_t &out2, matrix3x4_t &out3 ) const
+	{
+		fltx4 x2 = AddSIMD( x, x );
+		fltx4 y2 = AddSIMD( y, y );
+		fltx4 z2 = AddSIMD( z, z );
+		fltx4 xx = MulSIMD( x, x2 ), xy = MulSIMD( x, y2 ), xz = MulSIMD( x, z2 );
+		fltx4 yy = MulSIMD( y, y2 ), yz = MulSIMD( y, z2 ), zz = MulSIMD( z, z2 );
+		fltx4 wx = MulSIMD( w, x2 ), wy = MulSIMD( w, y2 ), wz = MulSIMD( w, z2 );
+
+		// one fltx4 per matrix element, the fourth column is patched in afterwards
+		fltx4 r0 = SubSIMD( Four_Ones, AddSIMD( yy, zz ) );
+		fltx4 r1 = SubSIMD( xy, wz );
+		fltx4 r2 = AddSIMD( xz, wy );
+		fltx4 r3 = Four_Zeros;
+		TransposeSIMD( r0, r1, r2, r3 );
+		StoreUnalignedSIMD( out0[0], r0 );
+		StoreUnalignedSIMD( out1[0], r1 );
+		StoreUnalignedSIMD( out2[0], r2 );
+		StoreUnalignedSIMD( out3[0], r3 );
+
+		r0 = AddSIMD( xy, wz );
+		r1 = SubSIMD( Four_Ones, AddSIMD( xx, zz ) );
+		r2 = SubSIMD( yz, wx );
+		r3 = Four_Zeros;
+		TransposeSIMD( r0, r1, r2, r3 );
+		StoreUnalignedSIMD( out0[1], r0 );
+		StoreUnalignedSIMD( out1[1], r1 );
+		StoreUnalignedSIMD( out2[1], r2 );
+		StoreUnalignedSIMD( out3[1], r3 );
+
+		r0 = SubSIMD( xz, wy );
+		r1 = AddSIMD( yz, wx );
+		r2 = SubSIMD( Four_Ones, AddSIMD( xx, yy ) );
+		r3 = Four_Zeros;
+		TransposeSIMD( r0, r1, r2, r3 );
+		StoreUnalignedSIMD( out0[2], r0 );
+		StoreUnalignedSIMD( out1[2], r1 );
+		StoreUnalignedSIMD( out2[2], r2 );
+		StoreUnalignedSIMD( out3[2], r3 );
+
+		out0[0][3] = pos0.x; out0[1][3] = pos0.y; out0[2][3] = pos0.z;
+		out1[0][3] = pos1.x; out1[1][3] = pos1.y; out1[2][3] = pos1.z;
+		out2[0][3] = pos2.x; out2[1][3] = pos2.y; out2[2][3] = pos2.z;
+		out3[0][3] = pos3.x; out3[1][3] = pos3.y; out3[2][3] = pos3.z;
+	}
+};
+
+
 #endif // SSEQUATMATH_H
 
@@ -41,6 +41,25 @@ public:
 
 };
 
+// Two packets of four rays which are traced through the tree together, so that they share the
+// node traversal and triangle fetches. All 8 rays must have the same direction signs.
+class EightRays
+{
+public:
+	FourRays rays[2];
+
+	inline void Check(void) const
+	{
+		rays[0].Check();
+		rays[1].Check();
+		Assert( rays[0].CalculateDirectionSignMask() == rays[1].CalculateDirectionSignMask() );
+	}
+	// returns direction sign mask for 8 rays. returns -1 if the rays can not be traced as a
+	// bundle.
+	int CalculateDirectionSignMask(void) const;
+
+};
+
 /// The format a triangle is stored in for intersections. size of this structure is important.
 /// This structure can be in one of two forms. Before the ray tracing environment is set up, the
 /// ProjectedEdgeEquations hold the coordinates of the 3 vertices, for facilitating bounding box
@@ -220,6 +239,7 @@ public:
 #define RTE_FLAGS_FAST_TREE_GENERATION 1
 #define RTE_FLAGS_DONT_STORE_TRIANGLE_COLORS 2				// saves memory if not needed
 #define RTE_FLAGS_DONT_STORE_TRIANGLE_MATERIALS 4
+#define RTE_FLAGS_SINGLE_THREADED_TREE_GENERATION 8			// build the kd tree on the calling thread only
 
 enum RayTraceLightingMode_t {
 	DIRECT_LIGHTING,										// just dot product lighting
@@ -310,6 +330,20 @@ public:
 					RayTracingResult *rslt_out,
 					int32 skip_id=-1, ITransparentTriangleCallback *pCallback = NULL);
 
+	// fire 8 rays through the scene as two packets of 4, with the same rules as Trace4Rays. All
+	// 8 rays must share direction signs. Per ray, the results are the same as tracing
+	// each packet with Trace4Rays, except which of several triangles hit at exactly the same
+	// distance is reported. With a transparency callback the packets are traced one at
+	// a time, since what the callback gets to see depends on the order triangles are visited in.
+	void Trace8Rays(const EightRays &rays, const fltx4 TMin[2], const fltx4 TMax[2],int DirectionSignMask,
+					RayTracingResult rslt_out[2],
+					int32 skip_id=-1, ITransparentTriangleCallback *pCallback = NULL);
+
+	// traces the packets together if their signs allow it, otherwise one at a time
+	void Trace8Rays(const EightRays &rays, const fltx4 TMin[2], const fltx4 TMax[2],
+					RayTracingResult rslt_out[2],
+					int32 skip_id=-1, ITransparentTriangleCallback *pCallback = NULL);
+
 	// compute virtual light sources to model inter-reflection
 	void ComputeVirtualLightSources(void);
 
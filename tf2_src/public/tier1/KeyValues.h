@@ -39,6 +39,7 @@ class CUtlBuffer;
 class Color;
 typedef void * FileHandle_t;
 class CKeyValuesGrowableStringTable;
+struct KeyValuesParseState_t;
 
 //-----------------------------------------------------------------------------
 // Purpose: Simple recursive data access class
@@ -290,7 +291,7 @@ private:
 	void SaveKeyToFile( KeyValues *dat, IBaseFileSystem *filesystem, FileHandle_t f, CUtlBuffer *pBuf, int indentLevel, bool sortKeys, bool bAllowEmptyString );
 	void WriteConvertedString( IBaseFileSystem *filesystem, FileHandle_t f, CUtlBuffer *pBuf, const char *pszString );
 	
-	void RecursiveLoadFromBuffer( char const *resourceName, CUtlBuffer &buf );
+	void RecursiveLoadFromBuffer( char const *resourceName, CUtlBuffer &buf, KeyValuesParseState_t &state );
 
 	// For handling #include "filename"
 	void AppendIncludedKeys( CUtlVector< KeyValues * >& includedKeys );
@@ -305,7 +306,7 @@ private:
 	void InternalWrite( IBaseFileSystem *filesystem, FileHandle_t f, CUtlBuffer *pBuf, const void *pData, int len );
 	
 	void Init();
-	const char * ReadToken( CUtlBuffer &buf, bool &wasQuoted, bool &wasConditional );
+	const char * ReadToken( CUtlBuffer &buf, KeyValuesParseState_t &state, bool &wasQuoted, bool &wasConditional );
 	void WriteIndents( IBaseFileSystem *filesystem, FileHandle_t f, CUtlBuffer *pBuf, int indentLevel );
 
 	void FreeAllocatedValue();
@@ -0,0 +1,189 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Read-only binary KeyValues images.
+//
+// A KeyValues tree is flattened into a single pointer-free block: a node array
+// with each node's children stored contiguously, an interned string section, and
+// hash tables for the children of large nodes.  Values are converted to every
+// type when the image is built, so reads never parse or allocate.  An image can
+// be used straight from memory, a file or a read-only mapping of a file, and is
+// read through CKeyValuesView, which mirrors the KeyValues getters.
+//
+//		CKeyValuesImage image;
+//		if ( image.LoadFromTextFile( g_pFullFileSystem, "scripts/items/items_game.txt", "GAME", "items_game.kvi" ) )
+//		{
+//			for ( CKeyValuesView item = image.GetRoot().FindKey( "items" ).GetFirstTrueSubKey(); item.IsValid(); item = item.GetNextTrueSubKey() )
+//				Msg( "%s\n", item.GetString( "name" ) );
+//		}
+//
+//=============================================================================//
+
+#ifndef KVIMAGE_H
+#define KVIMAGE_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier0/commonmacros.h"
+#include "tier1/KeyValues.h"
+
+class IBaseFileSystem;
+class CUtlBuffer;
+class CKeyValuesImage;
+
+#define KVIMAGE_ID				MAKEID('K','V','I','M')
+#define KVIMAGE_VERSION			1
+#define KVIMAGE_INVALID_NODE	0xFFFFFFFF
+#define KVIMAGE_NO_STRING		0xFFFFFFFF	// GetString() returns the default, as for subkeys and colors
+
+// Nodes with at least this many children get a hash table for FindKey
+#define KVIMAGE_MIN_HASHED_CHILDREN		8
+
+struct KVImageHeader_t
+{
+	uint32	m_nId;
+	uint32	m_nVersion;
+	uint32	m_nTotalSize;
+	uint32	m_nSourceCRC;		// CRC of the text the image was built from, 0 if unknown
+	uint32	m_nNodeCount;
+	uint32	m_nNodeOffset;		// KVImageNode_t[m_nNodeCount], node 0 is the root
+	uint32	m_nHashSlotCount;
+	uint32	m_nHashOffset;		// uint32[m_nHashSlotCount], child index + 1, 0 is an empty slot
+	uint32	m_nStringSize;
+	uint32	m_nStringOffset;	// NUL terminated strings, offset 0 is ""
+};
+
+struct KVImageNode_t
+{
+	uint32	m_nName;			// string offset
+	uint32	m_nNameHash;		// KVImage_HashName( name )
+	uint32	m_nParent;
+	uint32	m_nFirstChild;
+	uint32	m_nChildCount;
+	uint32	m_nHashSlot;		// first slot of the child hash table
+	uint8	m_nType;			// KeyValues::types_t
+	uint8	m_nHashBits;		// log2 of the child hash table size, 0 if there is none
+	uint16	m_nPad;
+	// the value in every form the KeyValues getters would return it
+	int32	m_nInt;
+	float	m_flFloat;
+	uint32	m_nUint64Low;
+	uint32	m_nUint64High;
+	uint32	m_nString;			// string offset or KVIMAGE_NO_STRING
+};
+
+// Case insensitive, matching KeyValues key name lookups
+uint32 KVImage_HashName( const char *pName );
+uint32 KVImage_HashName( const char *pName, int nLength );
+
+
+//-----------------------------------------------------------------------------
+// A node in a CKeyValuesImage.  Views are two words, pass them by value.
+//-----------------------------------------------------------------------------
+class CKeyValuesView
+{
+public:
+	CKeyValuesView() : m_pImage( NULL ), m_nNode( KVIMAGE_INVALID_NODE ) {}
+	CKeyValuesView( const CKeyValuesImage *pImage, uint32 nNode ) : m_pImage( pImage ), m_nNode( nNode ) {}
+
+	bool IsValid() const { return m_nNode != KVIMAGE_INVALID_NODE; }
+	const char *GetName() const;
+
+	// Finds a subkey, "a/b/c" finds nested keys
+	CKeyValuesView FindKey( const char *pKeyName ) const;
+
+	CKeyValuesView GetFirstSubKey() const;
+	CKeyValuesView GetNextKey() const;
+	CKeyValuesView GetFirstTrueSubKey() const;
+	CKeyValuesView GetNextTrueSubKey() const;
+	CKeyValuesView GetFirstValue() const;
+	CKeyValuesView GetNextValue() const;
+	int GetChildCount() const;
+
+	int GetInt( const char *pKeyName = NULL, int nDefaultValue = 0 ) const;
+	uint64 GetUint64( const char *pKeyName = NULL, uint64 nDefaultValue = 0 ) const;
+	float GetFloat( const char *pKeyName = NULL, float flDefaultValue = 0.0f ) const;
+	const char *GetString( const char *pKeyName = NULL, const char *pDefaultValue = "" ) const;
+	bool GetBool( const char *pKeyName = NULL, bool bDefaultValue = false ) const;
+	bool IsEmpty( const char *pKeyName = NULL ) const;
+	KeyValues::types_t GetDataType( const char *pKeyName = NULL ) const;
+
+	// Copies this node and everything below it into a KeyValues tree, for code that needs one
+	KeyValues *MakeKeyValues() const;
+
+private:
+	const KVImageNode_t &Node() const;
+	CKeyValuesView FindChild( const char *pName, int nLength ) const;
+	CKeyValuesView NextSibling() const;
+
+	const CKeyValuesImage	*m_pImage;
+	uint32					m_nNode;
+};
+
+
+//-----------------------------------------------------------------------------
+// Owns (or references) the memory of an image
+//-----------------------------------------------------------------------------
+class CKeyValuesImage
+{
+public:
+	CKeyValuesImage();
+	~CKeyValuesImage();
+
+	// Flattens a KeyValues tree into an image
+	static bool Build( KeyValues *pKeyValues, CUtlBuffer &buf, uint32 nSourceCRC = 0 );
+
+	// Uses an image in memory owned by the caller, nothing is copied
+	bool InitFromMemory( const void *pData, int nSize );
+
+	// Reads an image file into a single allocation
+	bool LoadFromFile( IBaseFileSystem *pFileSystem, const char *pFileName, const char *pPathID = NULL );
+
+	// Maps a local image file read-only, pages are shared between processes using it
+	bool MapFile( const char *pFullPath );
+
+	// Uses the cached image when it was built from the current text, otherwise parses
+	// the text and writes a new image to pCacheFile in the DEFAULT_WRITE_PATH
+	bool LoadFromTextFile( IBaseFileSystem *pFileSystem, const char *pFileName, const char *pPathID, const char *pCacheFile );
+
+	void Purge();
+
+	bool IsValid() const { return m_pHeader != NULL; }
+	uint32 GetSourceCRC() const { return m_pHeader ? m_pHeader->m_nSourceCRC : 0; }
+	int GetNodeCount() const { return m_pHeader ? m_pHeader->m_nNodeCount : 0; }
+	CKeyValuesView GetRoot() const { return CKeyValuesView( this, m_pHeader ? 0 : KVIMAGE_INVALID_NODE ); }
+
+private:
+	friend class CKeyValuesView;
+
+	bool Validate( const void *pData, int nSize ) const;
+	bool SetImage( const void *pData, int nSize );
+
+	const KVImageNode_t &GetNode( uint32 nNode ) const { return m_pNodes[nNode]; }
+	const char *GetString( uint32 nOffset ) const { return m_pStrings + nOffset; }
+
+	const KVImageHeader_t	*m_pHeader;
+	const KVImageNode_t		*m_pNodes;
+	const uint32			*m_pHashSlots;
+	const char				*m_pStrings;
+
+	void					*m_pAllocated;
+	void					*m_pMapped;
+	int						m_nMappedSize;
+#ifdef _WIN32
+	void					*m_hMapping;
+#endif
+
+	// not copyable
+	CKeyValuesImage( const CKeyValuesImage & );
+	CKeyValuesImage &operator=( const CKeyValuesImage & );
+};
+
+
+inline const KVImageNode_t &CKeyValuesView::Node() const
+{
+	return m_pImage->GetNode( m_nNode );
+}
+
+#endif // KVIMAGE_H
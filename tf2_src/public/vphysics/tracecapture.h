@@ -0,0 +1,78 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: File format of the trace workload captured by vphysics when
+//			run with -vphysics_tracecapture <file>.  Replayed by traceperf.
+//
+//=============================================================================//
+
+#ifndef TRACECAPTURE_H
+#define TRACECAPTURE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "mathlib/vector.h"
+#include "commonmacros.h"
+
+#define VPHYSICS_TRACECAPTURE_ID		MAKEID('V','T','R','C')
+#define VPHYSICS_TRACECAPTURE_VERSION	1
+
+// The file is a tracecapture_header_t followed by a stream of records.  Each record is
+// a tracecapture_record_t followed by record.size bytes of payload.
+enum tracecapturerecordtype_t
+{
+	TRACECAPTURE_COLLIDE = 0,		// tracecapture_collide_t followed by the serialized CPhysCollide
+	TRACECAPTURE_TRACEBOX,			// tracecapture_tracebox_t
+	TRACECAPTURE_TRACECOLLIDE,		// tracecapture_tracecollide_t
+	TRACECAPTURE_DESTROYCOLLIDE,	// int collideIndex, the collide will not be referenced again
+};
+
+struct tracecapture_header_t
+{
+	int		id;
+	int		version;
+};
+
+struct tracecapture_record_t
+{
+	int		type;
+	int		size;
+};
+
+// Collides are numbered in the order they were first traced against
+struct tracecapture_collide_t
+{
+	int		collideIndex;
+	int		vcollideIndex;
+	int		dataSize;
+};
+
+// Ray_t and the collide transform passed to IPhysicsCollision::TraceBox().
+// The IConvexInfo can't be captured, replay traces with NULL.
+struct tracecapture_tracebox_t
+{
+	int				collideIndex;
+	unsigned int	contentsMask;
+	Vector			start;
+	Vector			delta;
+	Vector			startOffset;
+	Vector			extents;
+	int				isRay;
+	int				isSwept;
+	Vector			collideOrigin;
+	QAngle			collideAngles;
+};
+
+// Arguments to IPhysicsCollision::TraceCollide()
+struct tracecapture_tracecollide_t
+{
+	int		sweepIndex;
+	int		collideIndex;
+	Vector	start;
+	Vector	end;
+	QAngle	sweepAngles;
+	Vector	collideOrigin;
+	QAngle	collideAngles;
+};
+
+#endif // TRACECAPTURE_H
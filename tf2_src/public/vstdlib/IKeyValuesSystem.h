@@ -48,6 +48,9 @@ public:
 	virtual bool LoadFileKeyValuesFromCache( KeyValues* _outKv, const char *resourceName, const char *pathID, IBaseFileSystem *filesystem ) const = 0;
 	virtual void InvalidateCache( ) = 0;
 	virtual void InvalidateCacheForFile( const char *resourceName, const char *pathID ) = 0;
+
+	// prints symbol table size, probe lengths and lock contention
+	virtual void DumpSymbolTableStats() = 0;
 };
 
 VSTDLIB_INTERFACE IKeyValuesSystem *KeyValuesSystem();
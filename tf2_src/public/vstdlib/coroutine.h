@@ -17,6 +17,7 @@
 //-----------------------------------------------------------------------------
 // Purpose: handles running coroutines
 //			setjmp/longjmp based cooperative multitasking system
+//			on Linux each coroutine instead runs on its own stack
 //-----------------------------------------------------------------------------
 
 // coroutine callback
@@ -235,6 +235,18 @@ void CacheOptimizedTriangle::ChangeIntoIntersectionFormat(void)
 
 int n_intersection_calculations=0;
 
+// classify a triangle's extent along an axis against a plane on that axis
+static FORCEINLINE int ClassifyExtentsAgainstSplit(float minc, float maxc, float split_value)
+{
+	if (minc>=split_value)
+		return PLANECHECK_POSITIVE;
+	if (maxc<=split_value)
+		return PLANECHECK_NEGATIVE;
+	if (minc==maxc)
+		return PLANECHECK_POSITIVE;
+	return PLANECHECK_STRADDLING;
+}
+
 int CacheOptimizedTriangle::ClassifyAgainstAxisSplit(int split_plane, float split_value)
 {
 	// classify a triangle against an axis-aligned plane
@@ -246,13 +258,7 @@ int CacheOptimizedTriangle::ClassifyAgainstAxisSplit(int split_plane, float spli
 		maxc=max(maxc,Vertex(v)[split_plane]);
 	}
 
-	if (minc>=split_value)
-		return PLANECHECK_POSITIVE;
-	if (maxc<=split_value)
-		return PLANECHECK_NEGATIVE;
-	if (minc==maxc)
-		return PLANECHECK_POSITIVE;
-	return PLANECHECK_STRADDLING;
+	return ClassifyExtentsAgainstSplit(minc,maxc,split_value);
 }
 
 #define MAILBOX_HASH_SIZE 256
@@ -595,6 +601,280 @@ void RayTracingEnvironment::Trace4Rays(const FourRays &rays, fltx4 TMin, fltx4 T
 }
 
 
+int EightRays::CalculateDirectionSignMask(void) const
+{
+	int msk=rays[0].CalculateDirectionSignMask();
+	if ( ( msk==-1 ) || ( rays[1].CalculateDirectionSignMask()!=msk ) )
+		return -1;
+	return msk;
+}
+
+
+struct EightRayNodeToVisit {
+	CacheOptimizedKDNode const *node;
+	fltx4 TMin[2];
+	fltx4 TMax[2];
+};
+
+
+void RayTracingEnvironment::Trace8Rays(const EightRays &rays, const fltx4 TMin[2], const fltx4 TMax[2],
+									   RayTracingResult rslt_out[2],
+									   int32 skip_id, ITransparentTriangleCallback *pCallback)
+{
+	int msk=rays.CalculateDirectionSignMask();
+	if (msk!=-1)
+		Trace8Rays(rays,TMin,TMax,msk,rslt_out,skip_id,pCallback);
+	else
+	{
+		Trace4Rays(rays.rays[0],TMin[0],TMax[0],&rslt_out[0],skip_id,pCallback);
+		Trace4Rays(rays.rays[1],TMin[1],TMax[1],&rslt_out[1],skip_id,pCallback);
+	}
+}
+
+
+// This is Trace4Rays with every per-ray operation done for both packets. A packet can end up
+// visiting nodes that none of its own rays needed, but the rays are inactive (TMin>TMax) there,
+// and the triangle tests don't depend on which node a triangle was found in, so each ray gets
+// the same closest hit it would have in its own packet (ties can go to a different triangle).
+void RayTracingEnvironment::Trace8Rays(const EightRays &rays, const fltx4 TMinIn[2], const fltx4 TMaxIn[2],
+									   int DirectionSignMask, RayTracingResult rslt_out[2],
+									   int32 skip_id, ITransparentTriangleCallback *pCallback)
+{
+	if ( pCallback )
+	{
+		Trace4Rays(rays.rays[0],TMinIn[0],TMaxIn[0],DirectionSignMask,&rslt_out[0],skip_id,pCallback);
+		Trace4Rays(rays.rays[1],TMinIn[1],TMaxIn[1],DirectionSignMask,&rslt_out[1],skip_id,pCallback);
+		return;
+	}
+
+	rays.Check();
+
+	FourVectors OneOverRayDir[2];
+	fltx4 TMin[2],TMax[2];
+	fltx4 any_active=Four_Zeros;
+	for(int p=0;p<2;p++)
+	{
+		memset(rslt_out[p].HitIds,0xff,sizeof(rslt_out[p].HitIds));
+		rslt_out[p].HitDistance=ReplicateX4(1.0e23);
+		rslt_out[p].surface_normal.DuplicateVector(Vector(0.,0.,0.));
+
+		OneOverRayDir[p]=rays.rays[p].direction;
+		OneOverRayDir[p].MakeReciprocalSaturate();
+
+		// now, clip rays against bounding box
+		TMin[p]=TMinIn[p];
+		TMax[p]=TMaxIn[p];
+		for(int c=0;c<3;c++)
+		{
+			fltx4 isect_min_t=
+				MulSIMD(SubSIMD(ReplicateX4(m_MinBound[c]),rays.rays[p].origin[c]),OneOverRayDir[p][c]);
+			fltx4 isect_max_t=
+				MulSIMD(SubSIMD(ReplicateX4(m_MaxBound[c]),rays.rays[p].origin[c]),OneOverRayDir[p][c]);
+			TMin[p]=MaxSIMD(TMin[p],MinSIMD(isect_min_t,isect_max_t));
+			TMax[p]=MinSIMD(TMax[p],MaxSIMD(isect_min_t,isect_max_t));
+		}
+		any_active=OrSIMD(any_active,CmpLeSIMD(TMin[p],TMax[p]));
+	}
+	if (! IsAnyNegative(any_active) )
+		return;												// missed bounding box
+
+	int32 mailboxids[MAILBOX_HASH_SIZE];					// used to avoid redundant triangle tests
+	memset(mailboxids,0xff,sizeof(mailboxids));
+
+	int front_idx[3],back_idx[3];							// based on ray direction, whether to
+															// visit left or right node first
+	for(int c=0;c<3;c++)
+	{
+		if (DirectionSignMask & (1<<c))
+		{
+			back_idx[c]=0;
+			front_idx[c]=1;
+		}
+		else
+		{
+			back_idx[c]=1;
+			front_idx[c]=0;
+		}
+	}
+
+	EightRayNodeToVisit NodeQueue[MAX_NODE_STACK_LEN];
+	CacheOptimizedKDNode const *CurNode=&(OptimizedKDTree[0]);
+	EightRayNodeToVisit *stack_ptr=&NodeQueue[MAX_NODE_STACK_LEN];
+	while(1)
+	{
+		while (CurNode->NodeType() != KDNODE_STATE_LEAF)		// traverse until next leaf
+		{
+			int split_plane_number=CurNode->NodeType();
+			CacheOptimizedKDNode const *FrontChild=&(OptimizedKDTree[CurNode->LeftChild()]);
+			fltx4 split_value=ReplicateX4(CurNode->SplittingPlaneValue);
+
+			fltx4 dist_to_sep_plane[2];						// dist=(split-org)/dir
+			fltx4 active[2];
+			for(int p=0;p<2;p++)
+			{
+				dist_to_sep_plane[p]=MulSIMD(SubSIMD(split_value,rays.rays[p].origin[split_plane_number]),
+											 OneOverRayDir[p][split_plane_number]);
+				active[p]=CmpLeSIMD(TMin[p],TMax[p]);		// mask of which rays are active
+			}
+
+			// now, decide how to traverse children. can either do front,back, or do front and push
+			// back.
+			fltx4 hits_front=OrSIMD(AndSIMD(active[0],CmpGeSIMD(dist_to_sep_plane[0],TMin[0])),
+									AndSIMD(active[1],CmpGeSIMD(dist_to_sep_plane[1],TMin[1])));
+			if (! IsAnyNegative(hits_front))
+			{
+				// missed the front. only traverse back
+				CurNode=FrontChild+back_idx[split_plane_number];
+				for(int p=0;p<2;p++)
+					TMin[p]=MaxSIMD(TMin[p],dist_to_sep_plane[p]);
+			}
+			else
+			{
+				fltx4 hits_back=OrSIMD(AndSIMD(active[0],CmpLeSIMD(dist_to_sep_plane[0],TMax[0])),
+									   AndSIMD(active[1],CmpLeSIMD(dist_to_sep_plane[1],TMax[1])));
+				if (! IsAnyNegative(hits_back) )
+				{
+					// missed the back - only need to traverse front node
+					CurNode=FrontChild+front_idx[split_plane_number];
+					for(int p=0;p<2;p++)
+						TMax[p]=MinSIMD(TMax[p],dist_to_sep_plane[p]);
+				}
+				else
+				{
+					// at least some rays hit both nodes.
+					// must push far, traverse near
+					assert(stack_ptr>NodeQueue);
+					--stack_ptr;
+					stack_ptr->node=FrontChild+back_idx[split_plane_number];
+					for(int p=0;p<2;p++)
+					{
+						stack_ptr->TMin[p]=MaxSIMD(TMin[p],dist_to_sep_plane[p]);
+						stack_ptr->TMax[p]=TMax[p];
+						TMax[p]=MinSIMD(TMax[p],dist_to_sep_plane[p]);
+					}
+					CurNode=FrontChild+front_idx[split_plane_number];
+				}
+			}
+		}
+		// hit a leaf! must do intersection check
+		int ntris=CurNode->NumberOfTrianglesInLeaf();
+		if (ntris)
+		{
+			int32 const *tlist=&(TriangleIndexList[CurNode->TriangleIndexStart()]);
+			do
+			{
+				int tnum=*(tlist++);
+				// check mailbox
+				int mbox_slot=tnum & (MAILBOX_HASH_SIZE-1);
+				TriIntersectData_t const *tri = &( OptimizedTriangleList[tnum].m_Data.m_IntersectData );
+				if ( ( mailboxids[mbox_slot] == tnum ) || ( tri->m_nTriangleID == skip_id ) )
+					continue;
+				n_intersection_calculations++;
+				mailboxids[mbox_slot] = tnum;
+
+				FourVectors N;
+				N.x = ReplicateX4( tri->m_flNx );
+				N.y = ReplicateX4( tri->m_flNy );
+				N.z = ReplicateX4( tri->m_flNz );
+				fltx4 D = ReplicateX4( tri->m_flD );
+				fltx4 replicated_n = ReplicateIX4(tnum);
+
+				for(int p=0;p<2;p++)
+				{
+					FourRays const &prays=rays.rays[p];
+					RayTracingResult *prslt=&rslt_out[p];
+
+					// compute plane intersection
+					fltx4 DDotN = prays.direction * N;
+					// mask off zero or near zero (ray parallel to surface)
+					fltx4 did_hit = OrSIMD( CmpGtSIMD( DDotN,FourEpsilons ),
+											CmpLtSIMD( DDotN, FourNegativeEpsilons ) );
+
+					fltx4 numerator=SubSIMD( D, prays.origin * N );
+
+					fltx4 isect_t=DivSIMD( numerator,DDotN );
+					// now, we have the distance to the plane. lets update our mask
+					did_hit = AndSIMD( did_hit, CmpGtSIMD( isect_t, FourZeros ) );
+					did_hit = AndSIMD( did_hit, CmpLtSIMD( isect_t, prslt->HitDistance ) );
+
+					if ( ! IsAnyNegative( did_hit ) )
+						continue;
+
+					// now, check 3 edges
+					fltx4 hitc1 = AddSIMD( prays.origin[tri->m_nCoordSelect0],
+										   MulSIMD( isect_t, prays.direction[ tri->m_nCoordSelect0] ) );
+					fltx4 hitc2 = AddSIMD( prays.origin[tri->m_nCoordSelect1],
+										   MulSIMD( isect_t, prays.direction[tri->m_nCoordSelect1] ) );
+
+					// do barycentric coordinate check
+					fltx4 B0 = MulSIMD( ReplicateX4( tri->m_ProjectedEdgeEquations[0] ), hitc1 );
+					B0 = AddSIMD(
+						B0,
+						MulSIMD( ReplicateX4( tri->m_ProjectedEdgeEquations[1] ), hitc2 ) );
+					B0 = AddSIMD(
+						B0, ReplicateX4( tri->m_ProjectedEdgeEquations[2] ) );
+
+					did_hit = AndSIMD( did_hit, CmpGeSIMD( B0, FourZeros ) );
+
+					fltx4 B1 = MulSIMD( ReplicateX4( tri->m_ProjectedEdgeEquations[3] ), hitc1 );
+					B1 = AddSIMD(
+						B1,
+						MulSIMD( ReplicateX4( tri->m_ProjectedEdgeEquations[4]), hitc2 ) );
+					B1 = AddSIMD(
+						B1, ReplicateX4( tri->m_ProjectedEdgeEquations[5] ) );
+
+					did_hit = AndSIMD( did_hit, CmpGeSIMD( B1, FourZeros ) );
+
+					fltx4 B2 = AddSIMD( B1, B0 );
+					did_hit = AndSIMD( did_hit, CmpLeSIMD( B2, Four_Ones ) );
+
+					if ( ! IsAnyNegative( did_hit ) )
+						continue;
+
+					// now, set the hit_id and closest_hit fields for any enabled rays
+					StoreAlignedSIMD((float *) prslt->HitIds,
+									 OrSIMD(AndSIMD(replicated_n,did_hit),
+											AndNotSIMD(did_hit,LoadAlignedSIMD(
+														   (float *) prslt->HitIds))));
+					prslt->HitDistance=OrSIMD(AndSIMD(isect_t,did_hit),
+											  AndNotSIMD(did_hit,prslt->HitDistance));
+
+					prslt->surface_normal.x=OrSIMD(
+						AndSIMD(N.x,did_hit),
+						AndNotSIMD(did_hit,prslt->surface_normal.x));
+					prslt->surface_normal.y=OrSIMD(
+						AndSIMD(N.y,did_hit),
+						AndNotSIMD(did_hit,prslt->surface_normal.y));
+					prslt->surface_normal.z=OrSIMD(
+						AndSIMD(N.z,did_hit),
+						AndNotSIMD(did_hit,prslt->surface_normal.z));
+				}
+			} while (--ntris);
+			// now, check if all rays have terminated
+			fltx4 raydone=OrSIMD(CmpLeSIMD(TMax[0],rslt_out[0].HitDistance),
+								 CmpLeSIMD(TMax[1],rslt_out[1].HitDistance));
+			if (! IsAnyNegative(raydone))
+			{
+				return;
+			}
+		}
+
+ 		if (stack_ptr==&NodeQueue[MAX_NODE_STACK_LEN])
+		{
+			return;
+		}
+		// pop stack!
+		CurNode=stack_ptr->node;
+		for(int p=0;p<2;p++)
+		{
+			TMin[p]=stack_ptr->TMin[p];
+			TMax[p]=stack_ptr->TMax[p];
+		}
+		stack_ptr++;
+	}
+}
+
+
 int RayTracingEnvironment::MakeLeafNode(int first_tri, int last_tri)
 {
 	CacheOptimizedKDNode ret;
@@ -651,6 +931,24 @@ void RayTracingEnvironment::CalculateTriangleListBounds(int32 const *tris,int nt
 #define COST_OF_INTERSECTION 167							// approximate #operations
 
 
+static float CostOfSplit(int split_plane, Vector const &MinBound, Vector const &MaxBound,
+						 float split_value, int nleft, int nright, int nboth)
+{
+	Vector LeftMins=MinBound;
+	Vector LeftMaxes=MaxBound;
+	Vector RightMins=MinBound;
+	Vector RightMaxes=MaxBound;
+	LeftMaxes[split_plane]=split_value;
+	RightMins[split_plane]=split_value;
+	float SA_L=BoxSurfaceArea(LeftMins,LeftMaxes);
+	float SA_R=BoxSurfaceArea(RightMins,RightMaxes);
+	float ISA=1.0/BoxSurfaceArea(MinBound,MaxBound);
+	float cost_of_split=COST_OF_TRAVERSAL+COST_OF_INTERSECTION*(nboth+
+		(SA_L*ISA*(nleft))+(SA_R*ISA*(nright)));
+	return cost_of_split;
+}
+
+
 float RayTracingEnvironment::CalculateCostsOfSplit(
 	int split_plane,int32 const *tri_list,int ntris,
 	Vector MinBound,Vector MaxBound, float &split_value,
@@ -702,173 +1000,375 @@ float RayTracingEnvironment::CalculateCostsOfSplit(
 		split_value=min_coord;
 
 	// now, perform surface area/cost check to determine whether this split was worth it
-	Vector LeftMins=MinBound;
-	Vector LeftMaxes=MaxBound;
-	Vector RightMins=MinBound;
-	Vector RightMaxes=MaxBound;
-	LeftMaxes[split_plane]=split_value;
-	RightMins[split_plane]=split_value;
-	float SA_L=BoxSurfaceArea(LeftMins,LeftMaxes);
-	float SA_R=BoxSurfaceArea(RightMins,RightMaxes);
-	float ISA=1.0/BoxSurfaceArea(MinBound,MaxBound);
-	float cost_of_split=COST_OF_TRAVERSAL+COST_OF_INTERSECTION*(nboth+
-		(SA_L*ISA*(nleft))+(SA_R*ISA*(nright)));
-	return cost_of_split;
+	return CostOfSplit(split_plane,MinBound,MaxBound,split_value,nleft,nright,nboth);
 }
 
 
 #define NEVER_SPLIT 0
 
-void RayTracingEnvironment::RefineNode(int node_number,int32 const *tri_list,int ntris,
-									   Vector MinBound,Vector MaxBound, int depth)
+
+// Building the kd tree
+//
+// The split planes tried for a node are the middle of the node and the vertices of every
+// tri_skip'th triangle in it. Rather than classifying every triangle against every one of
+// those candidates, the candidates on an axis are sorted, each triangle's extent along the
+// axis is dropped into the bins between them once, and running sums over the bins give the
+// left/right/both counts for all of the candidates. The costs, and so the tree, come out the
+// same as classifying each triangle against each candidate, in O(n log k) rather than O(n k).
+//
+// Big subtrees are built on their own threads into their own node and triangle index lists,
+// which are then appended to their parent's lists in the order a single thread would have
+// produced them.
+
+#define MAX_SPLIT_CANDIDATES (1+3*10)						// midpoint + 3 verts of <=10 tris
+#define MIN_TRIS_TO_BUILD_ON_THREAD 4096					// smaller subtrees aren't worth a thread
+
+class CKDTreeBuilder
 {
-	if (ntris<3)											// never split empty lists
+public:
+	CKDTreeBuilder( RayTracingEnvironment *pEnv, CUtlVector<CacheOptimizedKDNode> *pNodes,
+					CUtlVector<int32> *pTriangleIndices ) :
+		m_pEnv( pEnv ), m_pNodes( pNodes ), m_pTriangleIndices( pTriangleIndices )
 	{
-		// no point in continuing
-		OptimizedKDTree[node_number].Children=KDNODE_STATE_LEAF+(TriangleIndexList.Count()<<2);
-		OptimizedKDTree[node_number].SetNumberOfTrianglesInLeafNode(ntris);
+	}
+
+	// builds the subtree under node_number. subtrees are handed to other threads until
+	// nThreadLevels levels of the tree have been split up.
+	void RefineNode( int node_number, int32 const *tri_list, int ntris,
+					 Vector MinBound, Vector MaxBound, int depth, int nThreadLevels );
 
+private:
+	void MakeLeaf( int node_number, int32 const *tri_list, int ntris,
+				   Vector const &MinBound, Vector const &MaxBound );
+
+	// copies a subtree built by another builder (whose node 0 is the root) into node_number
+	// and after the end of our lists.
+	void AppendSubtree( int node_number, CKDTreeBuilder const &sub );
+
+	static unsigned SubtreeThreadFn( void *pParam );
+
+	RayTracingEnvironment *m_pEnv;
+	CUtlVector<CacheOptimizedKDNode> *m_pNodes;
+	CUtlVector<int32> *m_pTriangleIndices;
+
+	// when building a subtree on another thread, this is what it builds
+	int32 const *m_pSubtreeTriList;
+	int m_nSubtreeTris;
+	Vector m_SubtreeMinBound, m_SubtreeMaxBound;
+	int m_nSubtreeDepth;
+	int m_nSubtreeThreadLevels;
+};
+
+
+void CKDTreeBuilder::MakeLeaf( int node_number, int32 const *tri_list, int ntris,
+							   Vector const &MinBound, Vector const &MaxBound )
+{
+	CacheOptimizedKDNode &node=(*m_pNodes)[node_number];
+	node.Children=KDNODE_STATE_LEAF+(m_pTriangleIndices->Count()<<2);
+	node.SetNumberOfTrianglesInLeafNode(ntris);
 #ifdef DEBUG_RAYTRACE
-		OptimizedKDTree[node_number].vecMins = MinBound;
-		OptimizedKDTree[node_number].vecMaxs = MaxBound;
+	node.vecMins = MinBound;
+	node.vecMaxs = MaxBound;
 #endif
+	m_pTriangleIndices->AddMultipleToTail( ntris, tri_list );
+}
 
-		for(int t=0;t<ntris;t++)
-			TriangleIndexList.AddToTail(tri_list[t]);
+
+void CKDTreeBuilder::AppendSubtree( int node_number, CKDTreeBuilder const &sub )
+{
+	// node n>0 of the subtree lands at first_node+n, and its triangle indices go at the end of ours
+	int first_node=m_pNodes->Count()-1;
+	int first_tri=m_pTriangleIndices->Count();
+	for(int n=0;n<sub.m_pNodes->Count();n++)
+	{
+		CacheOptimizedKDNode node=(*sub.m_pNodes)[n];
+		if (node.NodeType()==KDNODE_STATE_LEAF)
+			node.Children=KDNODE_STATE_LEAF+((first_tri+node.TriangleIndexStart())<<2);
+		else
+			node.Children=node.NodeType()+((first_node+node.LeftChild())<<2);
+		if (n==0)
+			(*m_pNodes)[node_number]=node;
+		else
+			m_pNodes->AddToTail(node);
+	}
+	m_pTriangleIndices->AddMultipleToTail( sub.m_pTriangleIndices->Count(), sub.m_pTriangleIndices->Base() );
+}
+
+
+unsigned CKDTreeBuilder::SubtreeThreadFn( void *pParam )
+{
+	CKDTreeBuilder *pSub=(CKDTreeBuilder *) pParam;
+	pSub->RefineNode( 0, pSub->m_pSubtreeTriList, pSub->m_nSubtreeTris, pSub->m_SubtreeMinBound,
+					  pSub->m_SubtreeMaxBound, pSub->m_nSubtreeDepth, pSub->m_nSubtreeThreadLevels );
+	return 0;
+}
+
+
+void CKDTreeBuilder::RefineNode( int node_number, int32 const *tri_list, int ntris,
+								 Vector MinBound, Vector MaxBound, int depth, int nThreadLevels )
+{
+	if (ntris<3)											// never split empty lists
+	{
+		// no point in continuing
+		MakeLeaf(node_number,tri_list,ntris,MinBound,MaxBound);
 		return;
 	}
 
+	// gather the extent of each triangle along each axis
+	float *tri_mins=new float[3*ntris];
+	float *tri_maxs=new float[3*ntris];
+	for(int t=0;t<ntris;t++)
+	{
+		CacheOptimizedTriangle const &tri=m_pEnv->OptimizedTriangleList[tri_list[t]];
+		for(int axis=0;axis<3;axis++)
+		{
+			float minc=tri.Vertex(0)[axis];
+			float maxc=minc;
+			for(int v=1;v<3;v++)
+			{
+				minc=min(minc,tri.Vertex(v)[axis]);
+				maxc=max(maxc,tri.Vertex(v)[axis]);
+			}
+			tri_mins[3*t+axis]=minc;
+			tri_maxs[3*t+axis]=maxc;
+		}
+	}
+
 	float best_cost=1.0e23;
 	int best_nleft=0,best_nright=0,best_nboth=0;
 	float best_splitvalue=0;
+	float best_classifyvalue=0;								// split before "growing" empty sides
 	int split_plane=0;
 
 	int tri_skip=1+(ntris/10);								// don't try all trinagles as split
 															// points when there are a lot of them
 	for(int axis=0;axis<3;axis++)
 	{
-		for(int ts=-1;ts<ntris;ts+=tri_skip)
+		// the candidate splits, in the order they're tried
+		float candidates[MAX_SPLIT_CANDIDATES];
+		int ncandidates=0;
+		candidates[ncandidates++]=0.5*(MinBound[axis]+MaxBound[axis]);
+		for(int ts=tri_skip-1;ts<ntris;ts+=tri_skip)
 		{
+			CacheOptimizedTriangle const &tri=m_pEnv->OptimizedTriangleList[tri_list[ts]];
 			for(int tv=0;tv<3;tv++)
 			{
-				int trial_nleft,trial_nright,trial_nboth;
-				float trial_splitvalue;
-				if (ts==-1)
-					trial_splitvalue=0.5*(MinBound[axis]+MaxBound[axis]);
+				// split at the triangle vertex if possible
+				float trial_splitvalue = tri.Vertex(tv)[axis];
+				if ((trial_splitvalue>MaxBound[axis]) || (trial_splitvalue<MinBound[axis]))
+					continue;								// don't try this vertex - not inside
+				if (trial_splitvalue!=trial_splitvalue)
+					continue;								// NaN. its cost could never win
+				Assert( ncandidates < MAX_SPLIT_CANDIDATES );
+				candidates[ncandidates++]=trial_splitvalue;
+			}
+		}
+
+		// sorted, distinct split values. these bound the bins.
+		float bounds[MAX_SPLIT_CANDIDATES];
+		int nbounds=0;
+		for(int c=0;c<ncandidates;c++)
+		{
+			int pos=nbounds;
+			while( pos && bounds[pos-1]>candidates[c] )
+				pos--;
+			if ( pos && bounds[pos-1]==candidates[c] )
+				continue;
+			memmove( bounds+pos+1, bounds+pos, (nbounds-pos)*sizeof(float) );
+			bounds[pos]=candidates[c];
+			nbounds++;
+		}
+
+		// for each distinct split s, count the triangles with min>=s (right), max<=s, and
+		// min==max==s (which are on the right, not the left)
+		int nmin_at_or_above[MAX_SPLIT_CANDIDATES+1];
+		int nmax_at_or_below[MAX_SPLIT_CANDIDATES+1];
+		int nflat_at[MAX_SPLIT_CANDIDATES];
+		memset(nmin_at_or_above,0,sizeof(nmin_at_or_above));
+		memset(nmax_at_or_below,0,sizeof(nmax_at_or_below));
+		memset(nflat_at,0,sizeof(nflat_at));
+		float min_coord=1.0e23,max_coord=-1.0e23;
+		for(int t=0;t<ntris;t++)
+		{
+			float minc=tri_mins[3*t+axis];
+			float maxc=tri_maxs[3*t+axis];
+			min_coord = min( min_coord, minc );
+			max_coord = max( max_coord, maxc );
+
+			// # of bounds <= minc
+			int lo=0,hi=nbounds;
+			while(lo<hi)
+			{
+				int mid=(lo+hi)>>1;
+				if (bounds[mid]<=minc)
+					lo=mid+1;
 				else
-				{
-					// else, split at the triangle vertex if possible
-					CacheOptimizedTriangle &tri=OptimizedTriangleList[tri_list[ts]];
-					trial_splitvalue = tri.Vertex(tv)[axis];
-					if ((trial_splitvalue>MaxBound[axis]) || (trial_splitvalue<MinBound[axis]))
-						continue;							// don't try this vertex - not inside
-					
-				}
-//				printf("ts=%d tv=%d tp=%f\n",ts,tv,trial_splitvalue);
-				float trial_cost=
-					CalculateCostsOfSplit(axis,tri_list,ntris,MinBound,MaxBound,trial_splitvalue,
-										  trial_nleft,trial_nright, trial_nboth);
-// 				printf("try %d cost=%f nl=%d nr=%d nb=%d sp=%f\n",axis,trial_cost,trial_nleft,trial_nright, trial_nboth,
-// 					   trial_splitvalue);
-				if (trial_cost<best_cost)
-				{
-					split_plane=axis;
-					best_cost=trial_cost;
-					best_nleft=trial_nleft;
-					best_nright=trial_nright;
-					best_nboth=trial_nboth;
-					best_splitvalue=trial_splitvalue;
-					// save away the axis classification of each triangle
-					for(int t=0 ; t < ntris; t++)
-					{
-						CacheOptimizedTriangle &tri=OptimizedTriangleList[tri_list[t]];
-						tri.m_Data.m_GeometryData.m_nTmpData1 = tri.m_Data.m_GeometryData.m_nTmpData0;
-					}
-				}
-				if (ts==-1)
-					break;
+					hi=mid;
+			}
+			nmin_at_or_above[lo]++;
+
+			// # of bounds < maxc
+			lo=0;
+			hi=nbounds;
+			while(lo<hi)
+			{
+				int mid=(lo+hi)>>1;
+				if (bounds[mid]<maxc)
+					lo=mid+1;
+				else
+					hi=mid;
 			}
+			nmax_at_or_below[lo]++;
+			if ( (minc==maxc) && (lo<nbounds) && (bounds[lo]==maxc) )
+				nflat_at[lo]++;
 		}
+		// turn the bins into running sums
+		for(int b=nbounds-1;b>=0;b--)
+			nmin_at_or_above[b]+=nmin_at_or_above[b+1];
+		for(int b=1;b<nbounds;b++)
+			nmax_at_or_below[b]+=nmax_at_or_below[b-1];
 
+		for(int c=0;c<ncandidates;c++)
+		{
+			float trial_splitvalue=candidates[c];
+			int b=0;
+			while(bounds[b]!=trial_splitvalue)
+				b++;
+			int trial_nright=nmin_at_or_above[b+1];
+			int trial_nleft=nmax_at_or_below[b]-nflat_at[b];
+			int trial_nboth=ntris-trial_nleft-trial_nright;
+
+			// if the split resulted in one half being empty, "grow" the empty half
+			if (trial_nleft && (trial_nboth==0) && (trial_nright==0))
+				trial_splitvalue=max_coord;
+			if (trial_nright && (trial_nboth==0) && (trial_nleft==0))
+				trial_splitvalue=min_coord;
+
+			float trial_cost=CostOfSplit(axis,MinBound,MaxBound,trial_splitvalue,
+										 trial_nleft,trial_nright,trial_nboth);
+			if (trial_cost<best_cost)
+			{
+				split_plane=axis;
+				best_cost=trial_cost;
+				best_nleft=trial_nleft;
+				best_nright=trial_nright;
+				best_nboth=trial_nboth;
+				best_splitvalue=trial_splitvalue;
+				best_classifyvalue=candidates[c];
+			}
+		}
 	}
+
 	float cost_of_no_split=COST_OF_INTERSECTION*ntris;
 	if ( (cost_of_no_split<=best_cost) || NEVER_SPLIT || (depth>MAX_TREE_DEPTH))
 	{
 		// no benefit to splitting. just make this a leaf node
-		OptimizedKDTree[node_number].Children=KDNODE_STATE_LEAF+(TriangleIndexList.Count()<<2);
-		OptimizedKDTree[node_number].SetNumberOfTrianglesInLeafNode(ntris);
-#ifdef DEBUG_RAYTRACE
-		OptimizedKDTree[node_number].vecMins = MinBound;
-		OptimizedKDTree[node_number].vecMaxs = MaxBound;
-#endif
-		for(int t=0;t<ntris;t++)
-			TriangleIndexList.AddToTail(tri_list[t]);
+		MakeLeaf(node_number,tri_list,ntris,MinBound,MaxBound);
+		delete[] tri_mins;
+		delete[] tri_maxs;
+		return;
 	}
-	else
+
+	// its worth splitting!
+	// we will achieve the splitting without sorting by using a selection algorithm.
+	int32 *new_triangle_list;
+	new_triangle_list=new int32[ntris];
+
+	Vector LeftMins=MinBound;
+	Vector LeftMaxes=MaxBound;
+	Vector RightMins=MinBound;
+	Vector RightMaxes=MaxBound;
+	LeftMaxes[split_plane]=best_splitvalue;
+	RightMins[split_plane]=best_splitvalue;
+
+	int n_left_output=0;
+	int n_both_output=0;
+	int n_right_output=0;
+	for(int t=0;t<ntris;t++)
 	{
-// 		printf("best split was %d at %f (mid=%f,n=%d, sk=%d)\n",split_plane,best_splitvalue,
-// 			   0.5*(MinBound[split_plane]+MaxBound[split_plane]),ntris,tri_skip);
-		// its worth splitting!
-		// we will achieve the splitting without sorting by using a selection algorithm.
-		int32 *new_triangle_list;
-		new_triangle_list=new int32[ntris];
-
-		// now, perform surface area/cost check to determine whether this split was worth it
-		Vector LeftMins=MinBound;
-		Vector LeftMaxes=MaxBound;
-		Vector RightMins=MinBound;
-		Vector RightMaxes=MaxBound;
-		LeftMaxes[split_plane]=best_splitvalue;
-		RightMins[split_plane]=best_splitvalue;
-		
-		int n_left_output=0;
-		int n_both_output=0;
-		int n_right_output=0;
-		for(int t=0;t<ntris;t++)
+		switch( ClassifyExtentsAgainstSplit( tri_mins[3*t+split_plane], tri_maxs[3*t+split_plane],
+											 best_classifyvalue ) )
 		{
-			CacheOptimizedTriangle &tri=OptimizedTriangleList[tri_list[t]];
-			switch( tri.m_Data.m_GeometryData.m_nTmpData1 )
-			{
-				case PLANECHECK_NEGATIVE:
-//					printf("%d goes left\n",t);
-					new_triangle_list[n_left_output++]=tri_list[t];
-					break;
-				case PLANECHECK_POSITIVE:
-					n_right_output++;
-//					printf("%d goes right\n",t);
-					new_triangle_list[ntris-n_right_output]=tri_list[t];
-					break;
-				case PLANECHECK_STRADDLING:
-//					printf("%d goes both\n",t);
-					new_triangle_list[best_nleft+n_both_output]=tri_list[t];
-					n_both_output++;
-					break;
-
-					
-			}
+			case PLANECHECK_NEGATIVE:
+				new_triangle_list[n_left_output++]=tri_list[t];
+				break;
+			case PLANECHECK_POSITIVE:
+				n_right_output++;
+				new_triangle_list[ntris-n_right_output]=tri_list[t];
+				break;
+			case PLANECHECK_STRADDLING:
+				new_triangle_list[best_nleft+n_both_output]=tri_list[t];
+				n_both_output++;
+				break;
 		}
-		int left_child=OptimizedKDTree.Count();
-		int right_child=left_child+1;
-// 		printf("node %d split on axis %d at %f, nl=%d nr=%d nb=%d lc=%d rc=%d\n",node_number,
-// 			   split_plane,best_splitvalue,best_nleft,best_nright,best_nboth,
-// 			   left_child,right_child);
-		OptimizedKDTree[node_number].Children=split_plane+(left_child<<2);
-		OptimizedKDTree[node_number].SplittingPlaneValue=best_splitvalue;
+	}
+	Assert( ( n_left_output==best_nleft ) && ( n_right_output==best_nright ) && ( n_both_output==best_nboth ) );
+	delete[] tri_mins;
+	delete[] tri_maxs;
+
+	int left_child=m_pNodes->Count();
+	int right_child=left_child+1;
+	CacheOptimizedKDNode &node=(*m_pNodes)[node_number];
+	node.Children=split_plane+(left_child<<2);
+	node.SplittingPlaneValue=best_splitvalue;
 #ifdef DEBUG_RAYTRACE
-		OptimizedKDTree[node_number].vecMins = MinBound;
-		OptimizedKDTree[node_number].vecMaxs = MaxBound;
+	node.vecMins = MinBound;
+	node.vecMaxs = MaxBound;
 #endif
-		CacheOptimizedKDNode newnode;
-		OptimizedKDTree.AddToTail(newnode);
-		OptimizedKDTree.AddToTail(newnode);
-		// now, recurse!
-		if ( (ntris<20) && ((best_nleft==0) || (best_nright==0)) )
-			depth+=100;
-		RefineNode(left_child,new_triangle_list,best_nleft+best_nboth,LeftMins,LeftMaxes,depth+1);
-		RefineNode(right_child,new_triangle_list+best_nleft,best_nright+best_nboth,
-				   RightMins,RightMaxes,depth+1);
-		delete[] new_triangle_list;
-	}	
+	CacheOptimizedKDNode newnode;
+	m_pNodes->AddToTail(newnode);
+	m_pNodes->AddToTail(newnode);
+	// now, recurse!
+	if ( (ntris<20) && ((best_nleft==0) || (best_nright==0)) )
+		depth+=100;
+
+	int nleft_tris=best_nleft+best_nboth;
+	int nright_tris=best_nright+best_nboth;
+	if ( ( nThreadLevels>0 ) && ( min( nleft_tris, nright_tris ) >= MIN_TRIS_TO_BUILD_ON_THREAD ) )
+	{
+		// build the right side on another thread while we do the left
+		CUtlVector<CacheOptimizedKDNode> subNodes;
+		CUtlVector<int32> subTriangleIndices;
+		CKDTreeBuilder sub( m_pEnv, &subNodes, &subTriangleIndices );
+		subNodes.AddToTail(newnode);
+		sub.m_pSubtreeTriList=new_triangle_list+best_nleft;
+		sub.m_nSubtreeTris=nright_tris;
+		sub.m_SubtreeMinBound=RightMins;
+		sub.m_SubtreeMaxBound=RightMaxes;
+		sub.m_nSubtreeDepth=depth+1;
+		sub.m_nSubtreeThreadLevels=nThreadLevels-1;
+		ThreadHandle_t hThread=CreateSimpleThread( SubtreeThreadFn, &sub );
+
+		RefineNode(left_child,new_triangle_list,nleft_tris,LeftMins,LeftMaxes,depth+1,nThreadLevels-1);
+
+		ThreadJoin( hThread );
+		ReleaseThreadHandle( hThread );
+		AppendSubtree( right_child, sub );
+	}
+	else
+	{
+		RefineNode(left_child,new_triangle_list,nleft_tris,LeftMins,LeftMaxes,depth+1,nThreadLevels);
+		RefineNode(right_child,new_triangle_list+best_nleft,nright_tris,
+				   RightMins,RightMaxes,depth+1,nThreadLevels);
+	}
+	delete[] new_triangle_list;
+}
+
+
+void RayTracingEnvironment::RefineNode(int node_number,int32 const *tri_list,int ntris,
+									   Vector MinBound,Vector MaxBound, int depth)
+{
+	// split the work up until there are a couple of subtrees per processor
+	int nThreadLevels=0;
+	if ( !( Flags & RTE_FLAGS_SINGLE_THREADED_TREE_GENERATION ) )
+	{
+		int nThreads=GetCPUInformation()->m_nLogicalProcessors;
+		while( ( 1<<nThreadLevels ) < 2*nThreads )
+			nThreadLevels++;
+	}
+
+	CKDTreeBuilder builder( this, &OptimizedKDTree, &TriangleIndexList );
+	builder.RefineNode( node_number, tri_list, ntris, MinBound, MaxBound, depth, nThreadLevels );
 }
 
 
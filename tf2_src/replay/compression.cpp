@@ -8,7 +8,10 @@
 #include "convar.h"
 #include "filesystem.h"
 #include "fmtstr.h"
+#include "utlvector.h"
+#include "tier1/snappy.h"
 #include "../utils/bzip2/bzlib.h"
+#include "zlib/zlib.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -23,6 +26,8 @@ const char *g_pCompressorTypes[ NUM_COMPRESSOR_TYPES ] =
 {
 	"lzss",
 	"bz2",
+	"snappy",
+	"zlib",
 };
 
 //----------------------------------------------------------------------------------------
@@ -102,12 +107,144 @@ private:
 
 //----------------------------------------------------------------------------------------
 
-ICompressor *CreateCompressor( CompressorType_t nType )
+class CCompressor_Snappy : public ICompressor
+{
+public:
+	virtual bool Compress( char *pDest, unsigned int *pDestLen, const char *pSource, unsigned int nSourceLen )
+	{
+		if ( *pDestLen < snappy::MaxCompressedLength( nSourceLen ) )
+			return false;
+
+		size_t nCompressedLen;
+		snappy::RawCompress( pSource, nSourceLen, pDest, &nCompressedLen );
+		*pDestLen = (unsigned int)nCompressedLen;
+		return true;
+	}
+
+	virtual bool Decompress( char *pDest, unsigned int *pDestLen, const char *pSource, unsigned int nSourceLen )
+	{
+		size_t nUncompressedLen;
+		if ( !snappy::GetUncompressedLength( pSource, nSourceLen, &nUncompressedLen ) || nUncompressedLen > *pDestLen )
+			return false;
+
+		if ( !snappy::RawUncompress( pSource, nSourceLen, pDest ) )
+			return false;
+
+		*pDestLen = (unsigned int)nUncompressedLen;
+		return true;
+	}
+
+	virtual int GetEstimatedCompressionSize( unsigned int nSourceLen )
+	{
+		return (int)snappy::MaxCompressedLength( nSourceLen );
+	}
+};
+
+//----------------------------------------------------------------------------------------
+
+#define ZLIB_DEFAULT_LEVEL		6
+#define ZLIB_WINDOW_BITS		15	// 32k window
+#define ZLIB_MEM_LEVEL			8	// deflate state is about 256k, a fraction of bz2's ~7.5 MB at block size 9
+
+//----------------------------------------------------------------------------------------
+
+class CCompressor_Zlib : public ICompressor
+{
+public:
+	CCompressor_Zlib( int nLevel = ZLIB_DEFAULT_LEVEL )
+	:	m_nLevel( nLevel == COMPRESSION_LEVEL_DEFAULT ? ZLIB_DEFAULT_LEVEL : clamp( nLevel, 1, 9 ) )
+	{
+	}
+
+	virtual bool Compress( char *pDest, unsigned int *pDestLen, const char *pSource, unsigned int nSourceLen )
+	{
+		z_stream stream;
+		V_memset( &stream, 0, sizeof( stream ) );
+		if ( deflateInit2( &stream, m_nLevel, Z_DEFLATED, ZLIB_WINDOW_BITS, ZLIB_MEM_LEVEL, Z_DEFAULT_STRATEGY ) != Z_OK )
+			return false;
+
+		if ( m_Dictionary.Count() &&
+			 deflateSetDictionary( &stream, (const Bytef *)m_Dictionary.Base(), m_Dictionary.Count() ) != Z_OK )
+		{
+			deflateEnd( &stream );
+			return false;
+		}
+
+		stream.next_in = (Bytef *)pSource;
+		stream.avail_in = nSourceLen;
+		stream.next_out = (Bytef *)pDest;
+		stream.avail_out = *pDestLen;
+
+		const int nResult = deflate( &stream, Z_FINISH );
+		*pDestLen = stream.total_out;
+		deflateEnd( &stream );
+
+		return nResult == Z_STREAM_END;
+	}
+
+	virtual bool Decompress( char *pDest, unsigned int *pDestLen, const char *pSource, unsigned int nSourceLen )
+	{
+		z_stream stream;
+		V_memset( &stream, 0, sizeof( stream ) );
+		stream.next_in = (Bytef *)pSource;
+		stream.avail_in = nSourceLen;
+		if ( inflateInit2( &stream, ZLIB_WINDOW_BITS ) != Z_OK )
+			return false;
+
+		stream.next_out = (Bytef *)pDest;
+		stream.avail_out = *pDestLen;
+
+		int nResult = inflate( &stream, Z_FINISH );
+		if ( nResult == Z_NEED_DICT && m_Dictionary.Count() )
+		{
+			// Fails if the data was compressed with a different dictionary
+			if ( inflateSetDictionary( &stream, (const Bytef *)m_Dictionary.Base(), m_Dictionary.Count() ) == Z_OK )
+			{
+				nResult = inflate( &stream, Z_FINISH );
+			}
+		}
+
+		*pDestLen = stream.total_out;
+		inflateEnd( &stream );
+
+		return nResult == Z_STREAM_END;
+	}
+
+	virtual int GetEstimatedCompressionSize( unsigned int nSourceLen )
+	{
+		// Room for the dictionary ID too
+		return (int)compressBound( nSourceLen ) + 4;
+	}
+
+	virtual bool SetDictionary( const void *pData, unsigned int nSize )
+	{
+		// Only the last window's worth of the dictionary can be referenced
+		const unsigned int nMaxSize = 1 << ZLIB_WINDOW_BITS;
+		if ( nSize > nMaxSize )
+		{
+			pData = (const uint8 *)pData + nSize - nMaxSize;
+			nSize = nMaxSize;
+		}
+
+		m_Dictionary.CopyArray( (const uint8 *)pData, nSize );
+		return true;
+	}
+
+private:
+	int					m_nLevel;
+	CUtlVector< uint8 >	m_Dictionary;
+};
+
+//----------------------------------------------------------------------------------------
+
+ICompressor *CreateCompressor( CompressorType_t nType, int nLevel/*=COMPRESSION_LEVEL_DEFAULT*/ )
 {
 	switch ( nType )
 	{
 	case COMPRESSORTYPE_BZ2:	return new CCompressor_Bz2();
 	case COMPRESSORTYPE_LZSS:	return new CCompressor_Lzss();
+	case COMPRESSORTYPE_SNAPPY:	return new CCompressor_Snappy();
+	case COMPRESSORTYPE_ZLIB:	return new CCompressor_Zlib( nLevel );
 	}
 
 	return NULL;
@@ -121,109 +258,231 @@ const char *GetCompressorNameSafe( CompressorType_t nType )
 	return g_pCompressorTypes[ nType ];
 }
 
+CompressorType_t GetCompressorTypeFromName( const char *pName )
+{
+	for ( int i = 0; i < (int)NUM_COMPRESSOR_TYPES; ++i )
+	{
+		if ( !V_stricmp( pName, g_pCompressorTypes[ i ] ) )
+			return (CompressorType_t)i;
+	}
+
+	return COMPRESSORTYPE_INVALID;
+}
+
 //----------------------------------------------------------------------------------------
 
-#ifdef _DEBUG
+struct CompressBenchResult_t
+{
+	unsigned int	m_nCompressedSize;
+	double			m_flCompressTime;		// per pass, in seconds
+	double			m_flDecompressTime;
+};
 
-CON_COMMAND( replay_testcompress, "Test compression" )
+//----------------------------------------------------------------------------------------
+
+// Compresses the input in nBlockSize pieces, as the session block publisher would, and
+// repeats until about a second has passed so fast compressors get a stable measurement.
+static bool BenchmarkCompressor( ICompressor *pCompressor, const char *pIn, unsigned int nInSize, unsigned int nBlockSize,
+								 CUtlVector< char > &compressed, CompressBenchResult_t &result )
 {
-	if ( args.ArgC() < 3 )
-	{
-		Warning( "replay_testcompress <lzss|bz2> <file to compress>" );
-		return;
-	}
+	const int nBlocks = ( nInSize + nBlockSize - 1 ) / nBlockSize;
+	CUtlVector< unsigned int > blockSizes;
+	blockSizes.SetCount( nBlocks );
 
-	const char *pInFilename = args[ 2 ];
-	const char *pCompressionTypeName = args[ 1 ];
+	const unsigned int nMaxBlockSize = pCompressor->GetEstimatedCompressionSize( nBlockSize );
+	compressed.SetCount( nBlocks * nMaxBlockSize );
 
-	CompressorType_t nCompressorType = COMPRESSORTYPE_INVALID;
+	CUtlVector< char > decompressed;
+	decompressed.SetCount( nBlockSize );
 
-	for ( int i = 0; i < (int)NUM_COMPRESSOR_TYPES; ++i )
+	const int nMaxPasses = 20;
+	const double flMinTime = 1.0;
+
+	int nPasses = 0;
+	double flStartTime = Plat_FloatTime();
+	do
 	{
-		if ( !V_stricmp( pCompressionTypeName, g_pCompressorTypes[ i ] ) )
+		result.m_nCompressedSize = 0;
+		for ( int i = 0; i < nBlocks; ++i )
 		{
-			nCompressorType = (CompressorType_t)i;
-			break;
+			const unsigned int nOffset = i * nBlockSize;
+			blockSizes[ i ] = nMaxBlockSize;
+			if ( !pCompressor->Compress( compressed.Base() + i * nMaxBlockSize, &blockSizes[ i ], pIn + nOffset, MIN( nBlockSize, nInSize - nOffset ) ) )
+				return false;
+
+			result.m_nCompressedSize += blockSizes[ i ];
 		}
+		++nPasses;
 	}
+	while ( nPasses < nMaxPasses && Plat_FloatTime() - flStartTime < flMinTime );
+	result.m_flCompressTime = ( Plat_FloatTime() - flStartTime ) / nPasses;
 
-	if ( nCompressorType == COMPRESSORTYPE_INVALID )
+	nPasses = 0;
+	flStartTime = Plat_FloatTime();
+	do
 	{
-		Warning( "Invalid compression type specified.  Use \"bz2\" or \"lzss\"\n" );
-		return;
+		for ( int i = 0; i < nBlocks; ++i )
+		{
+			const unsigned int nOffset = i * nBlockSize;
+			const unsigned int nExpectedSize = MIN( nBlockSize, nInSize - nOffset );
+			unsigned int nDecompressedSize = nBlockSize;
+			if ( !pCompressor->Decompress( decompressed.Base(), &nDecompressedSize, compressed.Base() + i * nMaxBlockSize, blockSizes[ i ] ) ||
+				 nDecompressedSize != nExpectedSize ||
+				 V_memcmp( decompressed.Base(), pIn + nOffset, nExpectedSize ) )
+			{
+				return false;
+			}
+		}
+		++nPasses;
 	}
+	while ( nPasses < nMaxPasses && Plat_FloatTime() - flStartTime < flMinTime );
+	result.m_flDecompressTime = ( Plat_FloatTime() - flStartTime ) / nPasses;
 
-	const unsigned int nInFileSize = g_pFullFileSystem->Size( pInFilename );
-	if ( !nInFileSize )
+	// Pack the blocks so the caller can write them out
+	unsigned int nPut = 0;
+	for ( int i = 0; i < nBlocks; ++i )
 	{
-		Warning( "Zero length file.\n" );
-		return;
+		V_memmove( compressed.Base() + nPut, compressed.Base() + i * nMaxBlockSize, blockSizes[ i ] );
+		nPut += blockSizes[ i ];
+	}
+	compressed.SetCountNonDestructively( nPut );
+
+	return true;
+}
+
+//----------------------------------------------------------------------------------------
+
+static bool ReadFileForCompressionTest( const char *pFilename, CUtlVector< char > &data )
+{
+	const unsigned int nSize = g_pFullFileSystem->Size( pFilename );
+	FileHandle_t hFile = nSize ? g_pFullFileSystem->Open( pFilename, "rb" ) : FILESYSTEM_INVALID_HANDLE;
+	if ( !hFile )
+	{
+		Warning( "Failed to open file, %s\n", pFilename );
+		return false;
 	}
-	
-	FileHandle_t hInFile = g_pFullFileSystem->Open( pInFilename, "rb" );
-	if ( !hInFile )
+
+	data.SetCount( nSize );
+	const bool bResult = g_pFullFileSystem->Read( data.Base(), nSize, hFile ) == (int)nSize;
+	g_pFullFileSystem->Close( hFile );
+
+	if ( !bResult )
 	{
-		Warning( "Failed to open file, %s\n", pInFilename );
-		return;
+		Warning( "Failed to read file %s\n", pFilename );
 	}
 
-	char *pUncompressed = new char[ nInFileSize ];
-	if ( !pUncompressed )
+	return bResult;
+}
+
+//----------------------------------------------------------------------------------------
+
+CON_COMMAND( replay_testcompress, "Measure compression ratio and throughput on a file, e.g. a recorded demo or session block" )
+{
+	if ( args.ArgC() < 3 )
 	{
-		Warning( "Failed to alloc %u bytes\n", nInFileSize );
+		Warning( "replay_testcompress <lzss|bz2|snappy|zlib|all> <file to compress> [level] [-dict <file>] [-blocksize <KB>]\n" );
 		return;
 	}
 
-	if ( g_pFullFileSystem->Read( pUncompressed, nInFileSize, hInFile ) != (int)nInFileSize )
+	const char *pCompressionTypeName = args[ 1 ];
+	const char *pInFilename = args[ 2 ];
+	const bool bAll = !V_stricmp( pCompressionTypeName, "all" );
+
+	CompressorType_t nCompressorType = GetCompressorTypeFromName( pCompressionTypeName );
+	if ( !bAll && nCompressorType == COMPRESSORTYPE_INVALID )
 	{
-		Warning( "Failed to read file %s\n", pInFilename );
+		Warning( "Invalid compression type specified.  Use \"lzss\", \"bz2\", \"snappy\", \"zlib\" or \"all\"\n" );
+		return;
 	}
-	else
+
+	const int nLevel = ( args.ArgC() > 3 && args[ 3 ][ 0 ] != '-' ) ? V_atoi( args[ 3 ] ) : COMPRESSION_LEVEL_DEFAULT;
+
+	// Defaults to compressing the whole file as one block
+	const int nBlockSizeKB = args.FindArgInt( "-blocksize", 0 );
+
+	CUtlVector< char > uncompressed;
+	if ( !ReadFileForCompressionTest( pInFilename, uncompressed ) )
+		return;
+
+	CUtlVector< char > dictionary;
+	const char *pDictFilename = args.FindArg( "-dict" );
+	if ( pDictFilename && !ReadFileForCompressionTest( pDictFilename, dictionary ) )
+		return;
+
+	const unsigned int nInFileSize = uncompressed.Count();
+	const unsigned int nBlockSize = nBlockSizeKB > 0 ? MIN( (unsigned int)nBlockSizeKB * 1024, nInFileSize ) : nInFileSize;
+
+	struct TestCase_t
+	{
+		CompressorType_t	m_nType;
+		int					m_nLevel;
+	};
+
+	static const TestCase_t s_AllTests[] =
+	{
+		{ COMPRESSORTYPE_LZSS,		COMPRESSION_LEVEL_DEFAULT },
+		{ COMPRESSORTYPE_BZ2,		COMPRESSION_LEVEL_DEFAULT },
+		{ COMPRESSORTYPE_SNAPPY,	COMPRESSION_LEVEL_DEFAULT },
+		{ COMPRESSORTYPE_ZLIB,		1 },
+		{ COMPRESSORTYPE_ZLIB,		6 },
+		{ COMPRESSORTYPE_ZLIB,		9 },
+	};
+
+	const TestCase_t singleTest = { nCompressorType, nLevel };
+	const TestCase_t *pTests = bAll ? s_AllTests : &singleTest;
+	const int nTests = bAll ? ARRAYSIZE( s_AllTests ) : 1;
+
+	Msg( "%s: %u bytes in %u byte blocks\n", pInFilename, nInFileSize, nBlockSize );
+	Msg( "%-12s %10s %8s %12s %12s\n", "compressor", "size", "ratio", "comp MB/s", "decomp MB/s" );
+
+	const double flMegabytes = nInFileSize / ( 1024.0 * 1024.0 );
+	CUtlVector< char > compressed;
+	for ( int i = 0; i < nTests; ++i )
 	{
-		ICompressor *pCompressor = CreateCompressor( nCompressorType );
-		unsigned int nCompressedSize = pCompressor->GetEstimatedCompressionSize( nInFileSize );
-		char *pCompressed = new char[ nCompressedSize ];
-		if ( !pCompressed )
+		const char *pName = GetCompressorNameSafe( pTests[ i ].m_nType );
+		CFmtStr fmtName( pTests[ i ].m_nLevel == COMPRESSION_LEVEL_DEFAULT ? "%s" : "%s-%d", pName, pTests[ i ].m_nLevel );
+
+		ICompressor *pCompressor = CreateCompressor( pTests[ i ].m_nType, pTests[ i ].m_nLevel );
+		if ( dictionary.Count() && !pCompressor->SetDictionary( dictionary.Base(), dictionary.Count() ) )
 		{
-			Warning( "Failed to allocate %u bytes for compressed buffer.\n", nCompressedSize );
-			return;
+			Msg( "%-12s (no dictionary support)\n", fmtName.Access() );
 		}
 
-		// Compress
-		if ( !pCompressor->Compress( pCompressed, &nCompressedSize, pUncompressed, nInFileSize ) )
+		CompressBenchResult_t result;
+		const bool bResult = BenchmarkCompressor( pCompressor, uncompressed.Base(), nInFileSize, nBlockSize, compressed, result );
+		delete pCompressor;
+
+		if ( !bResult )
 		{
-			Warning( "Compression failed.\n" );
-		}
-		else
-		{
-			CFmtStr fmtOutFilename( "%s.%s", pInFilename, pCompressionTypeName );
-			FileHandle_t hOutFile = g_pFullFileSystem->Open( fmtOutFilename.Access(), "wb+" );	
-			if ( !hOutFile )
-			{
-				Warning( "Failed to open out file, %s\n", fmtOutFilename.Access() );
-			}
-			else
-			{
-				if ( g_pFullFileSystem->Write( pCompressed, nCompressedSize, hOutFile ) != (int)nCompressedSize )
-				{
-					Warning( "Failed to write compressed data to %s\n", fmtOutFilename.Access() );
-				}
-				else
-				{
-					const float flRatio = (float)nInFileSize / nCompressedSize;
-					Warning( "Wrote compressed file to successfully (%s) - ratio: %.2f:1\n", fmtOutFilename.Access(), flRatio );
-				}
-
-				g_pFullFileSystem->Close( hOutFile );
-			}
+			Warning( "%-12s failed to compress or round trip\n", fmtName.Access() );
+			continue;
 		}
 
-		delete [] pCompressed;
+		Msg( "%-12s %10u %7.2f:1 %12.1f %12.1f\n", fmtName.Access(), result.m_nCompressedSize, (float)nInFileSize / result.m_nCompressedSize,
+			 flMegabytes / MAX( result.m_flCompressTime, 1e-9 ), flMegabytes / MAX( result.m_flDecompressTime, 1e-9 ) );
 	}
 
-	g_pFullFileSystem->Close( hInFile );
-}
+	if ( bAll )
+		return;
 
-#endif	// _DEBUG
+	CFmtStr fmtOutFilename( "%s.%s", pInFilename, pCompressionTypeName );
+	FileHandle_t hOutFile = g_pFullFileSystem->Open( fmtOutFilename.Access(), "wb+" );
+	if ( !hOutFile )
+	{
+		Warning( "Failed to open out file, %s\n", fmtOutFilename.Access() );
+		return;
+	}
+
+	if ( g_pFullFileSystem->Write( compressed.Base(), compressed.Count(), hOutFile ) != compressed.Count() )
+	{
+		Warning( "Failed to write compressed data to %s\n", fmtOutFilename.Access() );
+	}
+	else
+	{
+		Msg( "Wrote compressed file to %s\n", fmtOutFilename.Access() );
+	}
+
+	g_pFullFileSystem->Close( hOutFile );
+}
 
 //----------------------------------------------------------------------------------------
\ No newline at end of file
@@ -19,6 +19,10 @@ public:
 	virtual bool	Decompress( char *pDest, unsigned int *pDestLen, const char *pSource, unsigned int nSourceLen ) = 0;
 
 	virtual int		GetEstimatedCompressionSize( unsigned int nSourceLen ) = 0;
+
+	// Data that is likely to show up in the source, e.g. a typical block.  Both sides must
+	// use the same dictionary.  Returns false if the compressor doesn't support one.
+	virtual bool	SetDictionary( const void *pData, unsigned int nSize ) { return false; }
 };
 
 //----------------------------------------------------------------------------------------
@@ -29,18 +33,25 @@ enum CompressorType_t
 
 	COMPRESSORTYPE_LZSS,
 	COMPRESSORTYPE_BZ2,
+	COMPRESSORTYPE_SNAPPY,		// Fastest, lowest ratio
+	COMPRESSORTYPE_ZLIB,		// Deflate, levels 1-9 and dictionaries
 
 	NUM_COMPRESSOR_TYPES
 };
 
+// NOTE: Compressor types are written to block and session info files, so only add new ones at the end.
+
+#define COMPRESSION_LEVEL_DEFAULT	-1		// Each compressor's own default
+
 //----------------------------------------------------------------------------------------
 
 extern const char *g_pCompressorTypes[ NUM_COMPRESSOR_TYPES ];
 
 //----------------------------------------------------------------------------------------
 
-ICompressor *CreateCompressor( CompressorType_t nType );
+ICompressor *CreateCompressor( CompressorType_t nType, int nLevel = COMPRESSION_LEVEL_DEFAULT );
 const char *GetCompressorNameSafe( CompressorType_t nType );
+CompressorType_t GetCompressorTypeFromName( const char *pName );	// COMPRESSORTYPE_INVALID if unknown
 
 //----------------------------------------------------------------------------------------
 
@@ -65,6 +65,8 @@ ConVar replay_fileserver_path( "replay_fileserver_path", "", FCVAR_REPLICATED |
 
 ConVar replay_max_publish_threads( "replay_max_publish_threads", "4", FCVAR_GAMEDLL, "The max number of threads allowed for publishing replay data, e.g. FTP threads.", true, 4, true, 8 );
 ConVar replay_block_dump_interval( "replay_block_dump_interval", "10", FCVAR_DONTRECORD, "The server will write partial replay files at this interval when recording.", true, MIN_SERVER_DUMP_INTERVAL, true, MAX_SERVER_DUMP_INTERVAL );
+ConVar replay_block_compressor( "replay_block_compressor", "bz2", FCVAR_DONTRECORD, "Compressor for session blocks before they are published: \"bz2\", \"lzss\", \"zlib\" or \"snappy\".  Only clients built with zlib and snappy support can download blocks compressed with them, so leave this at bz2 unless all of your players have such a client.  Use replay_testcompress to compare them on your own data." );
+ConVar replay_block_compression_level( "replay_block_compression_level", "6", FCVAR_DONTRECORD, "Compression level for compressors that support one (zlib: 1 is fastest, 9 is smallest).", true, 1, true, 9 );
 
 ConVar replay_data_lifespan( "replay_data_lifespan", "1", FCVAR_REPLICATED | FCVAR_DONTRECORD, "The number of days before replay data will be removed from the server.  Server operators can expect that any data written more than replay_data_lifespan days will be considered stale, and any subsequent execution of replay_docleanup (or automatic cleanup, which can be enabled with replay_fileserver_autocleanup) will remove that data.", true, 1, true, 30 );
 ConVar replay_local_fileserver_path( "replay_local_fileserver_path", "", FCVAR_DONTRECORD, "The file server local path.  For example, \"c:\\MyWebServer\\htdocs\\replays\" or \"/MyWebServer/htdocs/replays\"." );
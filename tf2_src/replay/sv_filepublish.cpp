@@ -153,7 +153,7 @@ CLocalPublishJob *SV_CreateLocalPublishJob( const char *pLocalFilename )
 
 //----------------------------------------------------------------------------------------
 
-CCompressionJob::CCompressionJob( const uint8 *pSrcData, uint32 nSrcSize, CompressorType_t nType,
+CCompressionJob::CCompressionJob( const uint8 *pSrcData, uint32 nSrcSize, CompressorType_t nType, int nLevel,
 								  bool *pOutResult, uint32 *pResultSize )
 :	m_pSrcData( pSrcData ),
 	m_nSrcSize( nSrcSize ),
@@ -163,7 +163,12 @@ CCompressionJob::CCompressionJob( const uint8 *pSrcData, uint32 nSrcSize, Compre
 	*m_pCompressionResult = false;
 	*m_pResultSize = 0;
 
-	m_pCompressor = CreateCompressor( nType );
+	m_pCompressor = CreateCompressor( nType, nLevel );
+}
+
+CCompressionJob::~CCompressionJob()
+{
+	delete m_pCompressor;
 }
 
 JobStatus_t	CCompressionJob::DoExecute()
@@ -176,14 +181,22 @@ JobStatus_t	CCompressionJob::DoExecute()
 		return JOB_FAILED;
 	}
 
+	if ( !m_pCompressor )
+	{
+		// Publish uncompressed
+		SetError( ERROR_OK_COULDNOTCOMPRESS );
+		m_pResult = (uint8 *)m_pSrcData;
+		*m_pResultSize = m_nSrcSize;
+		return JOB_FAILED;
+	}
+
 	int nResult = JOB_FAILED;
 
-	// Attempt to compress the file
-	const int nMaxCompressedSize = ceil( m_nSrcSize * 1.1f ) + 600;	// see "destLen" - http://www.bzip.org/1.0.3/html/util-fns.html
-	uint8 *pCompressed = new uint8[ nMaxCompressedSize ];
+	// Attempt to compress the file - each compressor knows its own worst case
+	unsigned int nCompressedSize = m_pCompressor->GetEstimatedCompressionSize( m_nSrcSize );
+	uint8 *pCompressed = new uint8[ nCompressedSize ];
 
 	// Compress
-	unsigned int nCompressedSize;
 	PrintEventStartMsg( "Compressing" );
 	if ( !m_pCompressor->Compress( (char *)pCompressed, &nCompressedSize, (const char *)m_pSrcData, m_nSrcSize ) )
 	{
@@ -313,6 +326,8 @@ public:
 		m_nPhase( PHASE_INVALID ),
 		m_bCompressedOk( false ),
 		m_bHashedOk( false ),
+		m_nCompressorType( COMPRESSORTYPE_INVALID ),
+		m_nCompressionLevel( COMPRESSION_LEVEL_DEFAULT ),
 		m_nHeaderSize( 0 ),
 		m_nCompressedSize( 0 ),
 		m_nInSize( 0 ),
@@ -401,6 +416,7 @@ public:
 		{
 			m_PhaseQueue.Insert( PHASE_COMPRESSION );
 			m_nCompressorType = params.m_nCompressorType;	// Cache compressor type
+			m_nCompressionLevel = params.m_nCompressionLevel;
 		}
 
 		if ( params.m_bHash )
@@ -600,7 +616,7 @@ private:
 		switch ( nPhase )
 		{
 		case PHASE_COMPRESSION:
-			pResult = new CCompressionJob( m_pInData, m_nInSize, m_nCompressorType, &m_bCompressedOk, &m_nCompressedSize );
+			pResult = new CCompressionJob( m_pInData, m_nInSize, m_nCompressorType, m_nCompressionLevel, &m_bCompressedOk, &m_nCompressedSize );
 			break;
 
 		case PHASE_HASH:
@@ -692,8 +708,10 @@ private:
 		// Create the job
 		m_pCurrentJob = GetJobForPhase( m_nPhase );
 
-		// Kick off the job now
-		SV_GetThreadPool()->AddJob( m_pCurrentJob );
+		// Kick off the job now - compression is CPU bound and gets its own low priority thread so it
+		// doesn't hold up the IO threads or compete with the game thread
+		IThreadPool *pThreadPool = m_nPhase == PHASE_COMPRESSION ? SV_GetCompressionThreadPool() : SV_GetThreadPool();
+		pThreadPool->AddJob( m_pCurrentJob );
 	}
 
 	void InvokeCallback()
@@ -708,6 +726,7 @@ private:
 	bool				m_bCompressedOk;
 	bool				m_bHashedOk;
 	CompressorType_t	m_nCompressorType;
+	int					m_nCompressionLevel;
 	uint8				m_aHash[16];
 	Phase_t				m_nPhase;
 	PublishStatus_t		m_nStatus;
@@ -37,6 +37,7 @@ struct PublishFileParams_t
 	{
 		V_memset( this, 0, sizeof( PublishFileParams_t ) );
 		m_nCompressorType = COMPRESSORTYPE_BZ2;
+		m_nCompressionLevel = COMPRESSION_LEVEL_DEFAULT;
 	}
 
 	IPublishCallbackHandler	*m_pCallbackHandler;
@@ -50,6 +51,7 @@ struct PublishFileParams_t
 	int						m_nHeaderSize;
 	void					*m_pUserData;
 	CompressorType_t		m_nCompressorType;
+	int						m_nCompressionLevel;
 };
 
 //----------------------------------------------------------------------------------------
@@ -142,8 +144,9 @@ class ICompressor;
 class CCompressionJob : public CBasePublishJob
 {
 public:
-	CCompressionJob( const uint8 *pSrcData, uint32 nSrcSize, CompressorType_t nType,
+	CCompressionJob( const uint8 *pSrcData, uint32 nSrcSize, CompressorType_t nType, int nLevel,
 		bool *pOutCompressed, uint32 *pCompressedSize );
+	~CCompressionJob();
 
 	enum CompressionError_t
 	{
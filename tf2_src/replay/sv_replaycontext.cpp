@@ -27,6 +27,7 @@
 CServerReplayContext::CServerReplayContext()
 :	m_pSessionRecorder( NULL ),
 	m_pFileserverCleaner( NULL ),
+	m_pCompressionThreadPool( NULL ),
 	m_bShouldAbortRecording( false ),
 	m_flConVarSanityCheckTime( 0.0f )
 {
@@ -36,6 +37,11 @@ CServerReplayContext::~CServerReplayContext()
 {
 	delete m_pSessionRecorder;
 	delete m_pFileserverCleaner;
+
+	if ( m_pCompressionThreadPool )
+	{
+		DestroyThreadPool( m_pCompressionThreadPool );
+	}
 }
 
 bool CServerReplayContext::Init( CreateInterfaceFn fnFactory )
@@ -54,6 +60,9 @@ bool CServerReplayContext::Init( CreateInterfaceFn fnFactory )
 
 	m_pShared->Init( fnFactory );
 
+	if ( !InitCompressionThreadPool() )
+		return false;
+
 	// Create directory for temp files
 	CFmtStr fmtTmpDir( "%s%s", SV_GetBasePath(), SUBDIR_TMP );
 	g_pFullFileSystem->CreateDirHierarchy( fmtTmpDir.Access() );
@@ -69,6 +78,34 @@ bool CServerReplayContext::Init( CreateInterfaceFn fnFactory )
 	return true;
 }
 
+bool CServerReplayContext::InitCompressionThreadPool()
+{
+	Log( "Replay: Creating compression thread pool..." );
+	IThreadPool *pThreadPool = CreateThreadPool();
+	if ( !pThreadPool )
+	{
+		Log( "failed!\n" );
+		return false;
+	}
+
+	// A single thread, so only one block's compressor state is ever alive and a slow compressor can't
+	// starve the publish threads.  Blocks are small and written every replay_block_dump_interval seconds,
+	// so one thread keeps up easily.
+	ThreadPoolStartParams_t params( false, 1 );
+	params.iThreadPriority = TP_PRIORITY_LOW;
+	if ( !pThreadPool->Start( params, "ReplayCompress" ) )
+	{
+		Log( "failed!\n" );
+		DestroyThreadPool( pThreadPool );
+		return false;
+	}
+	Log( "succeeded.\n" );
+
+	m_pCompressionThreadPool = pThreadPool;
+
+	return true;
+}
+
 void CServerReplayContext::CleanTmpDir()
 {
 	int nFilesRemoved = 0;
@@ -107,6 +144,11 @@ void CServerReplayContext::Shutdown()
 {
 	m_pShared->Shutdown();
 
+	if ( m_pCompressionThreadPool )
+	{
+		m_pCompressionThreadPool->Stop();
+	}
+
 #if BUILD_CURL
 	// Shutdown cURL
 	curl_global_cleanup();
@@ -64,12 +64,14 @@ public:
 
 	CSessionRecorder		*m_pSessionRecorder;
 	CFileserverCleaner		*m_pFileserverCleaner;
+	IThreadPool				*m_pCompressionThreadPool;	// Session block compression, kept off the shared IO pool
 
 	char					m_szFileserverIP[16];		// Fileserver's IP, cached any time "replay_fileserver_offload_hostname" is modified.
 	char					m_szFileserverProxyIP[16];	// Proxy's IP, cached any time "replay_fileserver_offload_proxy_host" is modified.
 
 private:
 	void					CleanTmpDir();
+	bool					InitCompressionThreadPool();
 	void					ConVarSanityThink();
 
 	float					m_flConVarSanityCheckTime; 
@@ -112,6 +114,11 @@ inline IThreadPool *SV_GetThreadPool()
 	return g_pServerReplayContext->m_pShared->m_pThreadPool;
 }
 
+inline IThreadPool *SV_GetCompressionThreadPool()
+{
+	return g_pServerReplayContext->m_pCompressionThreadPool;
+}
+
 inline char const *SV_GetFileserverIP()
 {
 	return g_pServerReplayContext->m_szFileserverIP;
@@ -14,6 +14,25 @@
 
 //----------------------------------------------------------------------------------------
 
+extern ConVar replay_block_compressor;
+extern ConVar replay_block_compression_level;
+
+//----------------------------------------------------------------------------------------
+
+static CompressorType_t GetBlockCompressorType()
+{
+	const CompressorType_t nType = GetCompressorTypeFromName( replay_block_compressor.GetString() );
+	if ( nType == COMPRESSORTYPE_INVALID )
+	{
+		Warning( "Replay: Unknown compressor \"%s\" in replay_block_compressor, using bz2.\n", replay_block_compressor.GetString() );
+		return COMPRESSORTYPE_BZ2;
+	}
+
+	return nType;
+}
+
+//----------------------------------------------------------------------------------------
+
 CSessionBlockPublisher::CSessionBlockPublisher( CServerRecordingSession *pSession,
 											    CSessionInfoPublisher *pSessionInfoPublisher )
 :	m_pSession( pSession ),
@@ -219,7 +238,8 @@ void CSessionBlockPublisher::PublishBlock( CServerRecordingSessionBlock *pBlock
 	params.m_pSrcData = pSafeBlockData;
 	params.m_nSrcSize = nBlockSize;
 	params.m_pCallbackHandler = this;
-	params.m_nCompressorType = COMPRESSORTYPE_BZ2;
+	params.m_nCompressorType = GetBlockCompressorType();
+	params.m_nCompressionLevel = replay_block_compression_level.GetInt();
 	params.m_bHash = true;
 	params.m_bFreeSrcData = true;
 	params.m_bDeleteFile = false;
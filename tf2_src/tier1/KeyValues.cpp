@@ -28,6 +28,7 @@
 #include "utlhash.h"
 #include "utlvector.h"
 #include "utlqueue.h"
+#include "tier0/threadtools.h"
 #include "UtlSortVector.h"
 #include "convar.h"
 
@@ -42,7 +43,6 @@ const char *(*KeyValues::s_pfGetStringForSymbol)( int symbol ) = &KeyValues::Get
 CKeyValuesGrowableStringTable *KeyValues::s_pGrowableStringTable = NULL;
 
 #define KEYVALUES_TOKEN_SIZE	4096
-static char s_pTokenBuf[KEYVALUES_TOKEN_SIZE];
 
 
 #define INTERNALWRITE( pData, len ) InternalWrite( filesystem, f, pBuf, pData, len )
@@ -122,29 +122,55 @@ private:
 	const char *m_pFilename;
 	int		m_errorIndex;
 	int		m_maxErrorIndex;
-} g_KeyValuesErrorStack;
+};
+
+
+// The token buffer and error stack are kept per thread so files can be parsed on
+// several threads at once.  A worker thread allocates its state the first time it
+// parses something and keeps it for the life of the thread.
+struct KeyValuesParseState_t
+{
+	char					m_TokenBuf[KEYVALUES_TOKEN_SIZE];
+	CKeyValuesErrorStack	m_ErrorStack;
+};
+static KeyValuesParseState_t s_MainThreadParseState;
+static CThreadLocalPtr<KeyValuesParseState_t> s_pParseState;
 
+// Each load looks its state up once and hands it down to everything it calls.
+static KeyValuesParseState_t &GetParseState()
+{
+	if ( ThreadInMainThread() )
+		return s_MainThreadParseState;
+
+	KeyValuesParseState_t *pState = s_pParseState;
+	if ( !pState )
+	{
+		pState = new KeyValuesParseState_t;
+		s_pParseState = pState;
+	}
+	return *pState;
+}
 
 // a simple helper that creates stack entries as it goes in & out of scope
 class CKeyErrorContext
 {
 public:
-	CKeyErrorContext( KeyValues *pKv )
+	CKeyErrorContext( CKeyValuesErrorStack &errorStack, KeyValues *pKv ) : m_errorStack( errorStack )
 	{
 		Init( pKv->GetNameSymbol() );
 	}
 
 	~CKeyErrorContext()
 	{
-		g_KeyValuesErrorStack.Pop();
+		m_errorStack.Pop();
 	}
-	CKeyErrorContext( int symName )
+	CKeyErrorContext( CKeyValuesErrorStack &errorStack, int symName ) : m_errorStack( errorStack )
 	{
 		Init( symName );
 	}
 	void Reset( int symName )
 	{
-		g_KeyValuesErrorStack.Reset( m_stackLevel, symName );
+		m_errorStack.Reset( m_stackLevel, symName );
 	}
 	int GetStackLevel() const
 	{
@@ -153,9 +179,10 @@ public:
 private:
 	void Init( int symName )
 	{
-		m_stackLevel = g_KeyValuesErrorStack.Push( symName );
+		m_stackLevel = m_errorStack.Push( symName );
 	}
 
+	CKeyValuesErrorStack &m_errorStack;
 	int m_stackLevel;
 };
 
@@ -535,7 +562,7 @@ const char *KeyValues::GetName( void ) const
 // Purpose: Read a single token from buffer (0 terminated)
 //-----------------------------------------------------------------------------
 #pragma warning (disable:4706)
-const char *KeyValues::ReadToken( CUtlBuffer &buf, bool &wasQuoted, bool &wasConditional )
+const char *KeyValues::ReadToken( CUtlBuffer &buf, KeyValuesParseState_t &state, bool &wasQuoted, bool &wasConditional )
 {
 	wasQuoted = false;
 	wasConditional = false;
@@ -543,6 +570,8 @@ const char *KeyValues::ReadToken( CUtlBuffer &buf, bool &wasQuoted, bool &wasCon
 	if ( !buf.IsValid() )
 		return NULL; 
 
+	char *pTokenBuf = state.m_TokenBuf;
+
 	// eating white spaces and remarks loop
 	while ( true )
 	{
@@ -564,17 +593,17 @@ const char *KeyValues::ReadToken( CUtlBuffer &buf, bool &wasQuoted, bool &wasCon
 	{
 		wasQuoted = true;
 		buf.GetDelimitedString( m_bHasEscapeSequences ? GetCStringCharConversion() : GetNoEscCharConversion(), 
-			s_pTokenBuf, KEYVALUES_TOKEN_SIZE );
-		return s_pTokenBuf;
+			pTokenBuf, KEYVALUES_TOKEN_SIZE );
+		return pTokenBuf;
 	}
 
 	if ( *c == '{' || *c == '}' )
 	{
 		// it's a control char, just add this one char and stop reading
-		s_pTokenBuf[0] = *c;
-		s_pTokenBuf[1] = 0;
+		pTokenBuf[0] = *c;
+		pTokenBuf[1] = 0;
 		buf.SeekGet( CUtlBuffer::SEEK_CURRENT, 1 );
-		return s_pTokenBuf;
+		return pTokenBuf;
 	}
 
 	// read in the token until we hit a whitespace or a control character
@@ -605,18 +634,18 @@ const char *KeyValues::ReadToken( CUtlBuffer &buf, bool &wasQuoted, bool &wasCon
 
 		if (nCount < (KEYVALUES_TOKEN_SIZE-1) )
 		{
-			s_pTokenBuf[nCount++] = *c;	// add char to buffer
+			pTokenBuf[nCount++] = *c;	// add char to buffer
 		}
 		else if ( !bReportedError )
 		{
 			bReportedError = true;
-			g_KeyValuesErrorStack.ReportError(" ReadToken overflow" );
+			state.m_ErrorStack.ReportError(" ReadToken overflow" );
 		}
 
 		buf.SeekGet( CUtlBuffer::SEEK_CURRENT, 1 );
 	}
-	s_pTokenBuf[ nCount ] = 0;
-	return s_pTokenBuf;
+	pTokenBuf[ nCount ] = 0;
+	return pTokenBuf;
 }
 #pragma warning (default:4706)
 
@@ -2228,24 +2257,25 @@ bool KeyValues::LoadFromBuffer( char const *resourceName, CUtlBuffer &buf, IBase
 	CUtlVector< KeyValues * > baseKeys;
 	bool wasQuoted;
 	bool wasConditional;
-	g_KeyValuesErrorStack.SetFilename( resourceName );	
+	KeyValuesParseState_t &state = GetParseState();
+	state.m_ErrorStack.SetFilename( resourceName );	
 	do 
 	{
 		bool bAccepted = true;
 
 		// the first thing must be a key
-		const char *s = ReadToken( buf, wasQuoted, wasConditional );
+		const char *s = ReadToken( buf, state, wasQuoted, wasConditional );
 		if ( !buf.IsValid() || !s || *s == 0 )
 			break;
 
 		if ( !Q_stricmp( s, "#include" ) )	// special include macro (not a key name)
 		{
-			s = ReadToken( buf, wasQuoted, wasConditional );
+			s = ReadToken( buf, state, wasQuoted, wasConditional );
 			// Name of subfile to load is now in s
 
 			if ( !s || *s == 0 )
 			{
-				g_KeyValuesErrorStack.ReportError("#include is NULL " );
+				state.m_ErrorStack.ReportError("#include is NULL " );
 			}
 			else
 			{
@@ -2256,12 +2286,12 @@ bool KeyValues::LoadFromBuffer( char const *resourceName, CUtlBuffer &buf, IBase
 		}
 		else if ( !Q_stricmp( s, "#base" ) )
 		{
-			s = ReadToken( buf, wasQuoted, wasConditional );
+			s = ReadToken( buf, state, wasQuoted, wasConditional );
 			// Name of subfile to load is now in s
 
 			if ( !s || *s == 0 )
 			{
-				g_KeyValuesErrorStack.ReportError("#base is NULL " );
+				state.m_ErrorStack.ReportError("#base is NULL " );
 			}
 			else
 			{
@@ -2290,24 +2320,24 @@ bool KeyValues::LoadFromBuffer( char const *resourceName, CUtlBuffer &buf, IBase
 		}
 
 		// get the '{'
-		s = ReadToken( buf, wasQuoted, wasConditional );
+		s = ReadToken( buf, state, wasQuoted, wasConditional );
 
 		if ( wasConditional )
 		{
 			bAccepted = !m_bEvaluateConditionals || EvaluateConditional( s );
 
 			// Now get the '{'
-			s = ReadToken( buf, wasQuoted, wasConditional );
+			s = ReadToken( buf, state, wasQuoted, wasConditional );
 		}
 
 		if ( s && *s == '{' && !wasQuoted )
 		{
 			// header is valid so load the file
-			pCurrentKey->RecursiveLoadFromBuffer( resourceName, buf );
+			pCurrentKey->RecursiveLoadFromBuffer( resourceName, buf, state );
 		}
 		else
 		{
-			g_KeyValuesErrorStack.ReportError("LoadFromBuffer: missing {" );
+			state.m_ErrorStack.ReportError("LoadFromBuffer: missing {" );
 		}
 
 		if ( !bAccepted )
@@ -2347,7 +2377,7 @@ bool KeyValues::LoadFromBuffer( char const *resourceName, CUtlBuffer &buf, IBase
 		}
 	}
 
-	g_KeyValuesErrorStack.SetFilename( "" );	
+	state.m_ErrorStack.SetFilename( "" );	
 
 	return true;
 }
@@ -2385,19 +2415,19 @@ bool KeyValues::LoadFromBuffer( char const *resourceName, const char *pBuffer, I
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
-void KeyValues::RecursiveLoadFromBuffer( char const *resourceName, CUtlBuffer &buf )
+void KeyValues::RecursiveLoadFromBuffer( char const *resourceName, CUtlBuffer &buf, KeyValuesParseState_t &state )
 {
-	CKeyErrorContext errorReport(this);
+	CKeyErrorContext errorReport( state.m_ErrorStack, this );
 	bool wasQuoted;
 	bool wasConditional;
 	if ( errorReport.GetStackLevel() > 100 )
 	{
-		g_KeyValuesErrorStack.ReportError( "RecursiveLoadFromBuffer:  recursion overflow" );
+		state.m_ErrorStack.ReportError( "RecursiveLoadFromBuffer:  recursion overflow" );
 		return;
 	}
 
 	// keep this out of the stack until a key is parsed
-	CKeyErrorContext errorKey( INVALID_KEY_SYMBOL );
+	CKeyErrorContext errorKey( state.m_ErrorStack, INVALID_KEY_SYMBOL );
 
 	// Locate the last child.  (Almost always, we will not have any children.)
 	// We maintain the pointer to the last child here, so we don't have to re-locate
@@ -2410,17 +2440,17 @@ void KeyValues::RecursiveLoadFromBuffer( char const *resourceName, CUtlBuffer &b
 		bool bAccepted = true;
 
 		// get the key name
-		const char * name = ReadToken( buf, wasQuoted, wasConditional );
+		const char * name = ReadToken( buf, state, wasQuoted, wasConditional );
 
 		if ( !name )	// EOF stop reading
 		{
-			g_KeyValuesErrorStack.ReportError("RecursiveLoadFromBuffer:  got EOF instead of keyname" );
+			state.m_ErrorStack.ReportError("RecursiveLoadFromBuffer:  got EOF instead of keyname" );
 			break;
 		}
 
 		if ( !*name ) // empty token, maybe "" or EOF
 		{
-			g_KeyValuesErrorStack.ReportError("RecursiveLoadFromBuffer:  got empty keyname" );
+			state.m_ErrorStack.ReportError("RecursiveLoadFromBuffer:  got empty keyname" );
 			break;
 		}
 
@@ -2434,25 +2464,25 @@ void KeyValues::RecursiveLoadFromBuffer( char const *resourceName, CUtlBuffer &b
 		errorKey.Reset( dat->GetNameSymbol() );
 
 		// get the value
-		const char * value = ReadToken( buf, wasQuoted, wasConditional );
+		const char * value = ReadToken( buf, state, wasQuoted, wasConditional );
 
 		if ( wasConditional && value )
 		{
 			bAccepted = !m_bEvaluateConditionals || EvaluateConditional( value );
 
 			// get the real value
-			value = ReadToken( buf, wasQuoted, wasConditional );
+			value = ReadToken( buf, state, wasQuoted, wasConditional );
 		}
 
 		if ( !value )
 		{
-			g_KeyValuesErrorStack.ReportError("RecursiveLoadFromBuffer:  got NULL key" );
+			state.m_ErrorStack.ReportError("RecursiveLoadFromBuffer:  got NULL key" );
 			break;
 		}
 		
 		if ( *value == '}' && !wasQuoted )
 		{
-			g_KeyValuesErrorStack.ReportError("RecursiveLoadFromBuffer:  got } in key" );
+			state.m_ErrorStack.ReportError("RecursiveLoadFromBuffer:  got } in key" );
 			break;
 		}
 
@@ -2461,13 +2491,13 @@ void KeyValues::RecursiveLoadFromBuffer( char const *resourceName, CUtlBuffer &b
 			// this isn't a key, it's a section
 			errorKey.Reset( INVALID_KEY_SYMBOL );
 			// sub value list
-			dat->RecursiveLoadFromBuffer( resourceName, buf );
+			dat->RecursiveLoadFromBuffer( resourceName, buf, state );
 		}
 		else 
 		{
 			if ( wasConditional )
 			{
-				g_KeyValuesErrorStack.ReportError("RecursiveLoadFromBuffer:  got conditional between key and value" );
+				state.m_ErrorStack.ReportError("RecursiveLoadFromBuffer:  got conditional between key and value" );
 				break;
 			}
 			
@@ -2543,7 +2573,7 @@ void KeyValues::RecursiveLoadFromBuffer( char const *resourceName, CUtlBuffer &b
 
 			// Look ahead one token for a conditional tag
 			int prevPos = buf.TellGet();
-			const char *peek = ReadToken( buf, wasQuoted, wasConditional );
+			const char *peek = ReadToken( buf, state, wasQuoted, wasConditional );
 			if ( wasConditional )
 			{
 				bAccepted = !m_bEvaluateConditionals || EvaluateConditional( peek );
@@ -56,6 +56,16 @@ inline unsigned int CountTrailingZeros(unsigned int elem)
 }
 
 #endif
+#elif defined( GNUC )
+#define FAST_BIT_SCAN 1
+inline unsigned int CountLeadingZeros(unsigned int x)
+{
+	return x ? __builtin_clz(x) : 32;
+}
+inline unsigned int CountTrailingZeros(unsigned int elem)
+{
+	return elem ? __builtin_ctz(elem) : 32;
+}
 #else
 #define FAST_BIT_SCAN 0
 #endif
@@ -119,6 +129,64 @@ public:
 static CBitWriteMasksInit g_BitWriteMasksInit;
 
 
+//-----------------------------------------------------------------------------
+// Bulk bit copy used by WriteBitsFromBuffer and ReadBits. Fills whole dwords
+// at pDest from an arbitrary bit offset in pSrc: each step does one unaligned
+// 64 bit load (memcpy) and shifts the wanted 32 bits out of it, instead of
+// going through the bounds checked, masked ReadUBitLong/WriteUBitLong pair.
+// Stops early rather than load past nSrcBytes. Returns the number of bits
+// copied, which is always a multiple of 32.
+//-----------------------------------------------------------------------------
+static int CopyBitsToDWords( unsigned long *pDest, const unsigned char *pSrc, int nSrcBytes, int iSrcBit, int nBits )
+{
+	int nCopied = 0;
+	int nShift = iSrcBit & 7;
+	const unsigned char *pCur = pSrc + ( iSrcBit >> 3 );
+	const unsigned char *pEnd = pSrc + nSrcBytes - sizeof( uint64 );
+
+	while ( nBits - nCopied >= 32 && pCur <= pEnd )
+	{
+		uint64 qw;
+		Q_memcpy( &qw, pCur, sizeof( qw ) );
+		StoreLittleDWord( pDest, 0, (uint32)( LittleQWord( qw ) >> nShift ) );
+		++pDest;
+		pCur += 4;
+		nCopied += 32;
+	}
+
+	return nCopied;
+}
+
+//-----------------------------------------------------------------------------
+// Branch free varint helpers. The encoded size only depends on the index of
+// the highest set bit, and the 7 bit groups can be spread into bytes with a
+// handful of masks and shifts instead of a compare per byte.
+//-----------------------------------------------------------------------------
+static FORCEINLINE int VarInt32Size( uint32 data )
+{
+#if FAST_BIT_SCAN
+	// (bits + 6) / 7 with bits = 32 - clz( data | 1 ), using x*37 >> 8 == x/7 for x < 39
+	int nBits = 32 - CountLeadingZeros( data | 1 );
+	return ( ( nBits + 6 ) * 37 ) >> 8;
+#else
+	return 1 + ( data >= ( 1u << 7 ) ) + ( data >= ( 1u << 14 ) ) + ( data >= ( 1u << 21 ) ) + ( data >= ( 1u << 28 ) );
+#endif
+}
+
+static FORCEINLINE uint64 VarInt32Spread( uint32 data, int nSize )
+{
+	uint64 v = data;
+	uint64 spread =	( v & 0x0000007F ) |
+					( ( v & 0x00003F80 ) << 1 ) |
+					( ( v & 0x001FC000 ) << 2 ) |
+					( ( v & 0x0FE00000 ) << 3 ) |
+					( ( v & 0xF0000000 ) << 4 );
+	// continuation bit on every byte but the last
+	uint64 cont = 0x8080808080ULL & ( ( 1ULL << ( ( nSize - 1 ) * 8 ) ) - 1 );
+	return spread | cont;
+}
+
+
 // ---------------------------------------------------------------------------------------- //
 // bf_write
 // ---------------------------------------------------------------------------------------- //
@@ -227,49 +295,27 @@ void bf_write::WriteVarInt32( uint32 data )
 	{
 		uint8 *target = ((uint8*)m_pData) + (m_iCurBit>>3);
 
-		target[0] = static_cast<uint8>(data | 0x80);
-		if ( data >= (1 << 7) )
+		int size = VarInt32Size( data );
+		uint64 encoded = VarInt32Spread( data, size );
+
+		if ( (m_iCurBit>>3) + (int)sizeof( uint64 ) <= m_nDataBytes )
 		{
-			target[1] = static_cast<uint8>((data >>  7) | 0x80);
-			if ( data >= (1 << 14) )
-			{
-				target[2] = static_cast<uint8>((data >> 14) | 0x80);
-				if ( data >= (1 << 21) )
-				{
-					target[3] = static_cast<uint8>((data >> 21) | 0x80);
-					if ( data >= (1 << 28) )
-					{
-						target[4] = static_cast<uint8>(data >> 28);
-						m_iCurBit += 5 * 8;
-						return;
-					}
-					else
-					{
-						target[3] &= 0x7F;
-						m_iCurBit += 4 * 8;
-						return;
-					}
-				}
-				else
-				{
-					target[2] &= 0x7F;
-					m_iCurBit += 3 * 8;
-					return;
-				}
-			}
-			else
-			{
-				target[1] &= 0x7F;
-				m_iCurBit += 2 * 8;
-				return;
-			}
+			// Merge into a whole qword so whatever follows the varint is left alone
+			uint64 mask = ( 1ULL << ( size * 8 ) ) - 1;
+			uint64 qw;
+			Q_memcpy( &qw, target, sizeof( qw ) );
+			qw = LittleQWord( ( LittleQWord( qw ) & ~mask ) | encoded );
+			Q_memcpy( target, &qw, sizeof( qw ) );
 		}
 		else
 		{
-			target[0] &= 0x7F;
-			m_iCurBit += 1 * 8;
-			return;
+			for ( int i = 0; i < size; ++i )
+			{
+				target[i] = static_cast<uint8>( encoded >> ( i * 8 ) );
+			}
 		}
+
+		m_iCurBit += size * 8;
 	}
 	else // Slow path
 	{
@@ -408,12 +454,7 @@ void bf_write::WriteSignedVarInt64( int64 data )
 
 int	bf_write::ByteSizeVarInt32( uint32 data )
 {
-	int size = 1;
-	while ( data > 0x7F ) {
-		size++;
-		data >>= 7;
-	}
-	return size;
+	return VarInt32Size( data );
 }
 
 int	bf_write::ByteSizeVarInt64( uint64 data )
@@ -536,14 +577,47 @@ bool bf_write::WriteBits(const void *pInData, int nBits)
 
 bool bf_write::WriteBitsFromBuffer( bf_read *pIn, int nBits )
 {
-	// This could be optimized a little by
+	if ( nBits <= 32 )
+	{
+		WriteUBitLong( pIn->ReadUBitLong( nBits ), nBits );
+		return !IsOverflowed() && !pIn->IsOverflowed();
+	}
+
+	// Let the per-call checks below produce the usual overflow behavior
+	if ( IsPC() && GetNumBitsLeft() >= nBits && pIn->GetNumBitsLeft() >= nBits )
+	{
+		// Source is byte aligned, WriteBits can take it straight from memory
+		if ( (pIn->m_iCurBit & 7) == 0 )
+		{
+			WriteBits( pIn->m_pData + (pIn->m_iCurBit >> 3), nBits );
+			pIn->m_iCurBit += nBits;
+			return !IsOverflowed();
+		}
+
+		// Get the destination onto a dword boundary, then copy whole dwords
+		int nHead = ( 32 - (m_iCurBit & 31) ) & 31;
+		if ( nHead )
+		{
+			WriteUBitLong( pIn->ReadUBitLong( nHead ), nHead );
+			nBits -= nHead;
+		}
+
+		int nCopied = CopyBitsToDWords( &m_pData[m_iCurBit >> 5], pIn->m_pData, pIn->m_nDataBytes, pIn->m_iCurBit, nBits );
+		m_iCurBit += nCopied;
+		pIn->m_iCurBit += nCopied;
+		nBits -= nCopied;
+	}
+
 	while ( nBits > 32 )
 	{
 		WriteUBitLong( pIn->ReadUBitLong( 32 ), 32 );
 		nBits -= 32;
 	}
 
-	WriteUBitLong( pIn->ReadUBitLong( nBits ), nBits );
+	if ( nBits )
+	{
+		WriteUBitLong( pIn->ReadUBitLong( nBits ), nBits );
+	}
 	return !IsOverflowed() && !pIn->IsOverflowed();
 }
 
@@ -893,6 +967,26 @@ void bf_read::ReadBits(void *pOutData, int nBits)
 	}
 
 	// X360TBD: Can't read dwords in ReadBits because they'll get swapped
+	if ( IsPC() && nBitsLeft >= 32 && GetNumBitsLeft() >= nBitsLeft )
+	{
+		if ( (m_iCurBit & 7) == 0 )
+		{
+			// byte aligned, block copy
+			int numbytes = nBitsLeft >> 3;
+			Q_memcpy( pOut, m_pData + (m_iCurBit >> 3), numbytes );
+			pOut += numbytes;
+			nBitsLeft -= numbytes << 3;
+			m_iCurBit += numbytes << 3;
+		}
+		else
+		{
+			int nCopied = CopyBitsToDWords( (unsigned long*)pOut, m_pData, m_nDataBytes, m_iCurBit, nBitsLeft );
+			pOut += nCopied >> 3;
+			nBitsLeft -= nCopied;
+			m_iCurBit += nCopied;
+		}
+	}
+
 	if ( IsPC() )
 	{
 		// read dwords
@@ -1024,6 +1118,21 @@ uint32 bf_read::ReadVarInt32()
 	int count = 0;
 	uint32 b;
 
+	// Byte aligned with a full varint left in the buffer, read bytes directly
+	if ( (m_iCurBit & 7) == 0 && GetNumBitsLeft() >= bitbuf::kMaxVarint32Bytes * 8 )
+	{
+		const unsigned char *pIn = m_pData + (m_iCurBit >> 3);
+		do
+		{
+			b = pIn[count];
+			result |= (b & 0x7F) << (7 * count);
+			++count;
+		} while ( (b & 0x80) && count < bitbuf::kMaxVarint32Bytes );
+
+		m_iCurBit += count * 8;
+		return result;
+	}
+
 	do 
 	{
 		if ( count == bitbuf::kMaxVarint32Bytes ) 
@@ -0,0 +1,763 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Read-only binary KeyValues images
+//
+//=============================================================================//
+
+#if defined( _WIN32 ) && !defined( _X360 )
+#include "winlite.h"
+#elif defined( POSIX )
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "tier1/kvimage.h"
+#include "tier1/KeyValues.h"
+#include "tier1/checksum_crc.h"
+#include "tier1/strtools.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/utlvector.h"
+#include "tier1/UtlStringMap.h"
+#include "filesystem.h"
+#include "Color.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#define KVIMAGE_MAX_HASH_BITS	24
+
+
+//-----------------------------------------------------------------------------
+// FNV-1a over the lower case name
+//-----------------------------------------------------------------------------
+uint32 KVImage_HashName( const char *pName, int nLength )
+{
+	uint32 nHash = 2166136261u;
+	for ( int i = 0; i < nLength; i++ )
+	{
+		uint8 c = (uint8)pName[i];
+		if ( c >= 'A' && c <= 'Z' )
+		{
+			c += 'a' - 'A';
+		}
+		nHash = ( nHash ^ c ) * 16777619u;
+	}
+	return nHash;
+}
+
+uint32 KVImage_HashName( const char *pName )
+{
+	return KVImage_HashName( pName, V_strlen( pName ) );
+}
+
+
+//-----------------------------------------------------------------------------
+// Flattens a KeyValues tree breadth first, so every node's children are contiguous
+//-----------------------------------------------------------------------------
+class CKVImageBuilder
+{
+public:
+	CKVImageBuilder() : m_StringOffsets( false ) {}
+
+	bool Build( KeyValues *pRoot, CUtlBuffer &buf, uint32 nSourceCRC );
+
+private:
+	uint32 AddString( const char *pString );
+	void AddNode( KeyValues *pKey, uint32 nParent );
+	void SetValue( KVImageNode_t &node, KeyValues *pKey );
+	void BuildChildHash( KVImageNode_t &node );
+
+	CUtlVector<KVImageNode_t>	m_Nodes;
+	CUtlVector<KeyValues *>		m_Source;
+	CUtlVector<uint32>			m_HashSlots;
+	CUtlVector<char>			m_Strings;
+	CUtlStringMap<uint32>		m_StringOffsets;
+};
+
+uint32 CKVImageBuilder::AddString( const char *pString )
+{
+	UtlSymId_t id = m_StringOffsets.Find( pString );
+	if ( id != m_StringOffsets.InvalidIndex() )
+		return m_StringOffsets[id];
+
+	uint32 nOffset = m_Strings.Count();
+	m_Strings.AddMultipleToTail( V_strlen( pString ) + 1, pString );
+	m_StringOffsets[pString] = nOffset;
+	return nOffset;
+}
+
+void CKVImageBuilder::AddNode( KeyValues *pKey, uint32 nParent )
+{
+	KVImageNode_t &node = m_Nodes[m_Nodes.AddToTail()];
+	memset( &node, 0, sizeof(node) );
+	node.m_nName = AddString( pKey->GetName() );
+	node.m_nNameHash = KVImage_HashName( pKey->GetName() );
+	node.m_nParent = nParent;
+	node.m_nFirstChild = KVIMAGE_INVALID_NODE;
+	SetValue( node, pKey );
+	m_Source.AddToTail( pKey );
+}
+
+// Stores the value in every form the KeyValues getters would convert it to.  The getters
+// are not used for the string form since KeyValues::GetString() changes the key's type.
+void CKVImageBuilder::SetValue( KVImageNode_t &node, KeyValues *pKey )
+{
+	KeyValues::types_t type = pKey->GetDataType();
+	node.m_nType = (uint8)type;
+	node.m_nString = KVIMAGE_NO_STRING;
+
+	uint64 nUint64 = 0;
+	char buf[64];
+	switch ( type )
+	{
+	case KeyValues::TYPE_STRING:
+	case KeyValues::TYPE_WSTRING:
+		{
+			char utf8[512];
+			const char *pString = utf8;
+			if ( type == KeyValues::TYPE_STRING )
+			{
+				pString = pKey->GetString();
+			}
+			else if ( !V_UnicodeToUTF8( pKey->GetWString(), utf8, sizeof(utf8) ) )
+			{
+				utf8[0] = 0;
+			}
+			node.m_nInt = atoi( pString );
+			node.m_flFloat = (float)atof( pString );
+			nUint64 = (uint64)V_atoi64( pString );
+			node.m_nString = AddString( pString );
+		}
+		break;
+
+	case KeyValues::TYPE_INT:
+		node.m_nInt = pKey->GetInt();
+		node.m_flFloat = (float)node.m_nInt;
+		nUint64 = node.m_nInt;
+		V_snprintf( buf, sizeof(buf), "%d", node.m_nInt );
+		node.m_nString = AddString( buf );
+		break;
+
+	case KeyValues::TYPE_FLOAT:
+		node.m_flFloat = pKey->GetFloat();
+		node.m_nInt = (int)node.m_flFloat;
+		nUint64 = node.m_nInt;
+		V_snprintf( buf, sizeof(buf), "%f", node.m_flFloat );
+		node.m_nString = AddString( buf );
+		break;
+
+	case KeyValues::TYPE_UINT64:
+		// GetInt() asserts on a uint64, it returns 0
+		nUint64 = pKey->GetUint64();
+		node.m_flFloat = (float)nUint64;
+		V_snprintf( buf, sizeof(buf), "%lld", nUint64 );
+		node.m_nString = AddString( buf );
+		break;
+
+	case KeyValues::TYPE_COLOR:
+		// the color shares storage with the int
+		node.m_nInt = pKey->GetInt();
+		nUint64 = (uint32)node.m_nInt;
+		break;
+
+	case KeyValues::TYPE_PTR:
+		// pointers mean nothing once written out
+		node.m_nString = AddString( "0" );
+		break;
+
+	default:
+		break;
+	}
+	node.m_nUint64Low = (uint32)nUint64;
+	node.m_nUint64High = (uint32)( nUint64 >> 32 );
+}
+
+// Open addressed with linear probing, at most half full.  Children are inserted in order
+// so a probe finds the first of several keys with the same name, like KeyValues::FindKey.
+void CKVImageBuilder::BuildChildHash( KVImageNode_t &node )
+{
+	int nBits = 1;
+	while ( ( 1u << nBits ) < node.m_nChildCount * 2 && nBits < KVIMAGE_MAX_HASH_BITS )
+	{
+		nBits++;
+	}
+	uint32 nMask = ( 1u << nBits ) - 1;
+
+	node.m_nHashBits = (uint8)nBits;
+	node.m_nHashSlot = m_HashSlots.Count();
+	m_HashSlots.AddMultipleToTail( nMask + 1 );
+	uint32 *pSlots = m_HashSlots.Base() + node.m_nHashSlot;
+	memset( pSlots, 0, ( nMask + 1 ) * sizeof(uint32) );
+
+	for ( uint32 i = 0; i < node.m_nChildCount; i++ )
+	{
+		uint32 nSlot = m_Nodes[node.m_nFirstChild + i].m_nNameHash & nMask;
+		while ( pSlots[nSlot] )
+		{
+			nSlot = ( nSlot + 1 ) & nMask;
+		}
+		pSlots[nSlot] = i + 1;
+	}
+}
+
+static void PutAligned( CUtlBuffer &buf, const void *pData, int nSize, uint32 *pOffset )
+{
+	while ( buf.TellPut() & 3 )
+	{
+		buf.PutUnsignedChar( 0 );
+	}
+	*pOffset = buf.TellPut();
+	buf.Put( pData, nSize );
+}
+
+bool CKVImageBuilder::Build( KeyValues *pRoot, CUtlBuffer &buf, uint32 nSourceCRC )
+{
+	if ( !pRoot )
+		return false;
+
+	// offset 0 is the empty string
+	m_Strings.AddToTail( 0 );
+	m_StringOffsets[""] = 0;
+
+	AddNode( pRoot, KVIMAGE_INVALID_NODE );
+	for ( int i = 0; i < m_Nodes.Count(); i++ )
+	{
+		uint32 nFirstChild = m_Nodes.Count();
+		uint32 nChildCount = 0;
+		for ( KeyValues *pSub = m_Source[i]->GetFirstSubKey(); pSub; pSub = pSub->GetNextKey() )
+		{
+			AddNode( pSub, i );
+			nChildCount++;
+		}
+
+		KVImageNode_t &node = m_Nodes[i];
+		node.m_nFirstChild = nChildCount ? nFirstChild : KVIMAGE_INVALID_NODE;
+		node.m_nChildCount = nChildCount;
+		if ( nChildCount >= KVIMAGE_MIN_HASHED_CHILDREN )
+		{
+			BuildChildHash( node );
+		}
+	}
+
+	KVImageHeader_t header;
+	memset( &header, 0, sizeof(header) );
+	header.m_nId = KVIMAGE_ID;
+	header.m_nVersion = KVIMAGE_VERSION;
+	header.m_nSourceCRC = nSourceCRC;
+	header.m_nNodeCount = m_Nodes.Count();
+	header.m_nHashSlotCount = m_HashSlots.Count();
+	header.m_nStringSize = m_Strings.Count();
+
+	int nStart = buf.TellPut();
+	buf.Put( &header, sizeof(header) );
+	PutAligned( buf, m_Nodes.Base(), m_Nodes.Count() * sizeof(KVImageNode_t), &header.m_nNodeOffset );
+	PutAligned( buf, m_HashSlots.Base(), m_HashSlots.Count() * sizeof(uint32), &header.m_nHashOffset );
+	PutAligned( buf, m_Strings.Base(), m_Strings.Count(), &header.m_nStringOffset );
+	header.m_nNodeOffset -= nStart;
+	header.m_nHashOffset -= nStart;
+	header.m_nStringOffset -= nStart;
+	header.m_nTotalSize = buf.TellPut() - nStart;
+
+	// now that the offsets are known
+	memcpy( (byte *)buf.Base() + nStart, &header, sizeof(header) );
+	return buf.IsValid();
+}
+
+bool CKeyValuesImage::Build( KeyValues *pKeyValues, CUtlBuffer &buf, uint32 nSourceCRC )
+{
+	CKVImageBuilder builder;
+	return builder.Build( pKeyValues, buf, nSourceCRC );
+}
+
+
+//-----------------------------------------------------------------------------
+// Image
+//-----------------------------------------------------------------------------
+CKeyValuesImage::CKeyValuesImage() : m_pHeader( NULL ), m_pNodes( NULL ), m_pHashSlots( NULL ), m_pStrings( NULL ),
+	m_pAllocated( NULL ), m_pMapped( NULL ), m_nMappedSize( 0 )
+#ifdef _WIN32
+	, m_hMapping( NULL )
+#endif
+{
+}
+
+CKeyValuesImage::~CKeyValuesImage()
+{
+	Purge();
+}
+
+void CKeyValuesImage::Purge()
+{
+	m_pHeader = NULL;
+	m_pNodes = NULL;
+	m_pHashSlots = NULL;
+	m_pStrings = NULL;
+
+	if ( m_pAllocated )
+	{
+		free( m_pAllocated );
+		m_pAllocated = NULL;
+	}
+
+	if ( m_pMapped )
+	{
+#if defined( _WIN32 ) && !defined( _X360 )
+		UnmapViewOfFile( m_pMapped );
+		CloseHandle( (HANDLE)m_hMapping );
+		m_hMapping = NULL;
+#elif defined( POSIX )
+		munmap( m_pMapped, m_nMappedSize );
+#endif
+		m_pMapped = NULL;
+		m_nMappedSize = 0;
+	}
+}
+
+// Checks every offset once so the accessors don't have to
+bool CKeyValuesImage::Validate( const void *pData, int nSize ) const
+{
+	if ( !pData || nSize < (int)sizeof(KVImageHeader_t) || ( (size_t)pData & 3 ) )
+		return false;
+
+	const KVImageHeader_t *pHeader = (const KVImageHeader_t *)pData;
+	if ( pHeader->m_nId != KVIMAGE_ID || pHeader->m_nVersion != KVIMAGE_VERSION || pHeader->m_nTotalSize > (uint32)nSize )
+		return false;
+
+	uint64 nTotalSize = pHeader->m_nTotalSize;
+	if ( pHeader->m_nNodeCount == 0 || ( pHeader->m_nNodeOffset & 3 ) || ( pHeader->m_nHashOffset & 3 ) ||
+		pHeader->m_nNodeOffset + (uint64)pHeader->m_nNodeCount * sizeof(KVImageNode_t) > nTotalSize ||
+		pHeader->m_nHashOffset + (uint64)pHeader->m_nHashSlotCount * sizeof(uint32) > nTotalSize ||
+		pHeader->m_nStringOffset + (uint64)pHeader->m_nStringSize > nTotalSize || pHeader->m_nStringSize == 0 )
+		return false;
+
+	const KVImageNode_t *pNodes = (const KVImageNode_t *)( (const byte *)pData + pHeader->m_nNodeOffset );
+	const uint32 *pHashSlots = (const uint32 *)( (const byte *)pData + pHeader->m_nHashOffset );
+	const char *pStrings = (const char *)pData + pHeader->m_nStringOffset;
+	if ( pStrings[0] != 0 || pStrings[pHeader->m_nStringSize - 1] != 0 )
+		return false;
+
+	if ( pNodes[0].m_nParent != KVIMAGE_INVALID_NODE )
+		return false;
+
+	for ( uint32 i = 0; i < pHeader->m_nNodeCount; i++ )
+	{
+		const KVImageNode_t &node = pNodes[i];
+		if ( node.m_nName >= pHeader->m_nStringSize || node.m_nType >= KeyValues::TYPE_NUMTYPES )
+			return false;
+		if ( node.m_nString != KVIMAGE_NO_STRING && node.m_nString >= pHeader->m_nStringSize )
+			return false;
+
+		if ( !node.m_nChildCount )
+			continue;
+
+		// children always come after their parent, which rules out cycles
+		if ( node.m_nFirstChild <= i || node.m_nFirstChild + (uint64)node.m_nChildCount > pHeader->m_nNodeCount )
+			return false;
+		for ( uint32 j = 0; j < node.m_nChildCount; j++ )
+		{
+			if ( pNodes[node.m_nFirstChild + j].m_nParent != i )
+				return false;
+		}
+
+		if ( node.m_nHashBits )
+		{
+			if ( node.m_nHashBits > KVIMAGE_MAX_HASH_BITS )
+				return false;
+			uint32 nSlotCount = 1u << node.m_nHashBits;
+			if ( nSlotCount < node.m_nChildCount * 2 || node.m_nHashSlot + (uint64)nSlotCount > pHeader->m_nHashSlotCount )
+				return false;
+			// each child fills one slot, so FindChild always reaches an empty one
+			uint32 nUsedSlots = 0;
+			for ( uint32 j = 0; j < nSlotCount; j++ )
+			{
+				if ( pHashSlots[node.m_nHashSlot + j] > node.m_nChildCount )
+					return false;
+				if ( pHashSlots[node.m_nHashSlot + j] )
+					++nUsedSlots;
+			}
+			if ( nUsedSlots > node.m_nChildCount )
+				return false;
+		}
+	}
+	return true;
+}
+
+bool CKeyValuesImage::SetImage( const void *pData, int nSize )
+{
+	if ( !Validate( pData, nSize ) )
+		return false;
+
+	m_pHeader = (const KVImageHeader_t *)pData;
+	m_pNodes = (const KVImageNode_t *)( (const byte *)pData + m_pHeader->m_nNodeOffset );
+	m_pHashSlots = (const uint32 *)( (const byte *)pData + m_pHeader->m_nHashOffset );
+	m_pStrings = (const char *)pData + m_pHeader->m_nStringOffset;
+	return true;
+}
+
+bool CKeyValuesImage::InitFromMemory( const void *pData, int nSize )
+{
+	Purge();
+	return SetImage( pData, nSize );
+}
+
+bool CKeyValuesImage::LoadFromFile( IBaseFileSystem *pFileSystem, const char *pFileName, const char *pPathID )
+{
+	Purge();
+
+	FileHandle_t hFile = pFileSystem->Open( pFileName, "rb", pPathID );
+	if ( !hFile )
+		return false;
+
+	int nSize = pFileSystem->Size( hFile );
+	m_pAllocated = malloc( MAX( nSize, 1 ) );
+	bool bOk = ( pFileSystem->Read( m_pAllocated, nSize, hFile ) == nSize );
+	pFileSystem->Close( hFile );
+
+	if ( !bOk || !SetImage( m_pAllocated, nSize ) )
+	{
+		Purge();
+		return false;
+	}
+	return true;
+}
+
+bool CKeyValuesImage::MapFile( const char *pFullPath )
+{
+	Purge();
+
+#if defined( _WIN32 ) && !defined( _X360 )
+	HANDLE hFile = CreateFileA( pFullPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( hFile == INVALID_HANDLE_VALUE )
+		return false;
+
+	DWORD nSize = GetFileSize( hFile, NULL );
+	HANDLE hMapping = ( nSize != INVALID_FILE_SIZE && nSize > 0 ) ? CreateFileMappingA( hFile, NULL, PAGE_READONLY, 0, 0, NULL ) : NULL;
+	CloseHandle( hFile );
+	if ( !hMapping )
+		return false;
+
+	m_pMapped = MapViewOfFile( hMapping, FILE_MAP_READ, 0, 0, 0 );
+	if ( !m_pMapped )
+	{
+		CloseHandle( hMapping );
+		return false;
+	}
+	m_hMapping = hMapping;
+	m_nMappedSize = (int)nSize;
+#elif defined( POSIX )
+	int fd = open( pFullPath, O_RDONLY );
+	if ( fd < 0 )
+		return false;
+
+	struct stat st;
+	if ( fstat( fd, &st ) != 0 || st.st_size <= 0 )
+	{
+		close( fd );
+		return false;
+	}
+
+	void *pMapped = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if ( pMapped == MAP_FAILED )
+		return false;
+
+	m_pMapped = pMapped;
+	m_nMappedSize = (int)st.st_size;
+#else
+	return false;
+#endif
+
+	if ( !SetImage( m_pMapped, m_nMappedSize ) )
+	{
+		Purge();
+		return false;
+	}
+	return true;
+}
+
+// Only the top level file is part of the CRC, an image of a file using #include or #base
+// is not rebuilt when just the included file changes.
+bool CKeyValuesImage::LoadFromTextFile( IBaseFileSystem *pFileSystem, const char *pFileName, const char *pPathID, const char *pCacheFile )
+{
+	Purge();
+
+	CUtlBuffer text;
+	if ( !pFileSystem->ReadFile( pFileName, pPathID, text ) )
+		return false;
+	CRC32_t nCRC = CRC32_ProcessSingleBuffer( text.Base(), text.TellPut() );
+
+	if ( pCacheFile && LoadFromFile( pFileSystem, pCacheFile, "DEFAULT_WRITE_PATH" ) )
+	{
+		if ( GetSourceCRC() == nCRC )
+			return true;
+		Purge();
+	}
+
+	text.PutChar( 0 );
+	KeyValues *pKeyValues = new KeyValues( pFileName );
+	CUtlBuffer image;
+	bool bOk = pKeyValues->LoadFromBuffer( pFileName, (const char *)text.Base(), pFileSystem, pPathID ) && Build( pKeyValues, image, nCRC );
+	pKeyValues->deleteThis();
+	if ( !bOk )
+		return false;
+
+	if ( pCacheFile )
+	{
+		pFileSystem->WriteFile( pCacheFile, "DEFAULT_WRITE_PATH", image );
+	}
+
+	m_pAllocated = malloc( image.TellPut() );
+	memcpy( m_pAllocated, image.Base(), image.TellPut() );
+	if ( !SetImage( m_pAllocated, image.TellPut() ) )
+	{
+		Purge();
+		return false;
+	}
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Views
+//-----------------------------------------------------------------------------
+const char *CKeyValuesView::GetName() const
+{
+	return IsValid() ? m_pImage->GetString( Node().m_nName ) : "";
+}
+
+CKeyValuesView CKeyValuesView::FindChild( const char *pName, int nLength ) const
+{
+	const KVImageNode_t &node = Node();
+	if ( !node.m_nChildCount )
+		return CKeyValuesView();
+
+	uint32 nHash = KVImage_HashName( pName, nLength );
+	if ( node.m_nHashBits )
+	{
+		uint32 nMask = ( 1u << node.m_nHashBits ) - 1;
+		const uint32 *pSlots = m_pImage->m_pHashSlots + node.m_nHashSlot;
+		uint32 nSlot = nHash & nMask;
+		for ( uint32 nProbes = 0; nProbes <= nMask && pSlots[nSlot]; nProbes++, nSlot = ( nSlot + 1 ) & nMask )
+		{
+			uint32 nChild = node.m_nFirstChild + pSlots[nSlot] - 1;
+			const KVImageNode_t &child = m_pImage->GetNode( nChild );
+			if ( child.m_nNameHash == nHash )
+			{
+				const char *pChildName = m_pImage->GetString( child.m_nName );
+				if ( !V_strnicmp( pChildName, pName, nLength ) && pChildName[nLength] == 0 )
+					return CKeyValuesView( m_pImage, nChild );
+			}
+		}
+		return CKeyValuesView();
+	}
+
+	for ( uint32 nChild = node.m_nFirstChild; nChild < node.m_nFirstChild + node.m_nChildCount; nChild++ )
+	{
+		const KVImageNode_t &child = m_pImage->GetNode( nChild );
+		if ( child.m_nNameHash == nHash )
+		{
+			const char *pChildName = m_pImage->GetString( child.m_nName );
+			if ( !V_strnicmp( pChildName, pName, nLength ) && pChildName[nLength] == 0 )
+				return CKeyValuesView( m_pImage, nChild );
+		}
+	}
+	return CKeyValuesView();
+}
+
+CKeyValuesView CKeyValuesView::FindKey( const char *pKeyName ) const
+{
+	CKeyValuesView key = *this;
+	if ( !IsValid() || !pKeyName )
+		return key;
+
+	// look for '/' characters deliminating sub fields
+	while ( *pKeyName && key.IsValid() )
+	{
+		const char *pSlash = strchr( pKeyName, '/' );
+		int nLength = pSlash ? pSlash - pKeyName : V_strlen( pKeyName );
+		key = key.FindChild( pKeyName, nLength );
+		pKeyName += pSlash ? nLength + 1 : nLength;
+	}
+	return key;
+}
+
+CKeyValuesView CKeyValuesView::NextSibling() const
+{
+	if ( !IsValid() )
+		return CKeyValuesView();
+
+	uint32 nParent = Node().m_nParent;
+	if ( nParent == KVIMAGE_INVALID_NODE )
+		return CKeyValuesView();
+
+	const KVImageNode_t &parent = m_pImage->GetNode( nParent );
+	if ( m_nNode + 1 >= parent.m_nFirstChild + parent.m_nChildCount )
+		return CKeyValuesView();
+
+	return CKeyValuesView( m_pImage, m_nNode + 1 );
+}
+
+int CKeyValuesView::GetChildCount() const
+{
+	return IsValid() ? Node().m_nChildCount : 0;
+}
+
+CKeyValuesView CKeyValuesView::GetFirstSubKey() const
+{
+	if ( !IsValid() || !Node().m_nChildCount )
+		return CKeyValuesView();
+	return CKeyValuesView( m_pImage, Node().m_nFirstChild );
+}
+
+CKeyValuesView CKeyValuesView::GetNextKey() const
+{
+	return NextSibling();
+}
+
+CKeyValuesView CKeyValuesView::GetFirstTrueSubKey() const
+{
+	CKeyValuesView key = GetFirstSubKey();
+	while ( key.IsValid() && key.Node().m_nType != KeyValues::TYPE_NONE )
+	{
+		key = key.NextSibling();
+	}
+	return key;
+}
+
+CKeyValuesView CKeyValuesView::GetNextTrueSubKey() const
+{
+	CKeyValuesView key = NextSibling();
+	while ( key.IsValid() && key.Node().m_nType != KeyValues::TYPE_NONE )
+	{
+		key = key.NextSibling();
+	}
+	return key;
+}
+
+CKeyValuesView CKeyValuesView::GetFirstValue() const
+{
+	CKeyValuesView key = GetFirstSubKey();
+	while ( key.IsValid() && key.Node().m_nType == KeyValues::TYPE_NONE )
+	{
+		key = key.NextSibling();
+	}
+	return key;
+}
+
+CKeyValuesView CKeyValuesView::GetNextValue() const
+{
+	CKeyValuesView key = NextSibling();
+	while ( key.IsValid() && key.Node().m_nType == KeyValues::TYPE_NONE )
+	{
+		key = key.NextSibling();
+	}
+	return key;
+}
+
+int CKeyValuesView::GetInt( const char *pKeyName, int nDefaultValue ) const
+{
+	CKeyValuesView key = FindKey( pKeyName );
+	return key.IsValid() ? key.Node().m_nInt : nDefaultValue;
+}
+
+uint64 CKeyValuesView::GetUint64( const char *pKeyName, uint64 nDefaultValue ) const
+{
+	CKeyValuesView key = FindKey( pKeyName );
+	if ( !key.IsValid() )
+		return nDefaultValue;
+
+	const KVImageNode_t &node = key.Node();
+	return ( (uint64)node.m_nUint64High << 32 ) | node.m_nUint64Low;
+}
+
+float CKeyValuesView::GetFloat( const char *pKeyName, float flDefaultValue ) const
+{
+	CKeyValuesView key = FindKey( pKeyName );
+	return key.IsValid() ? key.Node().m_flFloat : flDefaultValue;
+}
+
+const char *CKeyValuesView::GetString( const char *pKeyName, const char *pDefaultValue ) const
+{
+	CKeyValuesView key = FindKey( pKeyName );
+	if ( !key.IsValid() || key.Node().m_nString == KVIMAGE_NO_STRING )
+		return pDefaultValue;
+	return m_pImage->GetString( key.Node().m_nString );
+}
+
+bool CKeyValuesView::GetBool( const char *pKeyName, bool bDefaultValue ) const
+{
+	CKeyValuesView key = FindKey( pKeyName );
+	return key.IsValid() ? key.Node().m_nInt != 0 : bDefaultValue;
+}
+
+bool CKeyValuesView::IsEmpty( const char *pKeyName ) const
+{
+	CKeyValuesView key = FindKey( pKeyName );
+	if ( !key.IsValid() )
+		return true;
+	return key.Node().m_nType == KeyValues::TYPE_NONE && !key.Node().m_nChildCount;
+}
+
+KeyValues::types_t CKeyValuesView::GetDataType( const char *pKeyName ) const
+{
+	CKeyValuesView key = FindKey( pKeyName );
+	return key.IsValid() ? (KeyValues::types_t)key.Node().m_nType : KeyValues::TYPE_NONE;
+}
+
+static void CopyViewToKeyValues( CKeyValuesView view, KeyValues *pKeyValues )
+{
+	switch ( view.GetDataType() )
+	{
+	case KeyValues::TYPE_STRING:
+	case KeyValues::TYPE_WSTRING:
+		pKeyValues->SetString( NULL, view.GetString() );
+		break;
+	case KeyValues::TYPE_INT:
+		pKeyValues->SetInt( NULL, view.GetInt() );
+		break;
+	case KeyValues::TYPE_FLOAT:
+		pKeyValues->SetFloat( NULL, view.GetFloat() );
+		break;
+	case KeyValues::TYPE_UINT64:
+		pKeyValues->SetUint64( NULL, view.GetUint64() );
+		break;
+	case KeyValues::TYPE_COLOR:
+		{
+			int nColor = view.GetInt();
+			const unsigned char *pColor = (const unsigned char *)&nColor;
+			pKeyValues->SetColor( NULL, Color( pColor[0], pColor[1], pColor[2], pColor[3] ) );
+		}
+		break;
+	default:
+		break;
+	}
+
+	// append through the tail, AddSubKey() walks the whole list each time
+	KeyValues *pLast = NULL;
+	for ( CKeyValuesView child = view.GetFirstSubKey(); child.IsValid(); child = child.GetNextKey() )
+	{
+		KeyValues *pChild = new KeyValues( child.GetName() );
+		CopyViewToKeyValues( child, pChild );
+		if ( pLast )
+		{
+			pLast->SetNextKey( pChild );
+		}
+		else
+		{
+			pKeyValues->AddSubKey( pChild );
+		}
+		pLast = pChild;
+	}
+}
+
+KeyValues *CKeyValuesView::MakeKeyValues() const
+{
+	if ( !IsValid() )
+		return NULL;
+
+	KeyValues *pKeyValues = new KeyValues( GetName() );
+	CopyViewToKeyValues( *this, pKeyValues );
+	return pKeyValues;
+}
@@ -0,0 +1,201 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Unit test for bone setup
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "unitlib/unitlib.h"
+#include "tier1/tier1.h"
+#include "tier1/convar.h"
+#include "tier1/utlvector.h"
+#include "mathlib/mathlib.h"
+#include "vstdlib/random.h"
+#include "studio.h"
+#include "bone_setup.h"
+
+
+//-----------------------------------------------------------------------------
+// Used to connect/disconnect the DLL
+//-----------------------------------------------------------------------------
+class CBoneSetupTestAppSystem : public CTier1AppSystem< IAppSystem >
+{
+	typedef CTier1AppSystem< IAppSystem > BaseClass;
+
+public:
+	virtual InitReturnVal_t Init()
+	{
+		MathLib_Init( 2.2f, 2.2f, 0.0f, 2.0f );
+
+		InitReturnVal_t nRetVal = BaseClass::Init();
+		if ( nRetVal != INIT_OK )
+			return nRetVal;
+
+		return INIT_OK;
+	}
+};
+
+USE_UNITTEST_APPSYSTEM( CBoneSetupTestAppSystem )
+
+
+DEFINE_TESTSUITE( BoneSetupTestSuite )
+
+#define TEST_BONE_COUNT		41
+
+//-----------------------------------------------------------------------------
+// A model with only a skeleton: a binary tree of bones, parents before their
+// children, with every third bone used only by attachments
+//-----------------------------------------------------------------------------
+static studiohdr_t *BuildTestSkeleton( CUtlVector< byte > &memory )
+{
+	memory.SetCount( sizeof( studiohdr_t ) + TEST_BONE_COUNT * sizeof( mstudiobone_t ) );
+	V_memset( memory.Base(), 0, memory.Count() );
+
+	studiohdr_t *pHdr = (studiohdr_t *)memory.Base();
+	pHdr->numbones = TEST_BONE_COUNT;
+	pHdr->boneindex = sizeof( studiohdr_t );
+
+	for ( int i = 0; i < TEST_BONE_COUNT; i++ )
+	{
+		mstudiobone_t *pBone = pHdr->pBone( i );
+		pBone->parent = ( i == 0 ) ? -1 : ( i - 1 ) / 2;
+		pBone->flags = ( i % 3 == 0 ) ? BONE_USED_BY_ATTACHMENT : BONE_USED_BY_HITBOX;
+	}
+
+	// a bone is used by whatever its children are used by
+	for ( int i = TEST_BONE_COUNT - 1; i > 0; i-- )
+	{
+		pHdr->pBone( pHdr->pBone( i )->parent )->flags |= pHdr->pBone( i )->flags;
+	}
+
+	return pHdr;
+}
+
+//-----------------------------------------------------------------------------
+// Studio_BuildMatrices as it was before bones were gathered and built four at a time
+//-----------------------------------------------------------------------------
+static void ReferenceBuildMatrices( const CStudioHdr *pStudioHdr, const QAngle& angles, const Vector& origin,
+	const Vector pos[], const Quaternion q[], int iBone, float flScale, matrix3x4_t bonetoworld[], int boneMask )
+{
+	int chain[MAXSTUDIOBONES];
+	int chainlength = 0;
+
+	if ( iBone == -1 )
+	{
+		chainlength = pStudioHdr->numbones();
+		for ( int i = 0; i < pStudioHdr->numbones(); i++ )
+		{
+			chain[chainlength - i - 1] = i;
+		}
+	}
+	else
+	{
+		for ( int i = iBone; i != -1; i = pStudioHdr->boneParent( i ) )
+		{
+			chain[chainlength++] = i;
+		}
+	}
+
+	matrix3x4_t rotationmatrix;
+	AngleMatrix( angles, origin, rotationmatrix );
+
+	if ( flScale < 1.0f-FLT_EPSILON || flScale > 1.0f+FLT_EPSILON )
+	{
+		Vector vecOffset;
+		MatrixGetColumn( rotationmatrix, 3, vecOffset );
+		vecOffset -= origin;
+		vecOffset *= flScale;
+		vecOffset += origin;
+		MatrixSetColumn( vecOffset, 3, rotationmatrix );
+
+		VectorScale( rotationmatrix[0], flScale, rotationmatrix[0] );
+		VectorScale( rotationmatrix[1], flScale, rotationmatrix[1] );
+		VectorScale( rotationmatrix[2], flScale, rotationmatrix[2] );
+	}
+
+	for ( int j = chainlength - 1; j >= 0; j-- )
+	{
+		int i = chain[j];
+		if ( pStudioHdr->boneFlags( i ) & boneMask )
+		{
+			matrix3x4_t bonematrix;
+			QuaternionMatrix( q[i], pos[i], bonematrix );
+
+			if ( pStudioHdr->boneParent( i ) == -1 )
+			{
+				ConcatTransforms( rotationmatrix, bonematrix, bonetoworld[i] );
+			}
+			else
+			{
+				ConcatTransforms( bonetoworld[pStudioHdr->boneParent( i )], bonematrix, bonetoworld[i] );
+			}
+		}
+	}
+}
+
+static void CompareBuildMatrices( const CStudioHdr *pStudioHdr, const Vector pos[], const Quaternion q[], 
+	int iBone, float flScale, int boneMask, float flTolerance )
+{
+	QAngle angles( 10.0f, 120.0f, -5.0f );
+	Vector origin( 100.0f, -200.0f, 30.0f );
+
+	// bones that aren't built must be left alone, so start both from the same garbage
+	matrix3x4_t expected[TEST_BONE_COUNT], actual[TEST_BONE_COUNT];
+	for ( int i = 0; i < TEST_BONE_COUNT; i++ )
+	{
+		expected[i].Init( Vector( i, 0, 0 ), Vector( 0, i, 0 ), Vector( 0, 0, i ), Vector( i, i, i ) );
+		actual[i] = expected[i];
+	}
+
+	ReferenceBuildMatrices( pStudioHdr, angles, origin, pos, q, iBone, flScale, expected, boneMask );
+	Studio_BuildMatrices( pStudioHdr, angles, origin, pos, q, iBone, flScale, actual, boneMask );
+
+	for ( int i = 0; i < TEST_BONE_COUNT; i++ )
+	{
+		Shipping_Assert( MatricesAreEqual( expected[i], actual[i], flTolerance ) );
+	}
+}
+
+DEFINE_TESTCASE( BoneSetupTestBuildMatrices, BoneSetupTestSuite )
+{
+	Msg( "Running Studio_BuildMatrices tests\n" );
+
+	CUtlVector< byte > memory;
+	CStudioHdr studioHdr( BuildTestSkeleton( memory ), NULL );
+	Shipping_Assert( studioHdr.numbones() == TEST_BONE_COUNT );
+
+	CUniformRandomStream random;
+	random.SetSeed( 1234 );
+
+	Vector pos[TEST_BONE_COUNT];
+	Quaternion q[TEST_BONE_COUNT];
+	for ( int i = 0; i < TEST_BONE_COUNT; i++ )
+	{
+		pos[i].Init( random.RandomFloat( -10, 10 ), random.RandomFloat( -10, 10 ), random.RandomFloat( -10, 10 ) );
+		RadianEuler angles( random.RandomFloat( -M_PI, M_PI ), random.RandomFloat( -M_PI, M_PI ), random.RandomFloat( -M_PI, M_PI ) );
+		AngleQuaternion( angles, q[i] );
+	}
+
+	ConVarRef anim_simdbones( "anim_simdbones" );
+	Shipping_Assert( anim_simdbones.IsValid() );
+	bool bOldSIMD = anim_simdbones.GetBool();
+
+	// the scalar path is the old code, the 4-wide one may differ in the last bit
+	for ( int nSIMD = 0; nSIMD < 2; nSIMD++ )
+	{
+		anim_simdbones.SetValue( nSIMD );
+		float flTolerance = nSIMD ? 1e-4f : 1e-6f;
+
+		// whole skeleton, with masks that drop some of the leaves
+		CompareBuildMatrices( &studioHdr, pos, q, -1, 1.0f, BONE_USED_BY_ANYTHING, flTolerance );
+		CompareBuildMatrices( &studioHdr, pos, q, -1, 1.0f, BONE_USED_BY_HITBOX, flTolerance );
+		CompareBuildMatrices( &studioHdr, pos, q, -1, 2.0f, BONE_USED_BY_ATTACHMENT, flTolerance );
+
+		// a single chain from a leaf to the root, long enough to need more than one group of four
+		CompareBuildMatrices( &studioHdr, pos, q, TEST_BONE_COUNT - 1, 1.0f, BONE_USED_BY_ANYTHING, flTolerance );
+		CompareBuildMatrices( &studioHdr, pos, q, TEST_BONE_COUNT - 2, 0.5f, BONE_USED_BY_HITBOX, flTolerance );
+		CompareBuildMatrices( &studioHdr, pos, q, 0, 1.0f, BONE_USED_BY_ANYTHING, flTolerance );
+	}
+
+	anim_simdbones.SetValue( bOldSIMD );
+}
@@ -0,0 +1,165 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Unit test for RayTracingEnvironment
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "unitlib/unitlib.h"
+#include "tier1/tier1.h"
+#include "mathlib/mathlib.h"
+#include "mathlib/ssemath.h"
+#include "vstdlib/random.h"
+#include "raytrace.h"
+
+
+//-----------------------------------------------------------------------------
+// Used to connect/disconnect the DLL
+//-----------------------------------------------------------------------------
+class CRayTraceTestAppSystem : public CTier1AppSystem< IAppSystem >
+{
+	typedef CTier1AppSystem< IAppSystem > BaseClass;
+
+public:
+	virtual InitReturnVal_t Init()
+	{
+		MathLib_Init( 2.2f, 2.2f, 0.0f, 2.0f );
+
+		InitReturnVal_t nRetVal = BaseClass::Init();
+		if ( nRetVal != INIT_OK )
+			return nRetVal;
+
+		return INIT_OK;
+	}
+};
+
+USE_UNITTEST_APPSYSTEM( CRayTraceTestAppSystem )
+
+
+DEFINE_TESTSUITE( RayTraceTestSuite )
+
+#define TEST_TRIANGLE_COUNT		20000
+#define TEST_PACKET_COUNT		4096
+#define TEST_SCENE_SIZE			1000.0f
+
+//-----------------------------------------------------------------------------
+// A box of randomly placed and oriented small triangles with a floor under it
+//-----------------------------------------------------------------------------
+static void BuildTestScene( RayTracingEnvironment &env, CUniformRandomStream &random )
+{
+	for ( int i = 0; i < TEST_TRIANGLE_COUNT; i++ )
+	{
+		Vector vecCenter( random.RandomFloat( 0, TEST_SCENE_SIZE ), random.RandomFloat( 0, TEST_SCENE_SIZE ), random.RandomFloat( 0, TEST_SCENE_SIZE ) );
+		Vector v[3];
+		for ( int j = 0; j < 3; j++ )
+		{
+			v[j] = vecCenter + Vector( random.RandomFloat( -20, 20 ), random.RandomFloat( -20, 20 ), random.RandomFloat( -20, 20 ) );
+		}
+		env.AddTriangle( i, v[0], v[1], v[2], Vector( 1, 1, 1 ) );
+	}
+
+	env.AddQuad( TEST_TRIANGLE_COUNT, Vector( -10, -10, -1 ), Vector( TEST_SCENE_SIZE + 10, -10, -1 ),
+		Vector( TEST_SCENE_SIZE + 10, TEST_SCENE_SIZE + 10, -1 ), Vector( -10, TEST_SCENE_SIZE + 10, -1 ), Vector( 1, 1, 1 ) );
+
+	env.SetupAccelerationStructure();
+}
+
+//-----------------------------------------------------------------------------
+// 8 normalized rays which all have the same direction signs. With bShareOrigin
+// they fan out from one point, otherwise each starts somewhere else in the scene.
+//-----------------------------------------------------------------------------
+static void BuildTestPacket( EightRays &rays, bool bShareOrigin, CUniformRandomStream &random )
+{
+	Vector vecSigns( random.RandomInt( 0, 1 ) ? 1 : -1, random.RandomInt( 0, 1 ) ? 1 : -1, random.RandomInt( 0, 1 ) ? 1 : -1 );
+	Vector vecOrigin( random.RandomFloat( 0, TEST_SCENE_SIZE ), random.RandomFloat( 0, TEST_SCENE_SIZE ), random.RandomFloat( 0, TEST_SCENE_SIZE ) );
+	for ( int i = 0; i < 8; i++ )
+	{
+		if ( !bShareOrigin )
+		{
+			vecOrigin.Init( random.RandomFloat( 0, TEST_SCENE_SIZE ), random.RandomFloat( 0, TEST_SCENE_SIZE ), random.RandomFloat( 0, TEST_SCENE_SIZE ) );
+		}
+
+		Vector vecDir( random.RandomFloat( 0.05f, 1 ), random.RandomFloat( 0.05f, 1 ), random.RandomFloat( 0.05f, 1 ) );
+		vecDir *= vecSigns;
+		VectorNormalize( vecDir );
+
+		FourRays &packet = rays.rays[i >> 2];
+		packet.origin.X( i & 3 ) = vecOrigin.x;
+		packet.origin.Y( i & 3 ) = vecOrigin.y;
+		packet.origin.Z( i & 3 ) = vecOrigin.z;
+		packet.direction.X( i & 3 ) = vecDir.x;
+		packet.direction.Y( i & 3 ) = vecDir.y;
+		packet.direction.Z( i & 3 ) = vecDir.z;
+	}
+}
+
+static bool SameBits( float a, float b )
+{
+	return *(uint32 *)&a == *(uint32 *)&b;
+}
+
+//-----------------------------------------------------------------------------
+// Trace8Rays must give every ray exactly what tracing its packet with
+// Trace4Rays gives it: hit id, distance and normal
+//-----------------------------------------------------------------------------
+static void CompareTrace8Rays( RayTracingEnvironment &env, bool bShareOrigin, CUniformRandomStream &random )
+{
+	fltx4 TMin[2] = { Four_Zeros, Four_Zeros };
+	fltx4 TMax[2] = { ReplicateX4( 2.0f * TEST_SCENE_SIZE ), ReplicateX4( 2.0f * TEST_SCENE_SIZE ) };
+
+	int nHits = 0;
+	int nMismatches = 0;
+	for ( int nPacket = 0; nPacket < TEST_PACKET_COUNT; nPacket++ )
+	{
+		EightRays rays;
+		BuildTestPacket( rays, bShareOrigin, random );
+		int nMask = rays.CalculateDirectionSignMask();
+		Shipping_Assert( nMask != -1 );
+
+		RayTracingResult result8[2];
+		env.Trace8Rays( rays, TMin, TMax, nMask, result8 );
+
+		for ( int p = 0; p < 2; p++ )
+		{
+			RayTracingResult result4;
+			env.Trace4Rays( rays.rays[p], TMin[p], TMax[p], nMask, &result4 );
+
+			for ( int i = 0; i < 4; i++ )
+			{
+				if ( result4.HitIds[i] != -1 )
+				{
+					++nHits;
+				}
+
+				if ( result8[p].HitIds[i] != result4.HitIds[i] ||
+					!SameBits( SubFloat( result8[p].HitDistance, i ), SubFloat( result4.HitDistance, i ) ) ||
+					!SameBits( result8[p].surface_normal.X( i ), result4.surface_normal.X( i ) ) ||
+					!SameBits( result8[p].surface_normal.Y( i ), result4.surface_normal.Y( i ) ) ||
+					!SameBits( result8[p].surface_normal.Z( i ), result4.surface_normal.Z( i ) ) )
+				{
+					++nMismatches;
+				}
+			}
+		}
+	}
+
+	Msg( "  %s origins: %d of %d rays hit, %d mismatches\n", bShareOrigin ? "shared" : "scattered", nHits, TEST_PACKET_COUNT * 8, nMismatches );
+
+	// a scene that nothing hits wouldn't test anything
+	Shipping_Assert( nHits > TEST_PACKET_COUNT );
+	Shipping_Assert( nMismatches == 0 );
+}
+
+DEFINE_TESTCASE( RayTraceTestTrace8Rays, RayTraceTestSuite )
+{
+	Msg( "Running Trace8Rays vs Trace4Rays tests\n" );
+
+	CUniformRandomStream random;
+	random.SetSeed( 1234 );
+
+	RayTracingEnvironment env;
+	BuildTestScene( env, random );
+
+	CompareTrace8Rays( env, true, random );
+	CompareTrace8Rays( env, false, random );
+}
@@ -0,0 +1,287 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Unit test and microbenchmark for bf_write/bf_read
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "unitlib/unitlib.h"
+#include "tier0/fasttimer.h"
+#include "tier1/bitbuf.h"
+#include "tier1/strtools.h"
+
+
+DEFINE_TESTSUITE( BitBufTestSuite )
+
+//-----------------------------------------------------------------------------
+// Deterministic data so runs can be compared against each other
+//-----------------------------------------------------------------------------
+static uint32 s_nSeed;
+
+static uint32 NextRandom()
+{
+	s_nSeed = s_nSeed * 1664525u + 1013904223u;
+	return s_nSeed >> 8;
+}
+
+static int GetBit( const unsigned char *pData, int iBit )
+{
+	return ( pData[iBit >> 3] >> ( iBit & 7 ) ) & 1;
+}
+
+static void SetBit( unsigned char *pData, int iBit, int nValue )
+{
+	if ( nValue )
+		pData[iBit >> 3] |= ( 1 << ( iBit & 7 ) );
+	else
+		pData[iBit >> 3] &= ~( 1 << ( iBit & 7 ) );
+}
+
+
+//-----------------------------------------------------------------------------
+// WriteBitsFromBuffer/ReadBits must match a bit by bit copy for every
+// combination of source and destination alignment.
+//-----------------------------------------------------------------------------
+DEFINE_TESTCASE( BitBufTestBulkCopy, BitBufTestSuite )
+{
+	Msg( "Bulk bit copy test...\n" );
+
+	s_nSeed = 1;
+
+	ALIGN16 unsigned char src[256];
+	ALIGN16 unsigned char dst[256];
+	ALIGN16 unsigned char ref[256];
+	ALIGN16 unsigned char out[260];
+
+	for ( int i = 0; i < 20000; ++i )
+	{
+		for ( int j = 0; j < sizeof( src ); ++j )
+		{
+			src[j] = NextRandom();
+			dst[j] = ref[j] = NextRandom();
+		}
+
+		int nSrcBytes = 4 * ( 1 + NextRandom() % 64 );
+		int iSrcBit = NextRandom() % ( nSrcBytes * 8 );
+		int nBits = 1 + NextRandom() % ( nSrcBytes * 8 - iSrcBit );
+		int iDestBit = NextRandom() % ( sizeof( dst ) * 8 - nBits + 1 );
+
+		for ( int j = 0; j < nBits; ++j )
+		{
+			SetBit( ref, iDestBit + j, GetBit( src, iSrcBit + j ) );
+		}
+
+		bf_read in( src, nSrcBytes );
+		in.Seek( iSrcBit );
+		bf_write buf( dst, sizeof( dst ) );
+		buf.SeekToBit( iDestBit );
+
+		Shipping_Assert( buf.WriteBitsFromBuffer( &in, nBits ) );
+		Shipping_Assert( !V_memcmp( dst, ref, sizeof( dst ) ) );
+		Shipping_Assert( in.GetNumBitsRead() == iSrcBit + nBits );
+		Shipping_Assert( buf.GetNumBitsWritten() == iDestBit + nBits );
+
+		int nOffset = NextRandom() % 4;
+		bf_read in2( src, nSrcBytes );
+		in2.Seek( iSrcBit );
+		in2.ReadBits( out + nOffset, nBits );
+		Shipping_Assert( in2.GetNumBitsRead() == iSrcBit + nBits );
+		for ( int j = 0; j < nBits; ++j )
+		{
+			Shipping_Assert( GetBit( out + nOffset, j ) == GetBit( src, iSrcBit + j ) );
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Varints must be byte for byte identical to the reference encoding and must
+// not disturb anything already written past them.
+//-----------------------------------------------------------------------------
+DEFINE_TESTCASE( BitBufTestVarInt, BitBufTestSuite )
+{
+	Msg( "Varint test...\n" );
+
+	s_nSeed = 2;
+
+	ALIGN16 unsigned char buf1[64];
+	ALIGN16 unsigned char buf2[64];
+
+	for ( int i = 0; i < 20000; ++i )
+	{
+		V_memset( buf1, 0xAA, sizeof( buf1 ) );
+		V_memset( buf2, 0xAA, sizeof( buf2 ) );
+
+		uint32 nValue = ( NextRandom() << 8 ) ^ NextRandom();
+		nValue >>= NextRandom() % 32;
+		int iBit = 8 * ( NextRandom() % 8 ) + ( ( i & 1 ) ? NextRandom() % 8 : 0 );
+
+		bf_write fast( buf1, sizeof( buf1 ) );
+		fast.SeekToBit( iBit );
+		fast.WriteVarInt32( nValue );
+
+		bf_write slow( buf2, sizeof( buf2 ) );
+		slow.SeekToBit( iBit );
+		uint32 nTemp = nValue;
+		while ( nTemp > 0x7F )
+		{
+			slow.WriteUBitLong( ( nTemp & 0x7F ) | 0x80, 8 );
+			nTemp >>= 7;
+		}
+		slow.WriteUBitLong( nTemp, 8 );
+
+		Shipping_Assert( !V_memcmp( buf1, buf2, sizeof( buf1 ) ) );
+		Shipping_Assert( fast.GetNumBitsWritten() == slow.GetNumBitsWritten() );
+		Shipping_Assert( fast.ByteSizeVarInt32( nValue ) * 8 == fast.GetNumBitsWritten() - iBit );
+
+		bf_read in( buf1, sizeof( buf1 ) );
+		in.Seek( iBit );
+		Shipping_Assert( in.ReadVarInt32() == nValue );
+		Shipping_Assert( in.GetNumBitsRead() == fast.GetNumBitsWritten() );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Microbenchmarks. These report bits/ns for a few mixes that look like what
+// the engine pushes through the buffers: entity deltas (flags, small ints,
+// coords and floats), string table updates (varints and bytes) and the bulk
+// copies done when relaying packed entities and demo data.
+//-----------------------------------------------------------------------------
+enum
+{
+	BENCH_BUFFER_BYTES = 64 * 1024,
+	BENCH_ITERATIONS = 200,
+};
+
+static ALIGN16 unsigned char s_BenchBuffer[BENCH_BUFFER_BYTES];
+static ALIGN16 unsigned char s_BenchBuffer2[BENCH_BUFFER_BYTES];
+
+static void ReportBench( const char *pName, CFastTimer &timer, int64 nTotalBits )
+{
+	double flNanoseconds = timer.GetDuration().GetMicrosecondsF() * 1000.0;
+	Msg( "  %-28s %8.3f bits/ns\n", pName, flNanoseconds > 0.0 ? (double)nTotalBits / flNanoseconds : 0.0 );
+}
+
+static void WritePropMix( bf_write &buf )
+{
+	s_nSeed = 3;
+	while ( buf.GetNumBitsLeft() > 256 )
+	{
+		buf.WriteOneBit( NextRandom() & 1 );					// bool prop
+		buf.WriteUBitLong( NextRandom() & 0x7FF, 11 );			// model/ehandle index
+		buf.WriteUBitVar( NextRandom() & 0xFFF );				// prop index delta
+		buf.WriteSBitLong( (int)( NextRandom() & 0xFF ) - 128, 9 );	// small signed int
+		buf.WriteBitCoord( (float)( NextRandom() % 8192 ) * 0.25f );	// origin component
+		buf.WriteBitFloat( (float)NextRandom() );				// raw float
+		buf.WriteUBitLong( NextRandom(), 32 );					// full int
+	}
+}
+
+static int64 ReadPropMix( bf_read &buf )
+{
+	int64 nBits = 0;
+	while ( buf.GetNumBitsLeft() > 256 )
+	{
+		buf.ReadOneBit();
+		buf.ReadUBitLong( 11 );
+		buf.ReadUBitVar();
+		buf.ReadSBitLong( 9 );
+		buf.ReadBitCoord();
+		buf.ReadBitFloat();
+		buf.ReadUBitLong( 32 );
+		nBits = buf.GetNumBitsRead();
+	}
+	return nBits;
+}
+
+DEFINE_TESTCASE( BitBufTestBenchmark, BitBufTestSuite )
+{
+	Msg( "bf_write/bf_read benchmark...\n" );
+
+	CFastTimer timer;
+	int64 nTotalBits;
+
+	// Entity prop mix
+	nTotalBits = 0;
+	timer.Start();
+	for ( int i = 0; i < BENCH_ITERATIONS; ++i )
+	{
+		bf_write buf( s_BenchBuffer, sizeof( s_BenchBuffer ) );
+		WritePropMix( buf );
+		nTotalBits += buf.GetNumBitsWritten();
+	}
+	timer.End();
+	ReportBench( "prop mix write", timer, nTotalBits );
+
+	nTotalBits = 0;
+	timer.Start();
+	for ( int i = 0; i < BENCH_ITERATIONS; ++i )
+	{
+		bf_read buf( s_BenchBuffer, sizeof( s_BenchBuffer ) );
+		nTotalBits += ReadPropMix( buf );
+	}
+	timer.End();
+	ReportBench( "prop mix read", timer, nTotalBits );
+
+	// String table style varints
+	nTotalBits = 0;
+	timer.Start();
+	for ( int i = 0; i < BENCH_ITERATIONS; ++i )
+	{
+		s_nSeed = 4;
+		bf_write buf( s_BenchBuffer, sizeof( s_BenchBuffer ) );
+		while ( buf.GetNumBitsLeft() > 64 )
+		{
+			buf.WriteVarInt32( NextRandom() >> ( NextRandom() & 31 ) );
+			buf.WriteByte( NextRandom() );
+		}
+		nTotalBits += buf.GetNumBitsWritten();
+	}
+	timer.End();
+	ReportBench( "varint write", timer, nTotalBits );
+
+	nTotalBits = 0;
+	timer.Start();
+	for ( int i = 0; i < BENCH_ITERATIONS; ++i )
+	{
+		bf_read buf( s_BenchBuffer, sizeof( s_BenchBuffer ) );
+		while ( buf.GetNumBitsLeft() > 64 )
+		{
+			buf.ReadVarInt32();
+			buf.ReadByte();
+		}
+		nTotalBits += buf.GetNumBitsRead();
+	}
+	timer.End();
+	ReportBench( "varint read", timer, nTotalBits );
+
+	// Bulk copies at awkward alignments, as done for packed entity relaying
+	nTotalBits = 0;
+	timer.Start();
+	for ( int i = 0; i < BENCH_ITERATIONS; ++i )
+	{
+		bf_read in( s_BenchBuffer, sizeof( s_BenchBuffer ) );
+		in.Seek( 3 );
+		bf_write out( s_BenchBuffer2, sizeof( s_BenchBuffer2 ) );
+		out.SeekToBit( 13 );
+		int nBits = sizeof( s_BenchBuffer ) * 8 - 64;
+		out.WriteBitsFromBuffer( &in, nBits );
+		nTotalBits += nBits;
+	}
+	timer.End();
+	ReportBench( "WriteBitsFromBuffer unaligned", timer, nTotalBits );
+
+	nTotalBits = 0;
+	timer.Start();
+	for ( int i = 0; i < BENCH_ITERATIONS; ++i )
+	{
+		bf_read in( s_BenchBuffer, sizeof( s_BenchBuffer ) );
+		in.Seek( 5 );
+		int nBits = sizeof( s_BenchBuffer ) * 8 - 64;
+		in.ReadBits( s_BenchBuffer2, nBits );
+		nTotalBits += nBits;
+	}
+	timer.End();
+	ReportBench( "ReadBits unaligned", timer, nTotalBits );
+}
@@ -0,0 +1,90 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Unit test and yield rate benchmark for coroutines
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "unitlib/unitlib.h"
+#include "vstdlib/coroutine.h"
+#include "tier0/platform.h"
+#include "tier0/dbg.h"
+
+
+DEFINE_TESTSUITE( CoroutineTestSuite )
+
+struct CoroutineYieldTest_t
+{
+	int		m_cubStack;		// live stack held across every yield
+	int		m_nYields;
+	int		m_nDepth;		// stack depth seen inside the coroutine
+	bool	m_bStackIntact;
+};
+
+static void CoroutineYieldFunc( void *pvParam )
+{
+	CoroutineYieldTest_t *pTest = (CoroutineYieldTest_t *)pvParam;
+
+	volatile byte *pStack = (byte *)stackalloc( pTest->m_cubStack + 1 );
+	for ( int i = 0; i < pTest->m_cubStack; i++ )
+	{
+		pStack[i] = (byte)i;
+	}
+	pTest->m_nDepth = (int)Coroutine_GetStackDepth();
+
+	for ( int i = 0; i < pTest->m_nYields; i++ )
+	{
+		Coroutine_YieldToMain();
+	}
+
+	pTest->m_bStackIntact = true;
+	for ( int i = 0; i < pTest->m_cubStack; i++ )
+	{
+		if ( pStack[i] != (byte)i )
+		{
+			pTest->m_bStackIntact = false;
+		}
+	}
+}
+
+DEFINE_TESTCASE( CoroutineTestSelfTest, CoroutineTestSuite )
+{
+	Msg( "Running coroutine self test\n" );
+
+	Shipping_Assert( Coroutine_Test() );
+	Shipping_Assert( !Coroutine_IsActive() );
+
+	// yields come back with the stack as it was left
+	CoroutineYieldTest_t test = { 8192, 10, 0, false };
+	HCoroutine hCoroutine = Coroutine_Create( &CoroutineYieldFunc, &test );
+	int nContinues = 0;
+	while ( Coroutine_Continue( hCoroutine, "CoroutineTestSelfTest" ) )
+	{
+		nContinues++;
+	}
+	Shipping_Assert( nContinues == test.m_nYields );
+	Shipping_Assert( test.m_bStackIntact );
+	Shipping_Assert( test.m_nDepth >= test.m_cubStack );
+}
+
+DEFINE_TESTCASE( CoroutineTestYieldRate, CoroutineTestSuite )
+{
+	Msg( "Running coroutine yield rate benchmark\n" );
+
+	// a yield and continue per iteration, with more and more stack live in the coroutine
+	static const int s_cubStacks[] = { 0, 4096, 16384 };
+	for ( int i = 0; i < ARRAYSIZE( s_cubStacks ); i++ )
+	{
+		CoroutineYieldTest_t test = { s_cubStacks[i], 1000000, 0, false };
+		HCoroutine hCoroutine = Coroutine_Create( &CoroutineYieldFunc, &test );
+
+		double flStart = Plat_FloatTime();
+		while ( Coroutine_Continue( hCoroutine, "CoroutineTestYieldRate" ) )
+		{
+		}
+		double flElapsed = Plat_FloatTime() - flStart;
+
+		Shipping_Assert( test.m_bStackIntact );
+		Msg( "  %6d bytes of stack: %.0f yields/sec\n", test.m_cubStack, test.m_nYields / MAX( flElapsed, 1e-6 ) );
+	}
+}
@@ -0,0 +1,173 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Unit test for binary KeyValues images
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "unitlib/unitlib.h"
+#include "tier1/KeyValues.h"
+#include "tier1/kvimage.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/strtools.h"
+#include "tier1/fmtstr.h"
+
+
+DEFINE_TESTSUITE( KVImageTestSuite )
+
+static KeyValues *BuildTestKeyValues()
+{
+	KeyValues *pRoot = new KeyValues( "items_game" );
+	pRoot->SetString( "game_info/first_valid_class", "1" );
+	pRoot->SetInt( "game_info/num_classes", 9 );
+	pRoot->SetFloat( "game_info/scale", 0.5f );
+	pRoot->SetUint64( "game_info/steamid", 76561197960265728ull );
+	pRoot->SetString( "game_info/empty", "" );
+
+	// enough children to get a hash table
+	KeyValues *pItems = pRoot->FindKey( "items", true );
+	for ( int i = 0; i < 100; i++ )
+	{
+		KeyValues *pItem = pItems->FindKey( CFmtStr( "%d", i ), true );
+		pItem->SetString( "name", CFmtStr( "Item %d", i ) );
+		pItem->SetInt( "item_slot", i % 5 );
+	}
+
+	// a duplicate name, FindKey returns the first one
+	KeyValues *pDuplicate = new KeyValues( "7" );
+	pDuplicate->SetString( "name", "Duplicate" );
+	pItems->AddSubKey( pDuplicate );
+	return pRoot;
+}
+
+DEFINE_TESTCASE( KVImageTestLookup, KVImageTestSuite )
+{
+	Msg( "Running KVImage lookup tests\n" );
+
+	KeyValues *pRoot = BuildTestKeyValues();
+	CUtlBuffer buf;
+	Shipping_Assert( CKeyValuesImage::Build( pRoot, buf, 1234 ) );
+
+	CKeyValuesImage image;
+	Shipping_Assert( image.InitFromMemory( buf.Base(), buf.TellPut() ) );
+	Shipping_Assert( image.GetSourceCRC() == 1234 );
+
+	CKeyValuesView root = image.GetRoot();
+	Shipping_Assert( !V_strcmp( root.GetName(), "items_game" ) );
+
+	// values in every type
+	Shipping_Assert( root.GetInt( "game_info/first_valid_class" ) == 1 );
+	Shipping_Assert( !V_strcmp( root.GetString( "game_info/first_valid_class" ), "1" ) );
+	Shipping_Assert( root.GetInt( "GAME_INFO/Num_Classes" ) == 9 );
+	Shipping_Assert( !V_strcmp( root.GetString( "game_info/num_classes" ), "9" ) );
+	Shipping_Assert( root.GetFloat( "game_info/scale" ) == 0.5f );
+	Shipping_Assert( root.GetInt( "game_info/scale" ) == 0 );
+	Shipping_Assert( root.GetUint64( "game_info/steamid" ) == 76561197960265728ull );
+	Shipping_Assert( root.GetDataType( "game_info/steamid" ) == KeyValues::TYPE_UINT64 );
+	Shipping_Assert( root.GetDataType( "game_info" ) == KeyValues::TYPE_NONE );
+	Shipping_Assert( !V_strcmp( root.GetString( "game_info/empty", "default" ), "" ) );
+
+	// defaults
+	Shipping_Assert( root.GetInt( "game_info/missing", 42 ) == 42 );
+	Shipping_Assert( !V_strcmp( root.GetString( "game_info", "default" ), "default" ) );
+	Shipping_Assert( !root.FindKey( "missing/num_classes" ).IsValid() );
+	Shipping_Assert( root.IsEmpty( "missing" ) );
+	Shipping_Assert( !root.IsEmpty( "game_info" ) );
+	Shipping_Assert( root.GetBool( "missing", true ) );
+
+	// hashed lookups match a linear search through KeyValues
+	CKeyValuesView items = root.FindKey( "items" );
+	Shipping_Assert( items.GetChildCount() == 101 );
+	for ( int i = 0; i < 100; i++ )
+	{
+		CKeyValuesView item = items.FindKey( CFmtStr( "%d", i ) );
+		Shipping_Assert( item.IsValid() );
+		CFmtStr strNameKey( "items/%d/name", i );
+		Shipping_Assert( !V_strcmp( item.GetString( "name" ), pRoot->GetString( strNameKey ) ) );
+		Shipping_Assert( item.GetInt( "item_slot" ) == i % 5 );
+	}
+	Shipping_Assert( !V_strcmp( items.GetString( "7/name" ), "Item 7" ) );
+	Shipping_Assert( !items.FindKey( "100" ).IsValid() );
+
+	// iteration order matches the source
+	KeyValues *pItem = pRoot->FindKey( "items" )->GetFirstTrueSubKey();
+	CKeyValuesView item = items.GetFirstTrueSubKey();
+	int nCount = 0;
+	for ( ; pItem && item.IsValid(); pItem = pItem->GetNextTrueSubKey(), item = item.GetNextTrueSubKey() )
+	{
+		Shipping_Assert( !V_strcmp( pItem->GetName(), item.GetName() ) );
+		nCount++;
+	}
+	Shipping_Assert( !pItem && !item.IsValid() && nCount == 101 );
+
+	nCount = 0;
+	for ( CKeyValuesView value = root.FindKey( "game_info" ).GetFirstValue(); value.IsValid(); value = value.GetNextValue() )
+	{
+		nCount++;
+	}
+	Shipping_Assert( nCount == 5 );
+
+	// round trip back to KeyValues
+	KeyValues *pCopy = root.MakeKeyValues();
+	Shipping_Assert( pCopy->GetInt( "game_info/num_classes" ) == 9 );
+	Shipping_Assert( pCopy->GetUint64( "game_info/steamid" ) == 76561197960265728ull );
+	Shipping_Assert( !V_strcmp( pCopy->GetString( "items/99/name" ), "Item 99" ) );
+	pCopy->deleteThis();
+
+	pRoot->deleteThis();
+}
+
+DEFINE_TESTCASE( KVImageTestValidate, KVImageTestSuite )
+{
+	Msg( "Running KVImage validation tests\n" );
+
+	KeyValues *pRoot = BuildTestKeyValues();
+	CUtlBuffer buf;
+	Shipping_Assert( CKeyValuesImage::Build( pRoot, buf ) );
+	pRoot->deleteThis();
+
+	CKeyValuesImage image;
+	Shipping_Assert( !image.InitFromMemory( buf.Base(), sizeof(KVImageHeader_t) - 1 ) );
+	Shipping_Assert( !image.InitFromMemory( buf.Base(), buf.TellPut() - 1 ) );
+	Shipping_Assert( !image.IsValid() );
+	Shipping_Assert( !image.GetRoot().IsValid() );
+	Shipping_Assert( image.GetRoot().GetInt( "items/1/item_slot", -1 ) == -1 );
+
+	// a child pointing back at its parent is rejected
+	KVImageHeader_t *pHeader = (KVImageHeader_t *)buf.Base();
+	KVImageNode_t *pNodes = (KVImageNode_t *)( (byte *)buf.Base() + pHeader->m_nNodeOffset );
+	uint32 nFirstChild = pNodes[0].m_nFirstChild;
+	pNodes[0].m_nFirstChild = 0;
+	Shipping_Assert( !image.InitFromMemory( buf.Base(), buf.TellPut() ) );
+	pNodes[0].m_nFirstChild = nFirstChild;
+
+	// string offsets out of range are rejected
+	uint32 nName = pNodes[1].m_nName;
+	pNodes[1].m_nName = pHeader->m_nStringSize;
+	Shipping_Assert( !image.InitFromMemory( buf.Base(), buf.TellPut() ) );
+	pNodes[1].m_nName = nName;
+
+	// a hash table with no empty slot is rejected, FindChild would never stop probing
+	uint32 *pHashSlots = (uint32 *)( (byte *)buf.Base() + pHeader->m_nHashOffset );
+	bool bFoundHashTable = false;
+	for ( uint32 i = 0; i < pHeader->m_nNodeCount && !bFoundHashTable; i++ )
+	{
+		if ( !pNodes[i].m_nHashBits )
+			continue;
+
+		bFoundHashTable = true;
+
+		uint32 nSlotCount = 1u << pNodes[i].m_nHashBits;
+		CUtlVector<uint32> slots;
+		slots.CopyArray( pHashSlots + pNodes[i].m_nHashSlot, nSlotCount );
+		for ( uint32 j = 0; j < nSlotCount; j++ )
+		{
+			pHashSlots[pNodes[i].m_nHashSlot + j] = 1;
+		}
+		Shipping_Assert( !image.InitFromMemory( buf.Base(), buf.TellPut() ) );
+		V_memcpy( pHashSlots + pNodes[i].m_nHashSlot, slots.Base(), nSlotCount * sizeof(uint32) );
+	}
+	Shipping_Assert( bFoundHashTable );
+
+	Shipping_Assert( image.InitFromMemory( buf.Base(), buf.TellPut() ) );
+}
@@ -0,0 +1,320 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Runs DistributeWork-style jobs in worker processes on this machine.
+//
+//=============================================================================//
+
+#ifdef POSIX
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#endif
+#include "cmdlib.h"
+#include "local_distribute_work.h"
+#include "pacifier.h"
+#include "messbuf.h"
+#include "utlvector.h"
+#include "utllinkedlist.h"
+
+
+int g_nLocalWorkerProcesses = 0;
+bool g_bLocalWorkerProcess = false;
+
+
+// Sent from the master to a worker to hand it a work unit. Closing the pipe means no more work.
+// Sent back from a worker in front of the results of each work unit.
+struct LocalWorkUnitHeader_t
+{
+	uint64	m_iWorkUnit;
+	int		m_nBytes;		// bytes of results that follow (results only)
+	int		m_Pad;
+};
+
+// How many work units the master keeps queued up in each worker's pipe
+// so the worker never waits for the next one.
+#define LOCAL_WORK_UNITS_IN_FLIGHT	2
+
+
+#ifdef POSIX
+
+// ----------------------------------------------------------------------------- //
+// Pipe helpers. These retry on EINTR and short reads/writes.
+// ----------------------------------------------------------------------------- //
+
+static bool WriteAll( int fd, const void *pData, int nBytes )
+{
+	const char *pCur = (const char*)pData;
+	while ( nBytes > 0 )
+	{
+		ssize_t nWritten = write( fd, pCur, nBytes );
+		if ( nWritten < 0 )
+		{
+			if ( errno == EINTR )
+				continue;
+			return false;
+		}
+		pCur += nWritten;
+		nBytes -= nWritten;
+	}
+	return true;
+}
+
+static bool ReadAll( int fd, void *pData, int nBytes )
+{
+	char *pCur = (char*)pData;
+	while ( nBytes > 0 )
+	{
+		ssize_t nRead = read( fd, pCur, nBytes );
+		if ( nRead < 0 )
+		{
+			if ( errno == EINTR )
+				continue;
+			return false;
+		}
+		if ( nRead == 0 )
+			return false;
+		pCur += nRead;
+		nBytes -= nRead;
+	}
+	return true;
+}
+
+
+// ----------------------------------------------------------------------------- //
+// Worker side.
+// ----------------------------------------------------------------------------- //
+
+static void LocalWorkerMain( int workFd, int resultFd, ProcessWorkUnitFn processFn )
+{
+	g_bLocalWorkerProcess = true;
+	SuppressPacifier( true );
+
+	MessageBuffer mb;
+	LocalWorkUnitHeader_t header;
+	while ( ReadAll( workFd, &header, sizeof( header ) ) )
+	{
+		mb.reset( 0 );
+		processFn( 0, header.m_iWorkUnit, &mb );
+
+		header.m_nBytes = mb.getLen();
+		if ( !WriteAll( resultFd, &header, sizeof( header ) ) || !WriteAll( resultFd, mb.data, mb.getLen() ) )
+			break;
+	}
+
+	// Don't run the master's atexit handlers or static destructors.
+	_exit( 0 );
+}
+
+
+// ----------------------------------------------------------------------------- //
+// Master side.
+// ----------------------------------------------------------------------------- //
+
+class CLocalWorker
+{
+public:
+	pid_t			m_Pid;
+	int				m_WorkFd;		// we write work units here
+	int				m_ResultFd;		// and read results from here
+	CUtlLinkedList<uint64, int> m_InFlight;	// work units sent, in the order they'll come back
+};
+
+
+static bool SendLocalWorkUnit( CLocalWorker &worker, uint64 iWorkUnit )
+{
+	LocalWorkUnitHeader_t header;
+	header.m_iWorkUnit = iWorkUnit;
+	header.m_nBytes = 0;
+	header.m_Pad = 0;
+	if ( !WriteAll( worker.m_WorkFd, &header, sizeof( header ) ) )
+		return false;
+
+	worker.m_InFlight.AddToTail( iWorkUnit );
+	return true;
+}
+
+
+static void CloseLocalWorker( CLocalWorker &worker )
+{
+	if ( worker.m_WorkFd != -1 )
+	{
+		close( worker.m_WorkFd );
+		worker.m_WorkFd = -1;
+	}
+	if ( worker.m_ResultFd != -1 )
+	{
+		close( worker.m_ResultFd );
+		worker.m_ResultFd = -1;
+	}
+}
+
+
+double DistributeWorkLocal( int nProcesses, uint64 nWorkUnits, ProcessWorkUnitFn processFn, ReceiveWorkUnitFn receiveFn )
+{
+	double flStartTime = Plat_FloatTime();
+	if ( nWorkUnits == 0 )
+		return 0;
+
+	nProcesses = clamp( nProcesses, 1, (int)min( nWorkUnits, (uint64)1024 ) );
+
+	// A worker that dies closes its pipe; we want the EPIPE, not the signal.
+	void (*pOldSigPipe)( int ) = signal( SIGPIPE, SIG_IGN );
+
+	// Anything buffered now would be printed again by every worker.
+	fflush( stdout );
+	fflush( stderr );
+
+	CUtlVector<CLocalWorker> workers;
+	workers.SetCount( nProcesses );
+	for ( int i=0; i < nProcesses; i++ )
+	{
+		int workPipe[2], resultPipe[2];
+		if ( pipe( workPipe ) != 0 || pipe( resultPipe ) != 0 )
+			Error( "DistributeWorkLocal: pipe() failed (%s)\n", strerror( errno ) );
+
+		pid_t pid = fork();
+		if ( pid < 0 )
+			Error( "DistributeWorkLocal: fork() failed (%s)\n", strerror( errno ) );
+
+		if ( pid == 0 )
+		{
+			// Only keep our own ends of our own pipes.
+			for ( int j=0; j < i; j++ )
+				CloseLocalWorker( workers[j] );
+			close( workPipe[1] );
+			close( resultPipe[0] );
+
+			LocalWorkerMain( workPipe[0], resultPipe[1], processFn );
+		}
+
+		close( workPipe[0] );
+		close( resultPipe[1] );
+
+		CLocalWorker &worker = workers[i];
+		worker.m_Pid = pid;
+		worker.m_WorkFd = workPipe[1];
+		worker.m_ResultFd = resultPipe[0];
+	}
+
+	// Work units taken back from workers that died.
+	CUtlVector<uint64> retryWorkUnits;
+	uint64 iNextWorkUnit = 0;
+	uint64 nCompleted = 0;
+	int nAlive = nProcesses;
+
+	MessageBuffer mb;
+	CUtlVector<struct pollfd> pollFds;
+	CUtlVector<int> pollWorkers;
+	while ( nCompleted < nWorkUnits )
+	{
+		// Keep every live worker's queue full.
+		for ( int i=0; i < nProcesses; i++ )
+		{
+			CLocalWorker &worker = workers[i];
+			while ( worker.m_ResultFd != -1 && worker.m_InFlight.Count() < LOCAL_WORK_UNITS_IN_FLIGHT )
+			{
+				uint64 iWorkUnit;
+				if ( retryWorkUnits.Count() )
+				{
+					iWorkUnit = retryWorkUnits.Tail();
+					retryWorkUnits.RemoveMultipleFromTail( 1 );
+				}
+				else if ( iNextWorkUnit < nWorkUnits )
+				{
+					iWorkUnit = iNextWorkUnit++;
+				}
+				else
+				{
+					break;
+				}
+
+				if ( !SendLocalWorkUnit( worker, iWorkUnit ) )
+				{
+					retryWorkUnits.AddToTail( iWorkUnit );
+					break;
+				}
+			}
+		}
+
+		pollFds.RemoveAll();
+		pollWorkers.RemoveAll();
+		for ( int i=0; i < nProcesses; i++ )
+		{
+			if ( workers[i].m_ResultFd == -1 )
+				continue;
+
+			struct pollfd pfd;
+			pfd.fd = workers[i].m_ResultFd;
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+			pollFds.AddToTail( pfd );
+			pollWorkers.AddToTail( i );
+		}
+
+		if ( poll( pollFds.Base(), pollFds.Count(), -1 ) < 0 )
+		{
+			if ( errno == EINTR )
+				continue;
+			Error( "DistributeWorkLocal: poll() failed (%s)\n", strerror( errno ) );
+		}
+
+		for ( int iPoll=0; iPoll < pollFds.Count(); iPoll++ )
+		{
+			if ( !pollFds[iPoll].revents )
+				continue;
+
+			int iWorker = pollWorkers[iPoll];
+			CLocalWorker &worker = workers[iWorker];
+
+			LocalWorkUnitHeader_t header;
+			bool bOk = ReadAll( worker.m_ResultFd, &header, sizeof( header ) );
+			if ( bOk )
+			{
+				mb.reset( header.m_nBytes );
+				mb.setLen( header.m_nBytes );
+				bOk = ReadAll( worker.m_ResultFd, mb.data, header.m_nBytes );
+			}
+
+			if ( !bOk || !worker.m_InFlight.Count() || worker.m_InFlight[worker.m_InFlight.Head()] != header.m_iWorkUnit )
+			{
+				// The worker died (or is confused). Give its work to the others.
+				Warning( "\nDistributeWorkLocal: lost worker process %d, reassigning %d work units.\n", (int)worker.m_Pid, worker.m_InFlight.Count() );
+				FOR_EACH_LL( worker.m_InFlight, i )
+				{
+					retryWorkUnits.AddToTail( worker.m_InFlight[i] );
+				}
+				worker.m_InFlight.RemoveAll();
+				CloseLocalWorker( worker );
+
+				if ( --nAlive == 0 )
+					Error( "DistributeWorkLocal: all worker processes died.\n" );
+				continue;
+			}
+
+			worker.m_InFlight.Remove( worker.m_InFlight.Head() );
+
+			mb.setOffset( 0 );
+			receiveFn( header.m_iWorkUnit, &mb, iWorker );
+
+			++nCompleted;
+			UpdatePacifier( (float)nCompleted / nWorkUnits );
+		}
+	}
+
+	// Closing the work pipes tells the workers to exit.
+	for ( int i=0; i < nProcesses; i++ )
+	{
+		CloseLocalWorker( workers[i] );
+		int status;
+		while ( waitpid( workers[i].m_Pid, &status, 0 ) < 0 && errno == EINTR )
+		{
+		}
+	}
+
+	signal( SIGPIPE, pOldSigPipe );
+	return Plat_FloatTime() - flStartTime;
+}
+
+#endif // POSIX
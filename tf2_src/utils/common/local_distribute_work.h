@@ -0,0 +1,46 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Runs DistributeWork-style jobs in worker processes on this machine.
+//
+//=============================================================================//
+
+#ifndef LOCAL_DISTRIBUTE_WORK_H
+#define LOCAL_DISTRIBUTE_WORK_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+
+#include "vmpi_distribute_work.h"
+
+
+// Set by -localprocs. 0 means don't use worker processes. Always 0 without fork,
+// the tools reject -localprocs there.
+extern int g_nLocalWorkerProcesses;
+
+// True in a worker process started by DistributeWorkLocal.
+extern bool g_bLocalWorkerProcess;
+
+
+#ifdef POSIX
+
+
+// Forks nProcesses copies of this process and hands each of them work units. The workers
+// see everything the master had loaded (copy-on-write), run processFn on each work unit and
+// stream the results back through a pipe. The master calls receiveFn with the results just
+// like DistributeWork does with VMPI, so the same serialization code works for both.
+//
+// Work units from a worker that dies are given to the other workers.
+//
+// Returns time it took to finish the work.
+double DistributeWorkLocal(
+	int nProcesses,
+	uint64 nWorkUnits,
+	ProcessWorkUnitFn processFn,
+	ReceiveWorkUnitFn receiveFn
+	);
+
+#endif // POSIX
+
+
+#endif // LOCAL_DISTRIBUTE_WORK_H
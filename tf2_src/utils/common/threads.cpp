@@ -13,13 +13,16 @@
 
 #define	USED
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
 #include "cmdlib.h"
 #define NO_THREAD_NAMES
 #include "threads.h"
 #include "pacifier.h"
-
-#define	MAX_THREADS	16
+#include "tier0/threadtools.h"
 
 
 class CRunThreadsData
@@ -28,47 +31,156 @@ public:
 	int m_iThread;
 	void *m_pUserData;
 	RunThreadsFn m_Fn;
+	ERunThreadsPriority m_ePriority;
 };
 
-CRunThreadsData g_RunThreadsData[MAX_THREADS];
+CRunThreadsData g_RunThreadsData[MAX_TOOL_THREADS];
 
 
-int		dispatch;
 int		workcount;
 qboolean		pacifier;
 
 qboolean	threaded;
 bool g_bLowPriorityThreads = false;
 
-HANDLE g_ThreadHandles[MAX_THREADS];
+ThreadHandle_t g_ThreadHandles[MAX_TOOL_THREADS];
 
+// Index of the RunThreads thread we're on, for GetThreadWork.
+static CTHREADLOCALINT g_iWorkThread;
 
 
 /*
-=============
-GetThreadWork
+===================================================================
 
-=============
+WORK DISTRIBUTION
+
+Work items are handed out in ascending order from a single shared
+cursor; vvis relies on this, PortalFlow works through the portals
+smallest first so later portals can use their results. Each thread
+takes a chunk of items at a time so cheap items don't hammer the
+cursor. Chunks are sized from the measured cost per item and shrink
+as the work runs out so the last items spread over every thread.
+
+===================================================================
 */
-int	GetThreadWork (void)
+
+// Aim for chunks that take about this long to run.
+#define WORK_CHUNK_SECONDS	0.002
+#define MAX_WORK_CHUNK		1024
+
+// The chunk a thread is currently working through. Only touched by its
+// thread, padded so neighbouring threads don't share a cache line.
+class CThreadWorkChunk
 {
-	int	r;
+public:
+	int m_iNext;
+	int m_iEnd;
+	int m_nItems;
+	double m_flStartTime;
+	double m_flItemCost;		// running estimate of seconds per work item
+	char m_Pad[64];
+};
+
+CThreadWorkChunk g_ThreadWorkChunks[MAX_TOOL_THREADS];
 
-	ThreadLock ();
+// Next work item nobody has taken yet.
+static int volatile g_iNextWork;
+static CThreadFastMutex g_PacifierLock;
+
+
+static void InitThreadWork( int workcnt )
+{
+	workcount = workcnt;
+	g_iNextWork = 0;
 
-	if (dispatch == workcount)
+	for ( int i=0; i < numthreads; i++ )
+	{
+		CThreadWorkChunk &chunk = g_ThreadWorkChunks[i];
+		chunk.m_iNext = chunk.m_iEnd = 0;
+		chunk.m_nItems = 0;
+		chunk.m_flItemCost = 0;
+	}
+}
+
+
+// Take up to nWanted items from the cursor, but never more than a share
+// of what's left, so the tail of the work isn't stuck in one thread.
+static bool TakeThreadWork( int nWanted, int &iBegin, int &iEnd )
+{
+	while ( 1 )
+	{
+		int iNext = g_iNextWork;
+		int nRemaining = workcount - iNext;
+		if ( nRemaining <= 0 )
+			return false;
+
+		int nTake = min( nWanted, max( nRemaining / ( 2 * numthreads ), 1 ) );
+		if ( ThreadInterlockedAssignIf( &g_iNextWork, iNext + nTake, iNext ) )
+		{
+			iBegin = iNext;
+			iEnd = iNext + nTake;
+			return true;
+		}
+	}
+}
+
+
+static int GetThreadWorkChunk( int iThread )
+{
+	CThreadWorkChunk &chunk = g_ThreadWorkChunks[iThread];
+
+	// Fold the cost of the chunk we just finished into the estimate.
+	double flTime = Plat_FloatTime();
+	if ( chunk.m_nItems )
 	{
-		ThreadUnlock ();
+		double flItemCost = ( flTime - chunk.m_flStartTime ) / chunk.m_nItems;
+		chunk.m_flItemCost = ( chunk.m_flItemCost > 0 ) ? ( chunk.m_flItemCost + flItemCost ) * 0.5 : flItemCost;
+		chunk.m_nItems = 0;
+	}
+
+	// The first chunk is a single item to get a cost estimate.
+	int nWanted = 1;
+	if ( chunk.m_iEnd != 0 )
+	{
+		// Items too cheap to time get the largest chunk.
+		nWanted = MAX_WORK_CHUNK;
+		if ( chunk.m_flItemCost > 0 )
+			nWanted = (int)clamp( WORK_CHUNK_SECONDS / chunk.m_flItemCost, 1.0, (double)MAX_WORK_CHUNK );
+	}
+
+	int iBegin, iEnd;
+	if ( !TakeThreadWork( nWanted, iBegin, iEnd ) )
 		return -1;
+
+	chunk.m_iNext = iBegin + 1;
+	chunk.m_iEnd = iEnd;
+	chunk.m_nItems = iEnd - iBegin;
+	chunk.m_flStartTime = flTime;
+
+	if ( g_PacifierLock.TryLock() )
+	{
+		UpdatePacifier( (float)iEnd / workcount );
+		g_PacifierLock.Unlock();
 	}
 
-	UpdatePacifier( (float)dispatch / workcount );
+	return iBegin;
+}
+
 
-	r = dispatch;
-	dispatch++;
-	ThreadUnlock ();
+/*
+=============
+GetThreadWork
 
-	return r;
+=============
+*/
+int	GetThreadWork (void)
+{
+	int iThread = g_iWorkThread;
+	CThreadWorkChunk &chunk = g_ThreadWorkChunks[iThread];
+	if ( chunk.m_iNext < chunk.m_iEnd )
+		return chunk.m_iNext++;
+
+	return GetThreadWorkChunk( iThread );
 }
 
 
@@ -101,45 +213,38 @@ void RunThreadsOnIndividual (int workcnt, qboolean showpacifier, ThreadWorkerFn
 /*
 ===================================================================
 
-WIN32
+THREADS
 
 ===================================================================
 */
 
 int		numthreads = -1;
-CRITICAL_SECTION		crit;
+CThreadMutex		crit;
 static int enter;
 
 
-class CCritInit
-{
-public:
-	CCritInit()
-	{
-		InitializeCriticalSection (&crit);
-	}
-} g_CritInit;
-
-
-
 void SetLowPriority()
 {
+#ifdef _WIN32
 	SetPriorityClass( GetCurrentProcess(), IDLE_PRIORITY_CLASS );
+#else
+	setpriority( PRIO_PROCESS, 0, 19 );
+#endif
 }
 
 
 void ThreadSetDefault (void)
 {
-	SYSTEM_INFO info;
-
 	if (numthreads == -1)	// not set manually
 	{
-		GetSystemInfo (&info);
-		numthreads = info.dwNumberOfProcessors;
-		if (numthreads < 1 || numthreads > 32)
+		numthreads = GetCPUInformation()->m_nLogicalProcessors;
+		if (numthreads < 1)
 			numthreads = 1;
 	}
 
+	if (numthreads > MAX_TOOL_THREADS)
+		numthreads = MAX_TOOL_THREADS;
+
 	Msg ("%i threads\n", numthreads);
 }
 
@@ -148,7 +253,7 @@ void ThreadLock (void)
 {
 	if (!threaded)
 		return;
-	EnterCriticalSection (&crit);
+	crit.Lock();
 	if (enter)
 		Error ("Recursive ThreadLock\n");
 	enter = 1;
@@ -161,14 +266,24 @@ void ThreadUnlock (void)
 	if (!enter)
 		Error ("ThreadUnlock without lock\n");
 	enter = 0;
-	LeaveCriticalSection (&crit);
+	crit.Unlock();
 }
 
 
 // This runs in the thread and dispatches a RunThreadsFn call.
-DWORD WINAPI InternalRunThreadsFn( LPVOID pParameter )
+unsigned InternalRunThreadsFn( void *pParameter )
 {
 	CRunThreadsData *pData = (CRunThreadsData*)pParameter;
+	g_iWorkThread = pData->m_iThread;
+
+#ifndef _WIN32
+	// Linux niceness is per thread.
+	if ( pData->m_ePriority == k_eRunThreadsPriority_Idle )
+		setpriority( PRIO_PROCESS, 0, 19 );
+	else if ( pData->m_ePriority == k_eRunThreadsPriority_UseGlobalState && g_bLowPriorityThreads )
+		setpriority( PRIO_PROCESS, 0, 10 );
+#endif
+
 	pData->m_Fn( pData->m_iThread, pData->m_pUserData );
 	return 0;
 }
@@ -187,34 +302,32 @@ void RunThreads_Start( RunThreadsFn fn, void *pUserData, ERunThreadsPriority ePr
 		g_RunThreadsData[i].m_iThread = i;
 		g_RunThreadsData[i].m_pUserData = pUserData;
 		g_RunThreadsData[i].m_Fn = fn;
+		g_RunThreadsData[i].m_ePriority = ePriority;
 
-		DWORD dwDummy;
-		g_ThreadHandles[i] = CreateThread(
-		   NULL,	// LPSECURITY_ATTRIBUTES lpsa,
-		   0,		// DWORD cbStack,
-		   InternalRunThreadsFn,	// LPTHREAD_START_ROUTINE lpStartAddr,
-		   &g_RunThreadsData[i],	// LPVOID lpvThreadParm,
-		   0,			// DWORD fdwCreate,
-		   &dwDummy );
+		g_ThreadHandles[i] = CreateSimpleThread( InternalRunThreadsFn, &g_RunThreadsData[i] );
 
+#ifdef _WIN32
 		if ( ePriority == k_eRunThreadsPriority_UseGlobalState )
 		{
 			if( g_bLowPriorityThreads )
-				SetThreadPriority( g_ThreadHandles[i], THREAD_PRIORITY_LOWEST );
+				ThreadSetPriority( g_ThreadHandles[i], THREAD_PRIORITY_LOWEST );
 		}
 		else if ( ePriority == k_eRunThreadsPriority_Idle )
 		{
-			SetThreadPriority( g_ThreadHandles[i], THREAD_PRIORITY_IDLE );
+			ThreadSetPriority( g_ThreadHandles[i], THREAD_PRIORITY_IDLE );
 		}
+#endif
 	}
 }
 
 
 void RunThreads_End()
 {
-	WaitForMultipleObjects( numthreads, g_ThreadHandles, TRUE, INFINITE );
 	for ( int i=0; i < numthreads; i++ )
-		CloseHandle( g_ThreadHandles[i] );
+	{
+		ThreadJoin( g_ThreadHandles[i] );
+		ReleaseThreadHandle( g_ThreadHandles[i] );
+	}
 
 	threaded = false;
 }
@@ -230,8 +343,9 @@ void RunThreadsOn( int workcnt, qboolean showpacifier, RunThreadsFn fn, void *pU
 	int		start, end;
 
 	start = Plat_FloatTime();
-	dispatch = 0;
-	workcount = workcnt;
+	if ( numthreads > MAX_TOOL_THREADS )
+		numthreads = MAX_TOOL_THREADS;
+	InitThreadWork( workcnt );
 	StartPacifier("");
 	pacifier = showpacifier;
 
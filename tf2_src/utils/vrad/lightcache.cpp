@@ -0,0 +1,1172 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Sidecar cache of lighting results for -lightcache.
+//
+// Everything is keyed by content rather than by index, since any edit renumbers
+// faces, patches, lights and props. A result from the last compile is reused if
+// its own key still matches, the set of lights that can reach it is the same and
+// none of the triangles that changed comes near the paths from it to those lights.
+//
+//=============================================================================//
+
+#include "vrad.h"
+#include "lightcache.h"
+#include "lightmap.h"
+#include "bsptreedata.h"
+#include "vmpi.h"
+#include "tier1/generichash.h"
+#include "tier1/utlbuffer.h"
+#include "tier0/threadtools.h"
+
+
+#define LIGHTCACHE_VERSION		1
+#define LIGHTCACHE_HASH_SEED	0x6c636163
+
+// The changed triangles are merged into at most this many spheres for the path tests.
+#define MAX_CHANGED_OCCLUDER_SPHERES	32
+
+// Sample points are pushed off their surface a little before anything is traced from them.
+#define LIGHTCACHE_SAMPLE_SLACK	8.0f
+
+
+bool g_bLightCache = false;
+
+
+// ----------------------------------------------------------------------------- //
+// Cache file layout. Everything is written in this machine's layout; the header
+// rejects files from a build with a different sample_t.
+// ----------------------------------------------------------------------------- //
+
+struct LightCacheFileHeader_t
+{
+	int		m_nVersion;
+	int		m_nSampleSize;
+	int		m_nLightingValueSize;
+	int		m_nPad;
+	uint64	m_OptionsKey;
+	int		m_nOccluders;
+	int		m_nFaces;
+	int		m_nFaceDataBytes;
+	int		m_nPatches;
+	int		m_nVisReceivers;		// -1 if that compile didn't build the visibility matrix
+	int		m_nPoints;
+};
+
+// A light blocking triangle.
+struct CachedOccluder_t
+{
+	uint64	m_Key;
+	Vector	m_Mins;
+	Vector	m_Maxs;
+};
+
+// The direct lighting of one face.
+struct CachedFace_t
+{
+	uint64	m_Key;
+	uint64	m_LightSetKey;
+	int		m_nDataOffset;
+	int		m_nDataBytes;
+};
+
+// Header of a face's data, followed by its samples, light arrays, luxels and luxel normals.
+struct CachedFaceLighting_t
+{
+	byte	m_Styles[MAXLIGHTMAPS];
+	int		m_nSamples;
+	int		m_nLuxels;
+	float	m_flWorldAreaPerLuxel;
+	int		m_nLightMask;			// bit (style * (NUM_BUMP_VECTS+1) + bump) set for each light array stored
+	int		m_nLuxelMask;			// 1 = luxels stored, 2 = luxel normals stored
+};
+
+struct CachedPatch_t
+{
+	uint64	m_Key;
+	int		m_Index;
+};
+
+// Direct lighting at one static prop sample.
+struct CachedPoint_t
+{
+	uint64	m_Key;
+	uint64	m_LightSetKey;
+	Vector	m_Color;
+};
+
+struct ChangedOccluder_t
+{
+	Vector	m_Center;
+	float	m_flRadius;
+};
+
+
+// ----------------------------------------------------------------------------- //
+// State.
+// ----------------------------------------------------------------------------- //
+
+static uint64 s_CommandLineKey = 0;
+static uint64 s_OptionsKey = 0;
+static char s_CacheFilename[MAX_PATH];
+
+// This compile.
+static CUtlVector<CachedOccluder_t> s_Occluders;
+static CUtlVector<uint64> s_LightKeys;				// indexed by directlight_t::index
+static CUtlVector<uint64> s_FaceKeys;
+static CUtlVector<uint64> s_PatchKeys;
+static bool s_bStoredFaces = false;
+static CUtlVector<CachedFace_t> s_NewFaces;
+static CUtlBuffer s_NewFaceData;
+static CUtlVector<CachedPoint_t> s_NewPoints[MAX_TOOL_THREADS+1];
+
+// The last compile.
+static CUtlVector<CachedFace_t> s_CachedFaces;
+static CUtlVector<byte> s_CachedFaceData;
+static bool s_bHaveCachedVis = false;
+static CUtlVector<int> s_PatchToCached;			// this compile's patch -> the last compile's, or -1
+static CUtlVector<int> s_CachedVisRowStart;
+static CUtlVector<int> s_CachedVisReceivers;
+static CUtlVector<CachedPoint_t> s_CachedPoints;
+
+// What changed in between.
+static CUtlVector<ChangedOccluder_t> s_ChangedOccluders;
+static CUtlVector<ChangedOccluder_t> s_ChangedSkyOccluders;	// s_ChangedOccluders seen from the world through each 3D skybox camera
+
+static CInterlockedInt s_nRestoredFaces;
+static CInterlockedInt s_nRestoredPoints;
+
+
+// ----------------------------------------------------------------------------- //
+// Keys.
+// ----------------------------------------------------------------------------- //
+
+class CLightCacheKey
+{
+public:
+	template< class T >
+	void Add( T const &value )
+	{
+		AddBytes( &value, sizeof( value ) );
+	}
+
+	void AddBytes( void const *pData, int nBytes )
+	{
+		m_Data.AddMultipleToTail( nBytes, (byte const*)pData );
+	}
+
+	void AddString( char const *pString )
+	{
+		AddBytes( pString, V_strlen( pString ) + 1 );
+	}
+
+	uint64 Get() const
+	{
+		return MurmurHash64( m_Data.Base(), m_Data.Count(), LIGHTCACHE_HASH_SEED );
+	}
+
+private:
+	CUtlVectorFixedGrowable<byte, 256> m_Data;
+};
+
+
+template< class T >
+static int __cdecl CompareCacheKeys( const T *a, const T *b )
+{
+	if ( a->m_Key < b->m_Key )
+		return -1;
+	return ( a->m_Key > b->m_Key ) ? 1 : 0;
+}
+
+// Binary search of a list sorted with CompareCacheKeys.
+template< class T >
+static int FindCacheKey( CUtlVector<T> const &list, uint64 key )
+{
+	int iLow = 0, iHigh = list.Count() - 1;
+	while ( iLow <= iHigh )
+	{
+		int iMid = ( iLow + iHigh ) / 2;
+		if ( list[iMid].m_Key < key )
+			iLow = iMid + 1;
+		else if ( list[iMid].m_Key > key )
+			iHigh = iMid - 1;
+		else
+			return iMid;
+	}
+	return -1;
+}
+
+
+static uint64 ComputeLightKey( directlight_t *dl )
+{
+	dworldlight_t const &light = dl->light;
+
+	// Not cluster, texinfo or owner: those are indices that move around with unrelated edits.
+	CLightCacheKey key;
+	key.Add( light.origin );
+	key.Add( light.intensity );
+	key.Add( light.normal );
+	key.Add( light.type );
+	key.Add( light.style );
+	key.Add( light.stopdot );
+	key.Add( light.stopdot2 );
+	key.Add( light.exponent );
+	key.Add( light.radius );
+	key.Add( light.constant_attn );
+	key.Add( light.linear_attn );
+	key.Add( light.quadratic_attn );
+	key.Add( light.flags );
+	key.Add( dl->m_flStartFadeDistance );
+	key.Add( dl->m_flEndFadeDistance );
+	key.Add( dl->m_flCapDist );
+	if ( light.type == emit_skylight )
+	{
+		key.Add( g_SunAngularExtent );
+	}
+	return key.Get();
+}
+
+
+static uint64 ComputeFaceKey( int facenum, uint64 dispKey )
+{
+	dface_t *f = &g_pFaces[facenum];
+	faceneighbor_t *fn = &faceneighbor[facenum];
+	texinfo_t *tx = &texinfo[f->texinfo];
+
+	CLightCacheKey key;
+	key.Add( dplanes[f->planenum].normal );
+	key.Add( dplanes[f->planenum].dist );
+	key.Add( f->side );
+	key.Add( face_offset[facenum] );
+	for ( int i=0; i < f->numedges; i++ )
+	{
+		key.Add( dvertexes[EdgeVertex( f, i )].point );
+		key.Add( fn->normal[i] );
+	}
+	key.Add( tx->textureVecsTexelsPerWorldUnits );
+	key.Add( tx->lightmapVecsLuxelsPerWorldUnits );
+	key.Add( tx->flags );
+	key.Add( f->m_LightmapTextureMinsInLuxels );
+	key.Add( f->m_LightmapTextureSizeInLuxels );
+	key.Add( f->smoothingGroups );
+
+	// Displacement samples depend on the neighboring displacements too, so any
+	// change to any displacement changes all of their keys.
+	if ( f->dispinfo != -1 )
+	{
+		key.Add( dispKey );
+	}
+	return key.Get();
+}
+
+
+static uint64 ComputePointKey( Vector const &position, Vector const &normal, int nLFlags, bool bSkipProp )
+{
+	CLightCacheKey key;
+	key.Add( position );
+	key.Add( normal );
+	key.Add( nLFlags );
+	key.Add( bSkipProp );
+	return key.Get();
+}
+
+
+// ----------------------------------------------------------------------------- //
+// Which lights reach a spot, and whether anything that changed is in their way.
+// ----------------------------------------------------------------------------- //
+
+class CLightCacheLeafList : public ISpatialLeafEnumerator
+{
+public:
+	virtual bool EnumerateLeaf( int leaf, int context )
+	{
+		m_Leaves.AddToTail( leaf );
+		return true;
+	}
+
+	CUtlVectorFixedGrowable<int, 64> m_Leaves;
+};
+
+
+// Lights whose PVS has any of these clusters (a cluster of -1 passes every light, like
+// PVSCheck does), plus a key for the set that doesn't depend on the order of the lights.
+static uint64 GetLightsInClusters( int const *pClusters, int nClusters, bool bSkipStyled, CUtlVector<directlight_t*> &lights )
+{
+	CUtlVectorFixedGrowable<uint64, 128> keys;
+	for ( directlight_t *dl = activelights; dl != NULL; dl = dl->next )
+	{
+		if ( bSkipStyled && dl->light.style )
+			continue;
+
+		bool bVisible = false;
+		for ( int i=0; i < nClusters && !bVisible; i++ )
+		{
+			bVisible = ( PVSCheck( dl->pvs, pClusters[i] ) != 0 );
+		}
+		if ( !bVisible )
+			continue;
+
+		lights.AddToTail( dl );
+		keys.AddToTail( s_LightKeys[dl->index] );
+	}
+
+	keys.Sort();
+	return MurmurHash64( keys.Base(), keys.Count() * sizeof( uint64 ), LIGHTCACHE_HASH_SEED );
+}
+
+
+static void GetFaceBounds( int facenum, sample_t const *pSamples, int nSamples, Vector &vMins, Vector &vMaxs )
+{
+	dface_t *f = &g_pFaces[facenum];
+
+	ClearBounds( vMins, vMaxs );
+	for ( int i=0; i < f->numedges; i++ )
+	{
+		Vector vPoint = dvertexes[EdgeVertex( f, i )].point;
+		AddPointToBounds( vPoint, vMins, vMaxs );
+		AddPointToBounds( vPoint + face_offset[facenum], vMins, vMaxs );
+	}
+	for ( int i=0; i < nSamples; i++ )
+	{
+		AddPointToBounds( pSamples[i].pos, vMins, vMaxs );
+	}
+
+	Vector vSlack( LIGHTCACHE_SAMPLE_SLACK, LIGHTCACHE_SAMPLE_SLACK, LIGHTCACHE_SAMPLE_SLACK );
+	vMins -= vSlack;
+	vMaxs += vSlack;
+}
+
+
+// BuildFacelights tests lights against the cluster of each sample. Supersamples can land
+// in the neighboring clusters, so every cluster the face touches counts too.
+static uint64 GetFaceLights( int facenum, sample_t const *pSamples, int nSamples, Vector const &vMins, Vector const &vMaxs, CUtlVector<directlight_t*> &lights )
+{
+	CUtlVectorFixedGrowable<int, 64> clusters;
+	for ( int i=0; i < nSamples; i++ )
+	{
+		int cluster = ClusterFromPoint( pSamples[i].pos );
+		if ( clusters.Find( cluster ) == -1 )
+			clusters.AddToTail( cluster );
+	}
+
+	CLightCacheLeafList leafList;
+	ToolBSPTree()->EnumerateLeavesInBox( vMins, vMaxs, &leafList, 0 );
+	for ( int i=0; i < leafList.m_Leaves.Count(); i++ )
+	{
+		// Solid leaves have no cluster; those don't add anything.
+		int cluster = dleafs[leafList.m_Leaves[i]].cluster;
+		if ( cluster >= 0 && clusters.Find( cluster ) == -1 )
+			clusters.AddToTail( cluster );
+	}
+
+	return GetLightsInClusters( clusters.Base(), clusters.Count(), false, lights );
+}
+
+
+// Sky ambient light arrives from the whole hemisphere above each normal (or from
+// everywhere if there are no normals), all the way out to the sky.
+static bool SkyAmbientTouches( CUtlVector<ChangedOccluder_t> const &changed, Vector const &vCenter, float flRadius, Vector const *pNormals, int nNormals )
+{
+	for ( int i=0; i < changed.Count(); i++ )
+	{
+		if ( nNormals == 0 )
+			return true;
+
+		Vector vDelta = changed[i].m_Center - vCenter;
+		float flReach = changed[i].m_flRadius + flRadius;
+		for ( int j=0; j < nNormals; j++ )
+		{
+			if ( DotProduct( pNormals[j], vDelta ) > -flReach )
+				return true;
+		}
+	}
+	return false;
+}
+
+
+// Sun rays leave along vToSun, spread out by up to flSpread units sideways per unit of distance.
+static bool SunTouches( CUtlVector<ChangedOccluder_t> const &changed, Vector const &vCenter, float flRadius, Vector const &vToSun, float flSpread )
+{
+	for ( int i=0; i < changed.Count(); i++ )
+	{
+		Vector vDelta = changed[i].m_Center - vCenter;
+		float t = DotProduct( vDelta, vToSun );
+		float flReach = changed[i].m_flRadius + flRadius + max( t, 0.0f ) * flSpread;
+		if ( t < -flReach )
+			continue;
+
+		float flSideways2 = max( vDelta.LengthSqr() - t * t, 0.0f );
+		if ( flSideways2 <= flReach * flReach )
+			return true;
+	}
+	return false;
+}
+
+
+// Could any changed occluder be in the way of light from dl to a point within flRadius of vCenter?
+static bool LightPathTouchesChanges( directlight_t *dl, Vector const &vCenter, float flRadius, Vector const *pNormals, int nNormals )
+{
+	switch ( dl->light.type )
+	{
+	case emit_skyambient:
+		return SkyAmbientTouches( s_ChangedOccluders, vCenter, flRadius, pNormals, nNormals ) ||
+			SkyAmbientTouches( s_ChangedSkyOccluders, vCenter, flRadius, pNormals, nNormals );
+
+	case emit_skylight:
+		{
+			// The soft sun jitters the ray end by up to g_SunAngularExtent of its length.
+			float flSpread = 0.0f;
+			if ( g_SunAngularExtent > 0.0f )
+			{
+				if ( g_SunAngularExtent >= 0.99f )
+					return s_ChangedOccluders.Count() > 0;
+				flSpread = g_SunAngularExtent / ( 1.0f - g_SunAngularExtent );
+			}
+
+			Vector vToSun = -dl->light.normal;
+			return SunTouches( s_ChangedOccluders, vCenter, flRadius, vToSun, flSpread ) ||
+				SunTouches( s_ChangedSkyOccluders, vCenter, flRadius, vToSun, flSpread );
+		}
+
+	default:
+		for ( int i=0; i < s_ChangedOccluders.Count(); i++ )
+		{
+			ChangedOccluder_t const &changed = s_ChangedOccluders[i];
+			if ( CalcDistanceToLineSegment( changed.m_Center, vCenter, dl->light.origin ) <= changed.m_flRadius + flRadius )
+				return true;
+		}
+		return false;
+	}
+}
+
+
+static bool IsFaceLightingCurrent( int facenum, sample_t const *pSamples, int nSamples, uint64 lightSetKey )
+{
+	Vector vMins, vMaxs;
+	GetFaceBounds( facenum, pSamples, nSamples, vMins, vMaxs );
+
+	CUtlVector<directlight_t*> lights;
+	if ( GetFaceLights( facenum, pSamples, nSamples, vMins, vMaxs, lights ) != lightSetKey )
+		return false;
+
+	if ( s_ChangedOccluders.Count() == 0 )
+		return true;
+
+	// Flat faces have one normal; smooth ones keep all of them.
+	CUtlVectorFixedGrowable<Vector, 16> normals;
+	normals.AddToTail( dplanes[g_pFaces[facenum].planenum].normal );
+	for ( int i=0; i < nSamples; i++ )
+	{
+		if ( normals.Tail() != pSamples[i].normal )
+			normals.AddToTail( pSamples[i].normal );
+	}
+
+	Vector vCenter = ( vMins + vMaxs ) * 0.5f;
+	float flRadius = ( vMaxs - vMins ).Length() * 0.5f;
+	for ( int i=0; i < lights.Count(); i++ )
+	{
+		if ( LightPathTouchesChanges( lights[i], vCenter, flRadius, normals.Base(), normals.Count() ) )
+			return false;
+	}
+	return true;
+}
+
+
+// ----------------------------------------------------------------------------- //
+// Finding the occluders that changed.
+// ----------------------------------------------------------------------------- //
+
+static uint64 GridCellKey( Vector const &vPoint, float flCellSize )
+{
+	uint64 key = 0;
+	for ( int i=0; i < 3; i++ )
+	{
+		int iCell = (int)floor( vPoint[i] / flCellSize ) + ( 1 << 20 );
+		key = ( key << 21 ) | (uint64)( iCell & 0x1FFFFF );
+	}
+	return key;
+}
+
+
+static void FindChangedOccluders( CUtlVector<CachedOccluder_t> const &cached )
+{
+	s_ChangedOccluders.RemoveAll();
+	s_ChangedSkyOccluders.RemoveAll();
+
+	// Both lists are sorted, so whatever isn't in both is new or gone.
+	CUtlVector<CachedOccluder_t> changed;
+	int iCached = 0, iCurrent = 0;
+	while ( iCached < cached.Count() || iCurrent < s_Occluders.Count() )
+	{
+		if ( iCurrent == s_Occluders.Count() || ( iCached < cached.Count() && cached[iCached].m_Key < s_Occluders[iCurrent].m_Key ) )
+		{
+			changed.AddToTail( cached[iCached++] );
+		}
+		else if ( iCached == cached.Count() || s_Occluders[iCurrent].m_Key < cached[iCached].m_Key )
+		{
+			changed.AddToTail( s_Occluders[iCurrent++] );
+		}
+		else
+		{
+			++iCached;
+			++iCurrent;
+		}
+	}
+
+	int nChangedTriangles = changed.Count();
+
+	// Merge them into a few boxes: bucket by grid cell and double the cell size
+	// until there are few enough buckets left.
+	for ( float flCellSize = 64.0f; changed.Count() > MAX_CHANGED_OCCLUDER_SPHERES; flCellSize *= 2.0f )
+	{
+		for ( int i=0; i < changed.Count(); i++ )
+		{
+			changed[i].m_Key = GridCellKey( ( changed[i].m_Mins + changed[i].m_Maxs ) * 0.5f, flCellSize );
+		}
+		changed.Sort( CompareCacheKeys<CachedOccluder_t> );
+
+		int nMerged = 0;
+		for ( int i=0; i < changed.Count(); i++ )
+		{
+			if ( nMerged && changed[nMerged-1].m_Key == changed[i].m_Key )
+			{
+				VectorMin( changed[nMerged-1].m_Mins, changed[i].m_Mins, changed[nMerged-1].m_Mins );
+				VectorMax( changed[nMerged-1].m_Maxs, changed[i].m_Maxs, changed[nMerged-1].m_Maxs );
+			}
+			else
+			{
+				changed[nMerged++] = changed[i];
+			}
+		}
+		changed.SetCountNonDestructively( nMerged );
+	}
+
+	for ( int i=0; i < changed.Count(); i++ )
+	{
+		ChangedOccluder_t &sphere = s_ChangedOccluders[s_ChangedOccluders.AddToTail()];
+		sphere.m_Center = ( changed[i].m_Mins + changed[i].m_Maxs ) * 0.5f;
+		sphere.m_flRadius = ( changed[i].m_Maxs - changed[i].m_Mins ).Length() * 0.5f + 1.0f;
+
+		// Rays that reach the sky carry on from each 3D skybox camera (see TestLine_DoesHitSky).
+		// Scaling the change back out into the world lets the same tests catch that.
+		if ( !g_bNoSkyRecurse )
+		{
+			for ( int cam=0; cam < num_sky_cameras; cam++ )
+			{
+				ChangedOccluder_t &skySphere = s_ChangedSkyOccluders[s_ChangedSkyOccluders.AddToTail()];
+				skySphere.m_Center = ( sphere.m_Center - sky_cameras[cam].origin ) * sky_cameras[cam].sky_to_world;
+				skySphere.m_flRadius = sphere.m_flRadius * sky_cameras[cam].sky_to_world;
+			}
+		}
+	}
+
+	Msg( "Light cache: %d occluding triangles changed (%d regions)\n", nChangedTriangles, s_ChangedOccluders.Count() );
+}
+
+
+// ----------------------------------------------------------------------------- //
+// Setup.
+// ----------------------------------------------------------------------------- //
+
+void LightCache_SetOptions( int nArgs, char **argv )
+{
+	// Options that don't change the results.
+	static char const *s_pIgnored[] = { "-lightcache", "-low", "-v", "-verbose", "-novconfig", "-stoponexit", "-FullMinidumps", "-rederrors" };
+	static char const *s_pIgnoredWithValue[] = { "-threads", "-localprocs" };
+
+	CLightCacheKey key;
+	for ( int i=1; i < nArgs; i++ )
+	{
+		bool bIgnored = !V_strnicmp( argv[i], "-mpi", 4 );
+		for ( int j=0; j < ARRAYSIZE( s_pIgnored ) && !bIgnored; j++ )
+		{
+			bIgnored = !V_stricmp( argv[i], s_pIgnored[j] );
+		}
+		if ( bIgnored )
+			continue;
+
+		for ( int j=0; j < ARRAYSIZE( s_pIgnoredWithValue ) && !bIgnored; j++ )
+		{
+			bIgnored = !V_stricmp( argv[i], s_pIgnoredWithValue[j] );
+		}
+		if ( bIgnored )
+		{
+			++i;
+			continue;
+		}
+
+		key.AddString( argv[i] );
+	}
+	s_CommandLineKey = key.Get();
+}
+
+
+void LightCache_CaptureOccluders( RayTracingEnvironment &env )
+{
+	int nTriangles = env.OptimizedTriangleList.Count();
+	bool bColors = ( env.TriangleColors.Count() == nTriangles );
+	bool bMaterials = ( env.TriangleMaterials.Count() == nTriangles );
+
+	s_Occluders.SetCount( nTriangles );
+	for ( int i=0; i < nTriangles; i++ )
+	{
+		TriGeometryData_t &tri = env.OptimizedTriangleList[i].m_Data.m_GeometryData;
+
+		// Static prop triangle ids carry the prop index, which shifts when props are added or removed.
+		CLightCacheKey key;
+		key.Add( tri.m_nTriangleID & ( TRACE_ID_SKY | TRACE_ID_OPAQUE | TRACE_ID_STATICPROP ) );
+		key.Add( tri.m_VertexCoordData );
+		key.Add( tri.m_nFlags );
+		if ( bColors )
+			key.Add( env.TriangleColors[i] );
+		if ( bMaterials )
+			key.Add( env.TriangleMaterials[i] );
+
+		CachedOccluder_t &occluder = s_Occluders[i];
+		occluder.m_Key = key.Get();
+		ClearBounds( occluder.m_Mins, occluder.m_Maxs );
+		for ( int j=0; j < 3; j++ )
+		{
+			AddPointToBounds( tri.Vertex( j ), occluder.m_Mins, occluder.m_Maxs );
+		}
+	}
+
+	s_Occluders.Sort( CompareCacheKeys<CachedOccluder_t> );
+}
+
+
+template< class T >
+static bool ReadCacheArray( CUtlBuffer &buf, CUtlVector<T> &list, int nCount )
+{
+	if ( nCount < 0 || buf.GetBytesRemaining() < nCount * (int)sizeof( T ) )
+		return false;
+
+	list.SetCount( nCount );
+	buf.Get( list.Base(), nCount * sizeof( T ) );
+	return true;
+}
+
+
+static bool LoadLightCache( CUtlVector<CachedOccluder_t> &cachedOccluders, CUtlVector<CachedPatch_t> &cachedPatches )
+{
+	FileHandle_t fp = g_pFileSystem->Open( s_CacheFilename, "rb" );
+	if ( !fp )
+	{
+		Msg( "Light cache: no %s yet, lighting everything\n", s_CacheFilename );
+		return false;
+	}
+
+	CUtlBuffer buf;
+	int nSize = g_pFileSystem->Size( fp );
+	buf.EnsureCapacity( nSize );
+	int nRead = g_pFileSystem->Read( buf.Base(), nSize, fp );
+	g_pFileSystem->Close( fp );
+	buf.SeekPut( CUtlBuffer::SEEK_HEAD, max( nRead, 0 ) );
+
+	LightCacheFileHeader_t header;
+	if ( nRead != nSize || buf.GetBytesRemaining() < (int)sizeof( header ) )
+	{
+		Warning( "Light cache: %s is truncated, lighting everything\n", s_CacheFilename );
+		return false;
+	}
+	buf.Get( &header, sizeof( header ) );
+
+	if ( header.m_nVersion != LIGHTCACHE_VERSION || header.m_nSampleSize != sizeof( sample_t ) || header.m_nLightingValueSize != sizeof( LightingValue_t ) )
+	{
+		Msg( "Light cache: %s is from a different vrad, lighting everything\n", s_CacheFilename );
+		return false;
+	}
+
+	if ( header.m_OptionsKey != s_OptionsKey )
+	{
+		Msg( "Light cache: lighting options changed since %s was written, lighting everything\n", s_CacheFilename );
+		return false;
+	}
+
+	bool bOk = ReadCacheArray( buf, cachedOccluders, header.m_nOccluders ) &&
+		ReadCacheArray( buf, s_CachedFaces, header.m_nFaces ) &&
+		ReadCacheArray( buf, s_CachedFaceData, header.m_nFaceDataBytes ) &&
+		ReadCacheArray( buf, cachedPatches, header.m_nPatches );
+	if ( bOk && header.m_nVisReceivers >= 0 )
+	{
+		bOk = ReadCacheArray( buf, s_CachedVisRowStart, header.m_nPatches + 1 ) &&
+			ReadCacheArray( buf, s_CachedVisReceivers, header.m_nVisReceivers );
+		s_bHaveCachedVis = bOk;
+	}
+	bOk = bOk && ReadCacheArray( buf, s_CachedPoints, header.m_nPoints );
+
+	if ( !bOk )
+	{
+		Warning( "Light cache: %s is corrupt, lighting everything\n", s_CacheFilename );
+		s_CachedFaces.Purge();
+		s_CachedFaceData.Purge();
+		s_CachedVisRowStart.Purge();
+		s_CachedVisReceivers.Purge();
+		s_CachedPoints.Purge();
+		s_bHaveCachedVis = false;
+		return false;
+	}
+	return true;
+}
+
+
+void LightCache_Init( char const *pBSPFilename )
+{
+	if ( !g_bLightCache )
+		return;
+
+	if ( g_bUseMPI || g_pIncremental || g_bDumpPatches )
+	{
+		Warning( "-lightcache can't be used with -mpi, -incremental or -dump; ignoring it.\n" );
+		g_bLightCache = false;
+		return;
+	}
+
+	V_StripExtension( pBSPFilename, s_CacheFilename, sizeof( s_CacheFilename ) );
+	V_strncat( s_CacheFilename, g_bHDR ? ".hdr.vradcache" : ".ldr.vradcache", sizeof( s_CacheFilename ) );
+
+	// Options and global settings that change every result.
+	CLightCacheKey optionsKey;
+	optionsKey.Add( s_CommandLineKey );
+	optionsKey.Add( g_bHDR );
+	optionsKey.Add( num_sky_cameras );
+	optionsKey.AddBytes( sky_cameras, num_sky_cameras * sizeof( sky_camera_t ) );
+	s_OptionsKey = optionsKey.Get();
+
+	s_LightKeys.SetCount( numdlights );
+	for ( directlight_t *dl = activelights; dl != NULL; dl = dl->next )
+	{
+		s_LightKeys[dl->index] = ComputeLightKey( dl );
+	}
+
+	CLightCacheKey dispKey;
+	dispKey.AddBytes( g_dispinfo.Base(), g_dispinfo.Count() * sizeof( ddispinfo_t ) );
+	dispKey.AddBytes( g_DispVerts.Base(), g_DispVerts.Count() * sizeof( CDispVert ) );
+
+	s_FaceKeys.SetCount( numfaces );
+	for ( int i=0; i < numfaces; i++ )
+	{
+		s_FaceKeys[i] = ComputeFaceKey( i, dispKey.Get() );
+	}
+
+	CUtlVector<CachedPatch_t> patches;
+	s_PatchKeys.SetCount( g_Patches.Count() );
+	patches.SetCount( g_Patches.Count() );
+	for ( int i=0; i < g_Patches.Count(); i++ )
+	{
+		CPatch *patch = &g_Patches[i];
+
+		CLightCacheKey key;
+		key.Add( s_FaceKeys[patch->faceNumber] );
+		key.Add( patch->origin );
+		key.Add( patch->normal );
+		key.Add( patch->area );
+		s_PatchKeys[i] = key.Get();
+
+		patches[i].m_Key = s_PatchKeys[i];
+		patches[i].m_Index = i;
+	}
+
+	s_bStoredFaces = false;
+	s_nRestoredFaces = 0;
+	s_nRestoredPoints = 0;
+
+	CUtlVector<CachedOccluder_t> cachedOccluders;
+	CUtlVector<CachedPatch_t> cachedPatches;
+	if ( !LoadLightCache( cachedOccluders, cachedPatches ) )
+		return;
+
+	FindChangedOccluders( cachedOccluders );
+
+	// Patches are matched up by key. Two patches with the same key can't be told apart,
+	// so those always get traced.
+	patches.Sort( CompareCacheKeys<CachedPatch_t> );
+	s_PatchToCached.SetCount( g_Patches.Count() );
+	int nPatchesFound = 0;
+	for ( int i=0; i < patches.Count(); i++ )
+	{
+		bool bDuplicate = ( i > 0 && patches[i-1].m_Key == patches[i].m_Key ) ||
+			( i+1 < patches.Count() && patches[i+1].m_Key == patches[i].m_Key );
+
+		int iCached = bDuplicate ? -1 : FindCacheKey( cachedPatches, patches[i].m_Key );
+		if ( iCached >= 0 )
+		{
+			bool bCachedDuplicate = ( iCached > 0 && cachedPatches[iCached-1].m_Key == patches[i].m_Key ) ||
+				( iCached+1 < cachedPatches.Count() && cachedPatches[iCached+1].m_Key == patches[i].m_Key );
+			iCached = bCachedDuplicate ? -1 : cachedPatches[iCached].m_Index;
+		}
+
+		s_PatchToCached[patches[i].m_Index] = iCached;
+		if ( iCached >= 0 )
+			++nPatchesFound;
+	}
+
+	Msg( "Light cache: loaded %s (%d faces, %d of %d patches%s, %d prop samples)\n", s_CacheFilename,
+		s_CachedFaces.Count(), nPatchesFound, g_Patches.Count(), s_bHaveCachedVis ? "" : " (no visibility)", s_CachedPoints.Count() );
+}
+
+
+// ----------------------------------------------------------------------------- //
+// Face lighting.
+// ----------------------------------------------------------------------------- //
+
+// Do the arrays the header describes fit in the bytes stored for the face?
+static bool IsCachedFaceLightingValid( CachedFaceLighting_t const &lighting, int nDataBytes )
+{
+	if ( lighting.m_nSamples < 0 || lighting.m_nLuxels < 0 )
+		return false;
+
+	int nLightArrays = 0;
+	for ( int i=0; i < MAXLIGHTMAPS * ( NUM_BUMP_VECTS+1 ); i++ )
+	{
+		if ( lighting.m_nLightMask & ( 1 << i ) )
+			++nLightArrays;
+	}
+	int nLuxelArrays = ( ( lighting.m_nLuxelMask & 1 ) ? 1 : 0 ) + ( ( lighting.m_nLuxelMask & 2 ) ? 1 : 0 );
+
+	int64 nBytes = (int64)sizeof( lighting ) +
+		(int64)lighting.m_nSamples * ( (int64)sizeof( sample_t ) + nLightArrays * (int64)sizeof( LightingValue_t ) ) +
+		(int64)lighting.m_nLuxels * nLuxelArrays * (int64)sizeof( Vector );
+	return nBytes <= nDataBytes;
+}
+
+bool LightCache_RestoreFace( int facenum )
+{
+	int iCached = FindCacheKey( s_CachedFaces, s_FaceKeys[facenum] );
+	if ( iCached < 0 )
+		return false;
+
+	// if the cache file is damaged, light the face again rather than read outside the face data
+	CachedFace_t const &cached = s_CachedFaces[iCached];
+	if ( cached.m_nDataOffset < 0 || cached.m_nDataBytes < (int)sizeof( CachedFaceLighting_t ) ||
+		 cached.m_nDataOffset > s_CachedFaceData.Count() - cached.m_nDataBytes )
+		return false;
+
+	CUtlBuffer buf( s_CachedFaceData.Base() + cached.m_nDataOffset, cached.m_nDataBytes, CUtlBuffer::READ_ONLY );
+
+	CachedFaceLighting_t lighting;
+	buf.Get( &lighting, sizeof( lighting ) );
+	if ( !IsCachedFaceLightingValid( lighting, cached.m_nDataBytes ) )
+		return false;
+
+	sample_t *pSamples = (sample_t *)calloc( lighting.m_nSamples, sizeof( sample_t ) );
+	buf.Get( pSamples, lighting.m_nSamples * sizeof( sample_t ) );
+
+	if ( !IsFaceLightingCurrent( facenum, pSamples, lighting.m_nSamples, cached.m_LightSetKey ) )
+	{
+		free( pSamples );
+		return false;
+	}
+
+	dface_t *f = &g_pFaces[facenum];
+	facelight_t *fl = &facelight[facenum];
+
+	memcpy( f->styles, lighting.m_Styles, sizeof( f->styles ) );
+
+	fl->numsamples = lighting.m_nSamples;
+	fl->sample = pSamples;
+	for ( int i=0; i < MAXLIGHTMAPS; i++ )
+	{
+		for ( int n=0; n < NUM_BUMP_VECTS+1; n++ )
+		{
+			fl->light[i][n] = NULL;
+			if ( lighting.m_nLightMask & ( 1 << ( i * ( NUM_BUMP_VECTS+1 ) + n ) ) )
+			{
+				fl->light[i][n] = (LightingValue_t *)calloc( fl->numsamples, sizeof( LightingValue_t ) );
+				buf.Get( fl->light[i][n], fl->numsamples * sizeof( LightingValue_t ) );
+			}
+		}
+	}
+
+	fl->numluxels = lighting.m_nLuxels;
+	fl->worldAreaPerLuxel = lighting.m_flWorldAreaPerLuxel;
+	fl->luxel = NULL;
+	fl->luxelNormals = NULL;
+	if ( lighting.m_nLuxelMask & 1 )
+	{
+		fl->luxel = (Vector *)calloc( fl->numluxels, sizeof( Vector ) );
+		buf.Get( fl->luxel, fl->numluxels * sizeof( Vector ) );
+	}
+	if ( lighting.m_nLuxelMask & 2 )
+	{
+		fl->luxelNormals = (Vector *)calloc( fl->numluxels, sizeof( Vector ) );
+		buf.Get( fl->luxelNormals, fl->numluxels * sizeof( Vector ) );
+	}
+
+	++s_nRestoredFaces;
+	return true;
+}
+
+
+void LightCache_StoreFaces()
+{
+	s_NewFaces.RemoveAll();
+	s_NewFaceData.Purge();
+
+	for ( int facenum=0; facenum < numfaces; facenum++ )
+	{
+		facelight_t *fl = &facelight[facenum];
+		if ( !fl->numsamples || !fl->sample )
+			continue;
+
+		Vector vMins, vMaxs;
+		GetFaceBounds( facenum, fl->sample, fl->numsamples, vMins, vMaxs );
+		CUtlVector<directlight_t*> lights;
+
+		CachedFace_t &entry = s_NewFaces[s_NewFaces.AddToTail()];
+		entry.m_Key = s_FaceKeys[facenum];
+		entry.m_LightSetKey = GetFaceLights( facenum, fl->sample, fl->numsamples, vMins, vMaxs, lights );
+		entry.m_nDataOffset = s_NewFaceData.TellPut();
+
+		CachedFaceLighting_t lighting;
+		memcpy( lighting.m_Styles, g_pFaces[facenum].styles, sizeof( lighting.m_Styles ) );
+		lighting.m_nSamples = fl->numsamples;
+		lighting.m_nLuxels = fl->numluxels;
+		lighting.m_flWorldAreaPerLuxel = fl->worldAreaPerLuxel;
+		lighting.m_nLightMask = 0;
+		for ( int i=0; i < MAXLIGHTMAPS; i++ )
+		{
+			for ( int n=0; n < NUM_BUMP_VECTS+1; n++ )
+			{
+				if ( fl->light[i][n] )
+					lighting.m_nLightMask |= 1 << ( i * ( NUM_BUMP_VECTS+1 ) + n );
+			}
+		}
+		lighting.m_nLuxelMask = ( fl->luxel ? 1 : 0 ) | ( fl->luxelNormals ? 2 : 0 );
+		s_NewFaceData.Put( &lighting, sizeof( lighting ) );
+
+		for ( int i=0; i < fl->numsamples; i++ )
+		{
+			sample_t sample = fl->sample[i];
+			sample.w = NULL;
+			s_NewFaceData.Put( &sample, sizeof( sample ) );
+		}
+		for ( int i=0; i < MAXLIGHTMAPS; i++ )
+		{
+			for ( int n=0; n < NUM_BUMP_VECTS+1; n++ )
+			{
+				if ( fl->light[i][n] )
+					s_NewFaceData.Put( fl->light[i][n], fl->numsamples * sizeof( LightingValue_t ) );
+			}
+		}
+		if ( fl->luxel )
+			s_NewFaceData.Put( fl->luxel, fl->numluxels * sizeof( Vector ) );
+		if ( fl->luxelNormals )
+			s_NewFaceData.Put( fl->luxelNormals, fl->numluxels * sizeof( Vector ) );
+
+		entry.m_nDataBytes = s_NewFaceData.TellPut() - entry.m_nDataOffset;
+	}
+
+	s_bStoredFaces = true;
+
+	// Only faces lit in this process are counted.
+	if ( s_nRestoredFaces > 0 )
+	{
+		Msg( "Light cache: reused the direct lighting of %d of %d faces\n", (int)s_nRestoredFaces, s_NewFaces.Count() );
+	}
+}
+
+
+// ----------------------------------------------------------------------------- //
+// Visibility.
+// ----------------------------------------------------------------------------- //
+
+int LightCache_TestVis( int ndxShooter, int ndxReceiver, Vector const &start, Vector const &stop )
+{
+	if ( !s_bHaveCachedVis )
+		return -1;
+
+	int iShooter = s_PatchToCached[ndxShooter];
+	int iReceiver = s_PatchToCached[ndxReceiver];
+	if ( iShooter < 0 || iReceiver < 0 )
+		return -1;
+
+	for ( int i=0; i < s_ChangedOccluders.Count(); i++ )
+	{
+		if ( CalcDistanceToLineSegment( s_ChangedOccluders[i].m_Center, start, stop ) <= s_ChangedOccluders[i].m_flRadius )
+			return -1;
+	}
+
+	// The row only has the receivers that got a transfer. The rest were either blocked
+	// or rejected by MakeTransfer, which will reject them again.
+	int iLow = s_CachedVisRowStart[iShooter], iHigh = s_CachedVisRowStart[iShooter+1] - 1;
+	while ( iLow <= iHigh )
+	{
+		int iMid = ( iLow + iHigh ) / 2;
+		if ( s_CachedVisReceivers[iMid] < iReceiver )
+			iLow = iMid + 1;
+		else if ( s_CachedVisReceivers[iMid] > iReceiver )
+			iHigh = iMid - 1;
+		else
+			return 1;
+	}
+	return 0;
+}
+
+
+// ----------------------------------------------------------------------------- //
+// Static prop lighting.
+// ----------------------------------------------------------------------------- //
+
+// ComputeDirectLightingAtPoint skips styled lights and only checks the PVS of the point's cluster.
+static uint64 GetPointLights( Vector const &position, CUtlVector<directlight_t*> &lights )
+{
+	int cluster = ClusterFromPoint( position );
+	return GetLightsInClusters( &cluster, 1, true, lights );
+}
+
+
+bool LightCache_RestorePointLighting( Vector const &position, Vector const &normal, int nLFlags, bool bSkipProp, Vector &outColor )
+{
+	int iCached = FindCacheKey( s_CachedPoints, ComputePointKey( position, normal, nLFlags, bSkipProp ) );
+	if ( iCached < 0 )
+		return false;
+
+	CachedPoint_t const &cached = s_CachedPoints[iCached];
+
+	CUtlVector<directlight_t*> lights;
+	if ( GetPointLights( position, lights ) != cached.m_LightSetKey )
+		return false;
+
+	int nNormals = ( nLFlags & GATHERLFLAGS_IGNORE_NORMALS ) ? 0 : 1;
+	for ( int i=0; i < lights.Count(); i++ )
+	{
+		if ( LightPathTouchesChanges( lights[i], position, LIGHTCACHE_SAMPLE_SLACK, &normal, nNormals ) )
+			return false;
+	}
+
+	outColor = cached.m_Color;
+	++s_nRestoredPoints;
+	return true;
+}
+
+
+void LightCache_StorePointLighting( int iThread, Vector const &position, Vector const &normal, int nLFlags, bool bSkipProp, Vector const &color )
+{
+	CUtlVector<directlight_t*> lights;
+
+	CachedPoint_t &point = s_NewPoints[iThread][s_NewPoints[iThread].AddToTail()];
+	point.m_Key = ComputePointKey( position, normal, nLFlags, bSkipProp );
+	point.m_LightSetKey = GetPointLights( position, lights );
+	point.m_Color = color;
+}
+
+
+// ----------------------------------------------------------------------------- //
+// Saving.
+// ----------------------------------------------------------------------------- //
+
+static void FreeLightCache()
+{
+	s_Occluders.Purge();
+	s_LightKeys.Purge();
+	s_FaceKeys.Purge();
+	s_PatchKeys.Purge();
+	s_NewFaces.Purge();
+	s_NewFaceData.Purge();
+	for ( int i=0; i < ARRAYSIZE( s_NewPoints ); i++ )
+	{
+		s_NewPoints[i].Purge();
+	}
+
+	s_CachedFaces.Purge();
+	s_CachedFaceData.Purge();
+	s_PatchToCached.Purge();
+	s_CachedVisRowStart.Purge();
+	s_CachedVisReceivers.Purge();
+	s_CachedPoints.Purge();
+	s_ChangedOccluders.Purge();
+	s_ChangedSkyOccluders.Purge();
+	s_bHaveCachedVis = false;
+	s_bStoredFaces = false;
+}
+
+
+void LightCache_Save()
+{
+	// Without the face lighting (-onlydetail, -onlystaticprops) the old cache is still the best one.
+	if ( !s_bStoredFaces )
+	{
+		FreeLightCache();
+		return;
+	}
+
+	if ( s_nRestoredPoints > 0 )
+	{
+		Msg( "Light cache: reused the direct lighting of %d static prop samples\n", (int)s_nRestoredPoints );
+	}
+
+	CUtlVector<CachedPatch_t> patches;
+	patches.SetCount( g_Patches.Count() );
+	for ( int i=0; i < g_Patches.Count(); i++ )
+	{
+		patches[i].m_Key = s_PatchKeys[i];
+		patches[i].m_Index = i;
+	}
+	patches.Sort( CompareCacheKeys<CachedPatch_t> );
+
+	// The visibility rows are the receivers of each patch's transfers.
+	bool bHaveVis = ( numbounce > 0 );
+	CUtlVector<int> visRowStart, visReceivers;
+	if ( bHaveVis )
+	{
+		visRowStart.SetCount( g_Patches.Count() + 1 );
+		for ( int i=0; i < g_Patches.Count(); i++ )
+		{
+			CPatch *patch = &g_Patches[i];
+			visRowStart[i] = visReceivers.Count();
+			for ( int j=0; j < patch->numtransfers; j++ )
+			{
+				visReceivers.AddToTail( patch->transfers[j].patch );
+			}
+			std::sort( visReceivers.Base() + visRowStart[i], visReceivers.Base() + visReceivers.Count() );
+		}
+		visRowStart[g_Patches.Count()] = visReceivers.Count();
+	}
+
+	CUtlVector<CachedPoint_t> points;
+	for ( int i=0; i < ARRAYSIZE( s_NewPoints ); i++ )
+	{
+		points.AddVectorToTail( s_NewPoints[i] );
+	}
+	points.Sort( CompareCacheKeys<CachedPoint_t> );
+
+	s_NewFaces.Sort( CompareCacheKeys<CachedFace_t> );
+
+	LightCacheFileHeader_t header;
+	memset( &header, 0, sizeof( header ) );
+	header.m_nVersion = LIGHTCACHE_VERSION;
+	header.m_nSampleSize = sizeof( sample_t );
+	header.m_nLightingValueSize = sizeof( LightingValue_t );
+	header.m_OptionsKey = s_OptionsKey;
+	header.m_nOccluders = s_Occluders.Count();
+	header.m_nFaces = s_NewFaces.Count();
+	header.m_nFaceDataBytes = s_NewFaceData.TellPut();
+	header.m_nPatches = patches.Count();
+	header.m_nVisReceivers = bHaveVis ? visReceivers.Count() : -1;
+	header.m_nPoints = points.Count();
+
+	FileHandle_t fp = g_pFileSystem->Open( s_CacheFilename, "wb" );
+	if ( !fp )
+	{
+		Warning( "Light cache: can't write %s\n", s_CacheFilename );
+		FreeLightCache();
+		return;
+	}
+
+	g_pFileSystem->Write( &header, sizeof( header ), fp );
+	g_pFileSystem->Write( s_Occluders.Base(), s_Occluders.Count() * sizeof( CachedOccluder_t ), fp );
+	g_pFileSystem->Write( s_NewFaces.Base(), s_NewFaces.Count() * sizeof( CachedFace_t ), fp );
+	g_pFileSystem->Write( s_NewFaceData.Base(), s_NewFaceData.TellPut(), fp );
+	g_pFileSystem->Write( patches.Base(), patches.Count() * sizeof( CachedPatch_t ), fp );
+	if ( bHaveVis )
+	{
+		g_pFileSystem->Write( visRowStart.Base(), visRowStart.Count() * sizeof( int ), fp );
+		g_pFileSystem->Write( visReceivers.Base(), visReceivers.Count() * sizeof( int ), fp );
+	}
+	g_pFileSystem->Write( points.Base(), points.Count() * sizeof( CachedPoint_t ), fp );
+	g_pFileSystem->Close( fp );
+
+	Msg( "Light cache: wrote %s\n", s_CacheFilename );
+
+	FreeLightCache();
+}
@@ -0,0 +1,56 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Keeps direct lighting, visibility and static prop lighting from the
+//			last compile of a map in a sidecar file so a recompile only redoes
+//			the work that an edit can actually have changed.
+//
+//=============================================================================//
+
+#ifndef LIGHTCACHE_H
+#define LIGHTCACHE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+
+#include "mathlib/vector.h"
+
+
+class RayTracingEnvironment;
+
+
+// Set by -lightcache.
+extern bool g_bLightCache;
+
+
+// Remembers the options that change lighting results. Call after ParseCommandLine.
+void LightCache_SetOptions( int nArgs, char **argv );
+
+// Fingerprints every triangle that can block light. Must be called after all the
+// triangles are added and before SetupAccelerationStructure() repacks them.
+void LightCache_CaptureOccluders( RayTracingEnvironment &env );
+
+// Loads the cache for pBSPFilename. Call once faces, patches and direct lights
+// are set up (after RadWorld_Start). Turns g_bLightCache off if it can't be used.
+void LightCache_Init( char const *pBSPFilename );
+
+// Fills in facelight[facenum] from the last compile if nothing that lights the face
+// has changed. Threadsafe.
+bool LightCache_RestoreFace( int facenum );
+
+// Remembers the direct lighting of every face. Call on the master once all the facelights exist.
+void LightCache_StoreFaces();
+
+// Returns 1 if the last compile found ndxReceiver visible from ndxShooter, 0 if it was
+// blocked and -1 if it has to be traced again. Threadsafe.
+int LightCache_TestVis( int ndxShooter, int ndxReceiver, Vector const &start, Vector const &stop );
+
+// Direct lighting at a static prop sample. Threadsafe.
+bool LightCache_RestorePointLighting( Vector const &position, Vector const &normal, int nLFlags, bool bSkipProp, Vector &outColor );
+void LightCache_StorePointLighting( int iThread, Vector const &position, Vector const &normal, int nLFlags, bool bSkipProp, Vector const &color );
+
+// Writes the new cache (including the visibility rows in the patch transfers) and frees everything.
+void LightCache_Save();
+
+
+#endif // LIGHTCACHE_H
@@ -12,6 +12,8 @@
 #include "mathlib/bumpvects.h"
 #include "tier1/utlvector.h"
 #include "vmpi.h"
+#include "local_distribute_work.h"
+#include "lightcache.h"
 #include "mathlib/anorms.h"
 #include "map_utils.h"
 #include "mathlib/halton.h"
@@ -3102,6 +3104,14 @@ void BuildFacelights (int iThread, int facenum)
 
 	fl = &facelight[facenum];
 
+	// Reuse the last compile's lighting if nothing that reaches this face has changed.
+	if ( g_bLightCache && LightCache_RestoreFace( facenum ) )
+	{
+		if ( !g_bUseMPI && !g_bLocalWorkerProcess )
+			BuildPatchLights( facenum );
+		return;
+	}
+
 	InitLightinfo( &l, facenum );
 	CalcPoints( &l, fl, facenum );
 	InitSampleInfo( l, iThread, sampleInfo );
@@ -3174,10 +3184,10 @@ void BuildFacelights (int iThread, int facenum)
 		}
 	}
 
-	if (!g_bUseMPI) 
+	if (!g_bUseMPI && !g_bLocalWorkerProcess) 
 	{
 		//
-		// This is done on the master node when MPI is used
+		// This is done on the master node when MPI or worker processes are used
 		//
 		BuildPatchLights( facenum );
 	}
@@ -37,6 +37,8 @@ extern int g_iCurFace;
 extern int vertexref[MAX_MAP_VERTS];
 extern int *vertexface[MAX_MAP_VERTS];
 
+int EdgeVertex( dface_t *f, int edge );
+
 struct faceneighbor_t
 {
 	int		numneighbors;			// neighboring faces that share vertices
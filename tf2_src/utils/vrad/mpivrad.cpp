@@ -29,6 +29,7 @@
 #include "mpi_stats.h"
 #include "vmpi_distribute_work.h"
 #include "vmpi_tools_shared.h"
+#include "local_distribute_work.h"
 
 
 
@@ -270,6 +271,31 @@ void RunMPIBuildFacelights()
 }
 
 
+#ifdef POSIX
+// Same as RunMPIBuildFacelights but with forked worker processes on this machine.
+void RunLocalBuildFacelights()
+{
+	Msg( "%-20s ", "BuildFaceLights:" );
+	StartPacifier("");
+
+	double elapsed = DistributeWorkLocal( 
+		g_nLocalWorkerProcesses,
+		numfaces, 
+		MPI_ProcessFaces, 
+		MPI_ReceiveFaceResults );
+
+	EndPacifier(false);
+	Msg( " (%d)\n", (int)elapsed );
+
+	// The workers don't send their patch lights back, so do them here like the VMPI master does.
+	for ( int i=0; i < numfaces; ++i )
+	{
+		BuildPatchLights(i);
+	}
+}
+#endif
+
+
 //-----------------------------------------
 //
 // Run BuildVisLeafs across all available processing nodes
@@ -419,6 +445,32 @@ void RunMPIBuildVisLeafs()
 	}
 }
 
+
+#ifdef POSIX
+// Same as RunMPIBuildVisLeafs but with forked worker processes on this machine.
+void RunLocalBuildVisLeafs()
+{
+	Msg( "%-20s ", "BuildVisLeafs  :" );
+	StartPacifier("");
+
+	// The workers inherit this and always run as thread 0.
+	memset( g_VMPIVisLeafsData, 0, sizeof( g_VMPIVisLeafsData ) );
+	g_VMPIVisLeafsData[0].m_pBuildVisLeafsTransfers = BuildVisLeafs_Start();
+
+	double elapsed = DistributeWorkLocal( 
+		g_nLocalWorkerProcesses,
+		dvis->numclusters, 
+		MPI_ProcessVisLeafs, 
+		MPI_ReceiveVisLeafsResults );
+
+	BuildVisLeafs_End( g_VMPIVisLeafsData[0].m_pBuildVisLeafsTransfers );
+	g_VMPIVisLeafsData[0].m_pBuildVisLeafsTransfers = NULL;
+
+	EndPacifier(false);
+	Msg( " (%d)\n", (int)elapsed );
+}
+#endif
+
 void VMPI_DistributeLightData()
 {
 	if ( !g_bUseMPI )
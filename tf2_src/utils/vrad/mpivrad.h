@@ -27,6 +27,10 @@ void		VRAD_SetupMPI( int &argc, char **&argv );
 
 void		RunMPIBuildFacelights(void);
 void		RunMPIBuildVisLeafs(void);
+#ifdef POSIX
+void		RunLocalBuildFacelights(void);
+void		RunLocalBuildVisLeafs(void);
+#endif
 void		VMPI_DistributeLightData();
 
 // This handles disconnections. They're usually not fatal for the master.
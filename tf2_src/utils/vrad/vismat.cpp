@@ -8,6 +8,8 @@
 
 #include "vrad.h"
 #include "vmpi.h"
+#include "local_distribute_work.h"
+#include "lightcache.h"
 #ifdef MPI
 #include "messbuf.h"
 static MessageBuffer mb;
@@ -45,7 +47,19 @@ public:
 
 	FORCEINLINE void TestMakeTransfer( Vector start, Vector stop, int ndxShooter, int ndxReciever )
 	{
-		g_RtEnv.AddToRayStream( m_RayStream, start, stop, &m_pResults[m_nTests] );
+		int nCachedVis = g_bLightCache ? LightCache_TestVis( ndxShooter, ndxReciever, start, stop ) : -1;
+		if ( nCachedVis < 0 )
+		{
+			g_RtEnv.AddToRayStream( m_RayStream, start, stop, &m_pResults[m_nTests] );
+		}
+		else
+		{
+			// The last compile traced this pair and nothing in between has changed.
+			RayTracingSingleResult &result = m_pResults[m_nTests];
+			result.HitID = nCachedVis ? -1 : 0;
+			result.HitDistance = 0.0f;
+			result.ray_length = 1.0f;
+		}
 		m_pShooterPatches[m_nTests] = ndxShooter;
 		m_pRecieverPatches[m_nTests] = ndxReciever;
 		++m_nTests;
@@ -471,6 +485,12 @@ void BuildVisMatrix (void)
 	{
 		RunMPIBuildVisLeafs();
 	}
+#ifdef POSIX
+	else if ( g_nLocalWorkerProcesses > 0 )
+	{
+		RunLocalBuildVisLeafs();
+	}
+#endif
 	else 
 	{
 		RunThreadsOn (dvis->numclusters, true, BuildVisLeafs);
@@ -15,7 +15,9 @@
 #include "vmpi.h"
 #include "macro_texture.h"
 #include "vmpi_tools_shared.h"
+#include "local_distribute_work.h"
 #include "leaf_ambient_lighting.h"
+#include "lightcache.h"
 #include "tools_minidump.h"
 #include "loadcmdline.h"
 #include "byteswap.h"
@@ -2025,6 +2027,12 @@ bool RadWorld_Go()
 		// RunThreadsOnIndividual (numfaces, true, BuildFacelights);
 		RunMPIBuildFacelights();
 	}
+#ifdef POSIX
+	else if ( g_nLocalWorkerProcesses > 0 )
+	{
+		RunLocalBuildFacelights();
+	}
+#endif
 	else 
 	{
 		RunThreadsOnIndividual (numfaces, true, BuildFacelights);
@@ -2034,6 +2042,11 @@ bool RadWorld_Go()
 	if( g_pIncremental && (g_iCurFace != numfaces) )
 		return false;
 
+	if ( g_bLightCache )
+	{
+		LightCache_StoreFaces();
+	}
+
 	// Figure out the offset into lightmap data for each face.
 	PrecompLightmapOffsets();
 	
@@ -2268,6 +2281,11 @@ void VRAD_LoadBSP( char const *pFilename )
 	if ( g_bDumpRtEnv )
 		WriteRTEnv("trace.txt");
 
+	if ( g_bLightCache )
+	{
+		LightCache_CaptureOccluders( g_RtEnv );
+	}
+
 	// Build acceleration structure
 	printf ( "Setting up ray-trace acceleration structure... ");
 	float start = Plat_FloatTime();
@@ -2290,6 +2308,8 @@ void VRAD_LoadBSP( char const *pFilename )
 			return;
 		}
 	}
+
+	LightCache_Init( source );
 }
 
 
@@ -2326,6 +2346,11 @@ void VRAD_Finish()
 	VMPI_SetCurrentStage( "WriteBSPFile" );
 	WriteBSPFile(source);
 
+	if ( g_bLightCache )
+	{
+		LightCache_Save();
+	}
+
 	if ( g_bDumpPatches )
 	{
 		for ( int iStyle = 0; iStyle < 4; ++iStyle )
@@ -2400,6 +2425,10 @@ int ParseCommandLine( int argc, char **argv, bool *onlydetail )
 		{
 			g_bDumpPatches = true;
 		}
+		else if ( !Q_stricmp( argv[i], "-lightcache" ) )
+		{
+			g_bLightCache = true;
+		}
 		else if ( !Q_stricmp( argv[i], "-nodetaillight" ) )
 		{
 			g_bNoDetailLighting = true;
@@ -2463,6 +2492,29 @@ int ParseCommandLine( int argc, char **argv, bool *onlydetail )
 				return -1;
 			}
 		}
+		else if (!Q_stricmp(argv[i],"-localprocs"))
+		{
+			if ( ++i < argc )
+			{
+#ifdef POSIX
+				int nLocalProcs = atoi (argv[i]);
+				if ( nLocalProcs <= 0 )
+				{
+					Warning("Error: expected positive value after '-localprocs'\n" );
+					return -1;
+				}
+				g_nLocalWorkerProcesses = nLocalProcs;
+#else
+				Warning("Error: '-localprocs' needs fork(), which this platform doesn't have\n" );
+				return -1;
+#endif
+			}
+			else
+			{
+				Warning("Error: expected a value after '-localprocs'\n" );
+				return -1;
+			}
+		}
 		else if ( !Q_stricmp(argv[i], "-lights" ) )
 		{
 			if ( ++i < argc && *argv[i] )
@@ -2806,6 +2858,7 @@ void PrintUsage( int argc, char **argv )
 		"  -extrasky n     : trace N times as many rays for indirect light and sky ambient.\n"
 		"  -low            : Run as an idle-priority process.\n"
 		"  -mpi            : Use VMPI to distribute computations.\n"
+		"  -localprocs n   : Distribute computations to n worker processes on this machine (needs fork).\n"
 		"  -rederror       : Show errors in red.\n"
 		"\n"
 		"  -vproject <directory> : Override the VPROJECT environment variable.\n"
@@ -2854,6 +2907,9 @@ void PrintUsage( int argc, char **argv )
 		"  -textureshadows : Allows texture alpha channels to block light - rays intersecting alpha surfaces will sample the texture\n"
 		"  -noskyboxrecurse : Turn off recursion into 3d skybox (skybox shadows on world)\n"
 		"  -nossprops      : Globally disable self-shadowing on static props\n"
+		"  -lightcache     : Keep direct lighting, visibility and static prop lighting in\n"
+		"                    <map>.ldr/hdr.vradcache and only relight what an edit affects\n"
+		"                    on the next compile.\n"
 		"\n"
 #if 1 // Disabled for the initial SDK release with VMPI so we can get feedback from selected users.
 		);
@@ -2906,6 +2962,11 @@ int RunVRAD( int argc, char **argv )
 		CmdLib_Exit( 1 );
 	}
 
+	if ( g_bLightCache )
+	{
+		LightCache_SetOptions( i, argv );
+	}
+
 	// Initialize the filesystem, so additional commandline options can be loaded
 	Q_StripExtension( argv[ i ], source, sizeof( source ) );
 	CmdLib_InitFileSystem( argv[ i ] );
@@ -10,6 +10,7 @@
 //=============================================================================//
 
 #include "vrad.h"
+#include "lightcache.h"
 #include "mathlib/vector.h"
 #include "UtlBuffer.h"
 #include "utlvector.h"
@@ -1154,6 +1155,13 @@ void ComputeDirectLightingAtPoint( Vector &position, Vector &normal, Vector &out
 
 	outColor.Init();
 
+	bool bSkipProp = ( static_prop_id_to_skip != -1 );
+	if ( g_bLightCache && LightCache_RestorePointLighting( position, normal, nLFlags, bSkipProp, outColor ) )
+	{
+		LightCache_StorePointLighting( iThread, position, normal, nLFlags, bSkipProp, outColor );
+		return;
+	}
+
 	// Iterate over all direct lights and accumulate their contribution
 	int cluster = ClusterFromPoint( position );
 	for ( directlight_t *dl = activelights; dl != NULL; dl = dl->next )
@@ -1203,6 +1211,11 @@ void ComputeDirectLightingAtPoint( Vector &position, Vector &normal, Vector &out
 		
 		VectorMA( outColor, sampleOutput.m_flFalloff.m128_f32[0] * sampleOutput.m_flDot[0].m128_f32[0], dl->light.intensity, outColor );
 	}
+
+	if ( g_bLightCache )
+	{
+		LightCache_StorePointLighting( iThread, position, normal, nLFlags, bSkipProp, outColor );
+	}
 }
 
 //-----------------------------------------------------------------------------
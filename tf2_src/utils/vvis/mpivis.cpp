@@ -20,6 +20,7 @@
 #include "threadhelpers.h"
 #include "vstdlib/random.h"
 #include "vmpi_tools_shared.h"
+#include "local_distribute_work.h"
 #include <conio.h>
 #include "scratchpad_helpers.h"
 
@@ -638,3 +639,38 @@ void RunMPIPortalFlow()
 	}
 }
 
+
+#ifdef POSIX
+void RunLocalBasePortalVis()
+{
+	Msg( "%-20s ", "BasePortalVis:" );
+	StartPacifier( "" );
+
+	double elapsed = DistributeWorkLocal( 
+		g_nLocalWorkerProcesses,
+		g_numportals * 2,
+		ProcessBasePortalVis,
+		ReceiveBasePortalVis );
+
+	EndPacifier( false );
+	Msg( " (%d)\n", (int)elapsed );
+}
+
+
+void RunLocalPortalFlow()
+{
+	// There's no multicast between the workers here so each one only uses the portals
+	// it finished itself to cut down its flow. That costs time but not correctness.
+	Msg( "%-20s ", "PortalFlow:" );
+	StartPacifier( "" );
+
+	double elapsed = DistributeWorkLocal( 
+		g_nLocalWorkerProcesses,
+		g_numportals * 2,
+		ProcessPortalFlow,
+		ReceivePortalFlow );
+
+	EndPacifier( false );
+	Msg( " (%d)\n", (int)elapsed );
+}
+#endif
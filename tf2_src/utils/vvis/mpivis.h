@@ -17,5 +17,11 @@ void VVIS_SetupMPI( int &argc, char **&argv );
 void RunMPIBasePortalVis();
 void RunMPIPortalFlow();
 
+#ifdef POSIX
+// Same as the above but with forked worker processes on this machine.
+void RunLocalBasePortalVis();
+void RunLocalPortalFlow();
+#endif
+
 
 #endif // MPIVIS_H
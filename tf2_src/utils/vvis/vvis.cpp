@@ -18,6 +18,7 @@
 #include "collisionutils.h"
 #include "tier0/icommandline.h"
 #include "vmpi_tools_shared.h"
+#include "local_distribute_work.h"
 #include "ilaunchabledll.h"
 #include "tools_minidump.h"
 #include "loadcmdline.h"
@@ -306,6 +307,12 @@ void CalcPortalVis (void)
 	{
  		RunMPIPortalFlow();
 	}
+#ifdef POSIX
+	else if ( g_nLocalWorkerProcesses > 0 )
+	{
+		RunLocalPortalFlow();
+	}
+#endif
 	else 
 	{
 		RunThreadsOnIndividual (g_numportals*2, true, PortalFlow);
@@ -335,6 +342,12 @@ void CalcVis (void)
 	{
 		RunMPIBasePortalVis();
 	}
+#ifdef POSIX
+	else if ( g_nLocalWorkerProcesses > 0 )
+	{
+		RunLocalBasePortalVis();
+	}
+#endif
 	else 
 	{
 	    RunThreadsOnIndividual (g_numportals*2, true, BasePortalVis);
@@ -916,6 +929,17 @@ int ParseCommandLine( int argc, char **argv )
 			numthreads = atoi (argv[i+1]);
 			i++;
 		}
+		else if (!Q_stricmp(argv[i],"-localprocs"))
+		{
+#ifdef POSIX
+			g_nLocalWorkerProcesses = atoi (argv[i+1]);
+			i++;
+#else
+			Warning("Error: '-localprocs' needs fork(), which this platform doesn't have\n" );
+			i = 100000;	// force it to print the usage
+			break;
+#endif
+		}
 		else if (!Q_stricmp(argv[i], "-fast"))
 		{
 			Msg ("fastvis = true\n");
@@ -1029,6 +1053,7 @@ void PrintUsage( int argc, char **argv )
 		"  -mpi_pw <pw>    : Use a password to choose a specific set of VMPI workers.\n"
 		"  -threads        : Control the number of threads vbsp uses (defaults to the #\n"
 		"                    or processors on your machine).\n"
+		"  -localprocs n   : Distribute computations to n worker processes on this machine (needs fork).\n"
 		"  -nosort         : Don't sort portals (sorting is an optimization).\n"
 		"  -tmpin          : Make portals come from \\tmp\\<mapname>.\n"
 		"  -tmpout         : Make portals come from \\tmp\\<mapname>.\n"
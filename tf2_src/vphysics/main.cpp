@@ -11,6 +11,7 @@
 #include "vphysics/collision_set.h"
 #include "tier1/tier1.h"
 #include "ivu_vhash.hxx"
+#include "physics_tracecapture.h"
 
 
 
@@ -100,8 +101,12 @@ private:
 //-----------------------------------------------------------------------------
 class CPhysicsInterface : public CTier1AppSystem<IPhysics>
 {
+	typedef CTier1AppSystem<IPhysics> BaseClass;
+
 public:
 	CPhysicsInterface() : m_pCollisionSetHash(NULL) {}
+	virtual InitReturnVal_t Init();
+	virtual void Shutdown();
 	virtual void *QueryInterface( const char *pInterfaceName );
 	virtual	IPhysicsEnvironment *CreateEnvironment( void );
 	virtual void DestroyEnvironment( IPhysicsEnvironment *pEnvironment );
@@ -127,6 +132,26 @@ IPhysics *g_PhysicsInternal = &g_MainDLLInterface;
 EXPOSE_SINGLE_INTERFACE_GLOBALVAR( CPhysicsInterface, IPhysics, VPHYSICS_INTERFACE_VERSION, g_MainDLLInterface );
 
 
+//-----------------------------------------------------------------------------
+// Init, shutdown
+//-----------------------------------------------------------------------------
+InitReturnVal_t CPhysicsInterface::Init()
+{
+	InitReturnVal_t nRetVal = BaseClass::Init();
+	if ( nRetVal != INIT_OK )
+		return nRetVal;
+
+	TraceCapture_Init();
+	return INIT_OK;
+}
+
+void CPhysicsInterface::Shutdown()
+{
+	TraceCapture_Shutdown();
+	BaseClass::Shutdown();
+}
+
+
 //-----------------------------------------------------------------------------
 // Query interface
 //-----------------------------------------------------------------------------
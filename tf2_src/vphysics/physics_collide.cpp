@@ -26,6 +26,7 @@
 #include "physics_trace.h"
 #include "vcollide_parse_private.h"
 #include "physics_virtualmesh.h"
+#include "physics_tracecapture.h"
 
 #include "mathlib/polyhedron.h"
 #include "tier1/byteswap.h"
@@ -1546,6 +1547,12 @@ void CPhysicsCollision::SetConvexGameData( CPhysConvex *pConvex, unsigned int ga
 
 void CPhysicsCollision::TraceBox( const Vector &start, const Vector &end, const Vector &mins, const Vector &maxs, const CPhysCollide *pCollide, const Vector &collideOrigin, const QAngle &collideAngles, trace_t *ptr )
 {
+	if ( TraceCapture_IsActive() )
+	{
+		Ray_t ray;
+		ray.Init( start, end, mins, maxs );
+		TraceCapture_TraceBox( ray, MASK_ALL, pCollide, collideOrigin, collideAngles );
+	}
 	m_traceapi.SweepBoxIVP( start, end, mins, maxs, pCollide, collideOrigin, collideAngles, ptr );
 }
 
@@ -1556,12 +1563,20 @@ void CPhysicsCollision::TraceBox( const Ray_t &ray, const CPhysCollide *pCollide
 
 void CPhysicsCollision::TraceBox( const Ray_t &ray, unsigned int contentsMask, IConvexInfo *pConvexInfo, const CPhysCollide *pCollide, const Vector &collideOrigin, const QAngle &collideAngles, trace_t *ptr )
 {
+	if ( TraceCapture_IsActive() )
+	{
+		TraceCapture_TraceBox( ray, contentsMask, pCollide, collideOrigin, collideAngles );
+	}
 	m_traceapi.SweepBoxIVP( ray, contentsMask, pConvexInfo, pCollide, collideOrigin, collideAngles, ptr );
 }
 
 // Trace one collide against another
 void CPhysicsCollision::TraceCollide( const Vector &start, const Vector &end, const CPhysCollide *pSweepCollide, const QAngle &sweepAngles, const CPhysCollide *pCollide, const Vector &collideOrigin, const QAngle &collideAngles, trace_t *ptr )
 {
+	if ( TraceCapture_IsActive() )
+	{
+		TraceCapture_TraceCollide( start, end, pSweepCollide, sweepAngles, pCollide, collideOrigin, collideAngles );
+	}
 	m_traceapi.SweepIVP( start, end, pSweepCollide, sweepAngles, pCollide, collideOrigin, collideAngles, ptr );
 }
 
@@ -1589,6 +1604,10 @@ void CPhysicsCollision::DestroyCollide( CPhysCollide *pCollide )
 {
 	if ( !IsBBoxCache( pCollide ) )
 	{
+		if ( TraceCapture_IsActive() )
+		{
+			TraceCapture_DestroyCollide( pCollide );
+		}
 		delete pCollide;
 	}
 }
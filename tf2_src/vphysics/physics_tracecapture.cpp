@@ -0,0 +1,262 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Records the TraceBox/TraceCollide workload to a file so traceperf
+//			can replay real game traces against the same collision models.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "cmodel.h"
+#include "physics_trace.h"
+#include "physics_tracecapture.h"
+#include "vphysics/tracecapture.h"
+#include "tier0/icommandline.h"
+#include "tier0/threadtools.h"
+#include "tier1/utlmap.h"
+#include "tier1/utlbuffer.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+// Flush the record buffer to disk once it gets this big
+#define TRACECAPTURE_FLUSH_SIZE		(256*1024)
+#define TRACECAPTURE_DEFAULT_MAX	1000000
+
+bool g_bTraceCaptureActive = false;
+
+class CTraceCapture
+{
+public:
+	CTraceCapture();
+
+	bool Open( const char *pFilename, int maxTraces );
+	void Close();
+
+	void TraceBox( const Ray_t &ray, unsigned int contentsMask, const CPhysCollide *pCollide, const Vector &collideOrigin, const QAngle &collideAngles );
+	void TraceCollide( const Vector &start, const Vector &end, const CPhysCollide *pSweepCollide, const QAngle &sweepAngles, const CPhysCollide *pCollide, const Vector &collideOrigin, const QAngle &collideAngles );
+	void DestroyCollide( const CPhysCollide *pCollide );
+
+private:
+	int FindOrWriteCollide( const CPhysCollide *pCollide );
+	void WriteRecord( int type, const void *pData, int size );
+	void CountTrace();
+	void Flush();
+
+	CThreadFastMutex	m_mutex;
+	FILE				*m_fp;
+	CUtlBuffer			m_buffer;
+	CUtlVector<char>	m_collideData;
+	CUtlMap<const CPhysCollide *, int> m_collideIndex;
+	int					m_nextCollideIndex;
+	int					m_traceCount;
+	int					m_maxTraces;
+};
+
+static CTraceCapture g_TraceCapture;
+
+CTraceCapture::CTraceCapture() : m_fp(NULL), m_collideIndex( DefLessFunc(const CPhysCollide *) ), m_nextCollideIndex(0), m_traceCount(0), m_maxTraces(0)
+{
+}
+
+bool CTraceCapture::Open( const char *pFilename, int maxTraces )
+{
+	m_fp = fopen( pFilename, "wb" );
+	if ( !m_fp )
+	{
+		Warning( "vphysics: Couldn't open trace capture file %s\n", pFilename );
+		return false;
+	}
+
+	tracecapture_header_t header;
+	header.id = VPHYSICS_TRACECAPTURE_ID;
+	header.version = VPHYSICS_TRACECAPTURE_VERSION;
+	m_buffer.Put( &header, sizeof(header) );
+
+	m_maxTraces = maxTraces;
+	m_traceCount = 0;
+	m_nextCollideIndex = 0;
+	Msg( "vphysics: Capturing up to %d traces to %s\n", maxTraces, pFilename );
+	return true;
+}
+
+void CTraceCapture::Close()
+{
+	AUTO_LOCK( m_mutex );
+	if ( !m_fp )
+		return;
+
+	Flush();
+	fclose( m_fp );
+	m_fp = NULL;
+	m_collideIndex.RemoveAll();
+	m_buffer.Purge();
+	m_collideData.Purge();
+	g_bTraceCaptureActive = false;
+	Msg( "vphysics: Captured %d traces against %d collision models\n", m_traceCount, m_nextCollideIndex );
+}
+
+void CTraceCapture::Flush()
+{
+	if ( m_buffer.TellPut() )
+	{
+		fwrite( m_buffer.Base(), m_buffer.TellPut(), 1, m_fp );
+		m_buffer.Clear();
+	}
+}
+
+void CTraceCapture::WriteRecord( int type, const void *pData, int size )
+{
+	tracecapture_record_t record;
+	record.type = type;
+	record.size = size;
+	m_buffer.Put( &record, sizeof(record) );
+	m_buffer.Put( pData, size );
+	if ( m_buffer.TellPut() >= TRACECAPTURE_FLUSH_SIZE )
+	{
+		Flush();
+	}
+}
+
+// returns -1 if the collide can't be captured (virtual meshes have no serialized form)
+int CTraceCapture::FindOrWriteCollide( const CPhysCollide *pCollide )
+{
+	unsigned short index = m_collideIndex.Find( pCollide );
+	if ( index != m_collideIndex.InvalidIndex() )
+		return m_collideIndex[index];
+
+	int dataSize = pCollide->GetCompactSurface() ? pCollide->GetSerializationSize() : 0;
+	int collideIndex = -1;
+	if ( dataSize > 0 )
+	{
+		collideIndex = m_nextCollideIndex++;
+
+		tracecapture_collide_t collide;
+		collide.collideIndex = collideIndex;
+		collide.vcollideIndex = pCollide->GetVCollideIndex();
+		collide.dataSize = dataSize;
+
+		tracecapture_record_t record;
+		record.type = TRACECAPTURE_COLLIDE;
+		record.size = sizeof(collide) + dataSize;
+		m_buffer.Put( &record, sizeof(record) );
+		m_buffer.Put( &collide, sizeof(collide) );
+		m_collideData.SetCount( dataSize );
+		pCollide->SerializeToBuffer( m_collideData.Base(), false );
+		m_buffer.Put( m_collideData.Base(), dataSize );
+	}
+	// remember uncapturable collides too so they aren't serialized again
+	m_collideIndex.Insert( pCollide, collideIndex );
+	return collideIndex;
+}
+
+void CTraceCapture::CountTrace()
+{
+	m_traceCount++;
+	if ( m_traceCount >= m_maxTraces )
+	{
+		// stop taking the lock on every trace, Close() still writes out what we have
+		g_bTraceCaptureActive = false;
+		Flush();
+		Msg( "vphysics: Trace capture reached %d traces, stopping\n", m_traceCount );
+	}
+}
+
+void CTraceCapture::TraceBox( const Ray_t &ray, unsigned int contentsMask, const CPhysCollide *pCollide, const Vector &collideOrigin, const QAngle &collideAngles )
+{
+	AUTO_LOCK( m_mutex );
+	if ( !m_fp || !g_bTraceCaptureActive || !pCollide )
+		return;
+
+	int collideIndex = FindOrWriteCollide( pCollide );
+	if ( collideIndex < 0 )
+		return;
+
+	tracecapture_tracebox_t trace;
+	trace.collideIndex = collideIndex;
+	trace.contentsMask = contentsMask;
+	trace.start = ray.m_Start;
+	trace.delta = ray.m_Delta;
+	trace.startOffset = ray.m_StartOffset;
+	trace.extents = ray.m_Extents;
+	trace.isRay = ray.m_IsRay;
+	trace.isSwept = ray.m_IsSwept;
+	trace.collideOrigin = collideOrigin;
+	trace.collideAngles = collideAngles;
+	WriteRecord( TRACECAPTURE_TRACEBOX, &trace, sizeof(trace) );
+	CountTrace();
+}
+
+void CTraceCapture::TraceCollide( const Vector &start, const Vector &end, const CPhysCollide *pSweepCollide, const QAngle &sweepAngles, const CPhysCollide *pCollide, const Vector &collideOrigin, const QAngle &collideAngles )
+{
+	AUTO_LOCK( m_mutex );
+	if ( !m_fp || !g_bTraceCaptureActive || !pCollide || !pSweepCollide )
+		return;
+
+	int sweepIndex = FindOrWriteCollide( pSweepCollide );
+	int collideIndex = FindOrWriteCollide( pCollide );
+	if ( sweepIndex < 0 || collideIndex < 0 )
+		return;
+
+	tracecapture_tracecollide_t trace;
+	trace.sweepIndex = sweepIndex;
+	trace.collideIndex = collideIndex;
+	trace.start = start;
+	trace.end = end;
+	trace.sweepAngles = sweepAngles;
+	trace.collideOrigin = collideOrigin;
+	trace.collideAngles = collideAngles;
+	WriteRecord( TRACECAPTURE_TRACECOLLIDE, &trace, sizeof(trace) );
+	CountTrace();
+}
+
+// The memory may be reused for a different collide, so forget the pointer
+void CTraceCapture::DestroyCollide( const CPhysCollide *pCollide )
+{
+	AUTO_LOCK( m_mutex );
+	if ( !m_fp )
+		return;
+
+	unsigned short index = m_collideIndex.Find( pCollide );
+	if ( index == m_collideIndex.InvalidIndex() )
+		return;
+
+	int collideIndex = m_collideIndex[index];
+	m_collideIndex.RemoveAt( index );
+	if ( collideIndex >= 0 )
+	{
+		WriteRecord( TRACECAPTURE_DESTROYCOLLIDE, &collideIndex, sizeof(collideIndex) );
+	}
+}
+
+void TraceCapture_Init()
+{
+	const char *pFilename = CommandLine()->ParmValue( "-vphysics_tracecapture", (const char *)NULL );
+	if ( !pFilename )
+		return;
+
+	int maxTraces = CommandLine()->ParmValue( "-vphysics_tracecapture_max", TRACECAPTURE_DEFAULT_MAX );
+	if ( g_TraceCapture.Open( pFilename, MAX( maxTraces, 1 ) ) )
+	{
+		g_bTraceCaptureActive = true;
+	}
+}
+
+void TraceCapture_Shutdown()
+{
+	g_TraceCapture.Close();
+}
+
+void TraceCapture_TraceBox( const Ray_t &ray, unsigned int contentsMask, const CPhysCollide *pCollide, const Vector &collideOrigin, const QAngle &collideAngles )
+{
+	g_TraceCapture.TraceBox( ray, contentsMask, pCollide, collideOrigin, collideAngles );
+}
+
+void TraceCapture_TraceCollide( const Vector &start, const Vector &end, const CPhysCollide *pSweepCollide, const QAngle &sweepAngles, const CPhysCollide *pCollide, const Vector &collideOrigin, const QAngle &collideAngles )
+{
+	g_TraceCapture.TraceCollide( start, end, pSweepCollide, sweepAngles, pCollide, collideOrigin, collideAngles );
+}
+
+void TraceCapture_DestroyCollide( const CPhysCollide *pCollide )
+{
+	g_TraceCapture.DestroyCollide( pCollide );
+}
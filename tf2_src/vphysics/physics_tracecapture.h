@@ -0,0 +1,31 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Records the TraceBox/TraceCollide workload to a file for traceperf
+//
+//=============================================================================//
+
+#ifndef PHYSICS_TRACECAPTURE_H
+#define PHYSICS_TRACECAPTURE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+struct Ray_t;
+class CPhysCollide;
+
+// Opens the capture file if -vphysics_tracecapture <file> is on the command line
+void TraceCapture_Init();
+void TraceCapture_Shutdown();
+
+void TraceCapture_TraceBox( const Ray_t &ray, unsigned int contentsMask, const CPhysCollide *pCollide, const Vector &collideOrigin, const QAngle &collideAngles );
+void TraceCapture_TraceCollide( const Vector &start, const Vector &end, const CPhysCollide *pSweepCollide, const QAngle &sweepAngles, const CPhysCollide *pCollide, const Vector &collideOrigin, const QAngle &collideAngles );
+void TraceCapture_DestroyCollide( const CPhysCollide *pCollide );
+
+extern bool g_bTraceCaptureActive;
+
+inline bool TraceCapture_IsActive()
+{
+	return g_bTraceCaptureActive;
+}
+
+#endif // PHYSICS_TRACECAPTURE_H
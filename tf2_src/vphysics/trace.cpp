@@ -551,6 +551,7 @@ CTraceIVP::CTraceIVP( const CPhysCollide *pCollide, const Vector &origin, const
 
 bool CTraceIVP::BuildLeafmapCacheRLE( const leafmap_t * RESTRICT pLeafmap )
 {
+	VPROF("BuildLeafmapCacheRLE");
 	// iterate the rle spans of verts and output them to a buffer in post-transform space
 	int startPoint = pLeafmap->startVert[0];
 	int pointCount = pLeafmap->vertCount;
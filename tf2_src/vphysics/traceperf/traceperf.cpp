@@ -1,196 +1,640 @@
 //========= Copyright Valve Corporation, All rights reserved. ============//
 // traceperf.cpp : Defines the entry point for the console application.
 //
+// Usage: traceperf [-path <content dir>] [-bsp] [-replay <capture file>] [-count <traces>] [-repeat <n>] [-maxfiles <n>]
+//
+// Without -path or -replay a small set of props is benchmarked.  -path loads every .phy
+// (and .bsp with -bsp) under the directory, either absolute or relative to the GAME path.
+// -replay runs a workload captured by running the game with -vphysics_tracecapture <file>.
+//
 
 #include "stdafx.h"
 #include "gametrace.h"
 #include "fmtstr.h"
+#include "bspfile.h"
 #include "appframework/appframework.h"
 #include "filesystem.h"
 #include "filesystem_init.h"
+#include "tier0/fasttimer.h"
 #include "tier1/tier1.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/utlmap.h"
+#include "tier1/utlstring.h"
 #include "tier2/tier2.h"
 #include "tier3/tier3.h"
+#include "vphysics/tracecapture.h"
+#include "vstdlib/random.h"
 
 IPhysicsCollision *physcollision = NULL;
 
-#define NUM_COLLISION_TESTS 2500
-
-void ReadPHYFile(const char *name, vcollide_t &collide )
-{
-	FileHandle_t fp = g_pFullFileSystem->Open(name, "rb");
-	if (!fp)
-		Error ("Couldn't open %s", name);
+#define NUM_COLLISION_TESTS		2500
+#define NUM_CONTENT_TESTS		200
 
-	phyheader_t header;
+// Collides with more convex pieces than this are reported as complex
+#define COMPOUND_MAX_CONVEXES	16
 
-	g_pFullFileSystem->Read( &header, sizeof(header), fp );
-	if ( header.size != sizeof(header) || header.solidCount <= 0 )
-		return;
+enum shapeclass_t
+{
+	SHAPE_CONVEX = 0,
+	SHAPE_COMPOUND,
+	SHAPE_COMPLEX,
+	SHAPE_CLASS_COUNT,
+};
 
-	int fileSize = g_pFullFileSystem->Size(fp);
+static const char *g_pShapeClassNames[SHAPE_CLASS_COUNT] = { "convex", "compound", "complex" };
 
-	char *buf = (char *)_alloca( fileSize );
-	g_pFullFileSystem->Read( buf, fileSize, fp );
-	g_pFullFileSystem->Close( fp );
+enum tracetype_t
+{
+	TRACE_RAY = 0,
+	TRACE_BOX,
+	TRACE_COLLIDE,
+	TRACE_TYPE_COUNT,
+};
 
-	physcollision->VCollideLoad( &collide, header.solidCount, (const char *)buf, fileSize );
-}
+static const char *g_pTraceTypeNames[TRACE_TYPE_COUNT] = { "ray", "box", "collide" };
 
+// vprof nodes inside vphysics that are reported per trace type.  These are only present
+// when vphysics is built with VPROF_LEVEL > 0.
+static const char *g_pFeatureNodes[] =
+{
+	"TraceSolver::DoSweep",
+	"TraceSolver::SweepSingleConvex",
+	"SupportMapCached",
+	"BuildLeafmapCacheRLE",
+	"SupportMap_Leaf",
+	"SupportMap_Walk",
+	"TraceSolver::SolveMeshIntersection",
+};
 
-struct testlist_t
+struct testcollide_t
 {
-	Vector start;
-	Vector end;
-	Vector normal;
-	bool hit;
+	CUtlString		name;
+	CPhysCollide	*pCollide;
+	shapeclass_t	shape;
+	Vector			center;
+	float			radius;
 };
 
-struct benchresults_t
+// A single trace from the synthetic or captured workload
+struct testtrace_t
 {
-	int		collisionTests;
-	int		collisionHits;
-	float	totalTime;
-	float	rayTime;
-	float	boxTime;
+	tracetype_t		type;
+	int				collide;
+	int				sweepCollide;		// TRACE_COLLIDE only
+	unsigned int	contentsMask;
+	Vector			start;				// Ray_t fields for TRACE_RAY/TRACE_BOX
+	Vector			delta;
+	Vector			startOffset;
+	Vector			extents;
+	bool			isRay;
+	bool			isSwept;
+	Vector			end;				// TRACE_COLLIDE sweeps from start to end
+	QAngle			sweepAngles;
+	Vector			collideOrigin;
+	QAngle			collideAngles;
 };
 
-testlist_t g_Traces[NUM_COLLISION_TESTS];
-void Benchmark_PHY( const CPhysCollide *pCollide, benchresults_t *pOut )
+CUtlVector<testcollide_t>	g_Collides;
+CUtlVector<vcollide_t>		g_VCollides;
+CUtlVector<testtrace_t>		g_Traces;
+
+
+//-----------------------------------------------------------------------------
+// Loading
+//-----------------------------------------------------------------------------
+static shapeclass_t ClassifyCollide( const CPhysCollide *pCollide )
 {
-	int i;
-	Vector start = vec3_origin;
-	static Vector *targets = NULL;
-	static bool first = true;
-	static float test[2] = {1,1};
-	if ( first )
+	CPhysConvex *pConvexes[COMPOUND_MAX_CONVEXES+1];
+	int convexCount = physcollision->GetConvexesUsedInCollideable( pCollide, pConvexes, ARRAYSIZE(pConvexes) );
+	if ( convexCount <= 1 )
+		return SHAPE_CONVEX;
+	return convexCount <= COMPOUND_MAX_CONVEXES ? SHAPE_COMPOUND : SHAPE_COMPLEX;
+}
+
+static int AddTestCollide( const char *pName, CPhysCollide *pCollide )
+{
+	int index = g_Collides.AddToTail();
+	testcollide_t &collide = g_Collides[index];
+	collide.name = pName;
+	collide.pCollide = pCollide;
+	collide.shape = ClassifyCollide( pCollide );
+
+	Vector mins, maxs;
+	physcollision->CollideGetAABB( &mins, &maxs, pCollide, vec3_origin, vec3_angle );
+	collide.center = 0.5f * (mins + maxs);
+	collide.radius = 0.5f * (maxs - mins).Length();
+	return index;
+}
+
+static void AddVCollide( const char *pName, vcollide_t &vcollide )
+{
+	for ( int i = 0; i < vcollide.solidCount; i++ )
 	{
-		float radius = 0;
-		float theta = 0;
-		float phi = 0;
-		for ( int i = 0; i < NUM_COLLISION_TESTS; i++ )
+		if ( vcollide.solids[i] )
 		{
-			radius += NUM_COLLISION_TESTS * 123.123f;
-			radius = fabs(fmod(radius, 128));
-			theta += NUM_COLLISION_TESTS * 0.76f;
-			theta = fabs(fmod(theta, DEG2RAD(360)));
-			phi += NUM_COLLISION_TESTS * 0.16666666f;
-			phi = fabs(fmod(phi, DEG2RAD(180)));
-
-			float st, ct, sp, cp;
-			SinCos( theta, &st, &ct );
-			SinCos( phi, &sp, &cp );
-			st = sin(theta);
-			ct = cos(theta);
-			sp = sin(phi);
-			cp = cos(phi);
-
-			g_Traces[i].start.x = radius * ct * sp;
-			g_Traces[i].start.y = radius * st * sp;
-			g_Traces[i].start.z = radius * cp;
+			AddTestCollide( vcollide.solidCount > 1 ? CFmtStr( "%s[%d]", pName, i ).Access() : pName, vcollide.solids[i] );
 		}
-		first = false;
 	}
+	g_VCollides.AddToTail( vcollide );
+}
 
-	float duration = 0;
-	Vector size[2];
-	size[0].Init(0,0,0);
-	size[1].Init(16,16,16);
+static bool ReadPHYFile( const char *pName, const char *pPathID )
+{
+	CUtlBuffer buf;
+	if ( !g_pFullFileSystem->ReadFile( pName, pPathID, buf ) )
+	{
+		Msg( "Couldn't open %s\n", pName );
+		return false;
+	}
 
-#if VPROF_LEVEL > 0 
-	g_VProfCurrentProfile.Reset();
-	g_VProfCurrentProfile.ResetPeaks();
-	g_VProfCurrentProfile.Start();
-#endif
+	const phyheader_t *pHeader = (const phyheader_t *)buf.Base();
+	if ( buf.TellPut() < (int)sizeof(phyheader_t) || pHeader->size != sizeof(phyheader_t) || pHeader->solidCount <= 0 )
+		return false;
 
-#if TEST_BBOX
-	Vector mins, maxs;
-	physcollision->CollideGetAABB( &mins, &maxs, pCollide, Vector(-500, 200, -100), vec3_angle );
-	Vector extents = maxs - mins;
-	Vector center = 0.5f * (maxs+mins);
-	Msg("bbox: %.2f,%.2f, %.2f @ %.2f, %.2f, %.2f\n", extents.x, extents.y, extents.z, center.x, center.y, center.z );
-#endif
-	unsigned int hitCount = 0;
-	double startTime = Plat_FloatTime();
-	trace_t tr;
-	for ( i = 0; i < NUM_COLLISION_TESTS; i++ )
+	vcollide_t collide;
+	physcollision->VCollideLoad( &collide, pHeader->solidCount, (const char *)buf.Base() + pHeader->size, buf.TellPut() - pHeader->size );
+	AddVCollide( pName, collide );
+	return true;
+}
+
+// Loads the brush model collision out of the physcollide lump
+static bool ReadBSPFile( const char *pName, const char *pPathID )
+{
+	CUtlBuffer buf;
+	if ( !g_pFullFileSystem->ReadFile( pName, pPathID, buf ) )
+	{
+		Msg( "Couldn't open %s\n", pName );
+		return false;
+	}
+
+	const dheader_t *pHeader = (const dheader_t *)buf.Base();
+	if ( buf.TellPut() < (int)sizeof(dheader_t) || pHeader->ident != IDBSPHEADER )
+		return false;
+
+	const lump_t &lump = pHeader->lumps[LUMP_PHYSCOLLIDE];
+	if ( lump.uncompressedSize != 0 )
+	{
+		Msg( "%s: compressed physics lump, skipping\n", pName );
+		return false;
+	}
+	if ( lump.filelen <= 0 || lump.fileofs + lump.filelen > buf.TellPut() )
+		return false;
+
+	const byte *pBase = (const byte *)buf.Base() + lump.fileofs;
+	const byte *ptr = pBase;
+
+	// physics data is variable length.  The last physmodel has modelIndex -1, dataSize -1
+	dphysmodel_t physModel;
+	do
 	{
-		physcollision->TraceBox( g_Traces[i].start, start, -size[0], size[0], pCollide, vec3_origin, vec3_angle, &tr );
-		if ( tr.DidHit() )
+		if ( (int)(ptr - pBase) + (int)sizeof(physModel) > lump.filelen )
+			break;
+
+		memcpy( &physModel, ptr, sizeof(physModel) );
+		ptr += sizeof(physModel);
+
+		if ( physModel.dataSize > 0 )
 		{
-			g_Traces[i].end = tr.endpos;
-			g_Traces[i].normal = tr.plane.normal;
-			g_Traces[i].hit = true;
-			hitCount++;
+			if ( (int)(ptr - pBase) + physModel.dataSize + physModel.keydataSize > lump.filelen )
+				break;
+
+			vcollide_t collide;
+			physcollision->VCollideLoad( &collide, physModel.solidCount, (const char *)ptr, physModel.dataSize + physModel.keydataSize );
+			AddVCollide( CFmtStr( "%s*%d", pName, physModel.modelIndex ), collide );
+			ptr += physModel.dataSize + physModel.keydataSize;
 		}
-		else
+	} while ( physModel.dataSize > 0 );
+
+	return true;
+}
+
+static void FindContentFiles_R( const char *pDir, const char *pPathID, bool bBSP, CUtlVector<CUtlString> &files )
+{
+	CUtlVector<CUtlString> subDirs;
+
+	FileFindHandle_t handle;
+	const char *pFound = g_pFullFileSystem->FindFirstEx( CFmtStr( "%s%c*", pDir, CORRECT_PATH_SEPARATOR ), pPathID, &handle );
+	for ( ; pFound; pFound = g_pFullFileSystem->FindNext( handle ) )
+	{
+		if ( pFound[0] == '.' )
+			continue;
+
+		char fullPath[MAX_PATH];
+		V_ComposeFileName( pDir, pFound, fullPath, sizeof(fullPath) );
+		if ( g_pFullFileSystem->FindIsDirectory( handle ) )
+		{
+			subDirs.AddToTail( fullPath );
+			continue;
+		}
+
+		const char *pExt = V_GetFileExtension( pFound );
+		if ( pExt && ( !V_stricmp( pExt, "phy" ) || ( bBSP && !V_stricmp( pExt, "bsp" ) ) ) )
 		{
-			g_Traces[i].hit = false;
+			files.AddToTail( fullPath );
 		}
 	}
-	for ( i = 0; i < NUM_COLLISION_TESTS; i++ )
+	g_pFullFileSystem->FindClose( handle );
+
+	for ( int i = 0; i < subDirs.Count(); i++ )
 	{
-		physcollision->TraceBox( g_Traces[i].start, start, -size[1], size[1], pCollide, vec3_origin, vec3_angle, &tr );
+		FindContentFiles_R( subDirs[i], pPathID, bBSP, files );
 	}
-	duration = Plat_FloatTime() - startTime;
+}
 
-#if VPROF_LEVEL > 0 
-	g_VProfCurrentProfile.MarkFrame();
-	g_VProfCurrentProfile.Stop();
-	g_VProfCurrentProfile.Reset();
-	g_VProfCurrentProfile.ResetPeaks();
-	g_VProfCurrentProfile.Start();
-#endif
-	hitCount = 0;
-	startTime = Plat_FloatTime();
-	for ( i = 0; i < NUM_COLLISION_TESTS; i++ )
+static void LoadContentPath( const char *pPath, bool bBSP, int maxFiles )
+{
+	const char *pPathID = V_IsAbsolutePath( pPath ) ? NULL : "GAME";
+	char dir[MAX_PATH];
+	V_strncpy( dir, pPath, sizeof(dir) );
+	V_FixSlashes( dir );
+	V_StripTrailingSlash( dir );
+
+	CUtlVector<CUtlString> files;
+	FindContentFiles_R( dir, pPathID, bBSP, files );
+
+	int fileCount = MIN( files.Count(), maxFiles );
+	Msg( "Loading %d of %d files from %s\n", fileCount, files.Count(), dir );
+	for ( int i = 0; i < fileCount; i++ )
 	{
-		physcollision->TraceBox( g_Traces[i].start, start, -size[0], size[0], pCollide, vec3_origin, vec3_angle, &tr );
-		if ( tr.DidHit() )
+		const char *pExt = V_GetFileExtension( files[i] );
+		if ( !V_stricmp( pExt, "bsp" ) )
 		{
-			g_Traces[i].end = tr.endpos;
-			g_Traces[i].normal = tr.plane.normal;
-			g_Traces[i].hit = true;
-			hitCount++;
+			ReadBSPFile( files[i], pPathID );
 		}
 		else
 		{
-			g_Traces[i].hit = false;
+			ReadPHYFile( files[i], pPathID );
 		}
-#if VPROF_LEVEL > 0 
-		g_VProfCurrentProfile.MarkFrame();
-#endif
 	}
-	double midTime = Plat_FloatTime();
-	for ( i = 0; i < NUM_COLLISION_TESTS; i++ )
+}
+
+
+//-----------------------------------------------------------------------------
+// Workloads
+//-----------------------------------------------------------------------------
+
+// Traces from points around each collide's bounding sphere toward points inside it.  Every
+// collide gets the same number of rays, boxes and swept boxes
+static void BuildSyntheticWorkload( int tracesPerCollide )
+{
+	CUniformRandomStream random;
+	random.SetSeed( 1 );
+
+	const Vector sweepSize( 16, 16, 16 );
+	int sweepCollide = AddTestCollide( "sweep box", physcollision->BBoxToCollide( -sweepSize, sweepSize ) );
+
+	for ( int i = 0; i < g_Collides.Count(); i++ )
 	{
-		physcollision->TraceBox( g_Traces[i].start, start, -size[1], size[1], pCollide, vec3_origin, vec3_angle, &tr );
-#if VPROF_LEVEL > 0 
-		g_VProfCurrentProfile.MarkFrame();
-#endif
+		if ( i == sweepCollide )
+			continue;
+
+		const testcollide_t &collide = g_Collides[i];
+		for ( int j = 0; j < tracesPerCollide; j++ )
+		{
+			Vector dir;
+			float theta = random.RandomFloat( 0, 2 * M_PI );
+			float z = random.RandomFloat( -1, 1 );
+			float r = sqrtf( 1.0f - z*z );
+			dir.Init( r * cosf(theta), r * sinf(theta), z );
+
+			Vector start = collide.center + dir * ( collide.radius + random.RandomFloat( sweepSize.x, 128 ) );
+			Vector end = collide.center + collide.radius * 0.5f * Vector( random.RandomFloat(-1,1), random.RandomFloat(-1,1), random.RandomFloat(-1,1) );
+
+			for ( int type = 0; type < TRACE_TYPE_COUNT; type++ )
+			{
+				testtrace_t &trace = g_Traces[g_Traces.AddToTail()];
+				trace.type = (tracetype_t)type;
+				trace.collide = i;
+				trace.sweepCollide = sweepCollide;
+				trace.contentsMask = MASK_ALL;
+				trace.start = start;
+				trace.delta = end - start;
+				trace.startOffset.Init();
+				trace.extents = ( type == TRACE_RAY ) ? vec3_origin : sweepSize;
+				trace.isRay = ( type == TRACE_RAY );
+				trace.isSwept = true;
+				trace.end = end;
+				trace.sweepAngles = vec3_angle;
+				trace.collideOrigin = vec3_origin;
+				trace.collideAngles = vec3_angle;
+			}
+		}
 	}
-	double endTime = Plat_FloatTime();
-	duration = endTime - startTime;
-	pOut->collisionTests = NUM_COLLISION_TESTS;
-	pOut->collisionHits = hitCount;
-	pOut->totalTime = duration * 1000.0f;
-	pOut->rayTime = (midTime - startTime) * 1000.0f;
-	pOut->boxTime = (endTime - midTime)*1000.0f;
-
-#if VPROF_LEVEL > 0 
-	g_VProfCurrentProfile.Stop();
-	g_VProfCurrentProfile.OutputReport( VPRT_FULL & ~VPRT_HIERARCHY, NULL );
-#endif
 }
 
-//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
-//
-// Purpose: 
-//
-// $NoKeywords: $
-//
-//===========================================================================//
+// Reads a file written by vphysics with -vphysics_tracecapture
+static bool LoadCapturedWorkload( const char *pFilename )
+{
+	CUtlBuffer buf;
+	if ( !g_pFullFileSystem->ReadFile( pFilename, NULL, buf ) )
+	{
+		Warning( "Couldn't open trace capture %s\n", pFilename );
+		return false;
+	}
+
+	tracecapture_header_t header;
+	buf.Get( &header, sizeof(header) );
+	if ( !buf.IsValid() || header.id != VPHYSICS_TRACECAPTURE_ID || header.version != VPHYSICS_TRACECAPTURE_VERSION )
+	{
+		Warning( "%s is not a version %d trace capture\n", pFilename, VPHYSICS_TRACECAPTURE_VERSION );
+		return false;
+	}
+
+	// capture collide index -> g_Collides index
+	CUtlMap<int, int> collideMap( DefLessFunc(int) );
+	while ( buf.GetBytesRemaining() >= (int)sizeof(tracecapture_record_t) )
+	{
+		tracecapture_record_t record;
+		buf.Get( &record, sizeof(record) );
+		if ( record.size < 0 || record.size > buf.GetBytesRemaining() )
+		{
+			Warning( "%s: truncated record\n", pFilename );
+			break;
+		}
+
+		int nextRecord = buf.TellGet() + record.size;
+		switch ( record.type )
+		{
+		case TRACECAPTURE_COLLIDE:
+			{
+				tracecapture_collide_t collide;
+				buf.Get( &collide, sizeof(collide) );
+				if ( !buf.IsValid() || collide.dataSize < 0 || collide.dataSize > nextRecord - buf.TellGet() )
+				{
+					Warning( "%s: bad collide record (%d bytes of data)\n", pFilename, collide.dataSize );
+					return false;
+				}
+
+				CPhysCollide *pCollide = physcollision->UnserializeCollide( (char *)buf.PeekGet(), collide.dataSize, collide.vcollideIndex );
+				if ( pCollide )
+				{
+					collideMap.InsertOrReplace( collide.collideIndex, AddTestCollide( CFmtStr( "captured %d", collide.collideIndex ), pCollide ) );
+				}
+			}
+			break;
+
+		case TRACECAPTURE_TRACEBOX:
+			{
+				tracecapture_tracebox_t capture;
+				buf.Get( &capture, sizeof(capture) );
+				unsigned short index = collideMap.Find( capture.collideIndex );
+				if ( index == collideMap.InvalidIndex() )
+					break;
+
+				testtrace_t &trace = g_Traces[g_Traces.AddToTail()];
+				trace.type = capture.isRay ? TRACE_RAY : TRACE_BOX;
+				trace.collide = collideMap[index];
+				trace.sweepCollide = -1;
+				trace.contentsMask = capture.contentsMask;
+				trace.start = capture.start;
+				trace.delta = capture.delta;
+				trace.startOffset = capture.startOffset;
+				trace.extents = capture.extents;
+				trace.isRay = capture.isRay != 0;
+				trace.isSwept = capture.isSwept != 0;
+				trace.collideOrigin = capture.collideOrigin;
+				trace.collideAngles = capture.collideAngles;
+			}
+			break;
+
+		case TRACECAPTURE_TRACECOLLIDE:
+			{
+				tracecapture_tracecollide_t capture;
+				buf.Get( &capture, sizeof(capture) );
+				unsigned short sweepIndex = collideMap.Find( capture.sweepIndex );
+				unsigned short index = collideMap.Find( capture.collideIndex );
+				if ( index == collideMap.InvalidIndex() || sweepIndex == collideMap.InvalidIndex() )
+					break;
+
+				testtrace_t &trace = g_Traces[g_Traces.AddToTail()];
+				trace.type = TRACE_COLLIDE;
+				trace.collide = collideMap[index];
+				trace.sweepCollide = collideMap[sweepIndex];
+				trace.contentsMask = MASK_ALL;
+				trace.start = capture.start;
+				trace.end = capture.end;
+				trace.sweepAngles = capture.sweepAngles;
+				trace.collideOrigin = capture.collideOrigin;
+				trace.collideAngles = capture.collideAngles;
+			}
+			break;
+
+		default:
+			// TRACECAPTURE_DESTROYCOLLIDE: the replay keeps every collide until exit
+			break;
+		}
+		buf.SeekGet( CUtlBuffer::SEEK_HEAD, nextRecord );
+	}
+
+	Msg( "Loaded %d traces against %d collision models from %s\n", g_Traces.Count(), g_Collides.Count(), pFilename );
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Running and reporting
+//-----------------------------------------------------------------------------
+// Ray_t needs aligned storage so it is built on the stack outside of the timed region
+inline void BuildRay( const testtrace_t &test, Ray_t *pRay )
+{
+	pRay->m_Start = test.start;
+	pRay->m_Delta = test.delta;
+	pRay->m_StartOffset = test.startOffset;
+	pRay->m_Extents = test.extents;
+	pRay->m_IsRay = test.isRay;
+	pRay->m_IsSwept = test.isSwept;
+}
+
+inline void RunTrace( const testtrace_t &test, const Ray_t &ray, trace_t *ptr )
+{
+	const CPhysCollide *pCollide = g_Collides[test.collide].pCollide;
+	if ( test.type == TRACE_COLLIDE )
+	{
+		physcollision->TraceCollide( test.start, test.end, g_Collides[test.sweepCollide].pCollide, test.sweepAngles, pCollide, test.collideOrigin, test.collideAngles, ptr );
+	}
+	else
+	{
+		physcollision->TraceBox( ray, test.contentsMask, NULL, pCollide, test.collideOrigin, test.collideAngles, ptr );
+	}
+}
+
+class CTraceHistogram
+{
+public:
+	CTraceHistogram() : m_hits(0) {}
+
+	void AddSample( uint64 cycles, bool bHit )
+	{
+		m_cycles.AddToTail( (unsigned int)MIN( cycles, (uint64)UINT_MAX ) );
+		if ( bHit )
+		{
+			m_hits++;
+		}
+	}
+
+	int Count() const { return m_cycles.Count(); }
+
+	void Report( const char *pName )
+	{
+		if ( !m_cycles.Count() )
+			return;
+
+		m_cycles.Sort( CompareCycles );
+		double total = 0;
+		int buckets[32];
+		int maxBucket = 0;
+		memset( buckets, 0, sizeof(buckets) );
+		for ( int i = 0; i < m_cycles.Count(); i++ )
+		{
+			double ns = CyclesToNs( m_cycles[i] );
+			total += ns;
+			int bucket = 0;
+			while ( bucket < ARRAYSIZE(buckets)-1 && ns >= (double)(2 << bucket) )
+			{
+				bucket++;
+			}
+			buckets[bucket]++;
+			maxBucket = MAX( maxBucket, bucket );
+		}
+
+		Msg( "%-18s %8d traces %5.1f%% hit  mean %8.0f ns  p50 %8.0f ns  p99 %8.0f ns  max %9.0f ns\n", pName, m_cycles.Count(),
+			100.0f * m_hits / m_cycles.Count(), total / m_cycles.Count(), Percentile( 0.5f ), Percentile( 0.99f ), CyclesToNs( m_cycles.Tail() ) );
+
+		// log2 histogram, each bucket is [2^n, 2^(n+1)) ns
+		Msg( "%18s", "" );
+		for ( int i = 0; i <= maxBucket; i++ )
+		{
+			if ( buckets[i] )
+			{
+				Msg( " <%dns:%.1f%%", 2 << i, 100.0f * buckets[i] / m_cycles.Count() );
+			}
+		}
+		Msg( "\n" );
+	}
+
+private:
+	static int CompareCycles( const unsigned int *pLeft, const unsigned int *pRight )
+	{
+		return ( *pLeft < *pRight ) ? -1 : ( *pLeft > *pRight ) ? 1 : 0;
+	}
+
+	static double CyclesToNs( unsigned int cycles )
+	{
+		return (double)cycles * 1e9 / (double)CFastTimer::GetClockSpeed();
+	}
+
+	double Percentile( float fraction ) const
+	{
+		int index = clamp( (int)(fraction * m_cycles.Count()), 0, m_cycles.Count() - 1 );
+		return CyclesToNs( m_cycles[index] );
+	}
+
+	CUtlVector<unsigned int>	m_cycles;
+	int							m_hits;
+};
+
+static void RunTimedPasses( int repeatCount )
+{
+	CTraceHistogram histograms[TRACE_TYPE_COUNT][SHAPE_CLASS_COUNT];
+	CTraceHistogram totals[TRACE_TYPE_COUNT];
+
+	Ray_t ray;
+	trace_t tr;
+	CFastTimer timer;
+	for ( int pass = 0; pass < repeatCount; pass++ )
+	{
+		for ( int i = 0; i < g_Traces.Count(); i++ )
+		{
+			const testtrace_t &test = g_Traces[i];
+			BuildRay( test, &ray );
+			timer.Start();
+			RunTrace( test, ray, &tr );
+			timer.End();
+
+			uint64 cycles = timer.GetDuration().GetLongCycles();
+			histograms[test.type][g_Collides[test.collide].shape].AddSample( cycles, tr.DidHit() );
+			totals[test.type].AddSample( cycles, tr.DidHit() );
+		}
+	}
+
+	for ( int type = 0; type < TRACE_TYPE_COUNT; type++ )
+	{
+		if ( !totals[type].Count() )
+			continue;
+
+		Msg( "\n" );
+		totals[type].Report( g_pTraceTypeNames[type] );
+		for ( int shape = 0; shape < SHAPE_CLASS_COUNT; shape++ )
+		{
+			histograms[type][shape].Report( CFmtStr( "  %s %s", g_pTraceTypeNames[type], g_pShapeClassNames[shape] ) );
+		}
+	}
+}
+
+#ifdef VPROF_ENABLED
+static void SumVProfNodes_R( CVProfNode *pNode, const char *pName, int *pCalls, double *pTimeMs )
+{
+	for ( ; pNode; pNode = pNode->GetSibling() )
+	{
+		if ( !V_strcmp( pNode->GetName(), pName ) )
+		{
+			*pCalls += pNode->GetTotalCalls();
+			*pTimeMs += pNode->GetTotalTimeLessChildren();
+		}
+		SumVProfNodes_R( pNode->GetChild(), pName, pCalls, pTimeMs );
+	}
+}
+
+// Runs each trace type once more with vprof on and reports the cost of the solver features.
+// This is a separate pass because the vprof scopes distort the timed results.
+static void RunFeaturePass()
+{
+	Msg( "\nFeature breakdown (vprof, exclusive time)\n" );
+
+	Ray_t ray;
+	trace_t tr;
+	bool bFoundAny = false;
+	for ( int type = 0; type < TRACE_TYPE_COUNT; type++ )
+	{
+		int traceCount = 0;
+		g_VProfCurrentProfile.Reset();
+		g_VProfCurrentProfile.ResetPeaks();
+		g_VProfCurrentProfile.Start();
+		for ( int i = 0; i < g_Traces.Count(); i++ )
+		{
+			if ( g_Traces[i].type != type )
+				continue;
+			BuildRay( g_Traces[i], &ray );
+			RunTrace( g_Traces[i], ray, &tr );
+			traceCount++;
+		}
+		g_VProfCurrentProfile.MarkFrame();
+		g_VProfCurrentProfile.Stop();
+
+		if ( !traceCount )
+			continue;
+
+		for ( int i = 0; i < ARRAYSIZE(g_pFeatureNodes); i++ )
+		{
+			int calls = 0;
+			double timeMs = 0;
+			SumVProfNodes_R( g_VProfCurrentProfile.GetRoot(), g_pFeatureNodes[i], &calls, &timeMs );
+			if ( !calls )
+				continue;
+
+			bFoundAny = true;
+			Msg( "%-8s %-36s %10d calls %6.2f/trace %8.0f ns/call %8.0f ns/trace\n", g_pTraceTypeNames[type], g_pFeatureNodes[i],
+				calls, (float)calls / traceCount, timeMs * 1e6 / calls, timeMs * 1e6 / traceCount );
+		}
+	}
+	g_VProfCurrentProfile.Reset();
 
+	if ( !bFoundAny )
+	{
+		Msg( "No vphysics feature nodes were recorded, build vphysics with VPROF_LEVEL 1 to enable them.\n" );
+	}
+}
+#endif
 
 //-----------------------------------------------------------------------------
 // The application object
@@ -299,108 +743,88 @@ void CBenchmarkApp::PostShutdown()
 	DisconnectTier1Libraries();
 }
 
-struct baseline_t
-{
-	float	total;
-	float	ray;
-	float	box;
-};
-
-// current baseline measured on Core2DuoE6600
-baseline_t g_Baselines[] =
-{
-	{ 40.56f,	10.64f,		29.92f},		// bench01a.phy
-	{ 38.13f,	10.76f,		27.37f },		// bicycle01a.phy
-	{ 25.46f,	8.34f,		17.13f },		// furnituretable001a.phy
-	{ 12.65f,	6.02f,		6.62f },		// gravestone003a.phy
-	{ 40.58f,	16.49f,		24.10f },		// combineinnerwall001a.phy
-};
-
-const float g_TotalBaseline = 157.38f;
-
-/*
-Benchmark models\props_c17\bench01a.phy!
-
-33.90 ms [1.20 X] 2500/2500 hits
-8.95 ms rays    [1.19 X]        24.95 ms boxes [1.20 X]
-Benchmark models\props_junk\bicycle01a.phy!
-
-30.55 ms [1.25 X] 803/2500 hits
-8.96 ms rays    [1.20 X]        21.59 ms boxes [1.27 X]
-Benchmark models\props_c17\furnituretable001a.phy!
-
-20.61 ms [1.24 X] 755/2500 hits
-6.88 ms rays    [1.21 X]        13.73 ms boxes [1.25 X]
-Benchmark models\props_c17\gravestone003a.phy!
-
-9.13 ms [1.39 X] 2500/2500 hits
-4.34 ms rays    [1.39 X]        4.79 ms boxes [1.38 X]
-Benchmark models\props_combine\combineinnerwall001a.phy!
-
-33.04 ms [1.23 X] 985/2500 hits
-13.37 ms rays   [1.23 X]        19.67 ms boxes [1.23 X]
-
-127.22s total   [1.24 X]!
-*/
-
-#define IMPROVEMENT_FACTOR(x,baseline) (baseline/(x))
-#define IMPROVEMENT_PERCENT(x,baseline) (((baseline-(x)) / baseline) * 100.0f)
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#endif
+
 //-----------------------------------------------------------------------------
 // The application object
 //-----------------------------------------------------------------------------
 int CBenchmarkApp::Main()
 {
-	const char *pFileNames[] = 
-	{
-		"models\\props_c17\\bench01a.phy",
-		"models\\props_junk\\bicycle01a.phy",
-		"models\\props_c17\\furnituretable001a.phy",
-		"models\\props_c17\\gravestone003a.phy",
-		"models\\props_combine\\combineinnerwall001a.phy",
-	};
-	vcollide_t testModels[ARRAYSIZE(pFileNames)];
-	for ( int i = 0; i < ARRAYSIZE(pFileNames); i++ )
+	const char *pReplayFile = CommandLine()->ParmValue( "-replay", (const char *)NULL );
+	const char *pContentPath = CommandLine()->ParmValue( "-path", (const char *)NULL );
+	int repeatCount = MAX( CommandLine()->ParmValue( "-repeat", 3 ), 1 );
+
+	if ( pReplayFile )
 	{
-		ReadPHYFile( pFileNames[i], testModels[i] );
+		if ( !LoadCapturedWorkload( pReplayFile ) )
+			return 1;
 	}
-	SetPriorityClass( GetCurrentProcess(), REALTIME_PRIORITY_CLASS );
-	SetThreadPriority( GetCurrentThread(), THREAD_PRIORITY_HIGHEST );
-	float totalTime = 0.0f;
-	int loopCount = ARRAYSIZE(pFileNames);
-#if VPROF_LEVEL > 0
-//	loopCount = 3;
-#endif
-	for ( int i = 0; i < loopCount; i++ )
+	else
 	{
-		if ( testModels[i].solidCount < 1 )
+		int tracesPerCollide = NUM_COLLISION_TESTS;
+		if ( pContentPath )
 		{
-			Msg("Failed to load %s, skipping test!\n", pFileNames[i] );
-			continue;
+			LoadContentPath( pContentPath, CommandLine()->FindParm( "-bsp" ) != 0, CommandLine()->ParmValue( "-maxfiles", INT_MAX ) );
+			tracesPerCollide = NUM_CONTENT_TESTS;
+		}
+		else
+		{
+			const char *pFileNames[] = 
+			{
+				"models\\props_c17\\bench01a.phy",
+				"models\\props_junk\\bicycle01a.phy",
+				"models\\props_c17\\furnituretable001a.phy",
+				"models\\props_c17\\gravestone003a.phy",
+				"models\\props_combine\\combineinnerwall001a.phy",
+			};
+			for ( int i = 0; i < ARRAYSIZE(pFileNames); i++ )
+			{
+				ReadPHYFile( pFileNames[i], "GAME" );
+			}
 		}
-		Msg("Benchmark %s!\n\n", pFileNames[i] );
 
-		benchresults_t results;
-		memset( &results, 0, sizeof(results));
-		int numRepeats = 3;
-#if VPROF_LEVEL > 0
-		numRepeats = 1;
-#endif
-		for ( int j = 0; j < numRepeats; j++ )
+		if ( !g_Collides.Count() )
 		{
-			Benchmark_PHY( testModels[i].solids[0], &results );
+			Warning( "No collision models loaded!\n" );
+			return 1;
 		}
-		Msg("%.2f ms [%.2f X] %d/%d hits\n", results.totalTime, IMPROVEMENT_FACTOR(results.totalTime, g_Baselines[i].total), results.collisionHits, results.collisionTests);
-		Msg("%.2f ms rays \t[%.2f X] \t%.2f ms boxes [%.2f X]\n", 
-			results.rayTime, IMPROVEMENT_FACTOR(results.rayTime, g_Baselines[i].ray), 
-			results.boxTime, IMPROVEMENT_FACTOR(results.boxTime, g_Baselines[i].box));
-		totalTime += results.totalTime;
+		BuildSyntheticWorkload( CommandLine()->ParmValue( "-count", tracesPerCollide ) );
+		Msg( "Benchmark %d traces against %d collision models, %d passes\n", g_Traces.Count(), g_Collides.Count(), repeatCount );
 	}
-	SetPriorityClass( GetCurrentProcess(), NORMAL_PRIORITY_CLASS );
 
-	Msg("\n%.2fs total \t[%.2f X]!\n", totalTime, IMPROVEMENT_FACTOR(totalTime, g_TotalBaseline) );
-	return 0;
-}
+	int shapeCounts[SHAPE_CLASS_COUNT] = {};
+	for ( int i = 0; i < g_Collides.Count(); i++ )
+	{
+		shapeCounts[g_Collides[i].shape]++;
+	}
+	Msg( "Shapes: %d convex, %d compound, %d complex (more than %d convex pieces)\n", 
+		shapeCounts[SHAPE_CONVEX], shapeCounts[SHAPE_COMPOUND], shapeCounts[SHAPE_COMPLEX], COMPOUND_MAX_CONVEXES );
+
+#ifdef _WIN32
+	SetPriorityClass( GetCurrentProcess(), REALTIME_PRIORITY_CLASS );
+	SetThreadPriority( GetCurrentThread(), THREAD_PRIORITY_HIGHEST );
+#endif
 
+	double startTime = Plat_FloatTime();
+	RunTimedPasses( repeatCount );
+	double duration = Plat_FloatTime() - startTime;
 
+#ifdef _WIN32
+	SetPriorityClass( GetCurrentProcess(), NORMAL_PRIORITY_CLASS );
+#endif
 
+#ifdef VPROF_ENABLED
+	RunFeaturePass();
+#endif
+
+	Msg( "\n%.2fs total\n", duration );
+
+	for ( int i = 0; i < g_VCollides.Count(); i++ )
+	{
+		physcollision->VCollideUnload( &g_VCollides[i] );
+	}
+	return 0;
+}
@@ -22,6 +22,11 @@
 #define KEYVALUES_USE_POOL 1
 #endif
 
+#define KEYVALUES_SYMBOL_TABLE_INITIAL_SIZE	4096	// power of two, grows at half full
+#define KEYVALUES_SYMBOL_EMPTY				0		// offset 0 is "", which is never stored in the table
+#define KEYVALUES_SYMBOL_FROZEN				(-1)	// the table is being replaced, look in the new one
+#define KEYVALUES_STRING_CHUNK_SIZE			4096	// per thread string arena
+
 //-----------------------------------------------------------------------------
 // Purpose: Central storage point for KeyValues memory and symbols
 //-----------------------------------------------------------------------------
@@ -58,6 +63,9 @@ public:
 	virtual void InvalidateCache();
 	virtual void InvalidateCacheForFile( const char *resourceName, const char *pathID );
 
+	// prints symbol table size, probe lengths and lock contention
+	virtual void DumpSymbolTableStats();
+
 private:
 #ifdef KEYVALUES_USE_POOL
 	CUtlMemoryPool *m_pMemPool;
@@ -65,15 +73,46 @@ private:
 	int m_iMaxKeyValuesSize;
 
 	// string hash table
-	CMemoryStack m_Strings;
-	struct hash_item_t
+	// Open addressed, slots hold string indices and only ever change from empty to a
+	// string, so lookups don't lock.  To grow, every empty slot of the table is frozen,
+	// the strings are copied to a table twice the size and that is published in its place.
+	// Old tables are kept until shutdown as readers may still be probing them.
+	struct SymbolTable_t
 	{
-		int stringIndex;
-		hash_item_t *next;
+		int m_nMask;
+		int volatile m_nCount;
+		SymbolTable_t *m_pRetired;
+		int volatile m_Slots[1];
 	};
-	CUtlMemoryPool m_HashItemMemPool;
-	CUtlVector<hash_item_t> m_HashTable;
-	int CaseInsensitiveHash(const char *string, int iBounds);
+	static SymbolTable_t *AllocSymbolTable( int nSlots );
+	int FindSymbol( SymbolTable_t *pTable, const char *name, unsigned int hash, int *pSlot );
+	void GrowSymbolTable( SymbolTable_t *pTable );
+	static unsigned int CaseInsensitiveHash( const char *string, int *pLength );
+	unsigned int GetStringHash( int stringIndex ) { return ((unsigned int *)((char *)m_Strings.GetBase() + stringIndex))[-1]; }
+
+	// Strings are stored after their hash.  Each thread copies new strings into its own
+	// chunk of m_Strings so inserting only takes the lock to get another chunk.
+	struct StringArena_t
+	{
+		char *m_pNext;
+		char *m_pEnd;
+	};
+	char *AllocString( const char *name, int length, unsigned int hash, bool *pCommitted );
+	void CommitString( const char *pString, int length );
+	char *AllocStringSpace( int nBytes );
+	void LockStrings();
+
+	CMemoryStack m_Strings;
+	SymbolTable_t * volatile m_pSymbolTable;
+	CThreadLocalPtr<StringArena_t> m_StringArena;
+
+	// stats for DumpSymbolTableStats
+	int volatile m_nSymbolInserts;
+	int volatile m_nSymbolInsertRaces;
+	int m_nSymbolLocks;
+	int m_nSymbolLocksContended;
+	int m_nSymbolTableGrows;
+	int m_nStringChunks;
 
 	void DoInvalidateCache();
 
@@ -109,20 +148,21 @@ IKeyValuesSystem *KeyValuesSystem()
 // Purpose: Constructor
 //-----------------------------------------------------------------------------
 CKeyValuesSystem::CKeyValuesSystem() 
-: m_HashItemMemPool(sizeof(hash_item_t), 64, UTLMEMORYPOOL_GROW_FAST, "CKeyValuesSystem::m_HashItemMemPool")
-, m_KeyValuesTrackingList(0, 0, MemoryLeakTrackerLessFunc)
+: m_KeyValuesTrackingList(0, 0, MemoryLeakTrackerLessFunc)
 , m_KeyValueCache( UtlStringLessFunc )
 {
 	// initialize hash table
-	m_HashTable.AddMultipleToTail(2047);
-	for (int i = 0; i < m_HashTable.Count(); i++)
-	{
-		m_HashTable[i].stringIndex = 0;
-		m_HashTable[i].next = NULL;
-	}
-
+	m_pSymbolTable = AllocSymbolTable( KEYVALUES_SYMBOL_TABLE_INITIAL_SIZE );
+	m_nSymbolInserts = 0;
+	m_nSymbolInsertRaces = 0;
+	m_nSymbolLocks = 0;
+	m_nSymbolLocksContended = 0;
+	m_nSymbolTableGrows = 0;
+	m_nStringChunks = 0;
+
+	// the string base never moves, symbols are offsets into it.  Offset 0 is ""
 	m_Strings.Init( 4*1024*1024, 64*1024, 0, 4 );
-	char *pszEmpty = ((char *)m_Strings.Alloc(1));
+	char *pszEmpty = ((char *)m_Strings.Alloc(4));
 	*pszEmpty = 0;
 
 #ifdef KEYVALUES_USE_POOL
@@ -158,6 +198,15 @@ CKeyValuesSystem::~CKeyValuesSystem()
 #endif
 
 	DoInvalidateCache();
+
+	SymbolTable_t *pTable = m_pSymbolTable;
+	while ( pTable )
+	{
+		SymbolTable_t *pRetired = pTable->m_pRetired;
+		free( pTable );
+		pTable = pRetired;
+	}
+	m_pSymbolTable = NULL;
 }
 
 //-----------------------------------------------------------------------------
@@ -228,55 +277,231 @@ HKeySymbol CKeyValuesSystem::GetSymbolForString( const char *name, bool bCreate
 		return (-1);
 	}
 
-	AUTO_LOCK( m_mutex );
+	if ( !name[0] )
+	{
+		return 0;
+	}
 
-	int hash = CaseInsensitiveHash(name, m_HashTable.Count());
-	int i = 0;
-	hash_item_t *item = &m_HashTable[hash];
-	while (1)
+	int length;
+	unsigned int hash = CaseInsensitiveHash( name, &length );
+
+	char *pString = NULL;
+	bool bCommitted = false;
+	while ( 1 )
 	{
-		if (!stricmp(name, (char *)m_Strings.GetBase() + item->stringIndex ))
+		SymbolTable_t *pTable = m_pSymbolTable;
+		int slot;
+		int stringIndex = FindSymbol( pTable, name, hash, &slot );
+		if ( stringIndex > 0 )
 		{
-			return (HKeySymbol)item->stringIndex;
+			return (HKeySymbol)stringIndex;
 		}
 
-		i++;
-
-		if (item->next == NULL)
+		if ( stringIndex == KEYVALUES_SYMBOL_FROZEN )
 		{
-			if ( !bCreate )
+			if ( pTable == m_pSymbolTable )
 			{
-				// not found
-				return -1;
+				// the table is being grown.  Anything added before that started is in
+				// this table, so a lookup is done, but an insert waits for the new table
+				if ( !bCreate )
+				{
+					return -1;
+				}
+				m_mutex.Lock();
+				m_mutex.Unlock();
 			}
+			continue;
+		}
 
-			// we're not in the table
-			if (item->stringIndex != 0)
-			{
-				// first item is used, an new item
-				item->next = (hash_item_t *)m_HashItemMemPool.Alloc(sizeof(hash_item_t));
-				item = item->next;
-			}
+		if ( !bCreate )
+		{
+			// not found
+			return -1;
+		}
+
+		// keep the table at most half full so probes stay short
+		if ( ( pTable->m_nCount + 1 ) * 2 > pTable->m_nMask + 1 )
+		{
+			GrowSymbolTable( pTable );
+			continue;
+		}
+
+		// we're not in the table
+		if ( !pString )
+		{
+			pString = AllocString( name, length, hash, &bCommitted );
+		}
 
-			// build up the new item
-			item->next = NULL;
-			char *pString = (char *)m_Strings.Alloc( V_strlen(name) + 1 );
-			if ( !pString )
+		// claiming the slot publishes the string
+		stringIndex = pString - (char *)m_Strings.GetBase();
+		if ( ThreadInterlockedCompareExchange( &pTable->m_Slots[slot], stringIndex, KEYVALUES_SYMBOL_EMPTY ) == KEYVALUES_SYMBOL_EMPTY )
+		{
+			ThreadInterlockedIncrement( &pTable->m_nCount );
+			ThreadInterlockedIncrement( &m_nSymbolInserts );
+			if ( !bCommitted )
 			{
-				Error( "Out of keyvalue string space" );
-				return -1;
+				CommitString( pString, length );
 			}
-			item->stringIndex = pString - (char *)m_Strings.GetBase();
-			strcpy(pString, name);
-			return (HKeySymbol)item->stringIndex;
+			return (HKeySymbol)stringIndex;
+		}
+
+		// another thread took the slot, possibly with this same string, or froze the table
+		ThreadInterlockedIncrement( &m_nSymbolInsertRaces );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: returns the string index, or the empty or frozen slot that ended the search
+//-----------------------------------------------------------------------------
+int CKeyValuesSystem::FindSymbol( SymbolTable_t *pTable, const char *name, unsigned int hash, int *pSlot )
+{
+	const char *pBase = (const char *)m_Strings.GetBase();
+	int slot = hash & pTable->m_nMask;
+	while ( 1 )
+	{
+		int stringIndex = pTable->m_Slots[slot];
+		if ( stringIndex == KEYVALUES_SYMBOL_EMPTY || stringIndex == KEYVALUES_SYMBOL_FROZEN ||
+			( GetStringHash( stringIndex ) == hash && !V_stricmp( name, pBase + stringIndex ) ) )
+		{
+			*pSlot = slot;
+			return stringIndex;
+		}
+
+		slot = ( slot + 1 ) & pTable->m_nMask;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: allocates an empty symbol table
+//-----------------------------------------------------------------------------
+CKeyValuesSystem::SymbolTable_t *CKeyValuesSystem::AllocSymbolTable( int nSlots )
+{
+	Assert( ( nSlots & ( nSlots - 1 ) ) == 0 );
+	SymbolTable_t *pTable = (SymbolTable_t *)malloc( sizeof(SymbolTable_t) + ( nSlots - 1 ) * sizeof(int) );
+	memset( (void *)pTable->m_Slots, 0, nSlots * sizeof(int) );
+	pTable->m_nMask = nSlots - 1;
+	pTable->m_nCount = 0;
+	pTable->m_pRetired = NULL;
+	return pTable;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: replaces a full table with one twice the size
+//-----------------------------------------------------------------------------
+void CKeyValuesSystem::GrowSymbolTable( SymbolTable_t *pTable )
+{
+	LockStrings();
+	if ( m_pSymbolTable != pTable )
+	{
+		// another thread already grew it
+		m_mutex.Unlock();
+		return;
+	}
+
+	// stop strings going into this table, the ones that claimed a slot first are copied
+	for ( int i = 0; i <= pTable->m_nMask; i++ )
+	{
+		ThreadInterlockedCompareExchange( &pTable->m_Slots[i], KEYVALUES_SYMBOL_FROZEN, KEYVALUES_SYMBOL_EMPTY );
+	}
+
+	SymbolTable_t *pNewTable = AllocSymbolTable( ( pTable->m_nMask + 1 ) * 2 );
+	for ( int i = 0; i <= pTable->m_nMask; i++ )
+	{
+		int stringIndex = pTable->m_Slots[i];
+		if ( stringIndex == KEYVALUES_SYMBOL_FROZEN )
+			continue;
+
+		int slot = GetStringHash( stringIndex ) & pNewTable->m_nMask;
+		while ( pNewTable->m_Slots[slot] != KEYVALUES_SYMBOL_EMPTY )
+		{
+			slot = ( slot + 1 ) & pNewTable->m_nMask;
 		}
+		pNewTable->m_Slots[slot] = stringIndex;
+		pNewTable->m_nCount++;
+	}
+	pNewTable->m_pRetired = pTable;
+	m_nSymbolTableGrows++;
+
+	// the copy must be visible before the table is
+	ThreadMemoryBarrier();
+	m_pSymbolTable = pNewTable;
+	m_mutex.Unlock();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: copies a string and its hash to the end of this thread's arena.  The
+//			space is only kept once CommitString is called, so a thread that loses
+//			the race to add a string reuses it for the next one
+//-----------------------------------------------------------------------------
+char *CKeyValuesSystem::AllocString( const char *name, int length, unsigned int hash, bool *pCommitted )
+{
+	int nBytes = sizeof(unsigned int) + AlignValue( length + 1, 4 );
+	char *pEntry;
+	if ( nBytes > KEYVALUES_STRING_CHUNK_SIZE / 4 )
+	{
+		// long strings would waste too much of a chunk
+		pEntry = AllocStringSpace( nBytes );
+		*pCommitted = true;
+	}
+	else
+	{
+		StringArena_t *pArena = m_StringArena;
+		if ( !pArena || pArena->m_pNext + nBytes > pArena->m_pEnd )
+		{
+			// the arena header lives at the start of its chunk
+			pArena = (StringArena_t *)AllocStringSpace( KEYVALUES_STRING_CHUNK_SIZE );
+			pArena->m_pNext = (char *)( pArena + 1 );
+			pArena->m_pEnd = (char *)pArena + KEYVALUES_STRING_CHUNK_SIZE;
+			m_StringArena = pArena;
+		}
+		pEntry = pArena->m_pNext;
+		*pCommitted = false;
+	}
+
+	*(unsigned int *)pEntry = hash;
+	char *pString = pEntry + sizeof(unsigned int);
+	memcpy( pString, name, length + 1 );
+	return pString;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: keeps a string added by AllocString
+//-----------------------------------------------------------------------------
+void CKeyValuesSystem::CommitString( const char *pString, int length )
+{
+	StringArena_t *pArena = m_StringArena;
+	Assert( pArena && pArena->m_pNext + sizeof(unsigned int) == pString );
+	pArena->m_pNext = (char *)pString + AlignValue( length + 1, 4 );
+}
 
-		item = item->next;
+//-----------------------------------------------------------------------------
+// Purpose: allocates from the shared string memory
+//-----------------------------------------------------------------------------
+char *CKeyValuesSystem::AllocStringSpace( int nBytes )
+{
+	LockStrings();
+	char *pMem = (char *)m_Strings.Alloc( nBytes );
+	m_nStringChunks++;
+	m_mutex.Unlock();
+
+	if ( !pMem )
+	{
+		Error( "Out of keyvalue string space" );
 	}
+	return pMem;
+}
 
-	// shouldn't be able to get here
-	Assert(0);
-	return (-1);
+//-----------------------------------------------------------------------------
+// Purpose: takes the mutex, counting how often another thread had it
+//-----------------------------------------------------------------------------
+void CKeyValuesSystem::LockStrings()
+{
+	if ( !m_mutex.TryLock() )
+	{
+		m_mutex.Lock();
+		m_nSymbolLocksContended++;
+	}
+	m_nSymbolLocks++;
 }
 
 //-----------------------------------------------------------------------------
@@ -376,25 +601,25 @@ void CKeyValuesSystem::InvalidateCache()
 }
 
 //-----------------------------------------------------------------------------
-// Purpose: generates a simple hash value for a string
+// Purpose: generates a case insensitive hash value for a string, and its length
 //-----------------------------------------------------------------------------
-int CKeyValuesSystem::CaseInsensitiveHash(const char *string, int iBounds)
+unsigned int CKeyValuesSystem::CaseInsensitiveHash( const char *string, int *pLength )
 {
-	unsigned int hash = 0;
-
-	for ( ; *string != 0; string++ )
+	// FNV-1a, the low bits are mixed well enough to index a power of two table
+	unsigned int hash = 2166136261u;
+	const char *s = string;
+	for ( ; *s != 0; s++ )
 	{
-		if (*string >= 'A' && *string <= 'Z')
+		unsigned char c = *s;
+		if ( c >= 'A' && c <= 'Z' )
 		{
-			hash = (hash << 1) + (*string - 'A' + 'a');
-		}
-		else
-		{
-			hash = (hash << 1) + *string;
+			c += 'a' - 'A';
 		}
+		hash = ( hash ^ c ) * 16777619u;
 	}
-	  
-	return hash % iBounds;
+
+	*pLength = s - string;
+	return hash;
 }
 
 //-----------------------------------------------------------------------------
@@ -414,3 +639,44 @@ void CKeyValuesSystem::DoInvalidateCache()
 	m_KeyValueCache.Purge();
 }
 
+
+//-----------------------------------------------------------------------------
+// Purpose: prints symbol table size, probe lengths and lock contention
+//-----------------------------------------------------------------------------
+void CKeyValuesSystem::DumpSymbolTableStats()
+{
+	SymbolTable_t *pTable = m_pSymbolTable;
+	int nSlots = pTable->m_nMask + 1;
+	int nSymbols = 0;
+	int nTotalProbes = 0;
+	int nMaxProbes = 0;
+	int probeCounts[5] = { 0, 0, 0, 0, 0 };	// 1, 2, 3-4, 5-8, 9+
+	for ( int i = 0; i < nSlots; i++ )
+	{
+		int stringIndex = pTable->m_Slots[i];
+		if ( stringIndex == KEYVALUES_SYMBOL_EMPTY || stringIndex == KEYVALUES_SYMBOL_FROZEN )
+			continue;
+
+		// slots looked at to find this string
+		int nProbes = ( ( i - (int)GetStringHash( stringIndex ) ) & pTable->m_nMask ) + 1;
+		nSymbols++;
+		nTotalProbes += nProbes;
+		nMaxProbes = MAX( nMaxProbes, nProbes );
+		probeCounts[ nProbes <= 2 ? nProbes - 1 : nProbes <= 4 ? 2 : nProbes <= 8 ? 3 : 4 ]++;
+	}
+
+	int nRetired = 0;
+	for ( SymbolTable_t *pRetired = pTable->m_pRetired; pRetired; pRetired = pRetired->m_pRetired )
+	{
+		nRetired++;
+	}
+
+	Msg( "KeyValues symbol table: %d symbols in %d slots (%.1f%% full), grown %d times, %d retired tables\n",
+		nSymbols, nSlots, 100.0f * nSymbols / nSlots, m_nSymbolTableGrows, nRetired );
+	Msg( "  probes per lookup: avg %.2f, max %d\n", nSymbols ? (float)nTotalProbes / nSymbols : 0.0f, nMaxProbes );
+	Msg( "  probe lengths: 1: %d  2: %d  3-4: %d  5-8: %d  9+: %d\n", probeCounts[0], probeCounts[1], probeCounts[2], probeCounts[3], probeCounts[4] );
+	Msg( "  strings: %d KB of %d KB, %d allocations under the lock\n", m_Strings.GetUsed() / 1024, m_Strings.GetMaxSize() / 1024, m_nStringChunks );
+	Msg( "  inserts: %d, lost insert races: %d\n", m_nSymbolInserts, m_nSymbolInsertRaces );
+	Msg( "  lock: %d acquired, %d contended (%.1f%%)\n", m_nSymbolLocks, m_nSymbolLocksContended,
+		m_nSymbolLocks ? 100.0f * m_nSymbolLocksContended / m_nSymbolLocks : 0.0f );
+}
@@ -32,6 +32,15 @@
 #include "tier1/utlvector.h"
 #include <setjmp.h>
 
+// On Linux every coroutine runs on its own stack, and a switch only swaps the callee
+// saved registers instead of copying the live stack out and back in.  Define
+// COROUTINE_COPY_STACK to build the stack copying version there too.
+#if defined( LINUX ) && defined( GNUC ) && ( defined( __i386__ ) || defined( __x86_64__ ) ) && !defined( COROUTINE_COPY_STACK )
+#define COROUTINE_SEPARATE_STACKS
+#include <sys/mman.h>
+#include <errno.h>
+#endif
+
 // for debugging
 //#define CHECK_STACK_CORRUPTION
 
@@ -235,6 +244,93 @@ extern "C" byte *GetStackPtr64();
 #endif
 #endif
 
+#ifdef COROUTINE_SEPARATE_STACKS
+// Size of each coroutine stack, not counting the guard page below it.  Pages are only
+// committed when touched, so this is address space rather than memory.
+#ifdef PLATFORM_64BITS
+static const int k_cubCoroutineStack = (128 * 1024);
+#else
+static const int k_cubCoroutineStack = (64 * 1024);
+#endif
+static const int k_cubCoroutineStackGuard = 4096;
+
+// stacks of finished coroutines kept per thread for reuse
+static const int k_nMaxFreeCoroutineStacks = 32;
+
+// Pushes the callee saved registers and the SSE/x87 control words, stores the stack
+// pointer to *ppvSaveSP, then loads pvNewSP and pops the same state off of it.  A
+// new stack is primed with a frame that returns into Coroutine_StackStart, which
+// calls the function left in r12/ebx.
+extern "C" void Coroutine_SwitchStack( void **ppvSaveSP, void *pvNewSP ) __attribute__(( visibility( "hidden" ) ));
+extern "C" void Coroutine_StackStart() __attribute__(( visibility( "hidden" ) ));
+
+__asm__(
+	".text\n"
+	".p2align 4\n"
+	".globl Coroutine_SwitchStack\n"
+	".hidden Coroutine_SwitchStack\n"
+	".type Coroutine_SwitchStack, @function\n"
+	"Coroutine_SwitchStack:\n"
+#ifdef __x86_64__
+	"	pushq %rbp\n"
+	"	pushq %rbx\n"
+	"	pushq %r12\n"
+	"	pushq %r13\n"
+	"	pushq %r14\n"
+	"	pushq %r15\n"
+	"	subq $8, %rsp\n"
+	"	stmxcsr (%rsp)\n"
+	"	fnstcw 4(%rsp)\n"
+	"	movq %rsp, (%rdi)\n"
+	"	movq %rsi, %rsp\n"
+	"	ldmxcsr (%rsp)\n"
+	"	fldcw 4(%rsp)\n"
+	"	addq $8, %rsp\n"
+	"	popq %r15\n"
+	"	popq %r14\n"
+	"	popq %r13\n"
+	"	popq %r12\n"
+	"	popq %rbx\n"
+	"	popq %rbp\n"
+	"	ret\n"
+#else
+	"	movl 4(%esp), %eax\n"
+	"	movl 8(%esp), %edx\n"
+	"	pushl %ebp\n"
+	"	pushl %ebx\n"
+	"	pushl %esi\n"
+	"	pushl %edi\n"
+	"	subl $8, %esp\n"
+	"	stmxcsr (%esp)\n"
+	"	fnstcw 4(%esp)\n"
+	"	movl %esp, (%eax)\n"
+	"	movl %edx, %esp\n"
+	"	ldmxcsr (%esp)\n"
+	"	fldcw 4(%esp)\n"
+	"	addl $8, %esp\n"
+	"	popl %edi\n"
+	"	popl %esi\n"
+	"	popl %ebx\n"
+	"	popl %ebp\n"
+	"	ret\n"
+#endif
+	".size Coroutine_SwitchStack, .-Coroutine_SwitchStack\n"
+
+	".p2align 4\n"
+	".globl Coroutine_StackStart\n"
+	".hidden Coroutine_StackStart\n"
+	".type Coroutine_StackStart, @function\n"
+	"Coroutine_StackStart:\n"
+#ifdef __x86_64__
+	"	call *%r12\n"
+#else
+	"	call *%ebx\n"
+#endif
+	"	ud2\n"
+	".size Coroutine_StackStart, .-Coroutine_StackStart\n"
+);
+#endif // COROUTINE_SEPARATE_STACKS
+
 #ifdef _M_X64
 #define _REGISTER_ALIGNMENT 16ull
 
@@ -261,6 +357,10 @@ public:
 		m_pSavedStack = NULL;
 		m_pStackHigh = m_pStackLow = NULL;
 		m_cubSavedStack = 0;
+#ifdef COROUTINE_SEPARATE_STACKS
+		m_pStackBase = NULL;
+		m_pvSP = NULL;
+#endif
 		m_pFunc = NULL;
 		m_pchName = "(none)";
 		m_iJumpCode = 0;
@@ -367,26 +467,51 @@ public:
 
 			// resume accounting against the vprof node we were in when we yielded
 			// Make sure we are added after the coroutine we just copied onto the stack
+			pThis->EnterVProfScopes();
+		}
+	}
+
+	// Re-enters the vprof scopes ExitVProfScopes() left when the coroutine yielded
+	FORCEINLINE void EnterVProfScopes()
+	{
 #if defined( VPROF_ENABLED )
-			pThis->m_pVProfNodeScope = g_VProfCurrentProfile.GetCurrentNode();
+		m_pVProfNodeScope = g_VProfCurrentProfile.GetCurrentNode();
 
-			if ( g_VProfCurrentProfile.IsEnabled() )
+		if ( g_VProfCurrentProfile.IsEnabled() )
+		{
+			FOR_EACH_VEC_BACK( m_vecProfNodeStack, i )
 			{
-				FOR_EACH_VEC_BACK( pThis->m_vecProfNodeStack, i )
-				{
-					g_VProfCurrentProfile.EnterScope( 
-						pThis->m_vecProfNodeStack[i]->GetName(), 
-						0,  
-						g_VProfCurrentProfile.GetBudgetGroupName( pThis->m_vecProfNodeStack[i]->GetBudgetGroupID() ), 
-						false, 
-						g_VProfCurrentProfile.GetBudgetGroupFlags( pThis->m_vecProfNodeStack[i]->GetBudgetGroupID() ) 
-					);
-				}
+				g_VProfCurrentProfile.EnterScope( 
+					m_vecProfNodeStack[i]->GetName(), 
+					0,  
+					g_VProfCurrentProfile.GetBudgetGroupName( m_vecProfNodeStack[i]->GetBudgetGroupID() ), 
+					false, 
+					g_VProfCurrentProfile.GetBudgetGroupFlags( m_vecProfNodeStack[i]->GetBudgetGroupID() ) 
+				);
 			}
+		}
 
-			pThis->m_vecProfNodeStack.Purge();
+		m_vecProfNodeStack.Purge();
 #endif
+	}
+
+	// Exits any vprof scopes entered since the coroutine was continued, remembering them
+	FORCEINLINE void ExitVProfScopes()
+	{
+#if defined( VPROF_ENABLED )
+		// Exit any current vprof scope when we yield, and remember the vprof stack so we can restore it when we run again
+		m_vecProfNodeStack.RemoveAll();
+
+		CVProfNode *pCurNode = g_VProfCurrentProfile.GetCurrentNode();
+		while ( pCurNode && m_pVProfNodeScope && pCurNode != m_pVProfNodeScope && pCurNode != g_VProfCurrentProfile.GetRoot() )
+		{
+			m_vecProfNodeStack.AddToTail( pCurNode );
+			g_VProfCurrentProfile.ExitScope();
+			pCurNode = g_VProfCurrentProfile.GetCurrentNode();
 		}
+
+		m_pVProfNodeScope = NULL;
+#endif
 	}
 
 	FORCEINLINE void SaveStack()
@@ -408,20 +533,7 @@ public:
 		// check you haven't got any overly large string buffers allocated on the stack
 		Assert( m_cubSavedStack < k_cubMaxCoroutineStackSize );
 
-#if defined( VPROF_ENABLED )
-		// Exit any current vprof scope when we yield, and remember the vprof stack so we can restore it when we run again
-		m_vecProfNodeStack.RemoveAll();
-
-		CVProfNode *pCurNode = g_VProfCurrentProfile.GetCurrentNode();
-		while ( pCurNode && m_pVProfNodeScope && pCurNode != m_pVProfNodeScope && pCurNode != g_VProfCurrentProfile.GetRoot() )
-		{
-			m_vecProfNodeStack.AddToTail( pCurNode );
-			g_VProfCurrentProfile.ExitScope();
-			pCurNode = g_VProfCurrentProfile.GetCurrentNode();
-		}
-
-		m_pVProfNodeScope = NULL;
-#endif
+		ExitVProfScopes();
 
 		RW_MEMORY_BARRIER;
 		// save the stack in the newly allocated slot
@@ -434,6 +546,42 @@ public:
 #endif
 	}
 
+#ifdef COROUTINE_SEPARATE_STACKS
+	// Lays out a frame on the new stack the way Coroutine_SwitchStack leaves one, so
+	// switching to it "returns" into Coroutine_StackStart, which calls pfnEntry
+	void PrimeStack( void (*pfnEntry)() )
+	{
+		// start with the control words of the thread continuing us
+		uint32 mxcsr;
+		uint16 fpcw;
+		__asm__ __volatile__( "stmxcsr %0\n\tfnstcw %1" : "=m" (mxcsr), "=m" (fpcw) );
+
+		uintptr_t *pFrame;
+#ifdef __x86_64__
+		// leaves rsp 16 byte aligned at Coroutine_StackStart's call
+		pFrame = (uintptr_t *)( m_pStackHigh - 80 );
+		pFrame[0] = mxcsr | ( (uintptr_t)fpcw << 32 );
+		pFrame[1] = 0;						// r15
+		pFrame[2] = 0;						// r14
+		pFrame[3] = 0;						// r13
+		pFrame[4] = (uintptr_t)pfnEntry;	// r12
+		pFrame[5] = 0;						// rbx
+		pFrame[6] = 0;						// rbp, ends stack walks
+		pFrame[7] = (uintptr_t)&Coroutine_StackStart;
+#else
+		pFrame = (uintptr_t *)( m_pStackHigh - 44 );
+		pFrame[0] = mxcsr;
+		pFrame[1] = fpcw;
+		pFrame[2] = 0;						// edi
+		pFrame[3] = 0;						// esi
+		pFrame[4] = (uintptr_t)pfnEntry;	// ebx
+		pFrame[5] = 0;						// ebp, ends stack walks
+		pFrame[6] = (uintptr_t)&Coroutine_StackStart;
+#endif
+		m_pvSP = pFrame;
+	}
+#endif // COROUTINE_SEPARATE_STACKS
+
 #ifdef DBGFLAG_VALIDATE
 	void Validate( CValidator &validator, const char *pchName )
 	{
@@ -454,6 +602,10 @@ public:
 	byte *m_pStackLow;		// low point on the stack we plan on saving (stack ptr when we yield)
 	byte *m_pSavedStack;	// pointer to the saved stack (allocated on heap)
 	int m_cubSavedStack;	// amount of data on stack
+#ifdef COROUTINE_SEPARATE_STACKS
+	byte *m_pStackBase;		// the coroutine's own stack, guard page first, NULL until it's launched
+	void *m_pvSP;			// stack pointer saved when switching away, NULL until it's launched
+#endif
 	const char *m_pchName;
 	int m_iJumpCode;
 	const char *m_pchDebugMsg;
@@ -499,6 +651,73 @@ public:
 		m_VecCoroutineStack.AddToTail( hMainCoroutine );
 	}
 
+#ifdef COROUTINE_SEPARATE_STACKS
+	~CCoroutineMgr()
+	{
+		FOR_EACH_LL( m_ListCoroutines, iRoutine )
+		{
+			if ( m_ListCoroutines[iRoutine].m_pStackBase )
+			{
+				munmap( m_ListCoroutines[iRoutine].m_pStackBase, k_cubCoroutineStack + k_cubCoroutineStackGuard );
+			}
+		}
+
+		FOR_EACH_VEC( m_vecFreeStacks, i )
+		{
+			munmap( m_vecFreeStacks[i], k_cubCoroutineStack + k_cubCoroutineStackGuard );
+		}
+	}
+
+	// gives a coroutine a stack to launch on, primed to call pfnEntry
+	void AllocStack( CCoroutine &coroutine, void (*pfnEntry)() )
+	{
+		Assert( !coroutine.m_pStackBase );
+
+		byte *pStackBase;
+		if ( m_vecFreeStacks.Count() )
+		{
+			pStackBase = m_vecFreeStacks.Tail();
+			m_vecFreeStacks.RemoveMultipleFromTail( 1 );
+		}
+		else
+		{
+			void *pv = mmap( NULL, k_cubCoroutineStack + k_cubCoroutineStackGuard, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+			if ( pv == MAP_FAILED )
+			{
+				Error( "Coroutine stack allocation failed (errno %d)\n", errno );
+			}
+
+			// running off the end of the stack faults here instead of trashing other memory
+			if ( mprotect( pv, k_cubCoroutineStackGuard, PROT_NONE ) != 0 )
+			{
+				Error( "Coroutine stack guard page protection failed (errno %d)\n", errno );
+			}
+			pStackBase = (byte *)pv;
+		}
+
+		coroutine.m_pStackBase = pStackBase;
+		coroutine.m_pStackHigh = pStackBase + k_cubCoroutineStackGuard + k_cubCoroutineStack;
+		coroutine.PrimeStack( pfnEntry );
+	}
+
+	void FreeStack( CCoroutine &coroutine )
+	{
+		if ( !coroutine.m_pStackBase )
+			return;
+
+		if ( m_vecFreeStacks.Count() < k_nMaxFreeCoroutineStacks )
+		{
+			m_vecFreeStacks.AddToTail( coroutine.m_pStackBase );
+		}
+		else
+		{
+			munmap( coroutine.m_pStackBase, k_cubCoroutineStack + k_cubCoroutineStackGuard );
+		}
+		coroutine.m_pStackBase = NULL;
+		coroutine.m_pvSP = NULL;
+	}
+#endif // COROUTINE_SEPARATE_STACKS
+
 	HCoroutine CreateCoroutine( CoroutineFunc_t pFunc, void *pvParam )
 	{
 		HCoroutine hCoroutine = m_ListCoroutines.AddToTail();
@@ -559,6 +778,9 @@ public:
 
 	void DeleteCoroutine( HCoroutine hCoroutine )
 	{
+#ifdef COROUTINE_SEPARATE_STACKS
+		FreeStack( m_ListCoroutines[hCoroutine] );
+#endif
 		m_ListCoroutines.Remove( hCoroutine );
 	}
 
@@ -573,6 +795,9 @@ public:
 			ValidateObj( m_ListCoroutines[iRoutine] );
 		}
 		ValidateObj( m_VecCoroutineStack );
+#ifdef COROUTINE_SEPARATE_STACKS
+		ValidateObj( m_vecFreeStacks );
+#endif
 
 		validator.Pop();
 	}
@@ -583,6 +808,9 @@ public:
 private:
 	CUtlLinkedList<CCoroutine, HCoroutine> m_ListCoroutines;
 	CUtlVector<HCoroutine> m_VecCoroutineStack;
+#ifdef COROUTINE_SEPARATE_STACKS
+	CUtlVector<byte *> m_vecFreeStacks;
+#endif
 };
 
 CThreadLocalPtr< CCoroutineMgr > g_ThreadLocalCoroutineMgr;
@@ -642,6 +870,68 @@ HCoroutine Coroutine_Create( CoroutineFunc_t pFunc, void *pvParam )
 //-----------------------------------------------------------------------------
 static const char *k_pchDebugMsg_GenericBreak = (const char *)1;
 
+#ifdef COROUTINE_SEPARATE_STACKS
+static void Coroutine_StackEntry();
+
+bool Internal_Coroutine_Continue( HCoroutine hCoroutine, const char *pchDebugMsg, const char *pchName )
+{
+	Assert( GCoroutineMgr().IsValidCoroutine(hCoroutine) );
+
+	// start the new coroutine
+	GCoroutineMgr().SetActiveCoroutine( hCoroutine );
+
+	CCoroutine &coroutinePrev = GCoroutineMgr().GetPreviouslyActiveCoroutine();
+	CCoroutine &coroutine = GCoroutineMgr().GetActiveCoroutine();
+	if ( pchName )
+		coroutine.m_pchName = pchName;
+
+	CoroutineDbgMsg( g_fmtstr.sprintf( "Coroutine_Continue() %s#%x -> %s#%x\n", coroutinePrev.m_pchName, coroutinePrev.m_hCoroutine, coroutine.m_pchName, coroutine.m_hCoroutine ) );
+
+	if ( coroutine.m_pvSP )
+	{
+		if ( pchDebugMsg == NULL )
+		{					
+			coroutine.m_iJumpCode = k_iSetJmpContinue;
+			coroutine.m_pchDebugMsg = NULL;
+		}
+		else if ( pchDebugMsg == k_pchDebugMsg_GenericBreak )
+		{
+			coroutine.m_iJumpCode = k_iSetJmpDbgBreak;
+			coroutine.m_pchDebugMsg = NULL;
+		}
+		else
+		{
+			coroutine.m_iJumpCode = k_iSetJmpDbgBreak;
+			coroutine.m_pchDebugMsg = pchDebugMsg;
+		}
+	}
+	else
+	{
+		// hasn't started yet, so launch
+		coroutine.m_iJumpCode = k_iSetJmpContinue;
+		coroutine.m_pchDebugMsg = NULL;
+		GCoroutineMgr().AllocStack( coroutine, &Coroutine_StackEntry );
+	}
+
+	// runs the coroutine until it yields or finishes
+	Coroutine_SwitchStack( &coroutinePrev.m_pvSP, coroutine.m_pvSP );
+
+	// the coroutine may have created others, moving the list, so look it up again
+	bool bStillRunning = true;
+	if ( GCoroutineMgr().GetActiveCoroutine().m_iJumpCode == k_iSetJmpDone )
+	{
+		// we're done, remove the coroutine, we're off its stack now
+		GCoroutineMgr().DeleteCoroutine( hCoroutine );
+		bStillRunning = false;
+	}
+
+	// job has suspended itself, we'll get back to it later
+	GCoroutineMgr().PopCoroutineStack();
+	return bStillRunning;
+}
+
+#else // COROUTINE_SEPARATE_STACKS
+
 bool Internal_Coroutine_Continue( HCoroutine hCoroutine, const char *pchDebugMsg, const char *pchName )
 {
 	Assert( GCoroutineMgr().IsValidCoroutine(hCoroutine) );
@@ -777,6 +1067,7 @@ bool Internal_Coroutine_Continue( HCoroutine hCoroutine, const char *pchDebugMsg
 	GCoroutineMgr().PopCoroutineStack();
 	return bStillRunning;
 }
+#endif // COROUTINE_SEPARATE_STACKS
 
 
 //-----------------------------------------------------------------------------
@@ -788,6 +1079,26 @@ bool Coroutine_Continue( HCoroutine hCoroutine, const char *pchName )
 }
 
 
+#ifdef COROUTINE_SEPARATE_STACKS
+//-----------------------------------------------------------------------------
+// Purpose: first function run on a coroutine's own stack
+//-----------------------------------------------------------------------------
+static void Coroutine_StackEntry()
+{
+	CCoroutine &coroutine = GCoroutineMgr().GetActiveCoroutine();
+#if defined( VPROF_ENABLED )
+	coroutine.m_pVProfNodeScope = g_VProfCurrentProfile.GetCurrentNode();
+#endif
+
+	// run the function directly
+	coroutine.m_pFunc( coroutine.m_pvParam );
+
+	// switch back to the main 'thread', it frees our stack
+	Coroutine_Finish();
+}
+
+#else // COROUTINE_SEPARATE_STACKS
+
 //-----------------------------------------------------------------------------
 // Purpose: launches a coroutine way ahead on the stack
 //-----------------------------------------------------------------------------
@@ -838,6 +1149,7 @@ void NOINLINE Coroutine_Launch( CCoroutine &coroutine )
 	// longjmp back to the main 'thread'
 	Coroutine_Finish();
 }
+#endif // COROUTINE_SEPARATE_STACKS
 
 
 //-----------------------------------------------------------------------------
@@ -885,6 +1197,67 @@ HCoroutine Coroutine_GetCurrentlyActive()
 }
 
 
+#ifdef COROUTINE_SEPARATE_STACKS
+//-----------------------------------------------------------------------------
+// Purpose: lets the main thread continue
+//-----------------------------------------------------------------------------
+void Coroutine_YieldToMain()
+{
+	// if you've hit this assert, it's because you're calling yield when not in a coroutine
+	Assert( Coroutine_IsActive() );
+
+	while ( 1 )
+	{
+		CCoroutine &coroutinePrev = GCoroutineMgr().GetPreviouslyActiveCoroutine();
+		CCoroutine &coroutine = GCoroutineMgr().GetActiveCoroutine();
+		CoroutineDbgMsg( g_fmtstr.sprintf( "Coroutine_YieldToMain() %s#%x -> %s#%x\n", coroutine.m_pchName, coroutine.m_hCoroutine, coroutinePrev.m_pchName, coroutinePrev.m_hCoroutine ) );
+
+		coroutine.ExitVProfScopes();
+		Coroutine_SwitchStack( &coroutine.m_pvSP, coroutinePrev.m_pvSP );
+
+		// we've been continued, the list may have moved while we were away
+		CCoroutine &coroutineResumed = GCoroutineMgr().GetActiveCoroutine();
+		coroutineResumed.EnterVProfScopes();
+		if ( coroutineResumed.m_iJumpCode != k_iSetJmpDbgBreak )
+			break;
+
+		// Assert (minidump) requested?
+		if ( coroutineResumed.m_pchDebugMsg )
+		{
+			// Generate a failed assertion
+			AssertMsg1( !"Coroutine assert requested", "%s", coroutineResumed.m_pchDebugMsg );
+		}
+		else
+		{
+			// If we were loaded only to debug, call a break
+			DebuggerBreakIfDebugging();
+		}
+
+		// Now IMMEDIATELY yield back to the main thread
+		coroutineResumed.m_pchDebugMsg = NULL;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: done with the Coroutine, terminate safely
+//-----------------------------------------------------------------------------
+void Coroutine_Finish()
+{
+	Assert( Coroutine_IsActive() );
+
+	CoroutineDbgMsg( g_fmtstr.sprintf( "Coroutine_Finish() %s#%x -> %s#%x\n", GCoroutineMgr().GetActiveCoroutine().m_pchName, GCoroutineMgr().GetActiveCoroutineHandle(), GCoroutineMgr().GetPreviouslyActiveCoroutine().m_pchName, &GCoroutineMgr().GetPreviouslyActiveCoroutine() ) );
+
+	// go back to the main thread, signaling that we're done.  We never run again,
+	// so the stack pointer is saved nowhere in particular.
+	GCoroutineMgr().GetActiveCoroutine().m_iJumpCode = k_iSetJmpDone;
+	void *pvSP;
+	Coroutine_SwitchStack( &pvSP, GCoroutineMgr().GetPreviouslyActiveCoroutine().m_pvSP );
+
+	UNREACHABLE();
+}
+
+#else // COROUTINE_SEPARATE_STACKS
+
 //-----------------------------------------------------------------------------
 // Purpose: lets the main thread continue
 //-----------------------------------------------------------------------------
@@ -993,6 +1366,7 @@ void Coroutine_Finish()
 
 	UNREACHABLE();
 }
+#endif // COROUTINE_SEPARATE_STACKS
 
 //-----------------------------------------------------------------------------
 // Purpose: Coroutine that spawns another coroutine